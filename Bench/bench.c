@@ -0,0 +1,336 @@
+/*
+ * bench.c -- per-module microbenchmarks for the Library drivers
+ *
+ * Calls each public driver entry point BENCH_ITERS times and prints one
+ * JSON document with the average cost per call, for comparing commits:
+ *
+ *	cycles		A9 cycle counter on the board; the perf cycle counter (or
+ *				the TSC) on a Linux host
+ *	ns			wall time
+ *	mmio_reads	register traffic counted by the mock drivers (host only,
+ *	mmio_writes	c.f. Host/bsp/mock.c)
+ *	flops		A9 PMU floating-point instruction event on the board; perf
+ *				FP_ARITH_INST_RETIRED on Intel hosts
+ *	instructions	A9 PMU instructions out of the rename stage on the board
+ *				(the A9 has no retired-instruction event); perf
+ *				instructions on a host
+ *
+ * A counter that is not available is null. The "loop" entry is the cost
+ * of the harness itself. The regs entries are the compile-time bound
+ * setters of regs.h next to the drivers they stand in for.
+ *
+ * Board: a standalone application built from this file and Library/
+ * {led,io,servo,adc,gic,config,flash,linestats}.c; the JSON goes to the console
+ * uart.
+ *
+ * Host:
+ * gcc -O2 -Wall -DBENCH_HOST -DBENCH_COMMIT=\"$(git rev-parse --short HEAD)\" \
+ *     -IHost/bsp -IHost -ILibrary -I. -o bench Bench/bench.c Host/bsp/mock.c \
+ *     Library/led.c Library/io.c Library/servo.c Library/adc.c Library/gic.c \
+ *     Library/linestats.c
+ */
+#ifdef BENCH_HOST
+#define _GNU_SOURCE
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "adc.h"
+#include "config.h"
+#include "gic.h"
+#include "io.h"
+#include "led.h"
+#include "linestats.h"
+#include "regs.h"
+#include "servo.h"
+#include "xtime_l.h"		/* global timer */
+
+#define BENCH_ITERS 10000
+
+#ifndef BENCH_COMMIT
+#define BENCH_COMMIT "unknown"
+#endif
+
+#ifdef BENCH_HOST
+#define BENCH_TARGET "host"
+#else
+#define BENCH_TARGET "zynq"
+#endif
+
+typedef struct {
+	u64 cycles;
+	u64 flops;
+	u64 instructions;
+	u64 ns;
+	u64 reads;
+	u64 writes;
+} sample_t;
+
+typedef struct {
+	const char *module;
+	const char *api;
+	void (*run)(u32 i);
+} bench_t;
+
+static bool have_cycles = false;
+static bool have_flops = false;
+static bool have_instructions = false;
+static volatile u32 sink;		/* keeps results live */
+static update_response_t payloads[LINESTATS_HISTORY];	/* c.f. payloads_init */
+
+#ifdef BENCH_HOST
+/* the drivers read the configuration; the host has no flash to load it from */
+static const config_t defaults = {
+	TRAFFIC_TMR, PEDESTRIAN_TMR, LIGHT_TMR, FREQ, ID,
+	(u32)(MAXDUTY * 1000000), (u32)(MINDUTY * 1000000), POT_SCALE, 0, MARGIN_MS
+};
+const config_t * volatile config = &defaults;
+
+static int cycles_fd = -1;
+static int flops_fd = -1;
+static int instructions_fd = -1;
+
+static int perf_open(u32 type, u64 event){
+	struct perf_event_attr attr = { 0 };
+
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = event;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static u64 perf_read(int fd){
+	u64 v = 0;
+
+	if (read(fd, &v, sizeof(v)) != sizeof(v))
+		return 0;
+	return v;
+}
+
+static void counters_init(void){
+	cycles_fd = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+	flops_fd = perf_open(PERF_TYPE_RAW, 0x03C7);	/* scalar single + double */
+	instructions_fd = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+#if defined(__x86_64__) || defined(__i386__)
+	have_cycles = true;		/* the TSC at worst */
+#else
+	have_cycles = cycles_fd >= 0;
+#endif
+	have_flops = flops_fd >= 0;
+	have_instructions = instructions_fd >= 0;
+}
+
+static void counters_read(sample_t *s){
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	s->ns = (u64) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+	if (cycles_fd >= 0)
+		s->cycles = perf_read(cycles_fd);
+#if defined(__x86_64__) || defined(__i386__)
+	else
+		s->cycles = __builtin_ia32_rdtsc();
+#endif
+	s->flops = flops_fd >= 0 ? perf_read(flops_fd) : 0;
+	s->instructions = instructions_fd >= 0 ? perf_read(instructions_fd) : 0;
+	s->reads = mmio_reads;
+	s->writes = mmio_writes;
+}
+#else
+/*
+ * A9 performance monitor: the cycle counter, event counter 0 counting
+ * floating-point instructions (event 0x73) and counter 1 instructions out
+ * of the rename stage (event 0x68)
+ */
+static void counters_init(void){
+	__asm__ volatile("mcr p15, 0, %0, c9, c12, 5" :: "r"(0));			/* select counter 0 */
+	__asm__ volatile("mcr p15, 0, %0, c9, c13, 1" :: "r"(0x73));		/* its event */
+	__asm__ volatile("mcr p15, 0, %0, c9, c12, 5" :: "r"(1));			/* counter 1 */
+	__asm__ volatile("mcr p15, 0, %0, c9, c13, 1" :: "r"(0x68));
+	__asm__ volatile("mcr p15, 0, %0, c9, c12, 1" :: "r"(0x80000003));	/* enable them and the cycle counter */
+	__asm__ volatile("mcr p15, 0, %0, c9, c12, 0" :: "r"(0x7));		/* enable, reset all */
+	have_cycles = true;
+	have_flops = true;
+	have_instructions = true;
+}
+
+static void counters_read(sample_t *s){
+	u32 cycles, flops, instructions;
+	XTime now;
+
+	__asm__ volatile("mrc p15, 0, %0, c9, c13, 0" : "=r"(cycles));
+	__asm__ volatile("mcr p15, 0, %0, c9, c12, 5" :: "r"(0));
+	__asm__ volatile("mrc p15, 0, %0, c9, c13, 2" : "=r"(flops));
+	__asm__ volatile("mcr p15, 0, %0, c9, c12, 5" :: "r"(1));
+	__asm__ volatile("mrc p15, 0, %0, c9, c13, 2" : "=r"(instructions));
+	XTime_GetTime(&now);
+	s->cycles = cycles;		/* 32 bits: a benchmark is far shorter than a wrap */
+	s->flops = flops;
+	s->instructions = instructions;
+	s->ns = now * 1000000000ull / COUNTS_PER_SECOND;
+	s->reads = s->writes = 0;
+}
+#endif
+
+/*
+ * benchmarks
+ */
+static void btn_callback(u32 btn){ sink += btn; }
+static void sw_callback(u32 sw){ sink += sw; }
+static void train_callback(u64 entry){ sink += (u32) entry; }
+static void null_handler(void *ref){ }
+
+static void b_loop(u32 i){ sink = i; }
+static void b_led_set(u32 i){ led_set(0, i & 1); }
+static void b_led_set_rgb(u32 i){ led_set(RED, i & 1); }
+static void b_led_toggle(u32 i){ led_toggle(1); }
+static void b_servo_set(u32 i){ servo_set(0.06 + (i & 15) * 0.002); }
+static void b_servo_set_pos(u32 i){ servo_set_pos((i & 15) << 12); }
+static void b_regs_led_set(u32 i){ regs_led_set(0, i & 1); }
+static void b_regs_led_set_rgb(u32 i){ regs_led_set(RED, i & 1); }
+static void b_regs_servo_duty(u32 i){ regs_servo_duty(75000); }
+static void b_adc_get_pot(u32 i){ sink = (u32)(adc_get_pot() * 1000); }
+static void b_adc_get_gate(u32 i){ sink = adc_get_gate(); }
+static void b_adc_get_temp(u32 i){ sink = (u32) adc_get_temp(); }
+static void b_gic_connect(u32 i){ gic_connect(XPAR_XADCPS_INT_ID, null_handler, NULL); }
+static void b_gic_set_priority(u32 i){ gic_set_priority(XPAR_XADCPS_INT_ID, 0xA0); }
+
+static void b_linestats_rows(u32 i){
+	linestats_t s;
+
+	linestats_rows(&payloads[i & (LINESTATS_HISTORY - 1)], 1, 50, &s);
+	sink = s.sumsq;
+}
+
+static void b_linestats_rows_scalar(u32 i){
+	linestats_t s;
+
+	linestats_rows_scalar(&payloads[i & (LINESTATS_HISTORY - 1)], 1, 50, &s);
+	sink = s.sumsq;
+}
+
+static void b_linestats_history(u32 i){
+	linestats_t s;
+	u32 n;
+
+	linestats_history(50, &s, &n);
+	sink = s.sumsq;
+}
+
+/*
+ * a full history of updates: levels 0..100, some slots with a train
+ */
+static void payloads_init(void){
+	u32 k, i, x = 1;
+
+	for (k = 0; k < LINESTATS_HISTORY; k++){
+		for (i = 0; i < MSG_VALUES; i++){
+			x = x * 1103515245 + 12345;
+			payloads[k].values[i] = (x >> 16) % 101 | ((x >> 8) & 7 ? 0 : MSG_TRAIN);
+		}
+		linestats_push(&payloads[k]);
+	}
+}
+
+static void b_btn_handler(u32 i){
+#ifdef BENCH_HOST
+	mock_gpio_in[XPAR_AXI_GPIO_1_DEVICE_ID] = i & 1;	/* press, release */
+#endif
+	gic_dispatch(XPAR_FABRIC_GPIO_1_VEC_ID);
+}
+
+static void b_sw_handler(u32 i){
+#ifdef BENCH_HOST
+	mock_gpio_in[XPAR_AXI_GPIO_2_DEVICE_ID] = i & IO_TRAIN_SW;	/* train switch edges */
+#endif
+	gic_dispatch(XPAR_FABRIC_GPIO_2_VEC_ID);
+}
+
+static const bench_t benches[] = {
+	{ "none", "loop", b_loop },
+	{ "led", "led_set", b_led_set },
+	{ "led", "led_set(rgb)", b_led_set_rgb },
+	{ "led", "led_toggle", b_led_toggle },
+	{ "servo", "servo_set", b_servo_set },
+	{ "servo", "servo_set_pos", b_servo_set_pos },
+	{ "regs", "regs_led_set", b_regs_led_set },
+	{ "regs", "regs_led_set(rgb)", b_regs_led_set_rgb },
+	{ "regs", "regs_servo_duty", b_regs_servo_duty },
+	{ "adc", "adc_get_pot", b_adc_get_pot },
+	{ "adc", "adc_get_gate", b_adc_get_gate },
+	{ "adc", "adc_get_temp", b_adc_get_temp },
+	{ "gic", "gic_connect", b_gic_connect },
+	{ "gic", "gic_set_priority", b_gic_set_priority },
+	{ "io", "btn_handler", b_btn_handler },
+	{ "io", "sw_handler", b_sw_handler },
+	{ "linestats", "linestats_rows", b_linestats_rows },
+	{ "linestats", "linestats_rows(scalar)", b_linestats_rows_scalar },
+	{ "linestats", "linestats_history", b_linestats_history },
+};
+
+#define BENCHES (sizeof(benches) / sizeof(benches[0]))
+
+/*
+ * print <total>/BENCH_ITERS, or null
+ */
+static void field(const char *name, u64 total, bool have, const char *sep){
+	if (have)
+		printf("\"%s\": %lu.%02lu%s", name, (unsigned long)(total / BENCH_ITERS),
+				(unsigned long)(total * 100 / BENCH_ITERS % 100), sep);
+	else
+		printf("\"%s\": null%s", name, sep);
+}
+
+int main(void){
+	sample_t before, after;
+	u32 b, i;
+	bool mmio;
+
+#ifdef BENCH_HOST
+	mmio = true;
+#else
+	mmio = false;
+	config_init();
+#endif
+	gic_init();
+	led_init();
+	io_btn_init(btn_callback);
+	io_sw_init(sw_callback);
+	io_train_init(train_callback);
+	servo_init();
+	adc_init();
+	payloads_init();
+	counters_init();
+
+	printf("{\"target\": \"%s\", \"commit\": \"%s\", \"iterations\": %d, \"results\": [\n",
+			BENCH_TARGET, BENCH_COMMIT, BENCH_ITERS);
+	for (b = 0; b < BENCHES; b++){
+		benches[b].run(0);		/* warm caches and branch predictors */
+		counters_read(&before);
+		for (i = 0; i < BENCH_ITERS; i++)
+			benches[b].run(i);
+		counters_read(&after);
+
+		printf("  {\"module\": \"%s\", \"api\": \"%s\", ", benches[b].module, benches[b].api);
+		field("cycles", after.cycles - before.cycles, have_cycles, ", ");
+		field("ns", after.ns - before.ns, true, ", ");
+		field("mmio_reads", after.reads - before.reads, mmio, ", ");
+		field("mmio_writes", after.writes - before.writes, mmio, ", ");
+		field("flops", after.flops - before.flops, have_flops, ", ");
+		field("instructions", after.instructions - before.instructions, have_instructions, "");
+		printf("}%s\n", b + 1 < BENCHES ? "," : "");
+	}
+	printf("]}\n");
+
+	gic_disconnect(XPAR_XADCPS_INT_ID);
+	io_btn_close();
+	io_sw_close();
+	gic_close();
+	return 0;
+}
@@ -0,0 +1,284 @@
+/*
+ * crossing_io.v -- input filtering, event queue and servo pwm in the PL
+ *
+ * An AXI4-Lite slave for the module6 design that takes the buttons and
+ * switches and the servo off the AXI GPIO ports and the AXI timer
+ * (c.f. Library/plio.h for the driver).
+ *
+ * Each input is synchronized and filtered: its first change from the
+ * filtered level is taken at once, stamped with the 64-bit cycle counter
+ * and queued, and the input is then ignored for DEBOUNCE cycles, after
+ * which a level that differs again is a new change. Changes of several
+ * inputs in one cycle are queued lowest input first, a cycle apart. The
+ * queue holds 16 events; one arriving when it is full is dropped and
+ * sets the overflow flag.
+ *
+ * One level interrupt covers the queue. It is raised as soon as an
+ * URGENT input (the train switch) is queued, or THRESHOLD events are, or
+ * the oldest has waited HOLDOFF cycles, and it falls when the queue is
+ * empty.
+ *
+ * The servo pwm repeats every PWM_PERIOD cycles and is high for the
+ * first PWM_COMPARE of them. Both are taken at the start of a period, so
+ * a write never cuts a pulse short or stretches it.
+ *
+ * Registers (byte offsets; written whole, wstrb is ignored):
+ *	0x00 ID			"CIO1"
+ *	0x04 CTRL		0 queue events, 1 interrupt, 2 pwm, 3 flush the queue (reads 0)
+ *	0x08 STATUS		4:0 events queued, 8 overflow (write 1 to clear), 9 interrupt
+ *	0x0C STATE		7:0 filtered inputs, 15:8 synchronized inputs
+ *	0x10 DEBOUNCE	cycles an input is ignored after a change
+ *	0x14 HOLDOFF	cycles the oldest event may wait for the interrupt
+ *	0x18 THRESHOLD	events queued that raise it at once
+ *	0x1C URGENT		inputs whose events raise it at once
+ *	0x20 EVT_LO		31:0 of the oldest event's stamp
+ *	0x24 EVT_HI		31 valid, 30 level, 26:24 input, 15:0 stamp 47:32; a read
+ *					takes the event off the queue
+ *	0x28 TIME_LO	cycle counter; a read latches the top half for TIME_HI
+ *	0x2C TIME_HI
+ *	0x30 PWM_PERIOD	cycles
+ *	0x34 PWM_COMPARE	high cycles
+ *
+ * Inputs 3:0 are BTN0-3 and 7:4 are SW0-3; SW0 is the train sensor. The
+ * defaults suit the 50 MHz FCLK_CLK0: 10 ms debounce, 2 ms holdoff, a
+ * 20 ms period at 7.5%.
+ */
+`default_nettype none
+
+module crossing_io #(
+	parameter DEBOUNCE = 32'd500000,
+	parameter HOLDOFF = 32'd100000,
+	parameter THRESHOLD = 32'd8,
+	parameter URGENT = 8'h10,
+	parameter PWM_PERIOD = 32'd1000000,
+	parameter PWM_COMPARE = 32'd75000
+) (
+	input wire s_axi_aclk,
+	input wire s_axi_aresetn,
+
+	input wire [5:0] s_axi_awaddr,
+	input wire s_axi_awvalid,
+	output wire s_axi_awready,
+	input wire [31:0] s_axi_wdata,
+	input wire [3:0] s_axi_wstrb,
+	input wire s_axi_wvalid,
+	output wire s_axi_wready,
+	output wire [1:0] s_axi_bresp,
+	output reg s_axi_bvalid,
+	input wire s_axi_bready,
+
+	input wire [5:0] s_axi_araddr,
+	input wire s_axi_arvalid,
+	output wire s_axi_arready,
+	output reg [31:0] s_axi_rdata,
+	output wire [1:0] s_axi_rresp,
+	output reg s_axi_rvalid,
+	input wire s_axi_rready,
+
+	input wire [7:0] in,
+	(* X_INTERFACE_INFO = "xilinx.com:signal:interrupt:1.0 irq INTERRUPT" *)
+	(* X_INTERFACE_PARAMETER = "SENSITIVITY LEVEL_HIGH" *)
+	output reg irq,
+	output reg pwm
+);
+
+	localparam ID = 32'h43494F31;	/* "CIO1" */
+	localparam [4:0] DEPTH = 5'd16;
+
+	wire clk = s_axi_aclk;
+	wire reset = !s_axi_aresetn;
+	integer i, j;
+
+	/* registers */
+	reg [2:0] ctrl;
+	reg overflow;
+	reg [31:0] debounce, holdoff, threshold;
+	reg [7:0] urgent;
+	reg [31:0] period, compare;
+	reg [63:0] now;
+	reg [31:0] now_hi;				/* TIME_HI, latched by a TIME_LO read */
+
+	/* bus */
+	wire wr = s_axi_awvalid && s_axi_wvalid && !s_axi_bvalid;
+	wire rd = s_axi_arvalid && !s_axi_rvalid;
+	assign s_axi_awready = wr;
+	assign s_axi_wready = wr;
+	assign s_axi_bresp = 2'b00;
+	assign s_axi_arready = rd;
+	assign s_axi_rresp = 2'b00;
+	wire unused = &{ 1'b0, s_axi_wstrb, s_axi_awaddr[1:0], s_axi_araddr[1:0] };
+
+	/* inputs */
+	reg [7:0] sync1, sync2;			/* two flops against metastability */
+	reg [7:0] state;				/* filtered */
+	reg [31:0] lock [0:7];			/* cycles left ignoring each input */
+	reg [7:0] change;
+	reg [2:0] pick;					/* the lowest input that changed */
+	reg any;
+
+	always @* begin
+		for (i = 0; i < 8; i = i + 1)
+			change[i] = lock[i] == 32'd0 && sync2[i] != state[i];
+		any = change != 8'd0;
+		pick = 3'd0;
+		for (i = 7; i >= 0; i = i - 1)
+			if (change[i])
+				pick = i[2:0];
+	end
+
+	/* queue: level, input, stamp */
+	reg [51:0] queue [0:DEPTH - 1];
+	reg [4:0] wp, rp;
+	wire [4:0] count = wp - rp;
+	wire empty = count == 5'd0;
+	wire [51:0] head = queue[rp[3:0]];
+	wire push = any && ctrl[0];
+	wire pop = rd && s_axi_araddr[5:2] == 4'h9 && !empty;
+	wire flush = wr && s_axi_awaddr[5:2] == 4'h1 && s_axi_wdata[3];
+
+	/* interrupt */
+	reg pressing;					/* an urgent input is queued */
+	reg [31:0] age;					/* cycles since the queue was empty */
+	wire raise = !empty && (pressing || { 27'd0, count } >= threshold || age >= holdoff);
+
+	/* pwm */
+	reg [31:0] cycle, high, length;	/* in the period; compare and period taken at its start */
+
+	always @(posedge clk) begin
+		if (reset) begin
+			ctrl <= 0;
+			overflow <= 0;
+			debounce <= DEBOUNCE;
+			holdoff <= HOLDOFF;
+			threshold <= THRESHOLD;
+			urgent <= URGENT;
+			period <= PWM_PERIOD;
+			compare <= PWM_COMPARE;
+			now <= 0;
+			now_hi <= 0;
+			s_axi_bvalid <= 0;
+			s_axi_rvalid <= 0;
+			s_axi_rdata <= 0;
+			sync1 <= in;
+			sync2 <= in;
+			state <= in;
+			for (j = 0; j < 8; j = j + 1)
+				lock[j] <= 32'd0;
+			wp <= 0;
+			rp <= 0;
+			pressing <= 0;
+			age <= 0;
+			irq <= 0;
+			cycle <= 0;
+			high <= 0;
+			length <= 0;
+			pwm <= 0;
+		end else begin
+			now <= now + 64'd1;
+
+			/* filter */
+			sync1 <= in;
+			sync2 <= sync1;
+			for (j = 0; j < 8; j = j + 1)
+				if (lock[j] != 32'd0)
+					lock[j] <= lock[j] - 32'd1;
+			if (any) begin
+				state[pick] <= sync2[pick];
+				lock[pick] <= debounce;
+			end
+
+			/* queue */
+			if (push) begin
+				if (count != DEPTH) begin
+					queue[wp[3:0]] <= { sync2[pick], pick, now[47:0] };
+					wp <= wp + 5'd1;
+				end else
+					overflow <= 1;
+			end
+			if (pop)
+				rp <= rp + 5'd1;
+			if (flush)
+				rp <= wp;
+
+			/* interrupt */
+			if (push && urgent[pick])
+				pressing <= 1;
+			else if (empty)
+				pressing <= 0;
+			if (empty)
+				age <= 0;
+			else if (age != 32'hFFFFFFFF)
+				age <= age + 32'd1;
+			irq <= ctrl[1] && raise;
+
+			/* pwm */
+			if (!ctrl[2]) begin
+				cycle <= 0;
+				pwm <= 0;
+			end else begin
+				if (cycle == 32'd0) begin
+					high <= compare;
+					length <= period;
+					pwm <= compare != 32'd0;
+				end else
+					pwm <= cycle < high;
+				if (cycle != 32'd0 && cycle + 32'd1 >= length)
+					cycle <= 0;
+				else if (cycle == 32'd0 && period <= 32'd1)
+					cycle <= 0;
+				else
+					cycle <= cycle + 32'd1;
+			end
+
+			/* writes */
+			if (s_axi_bvalid && s_axi_bready)
+				s_axi_bvalid <= 0;
+			if (wr) begin
+				s_axi_bvalid <= 1;
+				case (s_axi_awaddr[5:2])
+					4'h1: ctrl <= s_axi_wdata[2:0];
+					4'h2: if (s_axi_wdata[8]) overflow <= 0;
+					4'h4: debounce <= s_axi_wdata;
+					4'h5: holdoff <= s_axi_wdata;
+					4'h6: threshold <= s_axi_wdata;
+					4'h7: urgent <= s_axi_wdata[7:0];
+					4'hC: period <= s_axi_wdata;
+					4'hD: compare <= s_axi_wdata;
+					default: ;
+				endcase
+				if (s_axi_awaddr[5:2] == 4'h2 && s_axi_wdata[8] && push && count == DEPTH)
+					overflow <= 1;		/* one dropped as it is cleared */
+			end
+
+			/* reads */
+			if (s_axi_rvalid && s_axi_rready)
+				s_axi_rvalid <= 0;
+			if (rd) begin
+				s_axi_rvalid <= 1;
+				case (s_axi_araddr[5:2])
+					4'h0: s_axi_rdata <= ID;
+					4'h1: s_axi_rdata <= { 29'd0, ctrl };
+					4'h2: s_axi_rdata <= { 22'd0, irq, overflow, 3'd0, count };
+					4'h3: s_axi_rdata <= { 16'd0, sync2, state };
+					4'h4: s_axi_rdata <= debounce;
+					4'h5: s_axi_rdata <= holdoff;
+					4'h6: s_axi_rdata <= threshold;
+					4'h7: s_axi_rdata <= { 24'd0, urgent };
+					4'h8: s_axi_rdata <= empty ? 32'd0 : head[31:0];
+					4'h9: s_axi_rdata <= empty ? 32'd0 : { 1'b1, head[51], 3'd0, head[50:48], 8'd0, head[47:32] };
+					4'hA: begin
+						s_axi_rdata <= now[31:0];
+						now_hi <= now[63:32];
+					end
+					4'hB: s_axi_rdata <= now_hi;
+					4'hC: s_axi_rdata <= period;
+					4'hD: s_axi_rdata <= compare;
+					default: s_axi_rdata <= 0;
+				endcase
+			end
+		end
+	end
+
+endmodule
+
+`default_nettype wire
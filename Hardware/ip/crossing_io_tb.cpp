@@ -0,0 +1,542 @@
+/*
+ * crossing_io_tb.cpp -- crossing_io.v against the AXI GPIO path it replaces
+ *
+ * Runs the Verilator model of crossing_io.v at CLK_HZ with bouncing
+ * buttons and switches, and plays the processor: ENTRY_NS after the
+ * interrupt goes up it drains the queue over AXI-Lite as Library/plio.c
+ * does (STATUS, then EVT_LO and EVT_HI for each event) and makes the
+ * callbacks of Library/io.c. The same waveforms are run through a model
+ * of the AXI GPIO path before it: a port interrupt on every change of its
+ * inputs that is not pending already, whose handler reads the port, makes
+ * the callbacks and clears the interrupt. The button handler calls back
+ * for any button down, the switch handler on every run. One processor
+ * runs the handlers of each path in turn.
+ *
+ * Each phase (pedestrian buttons, the train and key switches, a button
+ * chattering next to the others) reports for both paths the interrupts
+ * per debounced change and the processor cycles per change at CPU_HZ.
+ * That is exception entry and dispatch, the register accesses at their
+ * AXI GP latency, and CALLBACK_NS per callback (c.f. Host/capture_sim.c).
+ * Along the way it checks that:
+ *	- every change is queued once at its level, stamped no earlier than its
+ *	  first edge and at most STAMP_CYCLES after it
+ *	- the train switch raises the interrupt within URGENT_CYCLES
+ *	- no interrupt finds the queue empty and none overflows
+ *	- each pwm period is PERIOD cycles, high for the compare written
+ *	  before it started, and the pwm never stops
+ * and exits 1 if any of these fail.
+ *
+ * verilator -Wall --cc --exe --build -O2 -o crossing_io_tb \
+ *     Hardware/ip/crossing_io.v Hardware/ip/crossing_io_tb.cpp
+ *
+ * usage: obj_dir/crossing_io_tb [-s seconds_per_phase] [-r seed]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "Vcrossing_io.h"
+#include "verilated.h"
+
+#define CLK_HZ 50000000ull		/* FCLK_CLK0 */
+#define CPU_HZ 666666687ull		/* A9 */
+#define ENTRY_NS 400ull			/* exception entry, gic dispatch and return */
+#define READ_NS 150ull			/* an AXI GP read from the PL */
+#define WRITE_NS 45ull			/* a posted write */
+#define CALLBACK_NS 30000ull	/* button or switch callback, with its printf */
+#define STAMP_CYCLES 12			/* sync, then queued behind the other inputs */
+#define URGENT_CYCLES 6
+#define PERIOD 1000000ull		/* 20 ms (c.f. servo.h) */
+#define DUTY_MIN 55600			/* MINDUTY of PERIOD */
+#define DUTY_MAX 101900			/* MAXDUTY */
+#define TRAIN 4					/* SW0 */
+#define INPUTS 8
+#define EDGES 64
+
+/* registers (c.f. crossing_io.v) */
+#define CTRL 0x04
+#define STATUS 0x08
+#define EVT_LO 0x20
+#define EVT_HI 0x24
+#define TIME_LO 0x28
+#define TIME_HI 0x2C
+#define PWM_COMPARE 0x34
+
+#define NS_CYCLES(ns) ((ns) * CLK_HZ / 1000000000ull)
+#define NS_CPU(ns) ((ns) * CPU_HZ / 1000000000ull)
+
+typedef struct {
+	const char *label;
+	uint8_t inputs;				/* changing */
+	uint8_t chatter;			/* of those, chattering */
+	double min_s, max_s;		/* between changes */
+	double bounce_s;			/* at most */
+} phase_t;
+
+static const phase_t phases[] = {
+	{ "pedestrian", 0x0F, 0x00, 0.08, 0.6, 0.003 },
+	{ "switches",   0xF0, 0x00, 0.2,  1.0, 0.005 },
+	{ "chatter",    0x0F, 0x02, 0.08, 0.6, 0.003 },
+};
+
+#define PHASES (sizeof(phases) / sizeof(phases[0]))
+
+typedef struct {
+	uint64_t edge[EDGES];		/* cycles of the toggles still to come */
+	uint32_t head, n;
+	uint64_t next;				/* the next change begins */
+	uint64_t first[EDGES];		/* first edges of the changes not yet queued */
+	uint8_t level[EDGES];
+	uint32_t fhead, fn;
+} input_t;
+
+typedef struct {
+	uint64_t changes, irqs, reads, writes, callbacks, cycles;
+} path_t;
+
+static VerilatedContext *ctx;
+static Vcrossing_io *dut;
+static uint64_t cyc = 0;		/* rising edges so far */
+static uint64_t offset;			/* cyc less the queue stamps */
+static input_t inputs[INPUTS];
+static uint8_t level = 0;		/* of the pins */
+static const phase_t *phase;
+static uint64_t phase_end;
+
+/* the gpio path */
+static uint8_t port_seen[2];	/* as it last changed */
+static bool port_pending[2];
+static uint64_t port_raised[2];
+static uint64_t port_clear[2];	/* the handler clears it then; 0 before it runs */
+static uint8_t sw_prev = 0;
+static uint64_t gpio_busy = 0;	/* handler running until */
+static path_t gpio, plio;
+
+/* checks */
+static uint64_t stamps = 0, stamp_max = 0, urgent_max = 0, pulses = 0;
+static uint64_t failures = 0;
+
+/* pwm */
+static uint32_t compare = 0, compare_next = 0;
+static uint64_t compare_at = 0;	/* edge the last write was taken */
+static uint64_t pwm_rise = 0, pwm_last_rise = 0, pwm_expect = 0;
+static bool pwm_prev = false;
+
+static uint64_t irq_rise = 0;	/* edge the interrupt last went up */
+static bool irq_prev = false;
+
+static uint64_t rnd(void){
+	static uint64_t x = 88172645463325252ull;
+	static bool seeded = false;
+
+	if (!seeded){
+		x ^= (uint64_t) rand() << 32 | (uint64_t) rand();
+		seeded = true;
+	}
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	return x;
+}
+
+static uint64_t between(double a_s, double b_s){
+	uint64_t a = (uint64_t)(a_s * CLK_HZ), b = (uint64_t)(b_s * CLK_HZ);
+
+	return a + rnd() % (b - a + 1);
+}
+
+static void fail(const char *what, int input, uint64_t at){
+	if (failures++ < 10)
+		printf("FAIL %s: input %d at %.6f s\n", what, input, (double) at / CLK_HZ);
+}
+
+/*
+ * the toggles of the next change of input <i>: to the new level, then
+ * away and back while it bounces; a chattering input only toggles
+ */
+static void schedule(uint32_t i){
+	input_t *in = &inputs[i];
+	uint64_t t = in->next, span;
+	uint32_t k, pairs;
+
+	in->head = in->n = 0;
+	if (phase->chatter & 1 << i){
+		for (k = 0; k < EDGES; k++){
+			t += between(20e-6, 300e-6);
+			in->edge[in->n++] = t;
+		}
+		in->next = t + 1;
+		return;
+	}
+	in->edge[in->n++] = t;
+	pairs = rnd() % 7;
+	span = between(0, phase->bounce_s) / (2 * pairs + 1) + 1;
+	for (k = 0; k < 2 * pairs; k++){
+		t += 1 + rnd() % span;
+		in->edge[in->n++] = t;
+	}
+	if (in->fn < EDGES){
+		in->first[(in->fhead + in->fn) % EDGES] = in->next;
+		in->level[(in->fhead + in->fn) % EDGES] = !(level >> i & 1);
+		in->fn++;
+	}
+	in->next += between(phase->min_s, phase->max_s);
+}
+
+/*
+ * the gpio path's handler for <port> (0 buttons, 1 switches)
+ */
+static void gpio_handler(uint32_t port, uint64_t now){
+	uint8_t state = port ? level >> 4 & 0xF : level & 0xF;
+	uint64_t ns = ENTRY_NS;
+
+	gpio.irqs++;
+	gpio.reads += 2;			/* the port, and the status as it is cleared */
+	gpio.writes += 1;
+	ns += 2 * READ_NS + WRITE_NS;
+	if (port == 0 && state){
+		gpio.callbacks++;
+		ns += CALLBACK_NS;
+	}
+	if (port == 1){
+		if ((state ^ sw_prev) & 1){
+			gpio.callbacks++;	/* the train fast path */
+			ns += CALLBACK_NS;
+		}
+		gpio.callbacks++;
+		ns += CALLBACK_NS;
+		sw_prev = state;
+	}
+	gpio.cycles += NS_CPU(ns);
+	gpio_busy = now + NS_CYCLES(ns);
+	port_clear[port] = gpio_busy;	/* cleared last: changes meanwhile are lost */
+}
+
+/*
+ * the gpio ports at edge <now>
+ */
+static void gpio_step(uint64_t now){
+	uint32_t p;
+
+	for (p = 0; p < 2; p++){
+		uint8_t state = p ? level >> 4 & 0xF : level & 0xF;
+
+		if (state != port_seen[p] && !port_pending[p]){
+			port_pending[p] = true;
+			port_raised[p] = now;
+		}
+		port_seen[p] = state;
+	}
+	for (p = 0; p < 2; p++){
+		if (port_pending[p] && port_clear[p] && now >= port_clear[p]){
+			port_pending[p] = false;
+			port_clear[p] = 0;
+		}
+		if (port_pending[p] && !port_clear[p] && now >= gpio_busy && now >= port_raised[p] + NS_CYCLES(ENTRY_NS))
+			gpio_handler(p, now);
+	}
+}
+
+/*
+ * the pwm pin after edge <now>
+ */
+static void pwm_step(uint64_t now){
+	bool high = dut->pwm;
+	uint64_t width;
+
+	if (high && !pwm_prev){
+		if (pwm_last_rise && now - pwm_last_rise != PERIOD)
+			fail("pwm period", -1, now);
+		pwm_last_rise = pwm_rise = now;
+		pwm_expect = compare_at < now ? compare_next : compare;
+	}
+	if (!high && pwm_prev){
+		width = now - pwm_rise;
+		pulses++;
+		if (width != pwm_expect)
+			fail("pwm pulse", -1, now);
+	}
+	pwm_prev = high;
+}
+
+/*
+ * one clock: the pins change, the edge, the gpio path and the pwm follow
+ */
+static void tick(void){
+	uint32_t i;
+
+	for (i = 0; i < INPUTS; i++){
+		input_t *in = &inputs[i];
+
+		if (!(phase->inputs & 1 << i))
+			continue;
+		if (in->head == in->n && cyc >= in->next && cyc < phase_end)
+			schedule(i);
+		while (in->head < in->n && in->edge[in->head] <= cyc){
+			level ^= 1 << i;
+			in->head++;
+		}
+	}
+	dut->in = level;
+	dut->s_axi_aclk = 0;
+	dut->eval();
+	dut->s_axi_aclk = 1;
+	dut->eval();
+	if (dut->irq && !irq_prev)
+		irq_rise = cyc;
+	irq_prev = dut->irq;
+	gpio_step(cyc);
+	pwm_step(cyc);
+	cyc++;
+}
+
+static void idle(uint64_t cycles){
+	while (cycles--)
+		tick();
+}
+
+/*
+ * AXI-Lite transfers, padded to the processor's latency; *<at> the edge
+ * the register was taken
+ */
+static uint32_t axi_read(uint32_t addr, uint64_t *at){
+	uint64_t start = cyc;
+	uint32_t data;
+
+	dut->s_axi_araddr = addr;
+	dut->s_axi_arvalid = 1;
+	dut->s_axi_rready = 1;
+	dut->eval();
+	while (!dut->s_axi_arready){
+		tick();
+		dut->eval();
+	}
+	if (at)
+		*at = cyc;
+	tick();
+	dut->s_axi_arvalid = 0;
+	while (!dut->s_axi_rvalid)
+		tick();
+	data = dut->s_axi_rdata;
+	tick();
+	dut->s_axi_rready = 0;
+	if (cyc - start < NS_CYCLES(READ_NS))
+		idle(NS_CYCLES(READ_NS) - (cyc - start));
+	return data;
+}
+
+static void axi_write(uint32_t addr, uint32_t data){
+	dut->s_axi_awaddr = addr;
+	dut->s_axi_wdata = data;
+	dut->s_axi_wstrb = 0xF;
+	dut->s_axi_awvalid = 1;
+	dut->s_axi_wvalid = 1;
+	dut->s_axi_bready = 1;
+	dut->eval();
+	while (!dut->s_axi_awready){
+		tick();
+		dut->eval();
+	}
+	if (addr == PWM_COMPARE){
+		compare = compare_next;
+		compare_next = data;
+		compare_at = cyc;
+	}
+	tick();
+	dut->s_axi_awvalid = 0;
+	dut->s_axi_wvalid = 0;
+	while (!dut->s_axi_bvalid)
+		tick();
+	tick();
+	dut->s_axi_bready = 0;
+}
+
+/*
+ * the queued change of <input> to <lvl> stamped <stamp>; returns the
+ * edge it began with
+ */
+static uint64_t check(uint32_t input, uint32_t lvl, uint64_t stamp){
+	input_t *in = &inputs[input];
+	uint64_t first;
+
+	if (phase->chatter & 1 << input)
+		return stamp;
+	if (in->fn == 0){
+		fail("change queued twice", input, stamp);
+		return stamp;
+	}
+	first = in->first[in->fhead];
+	if (lvl != in->level[in->fhead])
+		fail("level", input, stamp);
+	if (stamp < first || stamp > first + STAMP_CYCLES)
+		fail("stamp", input, stamp);
+	else if (stamp - first > stamp_max)
+		stamp_max = stamp - first;
+	stamps++;
+	in->fhead = (in->fhead + 1) % EDGES;
+	in->fn--;
+	return first;
+}
+
+/*
+ * the plio path's handler, taken ENTRY_NS after the interrupt went up
+ */
+static void plio_handler(void){
+	uint64_t ns = ENTRY_NS, callbacks = 0;
+	uint32_t status, n, lo, hi, input;
+	uint64_t stamp, first;
+
+	plio.irqs++;
+	status = axi_read(STATUS, NULL);
+	plio.reads++;
+	ns += READ_NS;
+	n = status & 0x1F;
+	if (n == 0)
+		fail("interrupt with the queue empty", -1, cyc);
+	if (status & 1 << 8)
+		fail("queue overflow", -1, cyc);
+	while (n--){
+		lo = axi_read(EVT_LO, NULL);
+		hi = axi_read(EVT_HI, NULL);
+		plio.reads += 2;
+		ns += 2 * READ_NS;
+		if (!(hi & 1u << 31)){
+			fail("event missing", -1, cyc);
+			break;
+		}
+		input = hi >> 24 & 7;
+		stamp = ((uint64_t)(hi & 0xFFFF) << 32 | lo) + offset;
+		first = check(input, hi >> 30 & 1, stamp);
+		if (input == TRAIN && irq_rise >= first && irq_rise - first > urgent_max)
+			urgent_max = irq_rise - first;	/* it was down when the switch moved */
+		if (input < 4 ? hi >> 30 & 1 : 1)
+			callbacks++;		/* a button down, or any switch */
+		if (input == TRAIN)
+			callbacks++;		/* the train fast path */
+		plio.changes++;
+		gpio.changes++;
+	}
+	plio.callbacks += callbacks;
+	ns += callbacks * CALLBACK_NS;
+	plio.cycles += NS_CPU(ns);
+	idle(NS_CYCLES(callbacks * CALLBACK_NS));
+}
+
+int main(int argc, char *argv[]){
+	double seconds = 2;
+	uint64_t lo, at, failed_before;
+	path_t g0, p0;
+	uint32_t s, i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "s:r:")) != -1){
+		switch (opt){
+		case 's':
+			seconds = atof(optarg);
+			break;
+		case 'r':
+			srand(atoi(optarg));
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-s seconds_per_phase] [-r seed]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	ctx = new VerilatedContext;
+	dut = new Vcrossing_io(ctx);
+	phase = &phases[0];
+	phase_end = 0;
+	dut->s_axi_aresetn = 0;
+	idle(16);
+	dut->s_axi_aresetn = 1;
+	idle(4);
+
+	lo = axi_read(TIME_LO, &at);
+	offset = at - (lo | (uint64_t) axi_read(TIME_HI, NULL) << 32);
+	compare_next = 75000;
+	axi_write(PWM_COMPARE, compare_next);
+	compare = compare_next;
+	axi_write(CTRL, 0x7);
+
+	printf("%.1f s per phase, clock %llu MHz, cpu %llu MHz\n", seconds,
+			(unsigned long long)(CLK_HZ / 1000000), (unsigned long long)(CPU_HZ / 1000000));
+	printf("%-10s %-4s %7s %7s %8s %8s %8s %9s %11s\n", "phase", "path", "changes", "irqs", "irq/chg",
+			"reads", "writes", "callbacks", "cycles/chg");
+	for (s = 0; s < PHASES; s++){
+		uint64_t next_duty = cyc;
+
+		phase = &phases[s];
+		phase_end = cyc + (uint64_t)(seconds * CLK_HZ);
+		for (i = 0; i < INPUTS; i++){
+			inputs[i].head = inputs[i].n = 0;
+			inputs[i].next = cyc + between(0.001, phase->max_s);
+		}
+		g0 = gpio;
+		p0 = plio;
+		failed_before = failures;
+
+		while (cyc < phase_end + (uint64_t)(0.1 * CLK_HZ)){
+			if (cyc >= next_duty && cyc < phase_end){
+				axi_write(PWM_COMPARE, DUTY_MIN + rnd() % (DUTY_MAX - DUTY_MIN));
+				next_duty = cyc + between(0.001, 0.015);
+			}
+			if (!dut->irq){
+				tick();
+				continue;
+			}
+			idle(NS_CYCLES(ENTRY_NS));
+			plio_handler();
+			idle(2);			/* for the interrupt to fall */
+		}
+
+		for (i = 0; i < INPUTS; i++)
+			if (!(phase->chatter & 1 << i) && inputs[i].fn){
+				fail("change not queued", i, inputs[i].first[inputs[i].fhead]);
+				inputs[i].fn = 0;
+			}
+		if (urgent_max > URGENT_CYCLES)
+			fail("train interrupt late", TRAIN, cyc);
+		if (cyc - pwm_last_rise > PERIOD)
+			fail("pwm stopped", -1, cyc);		/* stuck high or low */
+
+		{
+			path_t *paths[2] = { &gpio, &plio }, *base[2] = { &g0, &p0 };
+			const char *names[2] = { "gpio", "plio" };
+			uint64_t per[2];
+			uint32_t p;
+
+			for (p = 0; p < 2; p++){
+				path_t d = *paths[p];
+				uint64_t n;
+
+				d.changes -= base[p]->changes;
+				d.irqs -= base[p]->irqs;
+				d.reads -= base[p]->reads;
+				d.writes -= base[p]->writes;
+				d.callbacks -= base[p]->callbacks;
+				d.cycles -= base[p]->cycles;
+				n = d.changes ? d.changes : 1;
+				per[p] = d.cycles / n;
+				printf("%-10s %-4s %7llu %7llu %8.2f %8llu %8llu %9llu %11llu\n", phase->label, names[p],
+						(unsigned long long) d.changes, (unsigned long long) d.irqs, (double) d.irqs / n,
+						(unsigned long long) d.reads, (unsigned long long) d.writes,
+						(unsigned long long) d.callbacks, (unsigned long long) per[p]);
+			}
+			printf("%-10s %.1f%% fewer cycles per change%s\n", phase->label,
+					per[0] ? 100.0 * (1 - (double) per[1] / per[0]) : 0.0,
+					failures > failed_before ? ", FAILED" : "");
+		}
+	}
+
+	printf("%llu stamps at most %llu ns after the edge, train interrupt at most %llu ns after it, %llu pwm pulses\n",
+			(unsigned long long) stamps, (unsigned long long)(stamp_max * 1000000000ull / CLK_HZ),
+			(unsigned long long)(urgent_max * 1000000000ull / CLK_HZ), (unsigned long long) pulses);
+	printf(failures ? "%llu checks failed\n" : "all checks passed\n", (unsigned long long) failures);
+	dut->final();
+	delete dut;
+	delete ctx;
+	return failures != 0;
+}
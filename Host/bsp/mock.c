@@ -0,0 +1,521 @@
+/*
+ * mock.c -- host stand-in for the Xilinx standalone drivers
+ *
+ * The register counts follow what the standalone drivers do per call: an
+ * xadc register read through the command fifo costs two writes and two
+ * reads, an xadc register write one of each, and read-modify-write
+ * helpers a read and a write.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "xbsp_mock.h"
+
+#define MMIO(r, w) (mmio_reads += (r), mmio_writes += (w))
+
+u64 mmio_reads = 0;
+u64 mmio_writes = 0;
+u32 mock_gpio_in[3];
+u16 mock_adc[32];
+u16 mock_adc_threshold[8];
+u16 mock_adc_alarms = 0;
+volatile u32 mock_adc_intr_enabled = 0;
+volatile u32 mock_adc_intr_status = 0;
+u32 mock_reg_in = 0;
+int mock_uart_fd = -1;
+int mock_uart_wake = -1;
+u32 mock_uart_baud = 115200;
+volatile u64 mock_uart_sent_ns = 0;
+volatile u32 mock_uart_framing = 0;
+volatile u32 mock_uart_overrun = 0;
+u64 (*mock_xtime)(void) = NULL;
+u32 (*mock_reg_read)(UINTPTR addr) = NULL;
+void (*mock_reg_write)(UINTPTR addr, u32 value) = NULL;
+void (*mock_unmask)(void) = NULL;
+void (*mock_wfi)(void) = NULL;
+u8 *mock_flash = NULL;
+u32 mock_flash_erase_us = 50000;	/* about, for a 4K erase */
+u32 mock_flash_program_us = 700;	/* and a 256-byte page */
+u32 mock_flash_erases = 0;
+u32 mock_flash_programs = 0;
+volatile u8 mock_gic_enabled[XSCUGIC_MAX_NUM_INTR_INPUTS];
+volatile u8 mock_gic_pending[XSCUGIC_MAX_NUM_INTR_INPUTS];
+
+static XScuGic_Config gic_config;
+static XGpioPs_Config gpiops_config;
+static XTtcPs_Config ttc_config[2] = {
+	{ 0, 0xF8001000, 111111115 },
+	{ 1, 0xF8001004, 111111115 },
+};
+static XAdcPs_Config adc_config;
+static XScuWdt_Config wdt_config;
+static XUartPs_Config uart_config;
+static XQspiPs_Config qspi_config;
+static XTime flash_busy_until = 0;
+static bool flash_wel = false;		/* write enable latch */
+static pthread_mutex_t irq_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread u32 cpsr = 0;
+
+/* the uart's clock: CLOCK_MONOTONIC, or the global timer's when a tool sets mock_xtime */
+static u64 now_ns(void){
+	struct timespec ts;
+	XTime t;
+
+	if (mock_xtime != NULL){
+		t = mock_xtime();
+		return t / COUNTS_PER_SECOND * 1000000000ull + t % COUNTS_PER_SECOND * 1000000000ull / COUNTS_PER_SECOND;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* xil_exception */
+void Xil_ExceptionRegisterHandler(u32 id, Xil_ExceptionHandler handler, void *data){ }
+void Xil_ExceptionRemoveHandler(u32 id){ }
+void Xil_ExceptionEnable(void){ }
+
+/* scugic: handlers live in the config's table, as in the driver */
+XScuGic_Config *XScuGic_LookupConfig(u16 id){
+	return &gic_config;
+}
+
+s32 XScuGic_CfgInitialize(XScuGic *gic, XScuGic_Config *config, u32 base){
+	gic->Config = config;
+	gic->IsReady = 1;
+	return XST_SUCCESS;
+}
+
+void XScuGic_InterruptHandler(XScuGic *gic){ }
+
+s32 XScuGic_Connect(XScuGic *gic, u32 id, Xil_InterruptHandler handler, void *ref){
+	if (id >= XSCUGIC_MAX_NUM_INTR_INPUTS)
+		return XST_FAILURE;
+	gic->Config->HandlerTable[id].Handler = handler;
+	gic->Config->HandlerTable[id].CallBackRef = ref;
+	return XST_SUCCESS;
+}
+
+void XScuGic_Disconnect(XScuGic *gic, u32 id){
+	MMIO(0, 1);
+	gic->Config->HandlerTable[id].Handler = NULL;
+}
+
+void XScuGic_Enable(XScuGic *gic, u32 id){ MMIO(0, 1); mock_gic_enabled[id] = 1; }
+void XScuGic_Disable(XScuGic *gic, u32 id){ MMIO(0, 1); mock_gic_enabled[id] = 0; }
+void XScuGic_Stop(XScuGic *gic){ MMIO(0, 1); }
+
+void XScuGic_SetPriorityTriggerType(XScuGic *gic, u32 id, u8 priority, u8 trigger){
+	MMIO(2, 2);
+}
+
+void XScuGic_GetPriorityTriggerType(XScuGic *gic, u32 id, u8 *priority, u8 *trigger){
+	MMIO(2, 0);
+	*priority = 0xA0;
+	*trigger = 1;
+}
+
+/* a pending register: 32 ids per word */
+u32 XScuGic_DistReadReg(XScuGic *gic, u32 offset){
+	u32 first = (offset & 0x7F) / 4 * 32, bits = 0, i;
+
+	MMIO(1, 0);
+	for (i = 0; i < 32 && first + i < XSCUGIC_MAX_NUM_INTR_INPUTS; i++)
+		bits |= (u32)(mock_gic_pending[first + i] != 0) << i;
+	return bits;
+}
+
+void XScuGic_DistWriteReg(XScuGic *gic, u32 offset, u32 value){
+	u32 first = (offset & 0x7F) / 4 * 32, i;
+
+	MMIO(0, 1);
+	for (i = 0; i < 32 && first + i < XSCUGIC_MAX_NUM_INTR_INPUTS; i++){
+		if (value & (1u << i))
+			mock_gic_pending[first + i] = offset >= XSCUGIC_PENDING_CLR_OFFSET ? 0 : 1;
+	}
+}
+
+/* axi gpio */
+int XGpio_Initialize(XGpio *gpio, u16 id){
+	gpio->DeviceId = id;
+	gpio->IsReady = 1;
+	return XST_SUCCESS;
+}
+
+void XGpio_SetDataDirection(XGpio *gpio, unsigned channel, u32 dirs){ MMIO(0, 1); }
+
+u32 XGpio_DiscreteRead(XGpio *gpio, unsigned channel){
+	MMIO(1, 0);
+	return mock_gpio_in[gpio->DeviceId % 3];
+}
+
+void XGpio_DiscreteWrite(XGpio *gpio, unsigned channel, u32 data){ MMIO(0, 1); }
+void XGpio_InterruptEnable(XGpio *gpio, u32 mask){ MMIO(1, 1); }
+void XGpio_InterruptDisable(XGpio *gpio, u32 mask){ MMIO(1, 1); }
+void XGpio_InterruptClear(XGpio *gpio, u32 mask){ MMIO(1, 1); }
+void XGpio_InterruptGlobalEnable(XGpio *gpio){ MMIO(0, 1); }
+
+/* ps gpio */
+XGpioPs_Config *XGpioPs_LookupConfig(u16 id){
+	return &gpiops_config;
+}
+
+s32 XGpioPs_CfgInitialize(XGpioPs *gpio, XGpioPs_Config *config, u32 base){
+	MMIO(0, 4);		/* interrupts off in every bank */
+	gpio->GpioConfig = *config;
+	return XST_SUCCESS;
+}
+
+void XGpioPs_SetDirectionPin(XGpioPs *gpio, u32 pin, u32 dir){ MMIO(1, 1); }
+void XGpioPs_SetOutputEnablePin(XGpioPs *gpio, u32 pin, u32 enable){ MMIO(1, 1); }
+void XGpioPs_WritePin(XGpioPs *gpio, u32 pin, u32 data){ MMIO(0, 1); }		/* masked data register */
+u32 XGpioPs_ReadPin(XGpioPs *gpio, u32 pin){ MMIO(1, 0); return 0; }
+
+/* axi timer */
+int XTmrCtr_Initialize(XTmrCtr *timer, u16 id){
+	MMIO(0, 2);		/* both counters reset */
+	timer->IsReady = 1;
+	return XST_SUCCESS;
+}
+
+void XTmrCtr_SetResetValue(XTmrCtr *timer, u8 counter, u32 value){ MMIO(0, 1); }
+void XTmrCtr_SetOptions(XTmrCtr *timer, u8 counter, u32 options){ MMIO(1, 1); }
+void XTmrCtr_Start(XTmrCtr *timer, u8 counter){ MMIO(1, 2); }	/* load, then run */
+
+/* triple timer counter */
+XTtcPs_Config *XTtcPs_LookupConfig(u16 id){
+	return &ttc_config[id];
+}
+
+s32 XTtcPs_CfgInitialize(XTtcPs *ttc, XTtcPs_Config *config, u32 base){
+	MMIO(0, 6);		/* stopped, then the registers reset */
+	ttc->Config = *config;
+	ttc->Config.BaseAddress = base;
+	ttc->IsReady = 1;
+	return XST_SUCCESS;
+}
+
+/*
+ * the smallest prescaler that fits the 16-bit interval, as the driver
+ */
+void XTtcPs_CalcIntervalFromFreq(XTtcPs *ttc, u32 freq, XInterval *interval, u8 *prescaler){
+	u32 counts = ttc->Config.InputClockHz / freq;
+	u8 p;
+
+	if (counts < 65536){
+		*interval = (XInterval) counts;
+		*prescaler = XTTCPS_CLK_CNTRL_PS_DISABLE;
+		return;
+	}
+	for (p = 0; p < 16 && counts >> (p + 1) >= 65536; p++)
+		;
+	*interval = (XInterval)(counts >> (p + 1));
+	*prescaler = p;
+}
+
+void XTtcPs_SetPrescaler(XTtcPs *ttc, u8 prescaler){ MMIO(1, 1); }
+void XTtcPs_SetInterval(XTtcPs *ttc, XInterval interval){ MMIO(0, 1); }
+s32 XTtcPs_SetOptions(XTtcPs *ttc, u32 options){ MMIO(2, 2); return XST_SUCCESS; }
+void XTtcPs_EnableInterrupts(XTtcPs *ttc, u32 mask){ MMIO(1, 1); }
+void XTtcPs_DisableInterrupts(XTtcPs *ttc, u32 mask){ MMIO(1, 1); }
+void XTtcPs_ClearInterruptStatus(XTtcPs *ttc, u32 mask){ MMIO(0, 1); }
+void XTtcPs_Start(XTtcPs *ttc){ MMIO(1, 1); }
+void XTtcPs_Stop(XTtcPs *ttc){ MMIO(1, 1); }
+
+/* xadc: registers are reached through the ps-xadc command fifo */
+#define ADC_READ() MMIO(2, 2)
+#define ADC_WRITE() MMIO(1, 1)
+
+XAdcPs_Config *XAdcPs_LookupConfig(u16 id){
+	return &adc_config;
+}
+
+s32 XAdcPs_CfgInitialize(XAdcPs *adc, XAdcPs_Config *config, u32 base){
+	MMIO(0, 3);		/* interface configuration */
+	adc->Config = *config;
+	return XST_SUCCESS;
+}
+
+s32 XAdcPs_SelfTest(XAdcPs *adc){
+	ADC_WRITE();
+	ADC_READ();
+	return XST_SUCCESS;
+}
+
+void XAdcPs_SetSequencerMode(XAdcPs *adc, u8 mode){ ADC_READ(); ADC_WRITE(); }
+
+void XAdcPs_SetAlarmEnables(XAdcPs *adc, u16 alarms){
+	ADC_READ();
+	ADC_WRITE();
+	mock_adc_alarms = alarms;
+}
+
+s32 XAdcPs_SetSeqChEnables(XAdcPs *adc, u32 channels){
+	ADC_READ();		/* sequencer must be in safe mode */
+	ADC_WRITE();
+	ADC_WRITE();
+	return XST_SUCCESS;
+}
+
+u16 XAdcPs_GetAdcData(XAdcPs *adc, u8 channel){
+	ADC_READ();
+	return mock_adc[channel & 31];
+}
+
+void XAdcPs_SetAlarmThreshold(XAdcPs *adc, u8 which, u16 value){
+	ADC_WRITE();
+	mock_adc_threshold[which & 7] = value;
+}
+
+void XAdcPs_IntrEnable(XAdcPs *adc, u32 mask){
+	MMIO(1, 1);
+	mock_adc_intr_enabled |= mask;
+}
+
+void XAdcPs_IntrDisable(XAdcPs *adc, u32 mask){
+	MMIO(1, 1);
+	mock_adc_intr_enabled &= ~mask;
+}
+
+u32 XAdcPs_IntrGetStatus(XAdcPs *adc){
+	MMIO(1, 0);
+	return mock_adc_intr_status;		/* raw: masked sources too */
+}
+
+void XAdcPs_IntrClear(XAdcPs *adc, u32 mask){
+	MMIO(0, 1);
+	mock_adc_intr_status &= ~mask;
+}
+
+/* global timer */
+void XTime_GetTime(XTime *t){
+	struct timespec ts;
+
+	MMIO(2, 0);		/* upper, lower (the driver rereads the upper on a carry) */
+	if (mock_xtime != NULL){
+		*t = mock_xtime();
+		return;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	*t = ((u64) ts.tv_sec * 1000000000ull + ts.tv_nsec) / 3;	/* ~333 MHz */
+}
+
+/* scu private watchdog */
+XScuWdt_Config *XScuWdt_LookupConfig(u16 id){
+	wdt_config.DeviceId = id;
+	return &wdt_config;
+}
+s32 XScuWdt_CfgInitialize(XScuWdt *wdt, XScuWdt_Config *config, u32 base){
+	wdt->Config = *config;
+	return XST_SUCCESS;
+}
+void XScuWdt_LoadWdt(XScuWdt *wdt, u32 value){ MMIO(0, 1); }
+void XScuWdt_SetWdMode(XScuWdt *wdt){ MMIO(1, 1); }
+void XScuWdt_SetTimerMode(XScuWdt *wdt){ MMIO(1, 3); }		/* disable sequence, then the mode bit */
+void XScuWdt_Start(XScuWdt *wdt){ MMIO(1, 1); }
+void XScuWdt_Stop(XScuWdt *wdt){ MMIO(1, 1); }
+void XScuWdt_RestartWdt(XScuWdt *wdt){ MMIO(0, 1); }		/* reload */
+
+/* register access */
+u32 Xil_In32(UINTPTR addr){
+	MMIO(1, 0);
+	return mock_reg_read != NULL ? mock_reg_read(addr) : mock_reg_in;
+}
+
+void Xil_Out32(UINTPTR addr, u32 value){
+	MMIO(0, 1);
+	if (mock_reg_write != NULL)
+		mock_reg_write(addr, value);
+}
+
+/* cache maintenance: one write to the line-clean register per line */
+void Xil_DCacheFlushRange(UINTPTR addr, u32 len){
+	MMIO(0, (addr + len - (addr & ~31u) + 31) / 32);
+}
+
+/* ps uart: a send completes 10 bit times per byte after it starts */
+XUartPs_Config *XUartPs_LookupConfig(u16 id){
+	uart_config.DeviceId = id;
+	return &uart_config;
+}
+s32 XUartPs_CfgInitialize(XUartPs *uart, XUartPs_Config *config, u32 base){
+	memset(uart, 0, sizeof(*uart));
+	uart->Config = *config;
+	MMIO(4, 8);
+	return XST_SUCCESS;
+}
+void XUartPs_SetInterruptMask(XUartPs *uart, u32 mask){ MMIO(0, 2); }
+void XUartPs_SetFifoThreshold(XUartPs *uart, u8 level){ MMIO(0, 1); }
+void XUartPs_SetRecvTimeout(XUartPs *uart, u8 words){ MMIO(1, 2); }
+void XUartPs_SetHandler(XUartPs *uart, XUartPs_Handler handler, void *ref){
+	uart->Handler = handler;
+	uart->CallBackRef = ref;
+}
+s32 XUartPs_SetBaudRate(XUartPs *uart, u32 baud){
+	mock_uart_baud = baud;
+	MMIO(2, 5);		/* disable, divisors, mode, enable */
+	return XST_SUCCESS;
+}
+int XUartPs_IsTransmitEmpty(XUartPs *uart){
+	MMIO(1, 0);
+	return uart->SendBytes == 0;
+}
+u32 XUartPs_Send(XUartPs *uart, u8 *buf, u32 len){
+	u8 wake = 1;
+
+	uart->SendBuffer = buf;
+	uart->SendBytes = len;
+	mock_uart_sent_ns = now_ns() + (u64) len * 10 * 1000000000ull / mock_uart_baud;
+	MMIO(2, len + 1);		/* status and fifo writes, tx empty enable */
+	if (mock_uart_wake >= 0 && write(mock_uart_wake, &wake, 1) < 0)
+		;
+	return len;
+}
+u32 XUartPs_Recv(XUartPs *uart, u8 *buf, u32 len){
+	u32 n = 0;
+
+	while (n < len && uart->RecvPos < uart->RecvLen)
+		buf[n++] = uart->RecvFifo[uart->RecvPos++];
+	MMIO(n + 1, 0);
+	return n;
+}
+void XUartPs_InterruptHandler(XUartPs *uart){
+	ssize_t n;
+	u32 sent;
+
+	MMIO(2, 1);		/* status, mask; clear */
+	if (mock_uart_framing != 0){
+		sent = mock_uart_framing;
+		mock_uart_framing = 0;
+		uart->Handler(uart->CallBackRef, XUARTPS_EVENT_PARE_FRAME_BRKE, sent);
+	}
+	if (mock_uart_overrun != 0){
+		sent = mock_uart_overrun;
+		mock_uart_overrun = 0;
+		uart->Handler(uart->CallBackRef, XUARTPS_EVENT_RECV_ORERR, sent);
+	}
+	if (uart->RecvPos == uart->RecvLen && mock_uart_fd >= 0){
+		n = read(mock_uart_fd, uart->RecvFifo, sizeof(uart->RecvFifo));
+		if (n > 0){
+			uart->RecvLen = n;
+			uart->RecvPos = 0;
+			uart->Handler(uart->CallBackRef, XUARTPS_EVENT_RECV_DATA, n);
+		}
+	}
+	if (uart->SendBytes != 0 && now_ns() >= mock_uart_sent_ns){
+		if (mock_uart_fd >= 0 && write(mock_uart_fd, uart->SendBuffer, uart->SendBytes) < 0)
+			;
+		sent = uart->SendBytes;
+		uart->SendBytes = 0;
+		mock_uart_sent_ns = 0;
+		uart->Handler(uart->CallBackRef, XUARTPS_EVENT_SENT_DATA, sent);
+	}
+}
+
+/* ps qspi: the flash commands flash.c sends */
+#define FLASH_WREN 0x06
+#define FLASH_ERASE 0x20
+#define FLASH_PROGRAM 0x02
+#define FLASH_READ 0x03
+#define FLASH_STATUS 0x05
+
+XQspiPs_Config *XQspiPs_LookupConfig(u16 id){
+	qspi_config.DeviceId = id;
+	qspi_config.BaseAddress = 0xE000D000;
+	return &qspi_config;
+}
+s32 XQspiPs_CfgInitialize(XQspiPs *qspi, XQspiPs_Config *config, u32 base){
+	MMIO(1, 6);		/* reset the controller and its fifos */
+	qspi->Config = *config;
+	return XST_SUCCESS;
+}
+s32 XQspiPs_SetOptions(XQspiPs *qspi, u32 options){ MMIO(1, 1); return XST_SUCCESS; }
+s32 XQspiPs_SetClkPrescaler(XQspiPs *qspi, u8 prescaler){ MMIO(1, 1); return XST_SUCCESS; }
+s32 XQspiPs_SetSlaveSelect(XQspiPs *qspi){ MMIO(1, 1); return XST_SUCCESS; }
+
+static bool flash_busy_now(void){
+	XTime now;
+
+	XTime_GetTime(&now);
+	return now < flash_busy_until;
+}
+
+static void flash_busy_for(u32 us){
+	XTime now;
+
+	XTime_GetTime(&now);
+	flash_busy_until = now + (u64) us * COUNTS_PER_SECOND / 1000000;
+}
+
+s32 XQspiPs_PolledTransfer(XQspiPs *qspi, u8 *send, u8 *recv, u32 len){
+	u32 addr, i;
+	bool busy;
+
+	MMIO(4 + (len + 3) / 4, 4 + (len + 3) / 4);	/* enable, start, a word a fifo slot each way, disable */
+	if (mock_flash == NULL){
+		mock_flash = malloc(MOCK_FLASH_BYTES);
+		memset(mock_flash, 0xFF, MOCK_FLASH_BYTES);
+	}
+	busy = flash_busy_now();
+	addr = len >= 4 ? ((u32) send[1] << 16 | (u32) send[2] << 8 | send[3]) % MOCK_FLASH_BYTES : 0;
+	switch (send[0]){
+	case FLASH_WREN:
+		flash_wel = !busy;
+		break;
+	case FLASH_STATUS:
+		if (recv != NULL && len >= 2)
+			recv[1] = (busy ? 0x01 : 0) | (flash_wel ? 0x02 : 0);
+		break;
+	case FLASH_READ:
+		if (recv != NULL && !busy){
+			for (i = 4; i < len; i++)
+				recv[i] = mock_flash[(addr + i - 4) % MOCK_FLASH_BYTES];
+		}
+		break;
+	case FLASH_ERASE:
+		if (busy || !flash_wel)
+			break;
+		memset(mock_flash + (addr & ~0xFFFu), 0xFF, 4096);
+		flash_wel = false;
+		mock_flash_erases++;
+		flash_busy_for(mock_flash_erase_us);
+		break;
+	case FLASH_PROGRAM:
+		if (busy || !flash_wel)
+			break;
+		for (i = 4; i < len; i++)		/* bits only go to 0, within the page */
+			mock_flash[(addr & ~0xFFu) | ((addr + i - 4) & 0xFF)] &= send[i];
+		flash_wel = false;
+		mock_flash_programs++;
+		flash_busy_for(mock_flash_program_us);
+		break;
+	}
+	return XST_SUCCESS;
+}
+
+/* cpsr */
+u32 mfcpsr(void){ return cpsr; }
+void mtcpsr(u32 value){
+	u32 unmasked = cpsr & ~value & XREG_CPSR_IRQ_ENABLE;
+
+	if ((value & ~cpsr) & XREG_CPSR_IRQ_ENABLE)
+		pthread_mutex_lock(&irq_lock);
+	else if (unmasked)
+		pthread_mutex_unlock(&irq_lock);
+	cpsr = value;
+	if (unmasked && mock_unmask != NULL)
+		mock_unmask();
+}
+
+/* wfi */
+void wfi(void){
+	if (mock_wfi != NULL)
+		mock_wfi();
+}
+
+/* platform */
+void init_platform(void){ }
+void cleanup_platform(void){ }
@@ -0,0 +1,342 @@
+/*
+ * xbsp_mock.h -- host stand-in for the Xilinx standalone drivers
+ *
+ * Enough of the BSP for the Library drivers to build into Linux tools.
+ * Each driver call adds the register reads and writes the real driver
+ * performs to mmio_reads/mmio_writes (c.f. mock.c), and GPIO inputs and
+ * ADC conversions come from the mock_ arrays, and the QSPI flash is an
+ * array erased to 0xFF. The PS UART moves bytes
+ * over a file descriptor at its baud rate, and masking IRQs through the
+ * cpsr takes a lock that a tool's interrupt thread also holds while it
+ * runs a handler.
+ */
+#pragma once
+
+#include <stdint.h>
+#include "xil_types.h"
+
+typedef uintptr_t UINTPTR;
+
+#define TRUE 1
+#define FALSE 0
+
+/* register traffic since start */
+extern u64 mmio_reads;
+extern u64 mmio_writes;
+
+/* mock inputs */
+extern u32 mock_gpio_in[3];		/* by axi gpio device id */
+extern u16 mock_adc[32];		/* by xadc channel */
+extern u16 mock_adc_threshold[8];	/* by XADCPS_ATR_* */
+extern u16 mock_adc_alarms;		/* XADCPS_CFR1_ALM_* enabled */
+extern volatile u32 mock_adc_intr_enabled;	/* XADCPS_INTX_* */
+extern volatile u32 mock_adc_intr_status;	/* set by a tool's alarm model */
+
+/* xparameters */
+#define XPAR_PS7_SCUGIC_0_DEVICE_ID 0
+#define XPAR_AXI_GPIO_0_DEVICE_ID 0
+#define XPAR_AXI_GPIO_1_DEVICE_ID 1
+#define XPAR_AXI_GPIO_2_DEVICE_ID 2
+#define XPAR_AXI_GPIO_3_DEVICE_ID 3
+#define XPAR_AXI_GPIO_0_BASEADDR 0x41200000
+#define XPAR_AXI_GPIO_3_BASEADDR 0x41230000
+#define XPAR_PS7_GPIO_0_BASEADDR 0xE000A000
+#define XPAR_AXI_TIMER_0_BASEADDR 0x42800000
+#define XPAR_PS7_GPIO_0_DEVICE_ID 0
+#define XPAR_FABRIC_GPIO_1_VEC_ID 62
+#define XPAR_FABRIC_GPIO_2_VEC_ID 63
+#define XPAR_XTTCPS_0_DEVICE_ID 0
+#define XPAR_XTTCPS_1_DEVICE_ID 1
+#define XPAR_XTTCPS_0_INTR 42
+#define XPAR_XTTCPS_1_INTR 43
+#define XPAR_XADCPS_0_DEVICE_ID 0
+#define XPAR_XADCPS_INT_ID 39
+#define XPAR_XUARTPS_0_INTR 59
+#define XPAR_XUARTPS_1_INTR 82
+#define XPAR_PS7_UART_0_DEVICE_ID 0
+#define XPAR_PS7_UART_1_DEVICE_ID 1
+#define XPAR_SCUWDT_0_DEVICE_ID 0
+#define XPAR_PS7_CORTEXA9_0_CPU_CLK_FREQ_HZ 666666687
+
+/* xil_exception */
+typedef void (*Xil_ExceptionHandler)(void *data);
+typedef void (*Xil_InterruptHandler)(void *data);
+typedef Xil_ExceptionHandler XExceptionHandler;
+#define XIL_EXCEPTION_ID_INT 5
+void Xil_ExceptionRegisterHandler(u32 id, Xil_ExceptionHandler handler, void *data);
+void Xil_ExceptionRemoveHandler(u32 id);
+void Xil_ExceptionEnable(void);
+
+/* scugic */
+#define XSCUGIC_MAX_NUM_INTR_INPUTS 95
+typedef struct {
+	Xil_InterruptHandler Handler;
+	void *CallBackRef;
+} XScuGic_VectorTableEntry;
+typedef struct {
+	u16 DeviceId;
+	u32 CpuBaseAddress;
+	u32 DistBaseAddress;
+	XScuGic_VectorTableEntry HandlerTable[XSCUGIC_MAX_NUM_INTR_INPUTS];
+} XScuGic_Config;
+typedef struct {
+	XScuGic_Config *Config;
+	u32 IsReady;
+} XScuGic;
+XScuGic_Config *XScuGic_LookupConfig(u16 id);
+s32 XScuGic_CfgInitialize(XScuGic *gic, XScuGic_Config *config, u32 base);
+void XScuGic_InterruptHandler(XScuGic *gic);
+s32 XScuGic_Connect(XScuGic *gic, u32 id, Xil_InterruptHandler handler, void *ref);
+void XScuGic_Disconnect(XScuGic *gic, u32 id);
+void XScuGic_Enable(XScuGic *gic, u32 id);
+void XScuGic_Disable(XScuGic *gic, u32 id);
+void XScuGic_Stop(XScuGic *gic);
+void XScuGic_SetPriorityTriggerType(XScuGic *gic, u32 id, u8 priority, u8 trigger);
+void XScuGic_GetPriorityTriggerType(XScuGic *gic, u32 id, u8 *priority, u8 *trigger);
+#define XSCUGIC_PENDING_SET_OFFSET 0x200
+#define XSCUGIC_PENDING_CLR_OFFSET 0x280
+u32 XScuGic_DistReadReg(XScuGic *gic, u32 offset);		/* the pending registers only */
+void XScuGic_DistWriteReg(XScuGic *gic, u32 offset, u32 value);
+extern volatile u8 mock_gic_enabled[XSCUGIC_MAX_NUM_INTR_INPUTS];	/* by XScuGic_Enable/Disable */
+extern volatile u8 mock_gic_pending[XSCUGIC_MAX_NUM_INTR_INPUTS];	/* set by a tool's interrupt source */
+
+/* axi gpio */
+#define XGPIO_IR_CH1_MASK 1
+typedef struct {
+	u16 DeviceId;
+	u32 IsReady;
+} XGpio;
+int XGpio_Initialize(XGpio *gpio, u16 id);
+void XGpio_SetDataDirection(XGpio *gpio, unsigned channel, u32 dirs);
+u32 XGpio_DiscreteRead(XGpio *gpio, unsigned channel);
+void XGpio_DiscreteWrite(XGpio *gpio, unsigned channel, u32 data);
+void XGpio_InterruptEnable(XGpio *gpio, u32 mask);
+void XGpio_InterruptDisable(XGpio *gpio, u32 mask);
+void XGpio_InterruptClear(XGpio *gpio, u32 mask);
+void XGpio_InterruptGlobalEnable(XGpio *gpio);
+
+/* ps gpio */
+typedef struct {
+	u16 DeviceId;
+	u32 BaseAddr;
+} XGpioPs_Config;
+typedef struct {
+	XGpioPs_Config GpioConfig;
+} XGpioPs;
+XGpioPs_Config *XGpioPs_LookupConfig(u16 id);
+s32 XGpioPs_CfgInitialize(XGpioPs *gpio, XGpioPs_Config *config, u32 base);
+void XGpioPs_SetDirectionPin(XGpioPs *gpio, u32 pin, u32 dir);
+void XGpioPs_SetOutputEnablePin(XGpioPs *gpio, u32 pin, u32 enable);
+void XGpioPs_WritePin(XGpioPs *gpio, u32 pin, u32 data);
+u32 XGpioPs_ReadPin(XGpioPs *gpio, u32 pin);
+
+/* axi timer */
+#define XTC_PWM_ENABLE_OPTION 0x200
+#define XTC_EXT_COMPARE_OPTION 0x100
+#define XTC_DOWN_COUNT_OPTION 0x2
+typedef struct {
+	u32 IsReady;
+} XTmrCtr;
+int XTmrCtr_Initialize(XTmrCtr *timer, u16 id);
+void XTmrCtr_SetResetValue(XTmrCtr *timer, u8 counter, u32 value);
+void XTmrCtr_SetOptions(XTmrCtr *timer, u8 counter, u32 options);
+void XTmrCtr_Start(XTmrCtr *timer, u8 counter);
+
+/* triple timer counter */
+#define XTTCPS_IXR_INTERVAL_MASK 0x1
+#define XTTCPS_OPTION_INTERVAL_MODE 0x2
+#define XTTCPS_CLK_CNTRL_PS_DISABLE 16	/* the prescaler value for none */
+typedef u16 XInterval;
+typedef struct {
+	u16 DeviceId;
+	u32 BaseAddress;
+	u32 InputClockHz;
+} XTtcPs_Config;
+typedef struct {
+	XTtcPs_Config Config;
+	u32 IsReady;
+} XTtcPs;
+XTtcPs_Config *XTtcPs_LookupConfig(u16 id);
+s32 XTtcPs_CfgInitialize(XTtcPs *ttc, XTtcPs_Config *config, u32 base);
+void XTtcPs_CalcIntervalFromFreq(XTtcPs *ttc, u32 freq, XInterval *interval, u8 *prescaler);
+void XTtcPs_SetPrescaler(XTtcPs *ttc, u8 prescaler);
+void XTtcPs_SetInterval(XTtcPs *ttc, XInterval interval);
+s32 XTtcPs_SetOptions(XTtcPs *ttc, u32 options);
+void XTtcPs_EnableInterrupts(XTtcPs *ttc, u32 mask);
+void XTtcPs_DisableInterrupts(XTtcPs *ttc, u32 mask);
+void XTtcPs_ClearInterruptStatus(XTtcPs *ttc, u32 mask);
+void XTtcPs_Start(XTtcPs *ttc);
+void XTtcPs_Stop(XTtcPs *ttc);
+
+/* xadc */
+#define XADCPS_SEQ_CH_TEMP 0x100
+#define XADCPS_SEQ_CH_VCCINT 0x200
+#define XADCPS_SEQ_CH_VCCAUX 0x400
+#define XADCPS_SEQ_CH_AUX14 0x40000000
+#define XADCPS_SEQ_CH_AUX15 0x80000000
+#define XADCPS_SEQ_MODE_SAFE 0
+#define XADCPS_SEQ_MODE_CONTINPASS 2
+#define XADCPS_CH_TEMP 0
+#define XADCPS_CH_VCCINT 1
+#define XADCPS_CH_VCCAUX 2
+#define XADCPS_CH_AUX_MAX 31
+#define XADCPS_INTX_ALL_MASK 0x3FF
+#define XADCPS_INTX_OT_MASK 0x80
+#define XADCPS_INTX_ALM2_MASK 0x04
+#define XADCPS_INTX_ALM1_MASK 0x02
+#define XADCPS_INTX_ALM0_MASK 0x01
+#define XADCPS_ATR_TEMP_UPPER 0
+#define XADCPS_ATR_VCCINT_UPPER 1
+#define XADCPS_ATR_VCCAUX_UPPER 2
+#define XADCPS_ATR_OT_UPPER 3
+#define XADCPS_ATR_TEMP_LOWER 4
+#define XADCPS_ATR_VCCINT_LOWER 5
+#define XADCPS_ATR_VCCAUX_LOWER 6
+#define XADCPS_ATR_OT_LOWER 7
+#define XADCPS_CFR1_ALM_VCCAUX_MASK 0x0400
+#define XADCPS_CFR1_ALM_VCCINT_MASK 0x0200
+#define XADCPS_CFR1_ALM_TEMP_MASK 0x0100
+#define XAdcPs_RawToTemperature(x) ((((float)(x)) * 503.975f / 65536.0f) - 273.15f)
+#define XAdcPs_RawToVoltage(x) ((((float)(x)) * 3.0f / 65536.0f))
+typedef struct {
+	u16 DeviceId;
+	u32 BaseAddress;
+} XAdcPs_Config;
+typedef struct {
+	XAdcPs_Config Config;
+} XAdcPs;
+XAdcPs_Config *XAdcPs_LookupConfig(u16 id);
+s32 XAdcPs_CfgInitialize(XAdcPs *adc, XAdcPs_Config *config, u32 base);
+s32 XAdcPs_SelfTest(XAdcPs *adc);
+void XAdcPs_SetSequencerMode(XAdcPs *adc, u8 mode);
+void XAdcPs_SetAlarmEnables(XAdcPs *adc, u16 alarms);
+s32 XAdcPs_SetSeqChEnables(XAdcPs *adc, u32 channels);
+u16 XAdcPs_GetAdcData(XAdcPs *adc, u8 channel);
+void XAdcPs_SetAlarmThreshold(XAdcPs *adc, u8 which, u16 value);
+void XAdcPs_IntrEnable(XAdcPs *adc, u32 mask);
+void XAdcPs_IntrDisable(XAdcPs *adc, u32 mask);
+u32 XAdcPs_IntrGetStatus(XAdcPs *adc);
+void XAdcPs_IntrClear(XAdcPs *adc, u32 mask);
+
+/* global timer (xtime_l) */
+typedef u64 XTime;
+#define COUNTS_PER_SECOND 333333343ull
+extern u64 (*mock_xtime)(void);	/* the timer's counts; NULL to follow CLOCK_MONOTONIC */
+void XTime_GetTime(XTime *t);
+
+/* scu private watchdog */
+typedef struct {
+	u16 DeviceId;
+	u32 BaseAddr;
+} XScuWdt_Config;
+typedef struct {
+	XScuWdt_Config Config;
+} XScuWdt;
+XScuWdt_Config *XScuWdt_LookupConfig(u16 id);
+s32 XScuWdt_CfgInitialize(XScuWdt *wdt, XScuWdt_Config *config, u32 base);
+void XScuWdt_LoadWdt(XScuWdt *wdt, u32 value);
+void XScuWdt_SetWdMode(XScuWdt *wdt);
+void XScuWdt_SetTimerMode(XScuWdt *wdt);
+void XScuWdt_Start(XScuWdt *wdt);
+void XScuWdt_Stop(XScuWdt *wdt);
+void XScuWdt_RestartWdt(XScuWdt *wdt);
+
+/* register access; every read returns mock_reg_in, unless a tool sets the hooks */
+extern u32 mock_reg_in;
+extern u32 (*mock_reg_read)(UINTPTR addr);
+extern void (*mock_reg_write)(UINTPTR addr, u32 value);
+u32 Xil_In32(UINTPTR addr);
+void Xil_Out32(UINTPTR addr, u32 value);
+
+/* cache maintenance */
+void Xil_DCacheFlushRange(UINTPTR addr, u32 len);
+
+/* ps uart */
+#define XUARTPS_IXR_RXOVR 0x1
+#define XUARTPS_IXR_OVER 0x20
+#define XUARTPS_IXR_FRAMING 0x40
+#define XUARTPS_IXR_PARITY 0x80
+#define XUARTPS_IXR_TOUT 0x100
+#define XUARTPS_EVENT_RECV_DATA 1
+#define XUARTPS_EVENT_RECV_TOUT 2
+#define XUARTPS_EVENT_SENT_DATA 3
+#define XUARTPS_EVENT_RECV_ERROR 4
+#define XUARTPS_EVENT_PARE_FRAME_BRKE 6
+#define XUARTPS_EVENT_RECV_ORERR 7
+typedef void (*XUartPs_Handler)(void *CallBackRef, u32 Event, u32 EventData);
+typedef struct {
+	u16 DeviceId;
+	u32 BaseAddress;
+} XUartPs_Config;
+typedef struct {
+	XUartPs_Config Config;
+	XUartPs_Handler Handler;
+	void *CallBackRef;
+	u8 *SendBuffer;			/* send in progress */
+	u32 SendBytes;
+	u8 RecvFifo[64];
+	u32 RecvLen;
+	u32 RecvPos;
+} XUartPs;
+extern int mock_uart_fd;		/* the wire */
+extern int mock_uart_wake;		/* written when a send starts; -1 for none */
+extern u32 mock_uart_baud;
+extern volatile u64 mock_uart_sent_ns;	/* when the send in progress is done (ns, CLOCK_MONOTONIC or mock_xtime's); 0 for none */
+extern volatile u32 mock_uart_framing;	/* line errors to report at the next interrupt */
+extern volatile u32 mock_uart_overrun;
+XUartPs_Config *XUartPs_LookupConfig(u16 id);
+s32 XUartPs_CfgInitialize(XUartPs *uart, XUartPs_Config *config, u32 base);
+void XUartPs_SetInterruptMask(XUartPs *uart, u32 mask);
+void XUartPs_SetFifoThreshold(XUartPs *uart, u8 level);
+void XUartPs_SetRecvTimeout(XUartPs *uart, u8 words);
+void XUartPs_SetHandler(XUartPs *uart, XUartPs_Handler handler, void *ref);
+s32 XUartPs_SetBaudRate(XUartPs *uart, u32 baud);
+int XUartPs_IsTransmitEmpty(XUartPs *uart);
+u32 XUartPs_Send(XUartPs *uart, u8 *buf, u32 len);
+u32 XUartPs_Recv(XUartPs *uart, u8 *buf, u32 len);
+void XUartPs_InterruptHandler(XUartPs *uart);
+
+/* ps qspi and the flash behind it: write enable, 4K erase, page program,
+ * read and status; an erase or program keeps the flash busy for the
+ * mock_flash_ time in global timer time (c.f. mock_xtime) */
+#define XPAR_XQSPIPS_0_DEVICE_ID 0
+#define XPAR_PS7_QSPI_LINEAR_0_S_AXI_BASEADDR 0xFC000000
+#define XQSPIPS_MANUAL_START_OPTION 0x1
+#define XQSPIPS_FORCE_SSELECT_OPTION 0x2
+#define XQSPIPS_HOLD_B_DRIVE_OPTION 0x4
+#define XQSPIPS_CLK_PRESCALE_8 0x2
+#define MOCK_FLASH_BYTES (16 * 1024 * 1024)
+typedef struct {
+	u16 DeviceId;
+	u32 BaseAddress;
+} XQspiPs_Config;
+typedef struct {
+	XQspiPs_Config Config;
+} XQspiPs;
+extern u8 *mock_flash;			/* MOCK_FLASH_BYTES, erased, at the first transfer */
+extern u32 mock_flash_erase_us;
+extern u32 mock_flash_program_us;
+extern u32 mock_flash_erases;
+extern u32 mock_flash_programs;
+XQspiPs_Config *XQspiPs_LookupConfig(u16 id);
+s32 XQspiPs_CfgInitialize(XQspiPs *qspi, XQspiPs_Config *config, u32 base);
+s32 XQspiPs_SetOptions(XQspiPs *qspi, u32 options);
+s32 XQspiPs_SetClkPrescaler(XQspiPs *qspi, u8 prescaler);
+s32 XQspiPs_SetSlaveSelect(XQspiPs *qspi);
+s32 XQspiPs_PolledTransfer(XQspiPs *qspi, u8 *send, u8 *recv, u32 len);
+
+/* cpsr: setting XREG_CPSR_IRQ_ENABLE takes the irq lock */
+#define XREG_CPSR_IRQ_ENABLE 0x80
+u32 mfcpsr(void);
+void mtcpsr(u32 cpsr);
+extern void (*mock_unmask)(void);	/* IRQs were just unmasked: pending ones run */
+
+/* barriers and wfi; a tool's mock_wfi moves time on to the next interrupt */
+#define dsb() do{}while(0)
+#define isb() do{}while(0)
+extern void (*mock_wfi)(void);
+void wfi(void);
+
+/* platform */
+void init_platform(void);
+void cleanup_platform(void);
@@ -0,0 +1,6 @@
+/*
+ * xil_cache.h -- host stand-in (c.f. xbsp_mock.h)
+ */
+#pragma once
+
+#include "xbsp_mock.h"
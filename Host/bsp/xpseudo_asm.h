@@ -0,0 +1,6 @@
+/*
+ * xpseudo_asm.h -- host stand-in (c.f. xbsp_mock.h)
+ */
+#pragma once
+
+#include "xbsp_mock.h"
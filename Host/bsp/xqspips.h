@@ -0,0 +1,6 @@
+/*
+ * xqspips.h -- host stand-in (c.f. xbsp_mock.h)
+ */
+#pragma once
+
+#include "xbsp_mock.h"
@@ -0,0 +1,6 @@
+/*
+ * xreg_cortexa9.h -- host stand-in (c.f. xbsp_mock.h)
+ */
+#pragma once
+
+#include "xbsp_mock.h"
@@ -0,0 +1,344 @@
+/*
+ * capture_sim.c -- accuracy of the input event stamps under interrupt jitter
+ *
+ * Runs Library/capture.c on one simulated core in virtual time. The core
+ * serves the interrupts the controller takes: the 1 kHz gate loop, the
+ * 1 Hz crossing tick, the console and substation UARTs, and the switch and
+ * button ports. It runs one handler at a time, as the standalone build
+ * does, taking the highest priority pending first (the switch port at
+ * IO_TRAIN_PRIORITY, the rest at the default). The main loop masks
+ * interrupts for a few us every pass. A GPIO handler stamps the event
+ * ENTRY_NS after it starts (c.f. io_entry), or after it wakes the core from
+ * WFI. During a button storm the button handler runs from gic_poll, and
+ * its stamps are late.
+ *
+ * Trains and pedestrian requests arrive at random; each train stays on the
+ * sensor for 20 to 90 s and each request is served 2 to 15 s later.
+ * For each scenario the tool reports how far the stamps fall behind the
+ * edges, and the error of the waits and occupancies capture.c folds,
+ * against their true length. It compares them with counting whole TTC
+ * ticks, as main_ttc_callback did. It checks every stamp taken at
+ * interrupt entry against the worst case of the jitter, and capture.c's
+ * statistics against the spans it returned. The exit status is 1 if any
+ * check fails.
+ *
+ * gcc -O2 -Wall -IHost/bsp -IHost -ILibrary -I. -o capture_sim Host/capture_sim.c \
+ *     Host/bsp/mock.c Library/capture.c -lm
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+
+#include "capture.h"
+#include "xtime_l.h"
+
+#define NS 1000000000ull
+#define ENTRY_NS 400ull				/* exception entry, gic dispatch and the guard */
+#define WFI_EXIT_NS 100ull
+#define CALLBACK_NS 30000ull		/* switch or button callback, with its printf */
+#define POLL_NS 100000000ull		/* c.f. POLL_US */
+#define TICK_NS NS					/* c.f. FREQ */
+
+enum { SWITCH, GATE, TICK, CONSOLE, SUBST, BUTTON, MAIN, SOURCES };
+
+typedef struct {
+	const char *name;
+	u32 prio;					/* gic priority, lower first; MAIN only runs with none pending */
+	u64 cost;					/* full-speed ns */
+	double period;				/* mean ns between arrivals; 0 for none */
+	bool periodic;
+	u64 next;
+	bool pending;
+} source_t;
+
+typedef struct {
+	const char *label;
+	bool uarts;					/* console listing and substation traffic */
+	u32 slow;					/* cpu clock divided by (c.f. power.h) */
+	bool storm;					/* buttons chattering: polled */
+} scenario_t;
+
+static const scenario_t scenarios[] = {
+	{ "quiet",   false, 1, false },
+	{ "uarts",   true,  1, false },
+	{ "slow",    true,  4, false },
+	{ "storm",   true,  1, true },
+};
+
+typedef struct {
+	u32 n, late;
+	u64 *err;					/* ns, stamps taken at entry */
+	u32 size;
+	u64 bound;
+} errors_t;
+
+static source_t sources[SOURCES];
+static double hours = 24;
+static double train_min = 10;		/* between trains */
+static double walk_min = 2;			/* between pedestrian requests */
+
+static u64 now;
+static const scenario_t *scenario;
+static errors_t stamps[2];			/* train edges, requests */
+static u64 span_err_max[2], tick_err_max[2];
+static u64 span_sum[2];				/* as capture_event returned them */
+static u32 spans[2];
+static u64 train_edge, press_edge, walk_at;
+static bool train_on, waiting;
+
+static double expo(double mean_ns){
+	return -mean_ns * log1p(-drand48());
+}
+
+static u64 uniform(double lo_s, double hi_s){
+	return (u64)((lo_s + (hi_s - lo_s) * drand48()) * 1e9);
+}
+
+static u64 ticks(u64 ns){
+	return ns / NS * COUNTS_PER_SECOND + ns % NS * COUNTS_PER_SECOND / NS;
+}
+
+static u64 diff(u64 a, u64 b){
+	return a > b ? a - b : b - a;
+}
+
+/* seconds counted by a 1 Hz tick from <from> to <to> */
+static u64 tick_count(u64 from, u64 to){
+	return (to / TICK_NS - from / TICK_NS) * TICK_NS;
+}
+
+static void add(errors_t *e, u64 err){
+	if (e->n == e->size){
+		e->size = e->size ? e->size * 2 : 1024;
+		e->err = realloc(e->err, e->size * sizeof(*e->err));
+	}
+	e->err[e->n++] = err;
+}
+
+static void span(u32 i, u64 got, u64 from, u64 to){
+	u64 e = diff(got, to - from), t = diff(tick_count(from, to), to - from);
+
+	span_err_max[i] = e > span_err_max[i] ? e : span_err_max[i];
+	tick_err_max[i] = t > tick_err_max[i] ? t : tick_err_max[i];
+	span_sum[i] += got;
+	spans[i]++;
+}
+
+/*
+ * a gpio handler started at <start> for the edge at <edge>
+ */
+static void gpio(u32 src, u64 edge, u64 start, bool late){
+	u64 at = start + ENTRY_NS * scenario->slow, got;
+
+	if (late)
+		stamps[src == SWITCH ? 0 : 1].late++;
+	else
+		add(&stamps[src == SWITCH ? 0 : 1], at - edge);
+	if (src == SWITCH){
+		if (!train_on){
+			capture_event(CAPTURE_ARRIVED, ticks(at), late);
+			train_edge = edge;
+		} else {
+			got = capture_event(CAPTURE_LEFT, ticks(at), late);
+			span(0, got, train_edge, edge);
+		}
+		train_on = !train_on;
+	} else {
+		capture_event(CAPTURE_PRESS, ticks(at), late);
+		if (!waiting){
+			waiting = true;
+			press_edge = edge;
+			walk_at = edge + uniform(2, 15);
+		}
+	}
+}
+
+static int cmp(const void *a, const void *b){
+	u64 x = *(const u64 *) a, y = *(const u64 *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void setup(const scenario_t *s){
+	static const source_t base[SOURCES] = {
+		{ "switch",  0x08, CALLBACK_NS, 0, false },
+		{ "gate",    0xA0, 6000, 1e6, true },
+		{ "tick",    0xA0, 20000, TICK_NS, true },
+		{ "console", 0xA0, 8000, 11e6, false },		/* tx fifo refills, half the time */
+		{ "subst",   0xA0, 4000, 10e6, false },		/* rx fifo triggers */
+		{ "button",  0xA0, CALLBACK_NS, 0, false },
+		{ "main",    0xFF, 5000, POLL_NS, true },		/* masked: snapshot, capture, power */
+	};
+	u32 i;
+
+	memcpy(sources, base, sizeof(sources));
+	if (!s->uarts)
+		sources[CONSOLE].period = sources[SUBST].period = 0;
+	for (i = 0; i < SOURCES; i++)
+		sources[i].next = sources[i].period == 0 ? ~0ull : (u64)(drand48() * sources[i].period);
+	sources[SWITCH].next = (u64) expo(train_min * 60e9);
+	sources[BUTTON].next = (u64) expo(walk_min * 60e9);
+}
+
+/*
+ * worst stamp delay: the longest handler running, then (for the button)
+ * one of each source ahead of it
+ */
+static u64 bound(u32 src){
+	u64 longest = 0, ahead = 0;
+	u32 i;
+
+	for (i = 0; i < SOURCES; i++){
+		if (i == src || (sources[i].period == 0 && i != SWITCH && i != BUTTON))
+			continue;
+		longest = sources[i].cost > longest ? sources[i].cost : longest;
+		if (sources[i].prio <= sources[src].prio && i != MAIN)
+			ahead += sources[i].cost;
+	}
+	return (longest + (src == SWITCH ? 0 : ahead) + ENTRY_NS) * scenario->slow + WFI_EXIT_NS;
+}
+
+static void run(const scenario_t *s){
+	u64 end = (u64)(hours * 3600e9), t, edge[SOURCES] = { 0 };
+	bool idle = false;
+	source_t *best;
+	u32 i;
+
+	scenario = s;
+	srand48(1);					/* the same day for each scenario */
+	memset(stamps, 0, sizeof(stamps));
+	memset(span_err_max, 0, sizeof(span_err_max));
+	memset(tick_err_max, 0, sizeof(tick_err_max));
+	memset(span_sum, 0, sizeof(span_sum));
+	memset(spans, 0, sizeof(spans));
+	train_on = waiting = false;
+	walk_at = ~0ull;
+	setup(s);
+	capture_init();
+	stamps[0].bound = bound(SWITCH);
+	stamps[1].bound = bound(BUTTON);
+
+	for (now = 0; now < end; ){
+		/* raise what has arrived; the gic latches one of each */
+		for (i = 0; i < SOURCES; i++){
+			source_t *src = &sources[i];
+
+			if (src->next > now)
+				continue;
+			if (!src->pending)
+				edge[i] = src->next;
+			src->pending = true;
+			if (i == SWITCH)
+				src->next += train_on ? (u64) expo(train_min * 60e9) : uniform(20, 90);
+			else if (i == BUTTON)
+				src->next += (u64) expo(walk_min * 60e9);
+			else
+				src->next += src->periodic ? (u64) src->period : (u64) expo(src->period);
+		}
+		if (walk_at <= now){		/* from the sequences: stamped as it happens */
+			span(1, capture_event(CAPTURE_WALK, ticks(walk_at), false), press_edge, walk_at);
+			waiting = false;
+			walk_at = ~0ull;
+		}
+
+		best = NULL;
+		for (i = 0; i < SOURCES; i++){
+			if (!sources[i].pending || (i == BUTTON && s->storm))
+				continue;
+			if (best == NULL || sources[i].prio < best->prio)
+				best = &sources[i];
+		}
+		if (best == NULL){			/* wfi until the next arrival */
+			for (t = walk_at, i = 0; i < SOURCES; i++)
+				t = sources[i].next < t ? sources[i].next : t;
+			now = t;
+			idle = true;
+			continue;
+		}
+		if (idle)
+			now += WFI_EXIT_NS;
+		idle = false;
+		i = best - sources;
+		best->pending = false;
+		if (i == SWITCH || i == BUTTON)
+			gpio(i, edge[i], now, false);
+		now += best->cost * s->slow;
+		if (i == MAIN && s->storm && sources[BUTTON].pending){	/* gic_poll runs the masked source */
+			sources[BUTTON].pending = false;
+			gpio(BUTTON, edge[BUTTON], now, true);
+			now += sources[BUTTON].cost * s->slow;
+		}
+	}
+}
+
+/*
+ * the checks; returns the failures
+ */
+static u32 report(const scenario_t *s){
+	static const char *inputs[2] = { "train", "request" };
+	capture_stats_t c;
+	const capture_span_t *cs;
+	errors_t *e;
+	u32 i, k, failed = 0;
+	u64 sum;
+
+	capture_stats(&c);
+	for (i = 0; i < 2; i++){
+		e = &stamps[i];
+		cs = i == 0 ? &c.occupancy : &c.wait;
+		qsort(e->err, e->n, sizeof(*e->err), cmp);
+		for (sum = 0, k = 0; k < e->n; k++)
+			sum += e->err[k];
+		printf("%-7s %-8s %6u %5u %8.2f %8.2f %8.2f %8.2f %11.2f %10.0f\n", s->label, inputs[i], e->n + e->late,
+				e->late, e->n ? sum / 1e3 / e->n : 0, e->n ? e->err[e->n * 99 / 100] / 1e3 : 0,
+				e->n ? e->err[e->n - 1] / 1e3 : 0, e->bound / 1e3, span_err_max[i] / 1e3, tick_err_max[i] / 1e6);
+		if (e->n && e->err[e->n - 1] > e->bound){
+			printf("%-7s %s stamp %.2f us after its edge, beyond %.2f us\n", s->label, inputs[i],
+					e->err[e->n - 1] / 1e3, e->bound / 1e3);
+			failed++;
+		}
+		if (cs->count != spans[i] || cs->sum_ns != span_sum[i]){
+			printf("%-7s capture.c folded %u %s spans summing %llu ns, returned %u summing %llu ns\n", s->label,
+					cs->count, i == 0 ? "occupancy" : "wait", (unsigned long long) cs->sum_ns, spans[i],
+					(unsigned long long) span_sum[i]);
+			failed++;
+		}
+		free(e->err);
+	}
+	if (c.late != stamps[0].late + stamps[1].late){
+		printf("%-7s capture.c counted %u late stamps, %u were\n", s->label, c.late,
+				stamps[0].late + stamps[1].late);
+		failed++;
+	}
+	return failed;
+}
+
+int main(int argc, char *argv[]){
+	u32 i, failed = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "h:t:w:")) != -1){
+		switch (opt){
+		case 'h': hours = atof(optarg); break;
+		case 't': train_min = atof(optarg); break;
+		case 'w': walk_min = atof(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-h hours] [-t minutes between trains] [-w minutes between requests]\n", argv[0]);
+			return 1;
+		}
+	}
+	printf("%.0f h per scenario; a train every %.1f min, a request every %.1f min\n", hours, train_min, walk_min);
+	printf("%-7s %-8s %6s %5s %8s %8s %8s %8s %11s %10s\n", "", "", "", "", "stamp us", "", "", "",
+			"span us", "ticks ms");
+	printf("%-7s %-8s %6s %5s %8s %8s %8s %8s %11s %10s\n", "scenario", "input", "events", "late", "mean", "p99",
+			"max", "bound", "max error", "max error");
+	for (i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++){
+		run(&scenarios[i]);
+		failed += report(&scenarios[i]);
+	}
+	printf("%s\n", failed ? "FAILED" : "all stamps within bounds, statistics consistent");
+	return failed ? 1 : 0;
+}
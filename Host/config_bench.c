@@ -0,0 +1,290 @@
+/*
+ * config_bench.c -- config read cost and update latency
+ *
+ * Runs Library/config.c and Library/flash.c against the mock QSPI flash.
+ * It first times a config->field read, as the hot path does one, against
+ * config_get, alone and with a second thread calling config_set as fast
+ * as it can. Every value read must be one the writer stored. It also
+ * times config_set itself and the slowest config_poll step; on the host
+ * both include the mock's irq lock.
+ *
+ * It then runs the main loop in virtual time, a config_poll every
+ * POLL_NS, with the flash taking mock_flash_erase_us per erase and
+ * mock_flash_program_us per page. For each scenario it reports, over many
+ * updates at random points in a pass, how long from config_set until
+ * config_poll reports it to the main loop (applied) and until the record
+ * in flash holds it (persisted), and the erases taken. Readers must see
+ * each value as soon as config_set returns. A burst of sets within a pass
+ * must take one erase, and a set while the record is being written must still reach
+ * flash. Last, config_init runs again as after a restart and must load
+ * the values that were set. The exit status is 1 if any check fails.
+ *
+ * gcc -O2 -Wall -IHost/bsp -IHost -ILibrary -I. -o config_bench Host/config_bench.c \
+ *     Host/bsp/mock.c Library/config.c Library/flash.c -lpthread
+ *
+ * usage: config_bench [-n reads] [-u updates] [-s seed]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "config.h"
+#include "flash.h"
+#include "xtime_l.h"
+
+#define POLL_NS 100000000ull	/* firmware main loop (c.f. POLL_US) */
+#define NS 1000000000ull
+#define MAGIC 0x33474643		/* c.f. config.c */
+#define BURST 10				/* sets within one pass */
+#define LIGHT_A 3				/* the two values the writer stores */
+#define LIGHT_B 4
+
+typedef struct {
+	u32 magic;
+	config_t values;
+	u32 check;
+} record_t;						/* c.f. config.c */
+
+typedef struct {
+	u32 n;
+	u64 max;
+	u64 sum;
+} stat_t;
+
+static u64 vnow;				/* virtual ns */
+static volatile bool writing;
+static volatile u64 sink;
+
+static u64 now_ns(void){
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static u64 counts(void){
+	return vnow / NS * COUNTS_PER_SECOND + vnow % NS * COUNTS_PER_SECOND / NS;
+}
+
+static void add(stat_t *s, u64 v){
+	s->n++;
+	s->sum += v;
+	if (v > s->max)
+		s->max = v;
+}
+
+/*
+ * the wall clock part
+ */
+static void *writer(void *arg){
+	u32 i = 0;
+
+	while (writing)
+		config_set(CONFIG_LIGHT, (i++ & 1) ? LIGHT_B : LIGHT_A);
+	return NULL;
+}
+
+/* returns ns per read; counts values the writer never stored */
+static double read_field(u32 n, u32 *bad){
+	u64 t0 = now_ns();
+	u64 sum = 0;
+	u32 i, v;
+
+	for (i = 0; i < n; i++){
+		v = config->light;
+		sum += v;
+		*bad += v != LIGHT_A && v != LIGHT_B;
+	}
+	sink = sum;
+	return (double)(now_ns() - t0) / n;
+}
+
+static double read_get(u32 n, u32 *bad){
+	u64 t0 = now_ns();
+	u64 sum = 0;
+	u32 i, v;
+
+	for (i = 0; i < n; i++){
+		config_get(CONFIG_LIGHT, &v);
+		sum += v;
+		*bad += v != LIGHT_A && v != LIGHT_B;
+	}
+	sink = sum;
+	return (double)(now_ns() - t0) / n;
+}
+
+/*
+ * the virtual time part
+ */
+static bool persisted(void){
+	const record_t *r = (const record_t*)(mock_flash + CONFIG_FLASH_OFFSET);
+
+	return r->magic == MAGIC && r->check != 0xFFFFFFFF && memcmp(&r->values, (const void*) config, sizeof(config_t)) == 0;
+}
+
+/* main loop passes until the flash is quiet and holds the values */
+static void settle(void){
+	u32 i;
+
+	for (i = 0; i < 10; i++){
+		vnow += POLL_NS;
+		config_poll();
+	}
+}
+
+/*
+ * <sets> sets spread over one pass at random points; returns false if a
+ * set is not seen, applied or persisted as it should be
+ */
+static bool update(u32 sets, bool during_write, stat_t *applied, stat_t *stored, stat_t *erases){
+	static u32 light = LIGHT_A;
+	u64 pass = (vnow / POLL_NS + 1) * POLL_NS;
+	u64 first = 0;
+	u32 erased = mock_flash_erases;
+	u32 i, passes;
+	bool ok = true;
+
+	if (during_write){
+		/* a set first, and the next one after the erase has started */
+		vnow = pass + (u64) rand() % POLL_NS;
+		config_set(CONFIG_LIGHT, light = light % 60 + 1);
+		pass += POLL_NS;
+		vnow = pass;
+		config_poll();
+		pass += POLL_NS;
+	}
+	for (i = 0; i < sets; i++){
+		vnow = pass + (u64) rand() % (POLL_NS / sets) + i * (POLL_NS / sets);
+		if (first == 0)
+			first = vnow;
+		light = light % 60 + 1;
+		if (config_set(CONFIG_LIGHT, light) != XST_SUCCESS || config->light != light)
+			ok = false;		/* the next read must see it */
+	}
+	vnow = pass + POLL_NS;
+	if (!config_poll())
+		ok = false;
+	add(applied, vnow - first);
+	for (passes = 0; !persisted() && passes < 100; passes++){
+		vnow += POLL_NS;
+		config_poll();
+		if (!persisted())
+			continue;
+		/* the program that finished it started at this pass */
+		vnow += (u64) mock_flash_program_us * 1000;
+	}
+	if (!persisted())
+		ok = false;
+	add(stored, vnow - first);
+	settle();
+	add(erases, mock_flash_erases - erased);
+	if (!during_write && sets > 0 && mock_flash_erases - erased != 1)
+		ok = false;
+	return ok;
+}
+
+static void row(const char *label, const stat_t *s, const char *unit, double scale){
+	printf("  %-10s mean %8.1f  max %8.1f %s\n", label, s->n ? s->sum / scale / s->n : 0, s->max / scale, unit);
+}
+
+int main(int argc, char **argv){
+	static const struct {
+		const char *label;
+		u32 sets;
+		bool during_write;
+	} scenarios[] = {
+		{ "single", 1, false },
+		{ "burst", BURST, false },
+		{ "during write", 1, true },
+	};
+	u32 reads = 20000000, updates = 200, seed = 1;
+	u32 bad = 0, i, j, k;
+	u64 t0, t, set_max = 0, poll_max = 0;
+	double ns_field, ns_get, ns_field_w, ns_get_w, ns_set;
+	config_t before;
+	pthread_t thread;
+	bool ok = true;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:u:s:")) != -1){
+		switch (opt){
+		case 'n': reads = strtoul(optarg, NULL, 0); break;
+		case 'u': updates = strtoul(optarg, NULL, 0); break;
+		case 's': seed = strtoul(optarg, NULL, 0); break;
+		default:
+			fprintf(stderr, "usage: %s [-n reads] [-u updates] [-s seed]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (reads == 0 || updates == 0){
+		fprintf(stderr, "reads and updates must be positive\n");
+		return 2;
+	}
+	srand(seed);
+
+	/* reads, alone and against a writer */
+	config_init();
+	config_set(CONFIG_LIGHT, LIGHT_A);
+	ns_field = read_field(reads, &bad);
+	ns_get = read_get(reads, &bad);
+	writing = true;
+	pthread_create(&thread, NULL, writer, NULL);
+	ns_field_w = read_field(reads, &bad);
+	ns_get_w = read_get(reads, &bad);
+	writing = false;
+	pthread_join(thread, NULL);
+	t0 = now_ns();
+	for (i = 0; i < reads / 100; i++)
+		config_set(CONFIG_LIGHT, (i & 1) ? LIGHT_B : LIGHT_A);
+	ns_set = (double)(now_ns() - t0) / (reads / 100);
+	for (i = 0; i < 100; i++){
+		t0 = now_ns();
+		config_set(CONFIG_LIGHT, (i & 1) ? LIGHT_B : LIGHT_A);
+		t = now_ns() - t0;
+		set_max = t > set_max ? t : set_max;
+		t0 = now_ns();
+		config_poll();
+		t = now_ns() - t0;
+		poll_max = t > poll_max ? t : poll_max;
+	}
+
+	printf("reads (host ns)   alone   with a writer\n");
+	printf("  config->light %7.2f %9.2f\n", ns_field, ns_field_w);
+	printf("  config_get    %7.2f %9.2f\n", ns_get, ns_get_w);
+	printf("  config_set    %7.1f   max %llu, the slowest config_poll step %llu\n",
+		ns_set, (unsigned long long) set_max, (unsigned long long) poll_max);
+	printf("  torn or foreign values read: %u\n", bad);
+	ok &= bad == 0;
+
+	/* update latency in virtual time, from where the wall clock left the flash */
+	vnow = now_ns();
+	mock_xtime = counts;
+	settle();
+	printf("\nupdates (virtual ms; poll every %llu ms, erase %u ms, page %.1f ms)\n",
+		(unsigned long long)(POLL_NS / 1000000), mock_flash_erase_us / 1000, mock_flash_program_us / 1000.0);
+	for (k = 0; k < sizeof(scenarios) / sizeof(scenarios[0]); k++){
+		stat_t applied = { 0 }, stored = { 0 }, erases = { 0 };
+		u32 failed = 0;
+
+		for (j = 0; j < updates; j++)
+			failed += !update(scenarios[k].sets, scenarios[k].during_write, &applied, &stored, &erases);
+		printf("%s (%u set%s per update)%s\n", scenarios[k].label, scenarios[k].sets, scenarios[k].sets > 1 ? "s" : "",
+			failed ? "  FAIL" : "");
+		row("applied", &applied, "ms", 1e6);
+		row("persisted", &stored, "ms", 1e6);
+		row("erases", &erases, "", 1);
+		ok &= failed == 0;
+	}
+
+	/* restart */
+	before = *config;
+	config_init();
+	k = memcmp(&before, (const void*) config, sizeof(config_t)) == 0;
+	printf("\nrestart: %s\n", k ? "values restored from flash" : "FAIL, values lost");
+	ok &= k;
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,279 @@
+/*
+ * console_sim.c -- operator console test over a pseudo-terminal
+ *
+ * Runs Library/console.c against the mock PS UART, with the master side
+ * of a pty as the wire at the console's baud rate. An interrupt thread
+ * runs the UART handler through gic_dispatch whenever a byte arrives or
+ * a send completes, holding the irq lock as the A9 would hold off other
+ * interrupts. A 1 kHz control loop stands in for the main loop: each
+ * pass masks IRQs once, the way the sequences do, then calls
+ * console_poll. The operator, on the slave side, types commands and
+ * waits for the prompt.
+ *
+ * Reports the command round trip (a one-line status and a long streamed
+ * dump), and what the console costs the control loop: time in
+ * console_poll, the wait to mask IRQs behind the console's interrupt,
+ * and how late each pass starts, idle and under load.
+ *
+ * gcc -O2 -Wall -IHost/bsp -IHost -ILibrary -I. -o console_sim Host/console_sim.c \
+ *     Host/bsp/mock.c Library/console.c Library/gic.c Library/lat.c -lpthread
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "console.h"
+#include "gic.h"
+#include "lat.h"
+#include "xpseudo_asm.h"
+#include "xreg_cortexa9.h"
+#include "xtime_l.h"
+
+#define LOOP_NS 1000000			/* control loop period */
+#define DUMP_LINES 200
+
+typedef struct {				/* costs to the control loop, one phase */
+	lat_t poll;					/* in console_poll */
+	lat_t mask;					/* waiting to mask IRQs */
+	lat_t late;					/* pass start after its deadline */
+} phase_t;
+
+static phase_t phases[2];		/* idle, load */
+static lat_t isr;				/* console interrupt */
+static volatile int phase = 0;
+static volatile int running = 1;
+static int wake_pipe[2];
+
+static bool cmd_status(u32 argc, char *argv[], u32 step){
+	console_printf("TRAFFIC_ON for 12 ticks, mode update, train 0, key 0, button 0, gate 0/65536, link udp, health 0\r\n");
+	return false;
+}
+
+static bool cmd_dump(u32 argc, char *argv[], u32 step){
+	console_printf("  %5lu ns %lu\r\n", (unsigned long)(step * LAT_BIN_NS), (unsigned long) step * 7);
+	return step + 1 < DUMP_LINES;
+}
+
+static bool cmd_echo(u32 argc, char *argv[], u32 step){
+	u32 i;
+
+	for (i = 1; i < argc; i++)
+		console_printf("%s%s", argv[i], i + 1 < argc ? " " : "");
+	console_printf("\r\n");
+	return false;
+}
+
+static const console_cmd_t commands[] = {
+	{ "status", "one line", cmd_status },
+	{ "dump", "a long streamed listing", cmd_dump },
+	{ "echo", "<words>  print the words", cmd_echo },
+};
+
+static u64 now_ns(void){
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static u64 ticks(u64 ns){
+	return ns * COUNTS_PER_SECOND / 1000000000ull;
+}
+
+/*
+ * the uart interrupt: a byte on the wire or a send completing
+ */
+static void *interrupt_main(void *arg){
+	struct pollfd fds[2] = { { mock_uart_fd, POLLIN, 0 }, { wake_pipe[0], POLLIN, 0 } };
+	struct timespec ts;
+	u64 done, start;
+	u8 drain[64];
+	u32 cpsr;
+
+	while (running){
+		done = mock_uart_sent_ns;
+		start = now_ns();
+		if (done == 0)
+			done = start + 10000000;	/* to notice the end */
+		done = done > start ? done - start : 0;
+		ts.tv_sec = done / 1000000000ull;
+		ts.tv_nsec = done % 1000000000ull;
+		if (ppoll(fds, 2, &ts, NULL) < 0)
+			break;
+		if (fds[1].revents & POLLIN && read(wake_pipe[0], drain, sizeof(drain)) < 0)
+			break;
+		if (!(fds[0].revents & POLLIN) && (mock_uart_sent_ns == 0 || now_ns() < mock_uart_sent_ns))
+			continue;
+		cpsr = mfcpsr();
+		mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);
+		start = now_ns();
+		gic_dispatch(XPAR_XUARTPS_1_INTR);
+		lat_add(&isr, ticks(now_ns() - start));
+		mtcpsr(cpsr);
+	}
+	return NULL;
+}
+
+/*
+ * the main loop
+ */
+static void *control_main(void *arg){
+	struct timespec next;
+	u64 deadline, start, t;
+	u32 cpsr;
+	phase_t *p;
+
+	deadline = now_ns();
+	while (running){
+		deadline += LOOP_NS;
+		next.tv_sec = deadline / 1000000000ull;
+		next.tv_nsec = deadline % 1000000000ull;
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+		p = &phases[phase];
+		start = now_ns();
+		lat_add(&p->late, ticks(start - deadline));
+
+		cpsr = mfcpsr();
+		mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);	/* as the sequences' critical sections do */
+		t = now_ns();
+		mtcpsr(cpsr);
+		lat_add(&p->mask, ticks(t - start));
+
+		t = now_ns();
+		console_poll();
+		lat_add(&p->poll, ticks(now_ns() - t));
+	}
+	return NULL;
+}
+
+/*
+ * type <cmd> and wait for the prompt after its output; returns the round
+ * trip in ns and the bytes received
+ */
+static u64 command(int fd, const char *cmd, u32 *received){
+	char buf[4096];
+	char tail[4] = { 0 };
+	u64 start = now_ns();
+	ssize_t n, i;
+
+	if (write(fd, cmd, strlen(cmd)) < 0 || write(fd, "\r", 1) < 0)
+		return 0;
+	*received = 0;
+	for(;;){
+		n = read(fd, buf, sizeof(buf));
+		if (n <= 0)
+			return 0;
+		*received += n;
+		for (i = 0; i < n; i++){		/* prompt at the start of a line */
+			memmove(tail, tail + 1, 3);
+			tail[3] = buf[i];
+			if (memcmp(tail, "\r\n> ", 4) == 0)
+				return now_ns() - start;
+		}
+	}
+}
+
+static int compare(const void *a, const void *b){
+	u64 x = *(const u64 *) a, y = *(const u64 *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void rtt(const char *name, u64 *ns, int n){
+	u64 sum = 0;
+	int i;
+
+	qsort(ns, n, sizeof(*ns), compare);
+	for (i = 0; i < n; i++)
+		sum += ns[i];
+	printf("  %s: min %.2f avg %.2f max %.2f p99 %.2f ms\n", name, ns[0] / 1e6,
+			sum / 1e6 / n, ns[n - 1] / 1e6, ns[n * 99 / 100] / 1e6);
+}
+
+static void summary(const char *name, lat_t *lat){
+	char buf[LAT_LINE];
+
+	lat_format(lat, name, buf, sizeof(buf));
+	printf("  %s\n", buf);
+}
+
+int main(int argc, char *argv[]){
+	int rounds = 50, opt, master, slave, i;
+	pthread_t interrupt, control;
+	u64 *status, *dump;
+	struct termios raw;
+	u32 bytes, dumped = 0;
+	char prompt[2];
+
+	while ((opt = getopt(argc, argv, "b:n:")) != -1){
+		switch (opt){
+		case 'b': mock_uart_baud = atoi(optarg); break;
+		case 'n': rounds = atoi(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-b baud] [-n rounds]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	status = calloc(rounds, sizeof(*status));
+	dump = calloc(rounds, sizeof(*dump));
+	master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0 || status == NULL || dump == NULL || grantpt(master) < 0 || unlockpt(master) < 0 ||
+			(slave = open(ptsname(master), O_RDWR | O_NOCTTY)) < 0 || pipe(wake_pipe) < 0){
+		perror("console_sim");
+		return 1;
+	}
+	tcgetattr(slave, &raw);
+	cfmakeraw(&raw);
+	tcsetattr(slave, TCSANOW, &raw);
+	fcntl(master, F_SETFL, O_NONBLOCK);
+	mock_uart_fd = master;
+	mock_uart_wake = wake_pipe[1];
+
+	for (i = 0; i < 2; i++){
+		lat_reset(&phases[i].poll);
+		lat_reset(&phases[i].mask);
+		lat_reset(&phases[i].late);
+	}
+	lat_reset(&isr);
+	gic_init();
+	console_init(commands, sizeof(commands) / sizeof(commands[0]));
+	pthread_create(&interrupt, NULL, interrupt_main, NULL);
+	pthread_create(&control, NULL, control_main, NULL);
+
+	if (read(slave, prompt, sizeof(prompt)) != sizeof(prompt))	/* first prompt */
+		return 1;
+	usleep(500000);			/* idle baseline */
+	phase = 1;
+	for (i = 0; i < rounds; i++){
+		status[i] = command(slave, "status", &bytes);
+		dump[i] = command(slave, "dump", &bytes);
+		dumped += bytes;
+	}
+	running = 0;
+	pthread_join(control, NULL);
+	pthread_join(interrupt, NULL);
+
+	printf("%d rounds at %lu baud, dump %lu bytes each, %lu bytes dropped\n", rounds,
+			(unsigned long) mock_uart_baud, (unsigned long)(dumped / rounds), (unsigned long) console_dropped());
+	printf("round trip:\n");
+	rtt("status", status, rounds);
+	rtt("dump", dump, rounds);
+	for (i = 0; i < 2; i++){
+		printf("control loop, %s:\n", i == 0 ? "idle" : "load");
+		summary("console_poll", &phases[i].poll);
+		summary("irq mask wait", &phases[i].mask);
+		summary("pass start late", &phases[i].late);
+	}
+	printf("console interrupt:\n");
+	summary("handler", &isr);
+	return 0;
+}
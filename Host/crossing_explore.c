@@ -0,0 +1,528 @@
+/*
+ * crossing_explore.c -- exhaustive state-space search of the crossing sequences
+ *
+ * Builds Library/crossing.c natively and explores every reachable
+ * configuration of the sequences, flags and timers under every ordering
+ * of the events the interrupt handlers deliver (tick, button, train
+ * switch, key switch, upstream train on/off, tracked train due) interleaved with runs of the
+ * main loop. Times are kept relative to the clock and clamped past the
+ * longest phase, so the space is finite.
+ *
+ * The search is a level-synchronous breadth-first search: each thread
+ * expands its own share of a level and steals from the others when it
+ * runs dry, so the first counterexample found for an invariant is a
+ * shortest one. The visited set keeps only a 64-bit fingerprint per
+ * state in a lock-free open-addressed table (hash compaction), plus a
+ * parent link and event for replaying traces.
+ *
+ * The search starts from a cold boot and from every set of flags a warm
+ * restart can resume with. Invariants are checked in quiescent states,
+ * where one more run of the main loop changes nothing.
+ *
+ * gcc -O2 -Wall -IHost -ILibrary -o crossing_explore Host/crossing_explore.c Library/crossing.c -lpthread
+ *
+ * usage: crossing_explore [-t threads] [-m log2_slots] [-g green] [-w walk] [-y yellow] [-h hold]
+ *        phase lengths are in ticks
+ */
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "crossing.h"
+
+#define BASE 1000			/* clock value of every canonical state */
+#define MAX_DEADLINE 255
+#define NO_NODE 0xFFFFFFFFu
+#define ROOTS 16			/* a cold start and every warm restart (c.f. start_state) */
+
+/* events */
+#define EV_RUN 0
+#define EV_TICK 1
+#define EV_BUTTON 2
+#define EV_TRAIN 3
+#define EV_KEY 4
+#define EV_UP_ON 5
+#define EV_UP_OFF 6
+#define EV_DUE 7
+#define EVENTS 8
+
+static const char *event_names[EVENTS] = {
+	"run", "tick", "button", "train switch", "key switch", "upstream on", "upstream off", "train due"
+};
+
+/* the crossing and the outputs it drives */
+typedef struct {
+	crossing_t c;			/* first: the ops get a crossing_t pointer */
+	u8 signal;
+	u8 request;
+	s32 gate;
+} model_t;
+
+/* canonical packed state; hashed for the visited set */
+typedef struct {
+	u16 lc;
+	u16 seqlc;
+	u8 state;
+	u8 flags;
+	u8 entered;
+	u8 deadline;
+	u8 seqdeadline;
+	u8 signal;
+	u8 request;
+	u8 gate;
+} skey_t;
+
+typedef struct {
+	model_t m;
+	u32 node;
+} item_t;
+
+typedef struct {
+	pthread_mutex_t lock;
+	item_t *items;			/* this level: the owner pops the tail, thieves take the head */
+	size_t head, tail, cap;
+	item_t *next;			/* next level, owner only */
+	size_t nnext, capnext;
+	u64 expanded, transitions, quiescent, steals;
+	unsigned seed;
+} worker_t;
+
+/* invariants */
+#define INVARIANTS 5
+static const char *invariant_names[INVARIANTS] = {
+	"gate not closed with a train at the crossing",
+	"signal not red with a train at the crossing",
+	"green with the gate not open",
+	"pedestrian phase with a train coming",
+	"traffic flowing with a train coming",
+};
+
+static u32 green = 2, walk = 2, yellow = 1, hold = 2;
+static int nthreads = 4;
+static int logslots = 20;
+
+static u64 *table;			/* fingerprints; 0 is empty */
+static u64 mask;
+static u32 *parents;		/* by node */
+static u8 *events;
+static u32 nodes = 0;
+static volatile int full = 0;
+
+static worker_t *workers;
+static pthread_barrier_t start, end;
+static volatile int done = 0;
+static u32 violation[INVARIANTS];
+
+/*
+ * model outputs
+ */
+static void op_signal(crossing_t *c, u32 aspect){ ((model_t*) c)->signal = aspect; }
+static void op_gate(crossing_t *c, s32 pos){ ((model_t*) c)->gate = pos; }
+static void op_request(crossing_t *c, bool on){ ((model_t*) c)->request = on; }
+static s32 op_wheel(crossing_t *c){ return CROSSING_CLOSED / 2; }
+static u32 op_green(crossing_t *c){ return green; }
+static u32 op_walk(crossing_t *c){ return walk; }
+static u32 op_yellow(crossing_t *c){ return yellow; }
+static u32 op_hold(crossing_t *c){ return hold; }
+static void op_enter(crossing_t *c){ }
+
+static const crossing_ops_t ops = {
+	op_signal, op_gate, op_request, op_wheel, op_green, op_walk, op_yellow, op_hold, op_enter
+};
+
+static double now_s(void){
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * rebase the clock to BASE, clamping relative times that no longer matter
+ */
+static u8 remaining(u32 deadline, u32 ticks){
+	s32 d = (s32)(deadline - ticks);
+
+	return d < 0 ? 0 : d > MAX_DEADLINE ? MAX_DEADLINE : d;
+}
+
+static void canonical(model_t *m, skey_t *k){
+	crossing_t *c = &m->c;
+	u32 since = c->ticks - c->entered;
+
+	if (since > 3)
+		since = 2 + (since & 1);	/* only the flash parity is observable */
+	memset(k, 0, sizeof(*k));
+	k->lc = c->pt.lc;
+	k->seqlc = c->seq.lc;
+	k->state = c->state;
+	k->flags = c->keyflag | c->traincoming << 1 | c->btnpressed << 2 | c->prewarned << 3 |
+			c->arrived << 4 | c->pedcrossed << 5 | c->blue << 6;
+	k->entered = since;
+	k->deadline = remaining(c->pt.deadline, c->ticks);
+	k->seqdeadline = remaining(c->seq.deadline, c->ticks);
+	k->signal = m->signal;
+	k->request = m->request;
+	k->gate = m->gate == CROSSING_OPEN ? 0 : m->gate == CROSSING_CLOSED ? 1 : 2;
+
+	c->ticks = BASE;
+	c->entered = BASE - since;
+	c->pt.deadline = BASE + k->deadline;
+	c->seq.deadline = BASE + k->seqdeadline;
+}
+
+static u64 fingerprint(const skey_t *k){
+	const u8 *p = (const u8*) k;
+	u64 h = 0xcbf29ce484222325ull;
+	size_t i;
+
+	for (i = 0; i < sizeof(*k); i++)
+		h = (h ^ p[i]) * 0x100000001b3ull;
+	h ^= h >> 29;
+	h *= 0xbf58476d1ce4e5b9ull;
+	h ^= h >> 32;
+	return h ? h : 1;
+}
+
+/*
+ * start <m> cold (0), or resumed after a watchdog reset with the flags in
+ * <how> (c.f. crossing_resume)
+ */
+static void start_state(model_t *m, int how){
+	memset(m, 0, sizeof(*m));
+	crossing_init(&m->c, &ops);
+	if (how != 0){
+		crossing_resume(&m->c, how & 1, how >> 1 & 1, how >> 2 & 1, how >> 3 & 1);
+		m->signal = SIGNAL_RED;		/* the restart drives these first */
+		m->gate = (how & 1) ? CROSSING_CLOSED : CROSSING_OPEN;
+	}
+}
+
+/*
+ * apply <ev> as the firmware would (c.f. railwayCrossing.c)
+ */
+static void step(model_t *m, int ev){
+	crossing_t *c = &m->c;
+
+	switch(ev){
+	case EV_RUN:
+		crossing_run(c);
+		break;
+	case EV_TICK:
+		crossing_tick(c);
+		break;
+	case EV_BUTTON:
+		crossing_button(c);
+		break;
+	case EV_TRAIN:
+		if (crossing_train_edge(c)){	/* fast path */
+			m->gate = CROSSING_CLOSED;
+			m->signal = SIGNAL_RED;
+		}
+		crossing_train(c);
+		break;
+	case EV_KEY:
+		crossing_key(c);
+		break;
+	case EV_UP_ON:
+	case EV_UP_OFF:
+		crossing_upstream(c, ev == EV_UP_ON);
+		break;
+	case EV_DUE:
+		crossing_due(c);
+		break;
+	}
+}
+
+/*
+ * returns the first invariant <m> violates; -1 if none
+ */
+static int check(const model_t *m){
+	const crossing_t *c = &m->c;
+	bool local = c->traincoming && !c->prewarned;
+
+	if (c->state == MAINTENANCE)
+		return -1;		/* the operator drives the gate */
+	if (local && m->gate != CROSSING_CLOSED)
+		return 0;
+	if (local && m->signal != SIGNAL_RED)
+		return 1;
+	if (m->signal == SIGNAL_GREEN && m->gate != CROSSING_OPEN)
+		return 2;
+	if (c->state == PEDESTRIAN && c->traincoming)
+		return 3;
+	if (c->state == TRAFFIC_ON && c->traincoming)
+		return 4;
+	return -1;
+}
+
+/*
+ * add <fp> to the visited set; returns its node, or NO_NODE if it was there
+ */
+static u32 visit(u64 fp, u32 parent, u8 ev){
+	u64 i = fp & mask;
+	u64 expect;
+	u32 node;
+
+	for (;;){
+		expect = 0;
+		if (__atomic_compare_exchange_n(&table[i], &expect, fp, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			break;
+		if (expect == fp)
+			return NO_NODE;
+		i = (i + 1) & mask;
+	}
+	node = __atomic_fetch_add(&nodes, 1, __ATOMIC_RELAXED);
+	if (node >= (mask + 1) * 3 / 4){
+		full = 1;
+		return NO_NODE;
+	}
+	parents[node] = parent;
+	events[node] = ev;
+	return node;
+}
+
+static void push(worker_t *w, const model_t *m, u32 node){
+	if (w->nnext == w->capnext){
+		w->capnext = w->capnext ? w->capnext * 2 : 1024;
+		w->next = realloc(w->next, w->capnext * sizeof(item_t));
+		if (w->next == NULL){
+			perror("realloc");
+			exit(1);
+		}
+	}
+	w->next[w->nnext].m = *m;
+	w->next[w->nnext].node = node;
+	w->nnext++;
+}
+
+/*
+ * take work from our own level, else steal from another thread's
+ */
+static bool take(worker_t *w, item_t *it){
+	int i, v;
+	bool got = false;
+
+	pthread_mutex_lock(&w->lock);
+	if (w->tail > w->head){
+		*it = w->items[--w->tail];
+		got = true;
+	}
+	pthread_mutex_unlock(&w->lock);
+	if (got)
+		return true;
+
+	v = rand_r(&w->seed) % nthreads;
+	for (i = 0; i < nthreads && !got; i++, v = (v + 1) % nthreads){
+		worker_t *victim = &workers[v];
+
+		if (victim == w)
+			continue;
+		pthread_mutex_lock(&victim->lock);
+		if (victim->tail > victim->head){
+			*it = victim->items[victim->head++];
+			got = true;
+			w->steals++;
+		}
+		pthread_mutex_unlock(&victim->lock);
+	}
+	return got;
+}
+
+static void expand(worker_t *w, const item_t *it){
+	skey_t k, self;
+	model_t m;
+	int ev, bad;
+	u32 node, none;
+
+	m = it->m;
+	canonical(&m, &self);
+	for (ev = 0; ev < EVENTS; ev++){
+		m = it->m;
+		step(&m, ev);
+		canonical(&m, &k);
+		w->transitions++;
+		if (ev == EV_RUN && memcmp(&k, &self, sizeof(k)) == 0){
+			w->quiescent++;
+			bad = check(&it->m);
+			none = NO_NODE;
+			if (bad >= 0)
+				__atomic_compare_exchange_n(&violation[bad], &none, it->node, false,
+						__ATOMIC_RELAXED, __ATOMIC_RELAXED);
+		}
+		node = visit(fingerprint(&k), it->node, ev);
+		if (node != NO_NODE)
+			push(w, &m, node);
+	}
+	w->expanded++;
+}
+
+static void *worker_main(void *arg){
+	worker_t *w = arg;
+	item_t it;
+
+	for (;;){
+		pthread_barrier_wait(&start);
+		if (done)
+			break;
+		while (!full && take(w, &it))
+			expand(w, &it);
+		pthread_barrier_wait(&end);
+	}
+	return NULL;
+}
+
+/*
+ * replay the events leading to <node> from the initial state
+ */
+static void trace(u32 node){
+	u8 path[4096];
+	int n = 0, i;
+	model_t m;
+	skey_t k;
+	static const char *aspects[] = { "off", "green", "yellow", "red", "blue" };
+
+	while (parents[node] != NO_NODE && n < (int) sizeof(path)){
+		path[n++] = events[node];
+		node = parents[node];
+	}
+	start_state(&m, events[node]);
+	canonical(&m, &k);
+	printf("  from a %s start\n", events[node] == 0 ? "cold" : "warm");
+	for (i = n - 1; i >= 0; i--){
+		step(&m, path[i]);
+		canonical(&m, &k);
+		printf("  %2d %-13s %-12s train %d prewarned %d key %d button %d signal %-6s gate %s\n",
+				n - i, event_names[path[i]], crossing_name(m.c.state), m.c.traincoming,
+				m.c.prewarned, m.c.keyflag, m.c.btnpressed, aspects[m.signal],
+				k.gate == 0 ? "open" : k.gate == 1 ? "closed" : "wheel");
+	}
+}
+
+int main(int argc, char **argv){
+	pthread_t *threads;
+	model_t root;
+	skey_t k;
+	u64 states, expanded = 0, transitions = 0, quiescent = 0, steals = 0;
+	size_t level;
+	int depth = 0, i, opt, found = 0;
+	u32 node;
+	double t0, secs;
+
+	while ((opt = getopt(argc, argv, "t:m:g:w:y:h:")) != -1){
+		switch(opt){
+		case 't': nthreads = atoi(optarg); break;
+		case 'm': logslots = atoi(optarg); break;
+		case 'g': green = atoi(optarg); break;
+		case 'w': walk = atoi(optarg); break;
+		case 'y': yellow = atoi(optarg); break;
+		case 'h': hold = atoi(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-t threads] [-m log2_slots] [-g green] [-w walk] [-y yellow] [-h hold]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (nthreads < 1 || logslots < 10 || logslots > 32 || green > MAX_DEADLINE ||
+			walk > MAX_DEADLINE || yellow > MAX_DEADLINE || hold > MAX_DEADLINE){
+		fprintf(stderr, "bad arguments\n");
+		return 1;
+	}
+
+	mask = (1ull << logslots) - 1;
+	table = calloc(mask + 1, sizeof(u64));
+	parents = malloc((mask + 1) * sizeof(u32));
+	events = malloc(mask + 1);
+	workers = calloc(nthreads, sizeof(worker_t));
+	threads = calloc(nthreads, sizeof(pthread_t));
+	if (!table || !parents || !events || !workers || !threads){
+		perror("alloc");
+		return 1;
+	}
+	for (i = 0; i < INVARIANTS; i++)
+		violation[i] = NO_NODE;
+
+	for (i = 0; i < ROOTS; i++){
+		start_state(&root, i);
+		canonical(&root, &k);
+		node = visit(fingerprint(&k), NO_NODE, i);
+		if (node != NO_NODE)
+			push(&workers[0], &root, node);
+	}
+
+	pthread_barrier_init(&start, NULL, nthreads + 1);
+	pthread_barrier_init(&end, NULL, nthreads + 1);
+	for (i = 0; i < nthreads; i++){
+		pthread_mutex_init(&workers[i].lock, NULL);
+		workers[i].seed = i + 1;
+		pthread_create(&threads[i], NULL, worker_main, &workers[i]);
+	}
+
+	t0 = now_s();
+	for (;;){
+		/* the next level becomes this level */
+		level = 0;
+		for (i = 0; i < nthreads; i++){
+			worker_t *w = &workers[i];
+			item_t *t = w->items;
+			size_t c = w->cap;
+
+			w->items = w->next;
+			w->cap = w->capnext;
+			w->head = 0;
+			w->tail = w->nnext;
+			w->next = t;
+			w->capnext = c;
+			w->nnext = 0;
+			level += w->tail;
+		}
+		if (level == 0 || full)
+			break;
+		depth++;
+		pthread_barrier_wait(&start);
+		pthread_barrier_wait(&end);
+	}
+	done = 1;
+	pthread_barrier_wait(&start);
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+	secs = now_s() - t0;
+
+	if (full){
+		fprintf(stderr, "visited set full; rerun with -m %d\n", logslots + 1);
+		return 1;
+	}
+	states = nodes;
+	for (i = 0; i < nthreads; i++){
+		expanded += workers[i].expanded;
+		transitions += workers[i].transitions;
+		quiescent += workers[i].quiescent;
+		steals += workers[i].steals;
+	}
+
+	printf("phases: green %u walk %u yellow %u hold %u ticks\n", green, walk, yellow, hold);
+	printf("states %llu (quiescent %llu), transitions %llu, depth %d\n",
+			(unsigned long long) states, (unsigned long long) quiescent,
+			(unsigned long long) transitions, depth);
+	printf("%.3f s, %.0f states/s, %d threads, %llu steals\n", secs, states / secs,
+			nthreads, (unsigned long long) steals);
+	printf("visited set: %zu bytes/state (%llu slots, %.1f MB, %.1f%% full), %zu bytes/state while queued\n",
+			sizeof(u64) + sizeof(u32) + 1, (unsigned long long)(mask + 1),
+			(mask + 1) * (sizeof(u64) + sizeof(u32) + 1) / 1e6, 100.0 * states / (mask + 1),
+			sizeof(item_t));
+
+	for (i = 0; i < INVARIANTS; i++){
+		if (violation[i] == NO_NODE)
+			continue;
+		found++;
+		printf("\nviolation: %s\n", invariant_names[i]);
+		trace(violation[i]);
+	}
+	if (!found)
+		printf("no invariant violations\n");
+	return found ? 2 : 0;
+}
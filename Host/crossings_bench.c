@@ -0,0 +1,177 @@
+/*
+ * crossings_bench.c -- line state deltas against the full update
+ *
+ * Runs Library/crossings.c against a substation that keeps the line's 30
+ * values and, on every update, sends the slots that changed as a
+ * STATE_DELTA, as substation_sim.c does, where it used to send the whole
+ * 132-byte update_response_t. A delta lost on the way leaves a version
+ * gap, and the controller asks for the table (STATE_RESYNC) and gets a
+ * STATE_FULL back; those bytes are counted against the delta.
+ *
+ * For each number of slots changed per update it reports the bytes on the
+ * wire per update, the time that takes at LINK_BAUD, and what applying
+ * one costs the controller, for the delta and for the full table. At the
+ * end of each row the controller's table must match the substation's;
+ * the exit status is 1 if it does not.
+ *
+ * gcc -O2 -Wall -IHost/bsp -IHost -ILibrary -I. -o crossings_bench Host/crossings_bench.c \
+ *     Host/bsp/mock.c Library/crossings.c
+ *
+ * usage: crossings_bench [-n updates] [-l loss %]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "crossings.h"
+#include "link.h"
+
+static const u32 churns[] = { 0, 1, 2, 5, 10, 30 };	/* slots changed per update */
+#define CHURNS (sizeof(churns) / sizeof(churns[0]))
+
+static int line[MSG_VALUES];	/* the substation's table */
+static u16 line_version = 0;
+static u64 seed = 0x9E3779B97F4A7C15ull;
+
+static u32 random32(void){
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return (u32) seed;
+}
+
+static u64 now_ns(void){
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static u32 delta_size(const state_delta_t *d){
+	return DELTA_HDR + d->count * sizeof(delta_entry_t);
+}
+
+/*
+ * the substation: change <churn> slots and encode the delta into <d>
+ */
+static void update(u32 churn, state_delta_t *d){
+	bool changed[MSG_VALUES] = { false };
+	u32 i, slot;
+
+	for (i = 0; i < churn; i++){
+		do {
+			slot = random32() % MSG_VALUES;
+		} while (changed[slot]);
+		changed[slot] = true;
+		line[slot] = (random32() % 101) | (random32() % 8 == 0 ? MSG_TRAIN : 0);
+	}
+	d->type = STATE_DELTA;
+	d->version = ++line_version;
+	d->count = 0;
+	d->pad = 0;
+	for (slot = 0; slot < MSG_VALUES; slot++){
+		if (changed[slot]){
+			d->entries[d->count].index = slot;
+			d->entries[d->count].pad = 0;
+			d->entries[d->count++].value = (s16) line[slot];
+		}
+	}
+}
+
+static void snapshot(state_full_t *f){
+	f->type = STATE_FULL;
+	f->version = line_version;
+	memcpy(f->values, line, sizeof(line));
+}
+
+static bool matches(void){
+	u32 i;
+
+	for (i = 0; i < MSG_VALUES; i++){
+		if (crossings_get(i) != line[i])
+			return false;
+	}
+	return true;
+}
+
+static void train(bool on){ }
+
+int main(int argc, char *argv[]){
+	u32 updates = 100000, loss = 0, c, i, mismatches = 0, resyncs;
+	state_delta_t *deltas;
+	state_full_t *fulls, resync;
+	u64 bytes, t0, delta_ns, full_ns;
+	double per;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:l:")) != -1){
+		switch (opt){
+		case 'n': updates = atoi(optarg); break;
+		case 'l': loss = atoi(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-n updates] [-l loss %%]\n", argv[0]);
+			return 2;
+		}
+	}
+	deltas = malloc(updates * sizeof(state_delta_t));
+	fulls = malloc(updates * sizeof(state_full_t));
+	if (updates == 0 || deltas == NULL || fulls == NULL){
+		fprintf(stderr, "%s: no memory for %u updates\n", argv[0], updates);
+		return 2;
+	}
+
+	printf("%u updates per row, %u%% of deltas lost; full update %u bytes, %.1f ms at %u baud\n", updates, loss,
+			(unsigned) sizeof(update_response_t), sizeof(update_response_t) * 10 * 1e3 / LINK_BAUD, LINK_BAUD);
+	printf("%6s %12s %10s %8s %14s %14s\n", "slots", "delta bytes", "wire ms", "resyncs", "delta apply ns",
+			"full apply ns");
+	for (c = 0; c < CHURNS; c++){
+		/* the controller in step with the line, then every update encoded first
+		 * so the timing is of applying them */
+		snapshot(&resync);
+		crossings_init(MSG_VALUES, train);
+		crossings_full(&resync);
+		for (i = 0; i < updates; i++){
+			update(churns[c], &deltas[i]);
+			snapshot(&fulls[i]);
+		}
+
+		/* deltas, in order, with losses and the resyncs they cause */
+		bytes = 0;
+		resyncs = 0;
+		t0 = now_ns();
+		for (i = 0; i < updates; i++){
+			bytes += delta_size(&deltas[i]);
+			if (loss && i + 1 < updates && random32() % 100 < loss)	/* nothing after the last would find its gap */
+				continue;
+			if (crossings_delta(&deltas[i]) != XST_SUCCESS){
+				crossings_full(&fulls[i]);		/* the resync answer, now the latest */
+				bytes += sizeof(ping_t) + sizeof(state_full_t);
+				resyncs++;
+			}
+		}
+		delta_ns = now_ns() - t0;
+		if (!matches() || crossings_version() != (u16) fulls[updates - 1].version)
+			mismatches++;
+
+		/* the full table every time */
+		t0 = now_ns();
+		for (i = 0; i < updates; i++)
+			crossings_full(&fulls[i]);
+		full_ns = now_ns() - t0;
+		if (!matches())
+			mismatches++;
+
+		per = (double) bytes / updates;
+		printf("%6u %12.1f %10.2f %8u %14.1f %14.1f\n", churns[c], per, per * 10 * 1e3 / LINK_BAUD, resyncs,
+				(double) delta_ns / updates, (double) full_ns / updates);
+	}
+	if (mismatches){
+		printf("%u rows ended with the tables apart\n", mismatches);
+		return 1;
+	}
+	printf("tables matched after every row\n");
+	return 0;
+}
@@ -0,0 +1,200 @@
+/*
+ * gate_sim.c -- step response test for the gate position loop
+ *
+ * Runs gate.c's PID tick by tick in virtual time against a model of the
+ * servo and the gate arm in place of the servo output and the XADC
+ * feedback. The servo slews toward its command at a fixed rate and comes
+ * in on a first-order lag, with a small dead band; the arm reads back
+ * through a linkage with a little gain and offset error, on 12-bit
+ * conversions with noise.
+ *
+ * Each step is run on each plant: it must come inside GATE_TOL and stay
+ * there for GATE_SETTLE_TICKS within its deadline, overshoot by no more
+ * than 5% of travel, hold inside the band for the rest of the run, and
+ * report a confirmation when its target is open or closed. The steps
+ * cover the 0, 0.5 and 1.0 targets from both sides. Exits 1 if any step
+ * fails.
+ *
+ * gcc -O2 -Wall -IHost/bsp -IHost -ILibrary -I. -o gate_sim Host/gate_sim.c \
+ *     Host/bsp/mock.c Library/gate.c -lm
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "gate.h"
+#include "gic.h"
+#include "adc.h"
+#include "servo.h"
+#include "watchdog.h"
+
+#define RUN_MS 3000				/* each step */
+#define SUBSTEPS 10				/* plant steps per loop tick */
+#define OVERSHOOT 0.05			/* of travel */
+
+typedef struct {
+	const char *name;
+	double travel_s;			/* full travel at the slew limit */
+	double tau_s;				/* lag as it comes in */
+	double deadband;			/* of travel */
+	double gain, offset;		/* linkage: arm = servo * gain + offset */
+	double noise;				/* feedback noise, of travel (peak) */
+} plant_t;
+
+static const plant_t plants[] = {
+	{ "ideal", 0.4, 0.02, 0.0, 1.0, 0.0, 0.0 },
+	{ "linkage", 0.4, 0.03, 0.003, 0.99, 0.005, 0.002 },
+	{ "slow", 1.2, 0.06, 0.003, 1.0, -0.004, 0.002 },
+};
+
+static const struct { double from, to; } steps[] = {
+	{ 0.0, 1.0 }, { 1.0, 0.0 }, { 0.0, 0.5 }, { 0.5, 1.0 }, { 1.0, 0.5 }, { 0.5, 0.0 },
+};
+
+static const plant_t *plant;
+static double servo;			/* servo shaft, fraction of travel */
+static double command;
+static u64 now;					/* global timer counts */
+static Xil_InterruptHandler tick;
+static void *tickref;
+static int confirms;
+static u32 confirmed_ms;
+
+static u64 virtual_time(void){
+	return now;
+}
+
+/* the drivers gate.c drives */
+void servo_set_pos(u32 pos){
+	command = (double) pos / GATE_ONE;
+}
+
+u32 adc_get_gate(void){
+	double arm = servo * plant->gain + plant->offset;
+	s32 raw;
+
+	arm += plant->noise * (2.0 * rand() / RAND_MAX - 1.0);
+	raw = (s32)(arm * GATE_ONE) & ~0xF;		/* 12 bits */
+	return raw < 0 ? 0 : (raw > GATE_ONE ? GATE_ONE : raw);
+}
+
+void watchdog_alive(u32 who){ }
+
+s32 gic_connect(u32 id, Xil_InterruptHandler handler, void *devp){
+	tick = handler;
+	tickref = devp;
+	return XST_SUCCESS;
+}
+
+void gic_disconnect(u32 id){ }
+
+static void confirmed(u32 event, u32 settle_ms){
+	confirms++;
+	confirmed_ms = settle_ms;
+}
+
+/*
+ * move the servo on by <dt> seconds
+ */
+static void advance(double dt){
+	double d = command - servo;
+	double v = d / plant->tau_s;
+	double vmax = 1.0 / plant->travel_s;
+
+	if (fabs(d) < plant->deadband)
+		return;
+	v = v > vmax ? vmax : (v < -vmax ? -vmax : v);
+	servo += v * dt;
+}
+
+/*
+ * one step on the current plant; returns 0 if it passed
+ */
+static int step(double from, double to){
+	s32 target = (s32)(to * GATE_ONE);
+	double worst = 0.0, over, arm;
+	int settled = -1, escaped = 0, inband = 0, ms, i;
+	bool edge = target == GATE_OPEN || target == GATE_CLOSED;
+	s32 err;
+
+	/* start at rest on <from> */
+	gate_set((s32)(from * GATE_ONE));
+	servo = command = from;
+	for (ms = 0; ms < RUN_MS; ms++){
+		for (i = 0; i < SUBSTEPS; i++)
+			advance(0.001 / SUBSTEPS);
+		now += COUNTS_PER_SECOND / GATE_RATE;
+		tick(tickref);
+	}
+
+	confirms = 0;
+	confirmed_ms = 0;
+	gate_set(target);
+	for (ms = 0; ms < RUN_MS; ms++){
+		for (i = 0; i < SUBSTEPS; i++)
+			advance(0.001 / SUBSTEPS);
+		now += COUNTS_PER_SECOND / GATE_RATE;
+		tick(tickref);
+
+		arm = servo * plant->gain + plant->offset;
+		over = to > from ? arm - to : to - arm;
+		if (over > worst)
+			worst = over;
+		err = target - gate_position();
+		if (err < GATE_TOL && err > -GATE_TOL){
+			if (++inband == GATE_SETTLE_TICKS && settled < 0)
+				settled = ms + 1 - GATE_SETTLE_TICKS;
+		} else {
+			if (settled >= 0)
+				escaped++;
+			inband = 0;
+		}
+	}
+
+	printf("%-8s %.1f -> %.1f  settle %5d ms  overshoot %5.2f%%  final %+6.2f%%  confirm ",
+			plant->name, from, to, settled, 100.0 * worst,
+			100.0 * (target - gate_position()) / GATE_ONE);
+	if (edge)
+		printf("%d ms (%d)", confirmed_ms, confirms);
+	else
+		printf("-");
+
+	/* the deadline: full travel at the slew limit, and a second to trim */
+	if (settled < 0 || settled > (int)(1000 * (plant->travel_s * fabs(to - from) + 1.0))){
+		printf("  FAIL: not settled\n");
+		return 1;
+	}
+	if (escaped){
+		printf("  FAIL: left the band %d times\n", escaped);
+		return 1;
+	}
+	if (worst > OVERSHOOT){
+		printf("  FAIL: overshoot\n");
+		return 1;
+	}
+	if (edge && confirms != 1){
+		printf("  FAIL: %d confirmations\n", confirms);
+		return 1;
+	}
+	printf("\n");
+	return 0;
+}
+
+int main(void){
+	unsigned p, s;
+	int failed = 0;
+
+	mock_xtime = virtual_time;
+	srand(1);
+	for (p = 0; p < sizeof(plants) / sizeof(plants[0]); p++){
+		plant = &plants[p];
+		servo = command = 0.0;
+		gate_init(confirmed);
+		for (s = 0; s < sizeof(steps) / sizeof(steps[0]); s++)
+			failed += step(steps[s].from, steps[s].to);
+		gate_stop();
+	}
+	if (failed)
+		printf("%d steps failed\n", failed);
+	return failed ? 1 : 0;
+}
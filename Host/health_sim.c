@@ -0,0 +1,297 @@
+/*
+ * health_sim.c -- alarm to load shed latency on synthetic sensor traces
+ *
+ * Runs Library/health.c and Library/adc.c in virtual time against the
+ * mock XADC, fed from piecewise-linear die temperature, VCCINT and VCCAUX
+ * traces with a little noise. The XADC is modelled as the hardware
+ * behaves: it converts every CONV_US, compares each channel with the
+ * thresholds health.c programmed (the temperature alarm with its
+ * hysteresis, the rails outside their window), and holds an enabled
+ * alarm's interrupt status while the alarm is active. Its interrupt goes
+ * through gic_dispatch; the main loop calls health_poll every POLL_US.
+ *
+ * Each time an alarm goes active the controller must be HOT, shedding its
+ * load, within ALARM_US; a rise above HEALTH_TEMP_WARN must be seen within
+ * a poll, and once every alarm has cleared and the die is cool again the
+ * level must be back to OK within a poll. HOT for more than a poll with
+ * every sensor clear of its limits is a false alarm. A rail with no
+ * hysteresis chatters as it drifts through a limit; health.c masks the
+ * alarm until a poll sees it back in range, so the interrupts it takes
+ * stay few. The tool reports, per trace, the alarm rises and the
+ * interrupts taken, the worst latency of each kind and the time spent
+ * HOT, and exits 1 on any miss.
+ *
+ * gcc -O2 -Wall -IHost/bsp -IHost -ILibrary -I. -o health_sim Host/health_sim.c \
+ *     Host/bsp/mock.c Library/health.c Library/adc.c Library/gic.c Library/lat.c
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "health.h"
+#include "adc.h"
+#include "gic.h"
+#include "config.h"
+#include "servo.h"		/* the duty defaults */
+
+#define CONV_US 10				/* xadc sequencer pass */
+#define POLL_US 100000			/* main loop (c.f. POLL_US) */
+#define ALARM_US 100			/* alarm active to HOT */
+#define NOISE_MC 300			/* peak */
+#define NOISE_MV 2
+#define POINTS 12
+
+typedef struct {
+	double t;					/* s */
+	s32 mc, vccint, vccaux;		/* mC, mV */
+} point_t;
+
+typedef struct {
+	const char *name;
+	point_t p[POINTS];			/* ends at the first t of 0 after the start */
+} trace_t;
+
+static const trace_t traces[] = {
+	{ "soak", {				/* heats through warn and alarm, holds, cools */
+		{ 0, 50000, 1000, 1800 }, { 60, 90000, 1000, 1800 }, { 80, 90000, 1000, 1800 },
+		{ 140, 60000, 1000, 1800 }, { 150, 60000, 1000, 1800 } } },
+	{ "spike", {			/* 1 ms over the alarm: only the hardware sees it */
+		{ 0, 60000, 1000, 1800 }, { 5, 60000, 1000, 1800 }, { 5.0005, 88000, 1000, 1800 },
+		{ 5.0015, 88000, 1000, 1800 }, { 5.002, 60000, 1000, 1800 }, { 10, 60000, 1000, 1800 } } },
+	{ "sag", {				/* vccint 200 ms under its minimum */
+		{ 0, 55000, 1000, 1800 }, { 2, 55000, 1000, 1800 }, { 2.001, 55000, 930, 1800 },
+		{ 2.2, 55000, 930, 1800 }, { 2.201, 55000, 1000, 1800 }, { 4, 55000, 1000, 1800 } } },
+	{ "surge", {			/* vccaux 50 ms over its maximum */
+		{ 0, 55000, 1000, 1800 }, { 1, 55000, 1000, 1800 }, { 1.001, 55000, 1000, 1900 },
+		{ 1.05, 55000, 1000, 1900 }, { 1.051, 55000, 1000, 1800 }, { 3, 55000, 1000, 1800 } } },
+	{ "repeat", {			/* in and out of the alarm band, then a second excursion */
+		{ 0, 60000, 1000, 1800 }, { 10, 88000, 1000, 1800 }, { 20, 80000, 1000, 1800 },
+		{ 30, 88000, 1000, 1800 }, { 40, 68000, 1000, 1800 }, { 50, 88000, 1000, 1800 },
+		{ 60, 60000, 1000, 1800 }, { 70, 60000, 1000, 1800 } } },
+	{ "both", {				/* hot, with a rail sagging slowly through its minimum */
+		{ 0, 65000, 1000, 1800 }, { 20, 87000, 1000, 1800 }, { 25, 87000, 930, 1800 },
+		{ 26, 87000, 1000, 1800 }, { 40, 60000, 1000, 1800 }, { 45, 60000, 1000, 1800 } } },
+};
+#define TRACES (sizeof(traces) / sizeof(traces[0]))
+
+/* adc.c reads the configuration; the host has no flash to load it from */
+static const config_t defaults = {
+	TRAFFIC_TMR, PEDESTRIAN_TMR, LIGHT_TMR, FREQ, ID,
+	(u32)(MAXDUTY * 1000000), (u32)(MINDUTY * 1000000), POT_SCALE, 0, MARGIN_MS
+};
+const config_t * volatile config = &defaults;
+
+static u64 now_us;
+static u64 seed = 0x9E3779B97F4A7C15ull;
+
+static u64 virtual_time(void){
+	return now_us * (COUNTS_PER_SECOND / 1000000);
+}
+
+static s32 noise(s32 peak){
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return (s32)(seed % (2 * peak + 1)) - peak;
+}
+
+/* the xadc's codes (c.f. XAdcPs_RawToTemperature/RawToVoltage) */
+static u16 mc_raw(s32 mc){
+	return (u16)(((s64) mc + 273150) * 65536 / 503975);
+}
+
+static u16 mv_raw(s32 mv){
+	return (u16)((s64) mv * 65536 / 3000);
+}
+
+/*
+ * the trace at <t>
+ */
+static void at(const trace_t *tr, double t, point_t *out){
+	u32 i;
+
+	for (i = 1; i < POINTS && tr->p[i].t != 0 && tr->p[i].t < t; i++)
+		;
+	if (i == POINTS || tr->p[i].t == 0){
+		*out = tr->p[i - 1];
+		return;
+	}
+	double f = (t - tr->p[i - 1].t) / (tr->p[i].t - tr->p[i - 1].t);
+	out->mc = tr->p[i - 1].mc + (s32)(f * (tr->p[i].mc - tr->p[i - 1].mc));
+	out->vccint = tr->p[i - 1].vccint + (s32)(f * (tr->p[i].vccint - tr->p[i - 1].vccint));
+	out->vccaux = tr->p[i - 1].vccaux + (s32)(f * (tr->p[i].vccaux - tr->p[i - 1].vccaux));
+}
+
+static double end_of(const trace_t *tr){
+	u32 i;
+
+	for (i = 1; i < POINTS && tr->p[i].t != 0; i++)
+		;
+	return tr->p[i - 1].t;
+}
+
+/*
+ * the xadc alarm outputs after a conversion of <raw> (XADCPS_INTX_ALM*)
+ */
+static u32 alarms(const u16 raw[3], u32 was){
+	const u16 *thr = mock_adc_threshold;
+	u32 out = 0;
+
+	if (mock_adc_alarms & XADCPS_CFR1_ALM_TEMP_MASK){
+		if (raw[0] > thr[XADCPS_ATR_TEMP_UPPER] || ((was & XADCPS_INTX_ALM0_MASK) && raw[0] >= thr[XADCPS_ATR_TEMP_LOWER]))
+			out |= XADCPS_INTX_ALM0_MASK;		/* hysteresis: holds until under the lower */
+	}
+	if ((mock_adc_alarms & XADCPS_CFR1_ALM_VCCINT_MASK) &&
+			(raw[1] > thr[XADCPS_ATR_VCCINT_UPPER] || raw[1] < thr[XADCPS_ATR_VCCINT_LOWER]))
+		out |= XADCPS_INTX_ALM1_MASK;
+	if ((mock_adc_alarms & XADCPS_CFR1_ALM_VCCAUX_MASK) &&
+			(raw[2] > thr[XADCPS_ATR_VCCAUX_UPPER] || raw[2] < thr[XADCPS_ATR_VCCAUX_LOWER]))
+		out |= XADCPS_INTX_ALM2_MASK;
+	return out;
+}
+
+typedef struct {
+	u32 alarms;					/* alarm outputs going active */
+	u64 alarm_us, warm_us, clear_us;	/* worst latencies */
+	u64 hot_us;
+	u32 missed, late_warm, late_clear, false_hot;
+} result_t;
+
+/*
+ * run <tr>; returns the misses
+ */
+static u32 run(const trace_t *tr, result_t *r){
+	u64 end = (u64)(end_of(tr) * 1e6) + 2 * POLL_US, next_poll = POLL_US;
+	u64 rise[3] = { 0 }, warm = 0, cool = 0, calm = 0;
+	bool waiting[3] = { false }, warm_wait = false, cool_wait = false, flagged = false;
+	u32 out = 0, prev, i;
+	point_t p;
+	u16 raw[3];
+
+	*r = (result_t) { 0 };
+	now_us = 0;
+	mock_adc_intr_status = 0;
+	at(tr, 0, &p);
+	mock_adc[XADCPS_CH_TEMP] = mc_raw(p.mc);
+	mock_adc[XADCPS_CH_VCCINT] = mv_raw(p.vccint);
+	mock_adc[XADCPS_CH_VCCAUX] = mv_raw(p.vccaux);
+	health_init();
+
+	for (now_us = 0; now_us < end; now_us += CONV_US){
+		/* a conversion */
+		at(tr, now_us / 1e6, &p);
+		raw[0] = mock_adc[XADCPS_CH_TEMP] = mc_raw(p.mc + noise(NOISE_MC));
+		raw[1] = mock_adc[XADCPS_CH_VCCINT] = mv_raw(p.vccint + noise(NOISE_MV));
+		raw[2] = mock_adc[XADCPS_CH_VCCAUX] = mv_raw(p.vccaux + noise(NOISE_MV));
+		prev = out;
+		out = alarms(raw, prev);
+		for (i = 0; i < 3; i++){
+			if ((out & ~prev) & (1 << i)){
+				r->alarms++;
+				rise[i] = now_us;
+				waiting[i] = true;
+			}
+		}
+		mock_adc_intr_status |= out;
+		if (mock_adc_intr_status & mock_adc_intr_enabled)
+			gic_dispatch(XPAR_XADCPS_INT_ID);
+
+		/* the main loop */
+		if (now_us >= next_poll){
+			health_poll();
+			next_poll += POLL_US;
+		}
+
+		/* what the controller shows */
+		if (health_level() == HEALTH_HOT)
+			r->hot_us += CONV_US;
+		for (i = 0; i < 3; i++){
+			if (waiting[i] && health_level() == HEALTH_HOT){
+				if (now_us - rise[i] > r->alarm_us)
+					r->alarm_us = now_us - rise[i];
+				waiting[i] = false;
+			} else if (waiting[i] && now_us - rise[i] > ALARM_US){
+				r->missed++;
+				waiting[i] = false;
+			}
+		}
+		if (p.mc >= HEALTH_TEMP_WARN + NOISE_MC){
+			if (!warm_wait && warm == 0){
+				warm = now_us;
+				warm_wait = true;
+			}
+		} else {
+			warm = 0;
+			warm_wait = false;
+		}
+		if (warm_wait && health_level() != HEALTH_OK){
+			if (now_us - warm > r->warm_us)
+				r->warm_us = now_us - warm;
+			warm_wait = false;
+		} else if (warm_wait && now_us - warm > POLL_US + CONV_US){
+			r->late_warm++;
+			warm_wait = false;
+		}
+		if (out == 0 && p.mc < HEALTH_TEMP_WARN - NOISE_MC){
+			if (!cool_wait && cool == 0){
+				cool = now_us;
+				cool_wait = true;
+			}
+		} else {
+			cool = 0;
+			cool_wait = false;
+		}
+		if (cool_wait && health_level() == HEALTH_OK){
+			if (now_us - cool > r->clear_us)
+				r->clear_us = now_us - cool;
+			cool_wait = false;
+		} else if (cool_wait && now_us - cool > POLL_US + CONV_US){
+			r->late_clear++;
+			cool_wait = false;
+		}
+		if (p.mc < HEALTH_TEMP_CLEAR - NOISE_MC &&
+				p.vccint >= HEALTH_VCCINT_MIN + NOISE_MV && p.vccint <= HEALTH_VCCINT_MAX - NOISE_MV &&
+				p.vccaux >= HEALTH_VCCAUX_MIN + NOISE_MV && p.vccaux <= HEALTH_VCCAUX_MAX - NOISE_MV){
+			if (calm == 0)
+				calm = now_us + 1;
+		} else {
+			calm = 0;
+			flagged = false;
+		}
+		if (calm != 0 && !flagged && health_level() == HEALTH_HOT && now_us + 1 - calm > POLL_US + CONV_US){
+			r->false_hot++;
+			flagged = true;
+		}
+	}
+	health_close();
+	return r->missed + r->late_warm + r->late_clear + r->false_hot;
+}
+
+int main(void){
+	health_t h;
+	result_t r;
+	u32 t, failed = 0, f, taken = 0;
+
+	mock_xtime = virtual_time;
+	gic_init();
+	adc_init();
+
+	printf("conversions every %u us, polls every %u ms; budgets: alarm %u us, warm and clear %u ms\n",
+			CONV_US, POLL_US / 1000, ALARM_US, POLL_US / 1000);
+	printf("%-8s %7s %8s %8s %9s %9s %9s %7s %8s\n", "trace", "rises", "taken", "alarm us", "warm ms",
+			"clear ms", "hot ms", "missed", "false");
+	for (t = 0; t < TRACES; t++){
+		f = run(&traces[t], &r);
+		health_get(&h);
+		printf("%-8s %7u %8lu %8lu %9.1f %9.1f %9.1f %7u %8u%s\n", traces[t].name, r.alarms, (unsigned long)(h.alarms - taken),
+				(unsigned long) r.alarm_us, r.warm_us / 1e3, r.clear_us / 1e3, r.hot_us / 1e3,
+				r.missed + r.late_warm + r.late_clear, r.false_hot, f ? "  FAIL" : "");
+		taken = h.alarms;
+		failed += f != 0;
+	}
+	if (failed){
+		printf("%u traces missed a reaction\n", failed);
+		return 1;
+	}
+	printf("every alarm shed load within its budget\n");
+	return 0;
+}
@@ -0,0 +1,179 @@
+/*
+ * image_layout.c -- section sizes and boot copy time of firmware images
+ *
+ * Reads each ELF image given (built with Hardware/lscript.ld or
+ * lscript_xip.ld) and lists its allocated sections by where they end up
+ * at boot:
+ *
+ *     xip   runs in place from the QSPI linear window
+ *     lazy  loaded in flash, linked in DDR: copied by boot.c after the
+ *           safe outputs (c.f. boot.h)
+ *     fsbl  loaded in DDR or OCM: copied by the FSBL before the handoff
+ *     zero  .bss and friends, cleared by the BSP's start-up
+ *     none  heap and stacks
+ *
+ * From the totals it estimates, per image, the time after the bitstream
+ * until the outputs are safe and until main runs. The FSBL and the
+ * fast path read the flash at set rates (-f, -a, MB/s); the boot banner
+ * prints the rate boot.c measured, to check them against. The fast path
+ * itself and the FSBL's own start are not counted.
+ *
+ * gcc -O2 -Wall -o image_layout Host/image_layout.c
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <elf.h>
+#include <getopt.h>
+
+#define QSPI_BASE 0xFC000000ull		/* linear window */
+#define QSPI_END 0xFE000000ull
+
+enum { XIP, LAZY, FSBL, ZERO, NONE, KINDS };
+static const char *kinds[KINDS] = { "xip", "lazy", "fsbl", "zero", "none" };
+
+typedef struct {
+	unsigned long long offset, vaddr, paddr, filesz;
+} segment_t;
+
+static double fsbl_rate = 20;		/* MB/s, the FSBL reading the flash */
+static double app_rate = 35;		/* MB/s, memcpy with the caches on */
+static double zero_rate = 400;		/* MB/s, clearing DDR */
+static int verbose = 1;
+
+static int in_qspi(unsigned long long a){
+	return a >= QSPI_BASE && a < QSPI_END;
+}
+
+/*
+ * the load address of the section at <offset> in the file, from the
+ * segment holding it (segments can overlap in vma, not in the file)
+ */
+static unsigned long long load_address(const segment_t *seg, int n, unsigned long long offset,
+		unsigned long long vaddr){
+	int i;
+
+	for (i = 0; i < n; i++){
+		if (offset >= seg[i].offset && offset < seg[i].offset + seg[i].filesz)
+			return seg[i].paddr + (vaddr - seg[i].vaddr);
+	}
+	return vaddr;
+}
+
+static int classify(const char *name, unsigned type, unsigned long long vma, unsigned long long lma){
+	if (type == SHT_NOBITS)
+		return strstr(name, "bss") != NULL ? ZERO : NONE;
+	if (in_qspi(lma))
+		return lma == vma ? XIP : LAZY;
+	return FSBL;
+}
+
+/*
+ * the sections of <path>; 0 on success
+ */
+static int report(const char *path){
+	unsigned long long total[KINDS] = { 0 }, vma, lma, size;
+	const char *strtab, *name;
+	segment_t *seg;
+	unsigned char *image;
+	unsigned type, flags;
+	int is64, nseg, nsec, i, k;
+	double safe, main_ms;
+	long len;
+	FILE *f;
+
+	if ((f = fopen(path, "rb")) == NULL){
+		perror(path);
+		return 1;
+	}
+	fseek(f, 0, SEEK_END);
+	len = ftell(f);
+	rewind(f);
+	image = malloc(len);
+	if (fread(image, 1, len, f) != (size_t) len || len < EI_NIDENT || memcmp(image, ELFMAG, SELFMAG) != 0){
+		fprintf(stderr, "%s: not an ELF image\n", path);
+		fclose(f);
+		free(image);
+		return 1;
+	}
+	fclose(f);
+	is64 = image[EI_CLASS] == ELFCLASS64;
+
+#define HDR(field) (is64 ? ((Elf64_Ehdr *) image)->field : ((Elf32_Ehdr *) image)->field)
+#define PHDR(i, field) (is64 ? ((Elf64_Phdr *)(image + HDR(e_phoff)))[i].field \
+		: ((Elf32_Phdr *)(image + HDR(e_phoff)))[i].field)
+#define SHDR(i, field) (is64 ? ((Elf64_Shdr *)(image + HDR(e_shoff)))[i].field \
+		: ((Elf32_Shdr *)(image + HDR(e_shoff)))[i].field)
+
+	nseg = HDR(e_phnum);
+	nsec = HDR(e_shnum);
+	seg = calloc(nseg + 1, sizeof(*seg));
+	for (i = k = 0; i < nseg; i++){
+		if (PHDR(i, p_type) != PT_LOAD)
+			continue;
+		seg[k].offset = PHDR(i, p_offset);
+		seg[k].vaddr = PHDR(i, p_vaddr);
+		seg[k].paddr = PHDR(i, p_paddr);
+		seg[k].filesz = PHDR(i, p_filesz);
+		k++;
+	}
+	nseg = k;
+	strtab = (const char *) image + SHDR(HDR(e_shstrndx), sh_offset);
+
+	printf("%s\n", path);
+	if (verbose)
+		printf("  %-22s %-5s %10s %10s %10s\n", "section", "where", "vma", "lma", "bytes");
+	for (i = 1; i < nsec; i++){
+		flags = SHDR(i, sh_flags);
+		size = SHDR(i, sh_size);
+		if (!(flags & SHF_ALLOC) || size == 0)
+			continue;
+		name = strtab + SHDR(i, sh_name);
+		type = SHDR(i, sh_type);
+		vma = SHDR(i, sh_addr);
+		lma = type == SHT_NOBITS ? vma : load_address(seg, nseg, SHDR(i, sh_offset), vma);
+		k = classify(name, type, vma, lma);
+		total[k] += size;
+		if (verbose)
+			printf("  %-22s %-5s %10llx %10llx %10llu\n", name, kinds[k], vma, lma, size);
+	}
+
+	/* the FSBL copies before the handoff, the start-up clears, then the fast path */
+	safe = total[FSBL] / (fsbl_rate * 1e3) + total[ZERO] / (zero_rate * 1e3);
+	main_ms = safe + total[LAZY] / (app_rate * 1e3);
+	printf("  %s layout:", total[XIP] != 0 ? "xip" : "ddr");
+	for (k = 0; k < KINDS; k++)
+		printf(" %s %llu KB%s", kinds[k], (total[k] + 1023) / 1024, k < KINDS - 1 ? "," : "\n");
+	printf("  fsbl copy %.1f ms, clear %.2f ms, boot copy %.1f ms: safe outputs after %.1f ms, main after %.1f ms\n",
+			total[FSBL] / (fsbl_rate * 1e3), total[ZERO] / (zero_rate * 1e3), total[LAZY] / (app_rate * 1e3),
+			safe, main_ms);
+	free(seg);
+	free(image);
+	return 0;
+}
+
+int main(int argc, char *argv[]){
+	int opt, i, failed = 0;
+
+	while ((opt = getopt(argc, argv, "a:f:qz:")) != -1){
+		switch (opt){
+		case 'a': app_rate = atof(optarg); break;
+		case 'f': fsbl_rate = atof(optarg); break;
+		case 'q': verbose = 0; break;
+		case 'z': zero_rate = atof(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-q] [-f fsbl MB/s] [-a boot copy MB/s] [-z clear MB/s] image.elf...\n", argv[0]);
+			return 1;
+		}
+	}
+	if (optind == argc){
+		fprintf(stderr, "usage: %s [-q] [-f fsbl MB/s] [-a boot copy MB/s] [-z clear MB/s] image.elf...\n", argv[0]);
+		return 1;
+	}
+	printf("flash read by the fsbl %.0f MB/s, by the boot copy %.0f MB/s; clear %.0f MB/s\n",
+			fsbl_rate, app_rate, zero_rate);
+	for (i = optind; i < argc; i++)
+		failed |= report(argv[i]);
+	return failed;
+}
@@ -0,0 +1,360 @@
+/*
+ * irq_replay.c -- interrupt latency budgets on a replayed input trace
+ *
+ * Replays a trace of input edges through Library/io.c and Library/gic.c
+ * in virtual time on one simulated core, as storm_sim.c runs its floods.
+ * An edge latches its source pending at the mock GIC; while the source is
+ * enabled the core takes it at once, switch port first, then by id, and
+ * runs the handler through gic_dispatch. A source the gic has masked for
+ * going over its budget waits for the main loop's gic_poll every POLL_NS.
+ * The two uarts are stand-in handlers with the firmware's budgets
+ * (LINK_IRQ_BUDGET, CONSOLE_IRQ_BUDGET), so the library drivers behind
+ * them are not needed.
+ *
+ * An edge is served when the handler for it reads its port: the switch
+ * and button ports through XGpio_DiscreteRead, a uart on entry. A train
+ * edge is served when it reaches the train callback. Each source's
+ * latency, from its oldest edge not yet served, is checked against its
+ * budget in budgets[], and so is how late the 1 ms control loop passes
+ * finish. The exit status is 1 if any source goes over.
+ *
+ * A trace is a text file of lines "<time s> <source> [<edges> <period us>]"
+ * in time order, where the source is train, key, btn, link or console,
+ * and the optional pair repeats the edge, as a chattering contact or a
+ * noisy line does; '#' starts a comment. Host/irq_replay.trace is a 20 s
+ * run of trains, presses and the storms storm_sim.c measures. -n runs it
+ * with the budgets off, which starves the control loop and must fail.
+ *
+ * gcc -O2 -Wall -IHost/bsp -IHost -ILibrary -I. -o irq_replay Host/irq_replay.c \
+ *     Host/bsp/mock.c Library/io.c Library/gic.c -Wl,--wrap=XGpio_DiscreteRead
+ *
+ * usage: irq_replay [-n] [trace]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "gic.h"
+#include "io.h"
+#include "link.h"
+#include "console.h"
+#include "xtime_l.h"
+
+#define LOOP_NS 1000000ull		/* control loop period */
+#define WORK_NS 200000ull		/* its work per pass */
+#define POLL_NS 100000000ull	/* main loop period (c.f. POLL_US) */
+#define POLL_COST_NS 2000ull	/* gic_poll, before any handler it runs */
+#define ENTRY_NS 1000ull		/* interrupt entry, handler and exit */
+#define CALLBACK_NS 20000ull	/* a button or switch callback, with its printf */
+#define UART_NS 4000ull			/* a uart handler emptying its fifo */
+#define KEY_SW 0x2				/* maintenance key switch bit */
+#define SAMPLES (1 << 20)
+#define NS 1000000000ull
+
+enum { TRAIN, KEY, BTN, LINK, CONSOLE, LOOP, SOURCES };
+
+typedef struct {
+	const char *name;
+	u64 budget_ns;				/* worst latency allowed */
+} budget_t;
+
+static const budget_t budgets[SOURCES] = {
+	{ "train", 50000 },					/* the fast path: never masked, first taken */
+	{ "key", 100000 },					/* same port; its callback may be shed, not its handler */
+	{ "btn", POLL_NS + LOOP_NS },		/* masked in a storm: the next gic_poll */
+	{ "link", POLL_NS + LOOP_NS },
+	{ "console", POLL_NS + LOOP_NS },
+	{ "loop", LOOP_NS },				/* a pass must end before the next is due */
+};
+
+typedef struct {
+	u64 t;						/* virtual ns */
+	u8 source;
+} edge_t;
+
+typedef struct {
+	u32 edges;
+	u64 waiting;				/* oldest edge not yet served, or ~0 */
+	u32 n;						/* latencies */
+	u64 *lat;
+} result_t;
+
+static result_t results[SOURCES];
+static u64 now = 0;				/* virtual ns */
+static u64 charge;				/* cost of the code running now */
+
+static u64 counts(void){
+	return now / NS * COUNTS_PER_SECOND + now % NS * COUNTS_PER_SECOND / NS;
+}
+
+/*
+ * <source> has been served at the current point of the code running
+ */
+static void served(u32 source){
+	result_t *r = &results[source];
+
+	if (r->waiting == ~0ull)
+		return;
+	if (r->n < SAMPLES)
+		r->lat[r->n++] = now + charge - r->waiting;
+	r->waiting = ~0ull;
+}
+
+/* the handlers read their port first */
+u32 __real_XGpio_DiscreteRead(XGpio *gpio, unsigned channel);
+
+u32 __wrap_XGpio_DiscreteRead(XGpio *gpio, unsigned channel){
+	served(gpio->DeviceId == XPAR_AXI_GPIO_2_DEVICE_ID ? KEY : BTN);
+	return __real_XGpio_DiscreteRead(gpio, channel);
+}
+
+/* callbacks */
+static void btn_callback(u32 btn){
+	charge += CALLBACK_NS;
+}
+
+static void sw_callback(u32 sw){
+	charge += CALLBACK_NS;
+}
+
+static void train_callback(u64 entry){
+	served(TRAIN);
+}
+
+/* the uarts */
+static void uart_handler(void *ref){
+	served((u32)(unsigned long) ref);
+	charge += UART_NS;
+}
+
+static u32 id_of(u32 source){
+	static const u32 ids[] = { XPAR_FABRIC_GPIO_2_VEC_ID, XPAR_FABRIC_GPIO_2_VEC_ID,
+			XPAR_FABRIC_GPIO_1_VEC_ID, XPAR_XUARTPS_0_INTR, XPAR_XUARTPS_1_INTR };
+
+	return ids[source];
+}
+
+/*
+ * the next interrupt the core would take, or 0
+ */
+static u32 taken(void){
+	static const u32 ids[] = { XPAR_FABRIC_GPIO_2_VEC_ID,		/* IO_TRAIN_PRIORITY */
+			XPAR_FABRIC_GPIO_1_VEC_ID, XPAR_XUARTPS_0_INTR, XPAR_XUARTPS_1_INTR };
+	u32 i;
+
+	for (i = 0; i < sizeof(ids) / sizeof(ids[0]); i++){
+		if (mock_gic_enabled[ids[i]] && mock_gic_pending[ids[i]])
+			return ids[i];
+	}
+	return 0;
+}
+
+/*
+ * an edge on <source> now
+ */
+static void edge(u32 source){
+	result_t *r = &results[source];
+
+	switch (source){
+	case TRAIN: mock_gpio_in[XPAR_AXI_GPIO_2_DEVICE_ID] ^= IO_TRAIN_SW; break;
+	case KEY: mock_gpio_in[XPAR_AXI_GPIO_2_DEVICE_ID] ^= KEY_SW; break;
+	case BTN: mock_gpio_in[XPAR_AXI_GPIO_1_DEVICE_ID] ^= 0x1; break;
+	}
+	mock_gic_pending[id_of(source)] = 1;
+	r->edges++;
+	if (r->waiting == ~0ull)
+		r->waiting = now;
+}
+
+/*
+ * read <path> into <edges>, in time order; returns how many, or -1
+ */
+static long load(const char *path, edge_t **edges){
+	static const char *names[] = { "train", "key", "btn", "link", "console" };
+	char line[256], name[32];
+	double t, period_us;
+	long n = 0, max = 0, repeat, i, lineno = 0;
+	u64 last = 0, at;
+	u32 s;
+	int fields;
+	FILE *f = fopen(path, "r");
+
+	if (f == NULL){
+		perror(path);
+		return -1;
+	}
+	*edges = NULL;
+	while (fgets(line, sizeof(line), f) != NULL){
+		lineno++;
+		if (strchr(line, '#') != NULL)
+			*strchr(line, '#') = '\0';
+		repeat = 1;
+		period_us = 0;
+		fields = sscanf(line, "%lf %31s %ld %lf", &t, name, &repeat, &period_us);
+		if (fields <= 0)
+			continue;
+		for (s = 0; s < LOOP && strcmp(name, names[s]) != 0; s++)
+			;
+		at = (u64)(t * 1e9);
+		if (fields == 1 || fields == 3 || s == LOOP || repeat < 1 || at < last){
+			fprintf(stderr, "%s:%ld: not \"<time s> <source> [<edges> <period us>]\" in time order\n",
+					path, lineno);
+			fclose(f);
+			return -1;
+		}
+		for (i = 0; i < repeat; i++){
+			if (n == max){
+				max = max ? 2 * max : 4096;
+				*edges = realloc(*edges, max * sizeof(edge_t));
+			}
+			(*edges)[n].t = at + (u64)(i * period_us * 1e3);
+			(*edges)[n++].source = s;
+		}
+		last = at;
+	}
+	fclose(f);
+	return n;
+}
+
+static int compare_edge(const void *a, const void *b){
+	const edge_t *x = a, *y = b;
+
+	return x->t < y->t ? -1 : x->t > y->t;
+}
+
+static int compare(const void *a, const void *b){
+	u64 x = *(const u64 *) a, y = *(const u64 *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * replay <n> <edges> and let the storms end
+ */
+static void replay(const edge_t *edges, long n){
+	u64 end = (n ? edges[n - 1].t : 0) + POLL_NS * (GIC_CALM + 2);
+	u64 next_pass = LOOP_NS, deadline = 0, left = 0, next;
+	result_t *loop = &results[LOOP];
+	long e = 0;
+	u32 id;
+
+	while (now < end){
+		for (; e < n && edges[e].t <= now; e++)
+			edge(edges[e].source);
+
+		/* interrupts first */
+		if ((id = taken()) != 0){
+			mock_gic_pending[id] = 0;		/* acknowledged */
+			charge = ENTRY_NS;
+			gic_dispatch(id);
+			now += charge;
+			continue;
+		}
+
+		/* a control loop pass starts at its deadline, or when the last is done */
+		if (left == 0 && now >= next_pass){
+			deadline = next_pass;
+			next_pass += LOOP_NS;
+			left = WORK_NS;
+			if (deadline % POLL_NS == 0){
+				charge = POLL_COST_NS;
+				gic_poll();
+				left += charge;
+			}
+		}
+
+		/* run it, or idle, up to the next edge */
+		next = e < n && edges[e].t < end ? edges[e].t : end;
+		if (left != 0){
+			if (left <= next - now){
+				now += left;
+				left = 0;
+				if (loop->n < SAMPLES)
+					loop->lat[loop->n++] = now - deadline;
+			} else {
+				left -= next - now;
+				now = next;
+			}
+		} else {
+			now = next_pass < next ? next_pass : next;
+		}
+	}
+}
+
+int main(int argc, char *argv[]){
+	const char *path = "Host/irq_replay.trace";
+	gic_source_t src[GIC_SOURCES];
+	bool unlimited = false;
+	edge_t *edges;
+	result_t *r;
+	u32 s, i, n, failed = 0, storms = 0;
+	long nedges;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n")) != -1){
+		switch (opt){
+		case 'n': unlimited = true; break;
+		default:
+			fprintf(stderr, "usage: %s [-n] [trace]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (optind < argc)
+		path = argv[optind];
+	if ((nedges = load(path, &edges)) < 0)
+		return 2;
+	qsort(edges, nedges, sizeof(edge_t), compare_edge);		/* repeats may interleave */
+	for (s = 0; s < SOURCES; s++){
+		results[s].waiting = ~0ull;
+		if ((results[s].lat = malloc(SAMPLES * sizeof(u64))) == NULL){
+			perror("irq_replay");
+			return 2;
+		}
+	}
+
+	mock_xtime = counts;
+	gic_init();
+	io_btn_init(btn_callback);
+	io_sw_init(sw_callback);
+	io_train_init(train_callback);
+	gic_limit(XPAR_XUARTPS_0_INTR, LINK_IRQ_BUDGET, false);
+	gic_connect(XPAR_XUARTPS_0_INTR, uart_handler, (void *)(unsigned long) LINK);
+	gic_limit(XPAR_XUARTPS_1_INTR, CONSOLE_IRQ_BUDGET, false);
+	gic_connect(XPAR_XUARTPS_1_INTR, uart_handler, (void *)(unsigned long) CONSOLE);
+	if (unlimited){
+		gic_limit(XPAR_FABRIC_GPIO_1_VEC_ID, 0, false);
+		gic_limit(XPAR_FABRIC_GPIO_2_VEC_ID, 0, true);
+		gic_limit(XPAR_XUARTPS_0_INTR, 0, false);
+		gic_limit(XPAR_XUARTPS_1_INTR, 0, false);
+	}
+
+	replay(edges, nedges);
+
+	n = gic_sources(src, GIC_SOURCES);
+	for (i = 0; i < n; i++)
+		storms += src[i].storms;
+	printf("%s: %ld edges over %.1f s, budgets %s, %u storms\n", path, nedges,
+			nedges ? edges[nedges - 1].t / 1e9 : 0, unlimited ? "off" : "on", storms);
+	printf("%-8s %8s %8s %10s %10s %10s %10s\n", "source", "edges", "served", "p50 us", "p99 us", "max us",
+			"budget us");
+	for (s = 0; s < SOURCES; s++){
+		r = &results[s];
+		qsort(r->lat, r->n, sizeof(u64), compare);
+		printf("%-8s %8u %8u %10.1f %10.1f %10.1f %10.1f", budgets[s].name, s == LOOP ? r->n : r->edges, r->n,
+				r->n ? r->lat[r->n / 2] / 1e3 : 0, r->n ? r->lat[r->n * 99 / 100] / 1e3 : 0,
+				r->n ? r->lat[r->n - 1] / 1e3 : 0, budgets[s].budget_ns / 1e3);
+		if ((r->n && r->lat[r->n - 1] > budgets[s].budget_ns) || r->waiting != ~0ull){
+			printf("  FAIL%s", r->waiting != ~0ull ? ": never served" : "");
+			failed++;
+		}
+		printf("\n");
+	}
+	if (failed){
+		printf("%u sources over their budget\n", failed);
+		return 1;
+	}
+	printf("every source within its budget\n");
+	return 0;
+}
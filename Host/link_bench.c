@@ -0,0 +1,431 @@
+/*
+ * link_bench.c -- substation round trips over UDP and over the uart
+ *
+ * Runs Library/link.c with the GEM and lwIP stood in for by a UDP socket
+ * on the loopback interface, and the PS UART by the mock on a socketpair
+ * carrying bytes at the wire rate. A substation thread answers update
+ * requests on both, as link_sim's does. eth_poll hands each datagram to
+ * link.c out of its receive buffer, as eth.c passes the pbuf payload.
+ *
+ * Each transport runs with one request outstanding and then with WINDOW,
+ * queued back to back in the uart transmit ring. It reports update round
+ * trips per second and the round trip time (median, 99th percentile and
+ * worst). The uart runs at LINK_BAUD and at the top rate once it has
+ * negotiated up; the udp rows spin the main loop, where the firmware
+ * passes every POLL_MS, so they show the transport and not the loop.
+ * Every response is checked against its request; a wrong or missing one
+ * is counted, and the exit status is 1 if any were.
+ *
+ * gcc -O2 -Wall -IHost/bsp -IHost -ILibrary -I. -o link_bench Host/link_bench.c \
+ *     Host/bsp/mock.c Library/link.c Library/gic.c -lpthread
+ *
+ * usage: link_bench [-d seconds per row]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "eth.h"
+#include "gic.h"
+#include "link.h"
+#include "msg.h"
+#include "xpseudo_asm.h"
+#include "xreg_cortexa9.h"
+
+#define POLL_MS 100				/* firmware main loop (c.f. POLL_US) */
+#define WINDOW 4				/* below LINK_MAX_MISSES, which would fall back */
+#define ID 21
+#define SAMPLES (1 << 20)
+#define SLOTS 64				/* requests in flight, by value */
+
+static double seconds = 2.0;
+static volatile int running = 1;
+static int line_fd;				/* substation end of the wire */
+static int wake_pipe[2];
+static volatile u32 sub_baud = LINK_BAUD;
+static volatile u32 sub_rates = 1;	/* rates the substation accepts (bits of msg_rates) */
+
+/* the udp stand-in */
+static int eth_fd = -1, sub_fd = -1;
+static volatile bool eth_up = false;
+static void (*eth_callback)(const u8 *msg, u32 len);
+
+/* controller side */
+static u64 sent_ns[SLOTS];
+static volatile int seq = 0;
+static volatile u32 outstanding = 0;
+static volatile u64 answered = 0, wrong = 0;
+static u32 *rtt;				/* ns */
+static volatile u32 samples = 0;
+
+static u64 now_ns(void){
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* the gem and lwIP (c.f. eth.h) */
+s32 eth_init(void (*callback)(const u8 *msg, u32 len)){
+	eth_callback = callback;
+	return eth_up ? XST_SUCCESS : XST_FAILURE;
+}
+
+void eth_poll(void){
+	u8 buf[1536];			/* one frame */
+	ssize_t n;
+
+	while ((n = recv(eth_fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0)
+		eth_callback(buf, (u32) n);
+}
+
+s32 eth_send(const void *msg, u32 len){
+	return send(eth_fd, msg, len, 0) == (ssize_t) len ? XST_SUCCESS : XST_FAILURE;
+}
+
+bool eth_link_up(void){
+	return eth_up;
+}
+
+void eth_close(void){ }
+
+/*
+ * the substation's response to <req>
+ */
+static void respond(const update_request_t *req, update_response_t *resp){
+	int i;
+
+	resp->type = UPDATE;
+	resp->id = req->id;
+	resp->average = req->value;
+	for (i = 0; i < MSG_VALUES; i++)
+		resp->values[i] = req->value * 31 + i;
+}
+
+/*
+ * substation: answer datagrams
+ */
+static void *udp_main(void *arg){
+	struct pollfd pfd = { sub_fd, POLLIN, 0 };
+	struct sockaddr_in from;
+	socklen_t fromlen;
+	update_request_t req;
+	update_response_t resp;
+	ssize_t n;
+
+	while (running){
+		if (poll(&pfd, 1, 5) <= 0)
+			continue;
+		fromlen = sizeof(from);
+		n = recvfrom(sub_fd, &req, sizeof(req), 0, (struct sockaddr *) &from, &fromlen);
+		if (n != sizeof(req) || req.type != UPDATE)
+			continue;		/* pings have nothing to prove here */
+		respond(&req, &resp);
+		sendto(sub_fd, &resp, sizeof(resp), 0, (struct sockaddr *) &from, fromlen);
+	}
+	return NULL;
+}
+
+/*
+ * substation: send <len> bytes down the wire at its rate
+ */
+static void sub_send(const void *msg, u32 len){
+	usleep((u64) len * 10 * 1000000 / sub_baud);
+	if (write(line_fd, msg, len) < 0)
+		perror("link_bench");
+}
+
+static u32 request_size(const u8 *msg){
+	int type;
+
+	memcpy(&type, msg, sizeof(int));
+	switch (type){
+	case PING:
+		return sizeof(ping_t);
+	case UPDATE:
+		return sizeof(update_request_t);
+	case LINK_OFFER:
+	case LINK_COMMIT:
+		return sizeof(link_speed_t);
+	}
+	return 0;
+}
+
+/*
+ * substation: answer the uart, taking the highest rate offered that it
+ * accepts
+ */
+static void *uart_main(void *arg){
+	struct pollfd pfd = { line_fd, POLLIN, 0 };
+	u8 buf[256];
+	u32 have = 0, need;
+	update_request_t req;
+	update_response_t resp;
+	link_speed_t speed;
+	ssize_t n;
+	int i;
+
+	while (running){
+		if (poll(&pfd, 1, 5) <= 0 || (n = read(line_fd, buf + have, sizeof(buf) - have)) <= 0)
+			continue;
+		have += n;
+		while (have >= sizeof(int)){
+			need = request_size(buf);
+			if (need == 0){
+				memmove(buf, buf + 1, --have);
+				continue;
+			}
+			if (have < need)
+				break;
+			memcpy(&req, buf, sizeof(int));
+			switch (req.type){
+			case PING:
+				sub_send(buf, sizeof(ping_t));
+				break;
+			case UPDATE:
+				memcpy(&req, buf, sizeof(req));
+				respond(&req, &resp);
+				sub_send(&resp, sizeof(resp));
+				break;
+			case LINK_OFFER:
+				memcpy(&speed, buf, sizeof(speed));
+				for (i = MSG_RATES - 1; i > 0 && !(speed.rates & sub_rates & (1 << i)); i--)
+					;
+				speed.type = LINK_ACCEPT;
+				speed.rates = i > 0 ? 1 << i : 0;
+				sub_send(&speed, sizeof(speed));
+				break;
+			case LINK_COMMIT:
+				memcpy(&speed, buf, sizeof(speed));
+				for (i = 1; i < MSG_RATES && speed.rates != (1 << i); i++)
+					;
+				if (i < MSG_RATES)
+					sub_baud = msg_rates[i];
+				break;
+			}
+			have -= need;
+			memmove(buf, buf + need, have);
+		}
+	}
+	return NULL;
+}
+
+/*
+ * the uart interrupt (c.f. link_sim.c)
+ */
+static void *interrupt_main(void *arg){
+	struct pollfd fds[2] = { { mock_uart_fd, POLLIN, 0 }, { wake_pipe[0], POLLIN, 0 } };
+	struct timespec ts;
+	u64 done, start;
+	u8 drain[64];
+	u32 cpsr;
+
+	while (running){
+		done = mock_uart_sent_ns;
+		start = now_ns();
+		if (done == 0)
+			done = start + 10000000;
+		done = done > start ? done - start : 0;
+		ts.tv_sec = done / 1000000000ull;
+		ts.tv_nsec = done % 1000000000ull;
+		if (ppoll(fds, 2, &ts, NULL) < 0)
+			break;
+		if (fds[1].revents & POLLIN && read(wake_pipe[0], drain, sizeof(drain)) < 0)
+			break;
+		if (!(fds[0].revents & POLLIN) && (mock_uart_sent_ns == 0 || now_ns() < mock_uart_sent_ns))
+			continue;
+		cpsr = mfcpsr();
+		mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);
+		gic_dispatch(XPAR_XUARTPS_0_INTR);
+		mtcpsr(cpsr);
+	}
+	return NULL;
+}
+
+/*
+ * messages for the controller: from the interrupt on the uart, from
+ * link_poll on udp
+ */
+static void on_msg(const u8 *msg, u32 len){
+	update_response_t resp;
+	int i, ok;
+
+	memcpy(&resp, msg, len < sizeof(resp) ? len : sizeof(resp));
+	if (resp.type != UPDATE)
+		return;
+	ok = len == sizeof(resp) && resp.id == ID && resp.average > seq - SLOTS && resp.average <= seq;
+	for (i = 0; ok && i < MSG_VALUES; i++)
+		ok = resp.values[i] == resp.average * 31 + i;
+	if (!ok){
+		wrong++;
+		return;
+	}
+	if (samples < SAMPLES)
+		rtt[samples++] = (u32)(now_ns() - sent_ns[resp.average % SLOTS]);
+	answered++;
+	if (outstanding > 0)
+		__sync_fetch_and_sub(&outstanding, 1);
+}
+
+static void on_raw(u8 byte){ }
+
+static int cmp(const void *a, const void *b){
+	u32 x = *(const u32 *) a, y = *(const u32 *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * the controller main loop for <ns> with up to <window> requests in
+ * flight; <spin> polls the link on every pass
+ */
+static void run(u64 ns, u32 window, bool spin){
+	u64 start = now_ns(), end = start + ns, next_poll = 0, last = start, t;
+	update_request_t req = { UPDATE, ID, 0 };
+
+	while ((t = now_ns()) < end){
+		if (spin || t >= next_poll){
+			link_poll();
+			next_poll = t + POLL_MS * 1000000ull;
+		}
+		if (outstanding < window){
+			req.value = seq + 1;
+			sent_ns[req.value % SLOTS] = now_ns();
+			if (link_send(&req, sizeof(req)) == XST_SUCCESS){
+				seq++;
+				__sync_fetch_and_add(&outstanding, 1);
+				last = t;
+			}
+		} else if (t - last > 2000000000ull){
+			outstanding = 0;		/* given up on */
+			last = t;
+		}
+		if (!spin)
+			usleep(50);
+	}
+}
+
+/*
+ * poll until the requests in flight are answered, or for a second
+ */
+static void drain(void){
+	u64 end = now_ns() + 1000000000ull;
+
+	while (outstanding > 0 && now_ns() < end){
+		link_poll();
+		usleep(1000);
+	}
+	outstanding = 0;
+}
+
+/*
+ * one row: settle, then measure
+ */
+static void row(const char *label, u32 window, bool spin, u64 *lost){
+	link_stats_t l;
+	u64 before, sent;
+	u32 n;
+
+	run(200000000ull, window, spin);
+	drain();
+	samples = 0;
+	before = answered;
+	sent = seq;
+	run((u64)(seconds * 1e9), window, spin);
+	sent = seq - sent;
+	drain();
+	n = samples;
+	qsort(rtt, n, sizeof(u32), cmp);
+	link_stats(&l);
+	printf("%-12s %7lu %6u %9.1f %10.1f %10.1f %10.1f %8lu\n", label,
+			(unsigned long)(link_active() == LINK_UDP ? 0 : l.baud), window,
+			(answered - before) / seconds,
+			n ? rtt[n / 2] / 1000.0 : 0, n ? rtt[n * 99 / 100] / 1000.0 : 0, n ? rtt[n - 1] / 1000.0 : 0,
+			(unsigned long)(sent - (answered - before)));
+	*lost += sent - (answered - before);
+}
+
+int main(int argc, char *argv[]){
+	struct sockaddr_in a = { 0 };
+	socklen_t alen = sizeof(a);
+	pthread_t interrupt, uart, udp;
+	int sv[2], opt;
+	u64 lost = 0;
+
+	while ((opt = getopt(argc, argv, "d:")) != -1){
+		switch (opt){
+		case 'd': seconds = atof(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-d seconds per row]\n", argv[0]);
+			return 2;
+		}
+	}
+	rtt = malloc(SAMPLES * sizeof(u32));
+	if (rtt == NULL || socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0 || pipe(wake_pipe) < 0){
+		perror("link_bench");
+		return 1;
+	}
+	fcntl(sv[0], F_SETFL, O_NONBLOCK);
+	mock_uart_fd = sv[0];
+	mock_uart_wake = wake_pipe[1];
+	line_fd = sv[1];
+	mock_uart_baud = LINK_BAUD;
+
+	/* loopback endpoints: the substation's, and the controller's connected to it */
+	a.sin_family = AF_INET;
+	a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sub_fd = socket(AF_INET, SOCK_DGRAM, 0);
+	eth_fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sub_fd < 0 || eth_fd < 0 || bind(sub_fd, (struct sockaddr *) &a, sizeof(a)) < 0 ||
+			getsockname(sub_fd, (struct sockaddr *) &a, &alen) < 0 ||
+			connect(eth_fd, (struct sockaddr *) &a, sizeof(a)) < 0){
+		perror("link_bench");
+		return 1;
+	}
+
+	gic_init();
+	eth_up = true;
+	link_init(ID, on_msg, on_raw);
+	pthread_create(&interrupt, NULL, interrupt_main, NULL);
+	pthread_create(&uart, NULL, uart_main, NULL);
+	pthread_create(&udp, NULL, udp_main, NULL);
+
+	printf("%-12s %7s %6s %9s %10s %10s %10s %8s\n", "transport", "baud", "window", "rt/s",
+			"p50 us", "p99 us", "max us", "lost");
+	row("udp", 1, true, &lost);
+	row("udp", WINDOW, true, &lost);
+
+	eth_up = false;				/* link down: link_send falls back to the uart */
+	row("uart", 1, false, &lost);
+	row("uart", WINDOW, false, &lost);
+
+	sub_rates = 0xFF;			/* let it negotiate up */
+	link_renegotiate();
+	for (opt = 0; opt < 50 && mock_uart_baud == LINK_BAUD; opt++){
+		link_poll();
+		usleep(POLL_MS * 1000);
+	}
+	row("uart", 1, false, &lost);
+	row("uart", WINDOW, false, &lost);
+
+	running = 0;
+	pthread_join(udp, NULL);
+	pthread_join(uart, NULL);
+	pthread_join(interrupt, NULL);
+	if (wrong || lost){
+		printf("%lu wrong responses, %lu lost\n", (unsigned long) wrong, (unsigned long) lost);
+		return 1;
+	}
+	printf("every response matched its request\n");
+	return 0;
+}
@@ -0,0 +1,472 @@
+/*
+ * link_sim.c -- substation uart rate negotiation over an emulated line
+ *
+ * Runs Library/link.c against the mock PS UART and a substation stand-in
+ * on the other end of a socketpair, both in virtual time. The line between
+ * them garbles every byte while the two ends disagree on the rate, and
+ * otherwise flips bits at a set bit error rate. A hit start or stop bit
+ * shows up as a framing error, like a real UART would report it. A
+ * message takes 10 bit times per byte at the sender's rate to arrive. The
+ * controller runs the firmware loop (gic_poll and link_poll every
+ * POLL_NS, and the next update request as soon as the answer is in or
+ * overdue). The substation drops back to LINK_BAUD after LINK_SILENT_MS
+ * without a frame. The same seed gives the same run.
+ *
+ * For each substation rate limit it renegotiates and reports the effective
+ * throughput: intact update round trips per second and response bytes per
+ * second. It then repeats the fastest rate at raised bit error rates, and
+ * over a cable that only carries 115200 cleanly, to show the fallback.
+ * Each phase gets a row for every rate the controller's UART ran at during
+ * it, with the share of the phase spent there, and the round trips and
+ * bytes are counted against the rate they ran at.
+ *
+ * gcc -O2 -Wall -IHost/bsp -IHost -ILibrary -I. -o link_sim Host/link_sim.c \
+ *     Host/bsp/mock.c Library/link.c Library/gic.c -lm
+ *
+ * usage: link_sim [-d seconds per phase] [-s seed]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "eth.h"
+#include "gic.h"
+#include "link.h"
+#include "msg.h"
+#include "xpseudo_asm.h"
+#include "xreg_cortexa9.h"
+#include "xtime_l.h"
+
+#define POLL_NS 100000000ull	/* firmware main loop (c.f. POLL_US) */
+#define NS 1000000000ull
+#define ID 21
+#define SENDS 16				/* substation messages on the wire */
+#define UART XPAR_XUARTPS_0_INTR
+
+typedef struct {				/* one phase at one rate */
+	u64 ns;						/* the controller's uart was at it */
+	u64 requests;
+	u64 intact;					/* responses with the expected values */
+	u64 corrupt;
+} at_rate_t;
+
+typedef struct {				/* one measurement */
+	at_rate_t at[MSG_RATES];
+	link_stats_t before, after;
+} phase_t;
+
+typedef struct {				/* a substation message on its way */
+	u64 at;						/* fully arrived */
+	u32 baud;					/* sent at */
+	u32 len;
+	u8 buf[MSG_MAX];
+} send_t;
+
+static u64 now = 0;				/* virtual ns */
+static double seconds = 1.0;
+static int line_fd;				/* substation end of the wire */
+static phase_t *phase;
+
+/* line and substation state */
+static double ber = 0;			/* bit error rate */
+static u32 ber_above = 0;		/* rate above which the errors start */
+static u32 sub_rates = 1;		/* rates the substation supports (bits of msg_rates) */
+static u32 sub_baud = LINK_BAUD;
+static u64 sub_framing = 0;		/* framing errors the substation saw */
+static u64 sub_last = 0;		/* last frame in */
+static u8 sub_in[256];			/* frame being assembled */
+static u32 sub_have = 0;
+static send_t sends[SENDS];
+static u32 send_head = 0, send_tail = 0;
+static u64 wire_free = 0;		/* the substation's transmitter is done */
+
+/* controller side */
+static int seq = 0;
+static bool answered = false;
+static bool outstanding = false;
+static u64 deadline = 0;		/* to give up on the request outstanding */
+static u64 retry = 0;			/* to try again after a refused send */
+static u64 next_poll = 0;
+
+static u64 counts(void){
+	return now / NS * COUNTS_PER_SECOND + now % NS * COUNTS_PER_SECOND / NS;
+}
+
+/* msg_rates index of <baud> */
+static u32 rate_of(u32 baud){
+	u32 i;
+
+	for (i = MSG_RATES - 1; i > 0 && msg_rates[i] != baud; i--)
+		;
+	return i;
+}
+
+/* no ethernet: the link stays on the uart */
+s32 eth_init(void (*eth_callback)(const u8 *msg, u32 len)){ return XST_FAILURE; }
+void eth_poll(void){ }
+s32 eth_send(const void *msg, u32 len){ return XST_FAILURE; }
+bool eth_link_up(void){ return false; }
+void eth_close(void){ }
+
+/*
+ * what the line does to one byte sent at <from> baud and received at <to>;
+ * returns true if the receiver flags a framing error
+ */
+static bool line(u8 *byte, u32 from, u32 to){
+	int bit;
+
+	if (from != to){
+		*byte = rand();
+		return rand() & 1;
+	}
+	if (ber == 0 || to <= ber_above || drand48() >= 1 - pow(1 - ber, 10))
+		return false;
+	bit = rand() % 10;			/* start, 8 data, stop */
+	if (bit == 0 || bit == 9)
+		return true;
+	*byte ^= 1 << (bit - 1);
+	return false;
+}
+
+/*
+ * the uart interrupt, again while received bytes are left: taken now if
+ * the gic has it enabled, otherwise left pending for gic_poll
+ */
+static void irq(void){
+	struct pollfd pfd = { mock_uart_fd, POLLIN, 0 };
+	u32 cpsr;
+
+	do {
+		mock_gic_pending[UART] = 1;
+		if (!mock_gic_enabled[UART])
+			return;
+		mock_gic_pending[UART] = 0;
+		cpsr = mfcpsr();
+		mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);
+		gic_dispatch(UART);
+		mtcpsr(cpsr);
+	} while (poll(&pfd, 1, 0) > 0);
+}
+
+/*
+ * the substation's response values for request <n>
+ */
+static int value_of(int n, int i){
+	return n * 31 + i;
+}
+
+/*
+ * substation: send <len> bytes at its rate, after whatever it is sending
+ */
+static void sub_send(const void *msg, u32 len){
+	send_t *s;
+
+	if (send_tail - send_head == SENDS)
+		return;					/* its own queue is full: dropped */
+	s = &sends[send_tail++ % SENDS];
+	if (wire_free < now)
+		wire_free = now;
+	wire_free += (u64) len * 10 * NS / sub_baud;
+	s->at = wire_free;
+	s->baud = sub_baud;
+	s->len = len;
+	memcpy(s->buf, msg, len);
+}
+
+static u32 request_size(const u8 *msg){
+	int type;
+
+	memcpy(&type, msg, sizeof(int));
+	switch (type){
+	case PING:
+		return sizeof(ping_t);
+	case UPDATE:
+		return sizeof(update_request_t);
+	case LINK_OFFER:
+	case LINK_COMMIT:
+		return sizeof(link_speed_t);
+	}
+	return 0;
+}
+
+/*
+ * answer one controller message
+ */
+static void serve(const u8 *msg){
+	update_request_t req;
+	update_response_t resp;
+	link_speed_t speed;
+	int i;
+
+	memcpy(&req, msg, sizeof(int));
+	switch (req.type){
+	case PING:
+		sub_send(msg, sizeof(ping_t));
+		break;
+	case UPDATE:
+		memcpy(&req, msg, sizeof(req));
+		resp.type = UPDATE;
+		resp.id = req.id;
+		resp.average = req.value;
+		for (i = 0; i < MSG_VALUES; i++)
+			resp.values[i] = value_of(req.value, i);
+		sub_send(&resp, sizeof(resp));
+		break;
+	case LINK_OFFER:
+		memcpy(&speed, msg, sizeof(speed));
+		for (i = MSG_RATES - 1; i > 0 && !(speed.rates & sub_rates & (1 << i)); i--)
+			;
+		speed.type = LINK_ACCEPT;
+		speed.rates = i > 0 ? 1 << i : 0;
+		speed.fifo = speed.fifo < 32 ? speed.fifo : 32;
+		sub_send(&speed, sizeof(speed));
+		break;
+	case LINK_COMMIT:
+		memcpy(&speed, msg, sizeof(speed));
+		for (i = 1; i < MSG_RATES && speed.rates != (1 << i); i++)
+			;
+		if (i < MSG_RATES)
+			sub_baud = msg_rates[i];	/* the commit is fully in */
+		break;
+	}
+}
+
+/*
+ * the substation end of the line: take in what the controller's uart has
+ * sent, and go back to LINK_BAUD after a silence
+ */
+static void substation(void){
+	u8 in[256];
+	u32 need;
+	ssize_t n, i;
+
+	while ((n = read(line_fd, in, sizeof(in))) > 0){
+		for (i = 0; i < n; i++){		/* byte by byte: a commit changes the rate of the next */
+			if (line(&in[i], mock_uart_baud, sub_baud))
+				sub_framing++;
+			sub_in[sub_have++] = in[i];
+			while (sub_have >= sizeof(int)){
+				need = request_size(sub_in);
+				if (need == 0){			/* resync by one byte */
+					memmove(sub_in, sub_in + 1, --sub_have);
+					continue;
+				}
+				if (sub_have < need)
+					break;
+				serve(sub_in);
+				sub_last = now;
+				sub_have -= need;
+				memmove(sub_in, sub_in + need, sub_have);
+			}
+			if (sub_have == sizeof(sub_in))
+				sub_have = 0;
+		}
+	}
+	if (sub_baud != LINK_BAUD && now - sub_last >= (u64) LINK_SILENT_MS * 1000000){
+		sub_baud = LINK_BAUD;		/* nobody at this rate */
+		sub_have = 0;
+	}
+}
+
+/*
+ * messages for the controller (c.f. link_init)
+ */
+static void on_msg(const u8 *msg, u32 len){
+	const update_response_t *resp = (const update_response_t *) msg;
+	int i, ok;
+
+	if (resp->type != UPDATE)
+		return;
+	ok = resp->id == ID && resp->average == seq;
+	for (i = 0; ok && i < MSG_VALUES; i++)
+		ok = resp->values[i] == value_of(seq, i);
+	if (ok)
+		phase->at[rate_of(mock_uart_baud)].intact++;
+	else
+		phase->at[rate_of(mock_uart_baud)].corrupt++;
+	answered = true;
+}
+
+static void on_raw(u8 byte){ }
+
+/*
+ * everything due at <now>
+ */
+static void step(void){
+	update_request_t req = { UPDATE, ID, 0 };
+	link_stats_t stats;
+	send_t *s;
+	u32 i;
+
+	/* substation messages that have arrived */
+	while (send_head != send_tail && sends[send_head % SENDS].at <= now){
+		s = &sends[send_head++ % SENDS];
+		for (i = 0; i < s->len; i++){
+			if (line(&s->buf[i], s->baud, mock_uart_baud))
+				mock_uart_framing++;
+		}
+		if (write(line_fd, s->buf, s->len) < 0)
+			perror("link_sim");
+		irq();
+	}
+
+	/* the controller's send is done: its bytes go on the wire */
+	if (mock_uart_sent_ns != 0 && now >= mock_uart_sent_ns)
+		irq();
+	substation();
+
+	/* the main loop */
+	if (now >= next_poll){
+		gic_poll();
+		link_poll();
+		next_poll += POLL_NS;
+	}
+	if (answered || (outstanding && now >= deadline))
+		outstanding = false;	/* answered, or given up on */
+	answered = false;
+	if (!outstanding && now >= retry){
+		req.value = ++seq;
+		if (link_send(&req, sizeof(req)) == XST_SUCCESS){
+			link_stats(&stats);		/* twice the wire time of a round trip */
+			outstanding = true;
+			deadline = now + (u64)(sizeof(req) + sizeof(update_response_t)) * 20 * NS / stats.baud + POLL_NS / 2;
+			phase->at[rate_of(mock_uart_baud)].requests++;
+		} else {
+			retry = now + POLL_NS / 4;
+		}
+	}
+	substation();		/* a send may have finished at once */
+}
+
+/* <t> if it is the earliest so far */
+static void earliest(u64 *next, u64 t){
+	if (t < *next)
+		*next = t;
+}
+
+/*
+ * the controller and the substation for <ns>
+ */
+static void run(u64 ns, phase_t *p){
+	u64 end = now + ns, next;
+
+	phase = p;
+	link_stats(&p->before);
+	while (now < end){
+		step();
+		next = end;
+		earliest(&next, next_poll);
+		if (send_head != send_tail)
+			earliest(&next, sends[send_head % SENDS].at);
+		if (mock_uart_sent_ns != 0 && mock_gic_enabled[UART])
+			earliest(&next, mock_uart_sent_ns);
+		earliest(&next, outstanding ? deadline : retry);
+		if (sub_baud != LINK_BAUD)
+			earliest(&next, sub_last + (u64) LINK_SILENT_MS * 1000000);
+		if (next <= now)
+			next = now + 1;		/* the uart's clock is a timer count behind */
+		p->at[rate_of(mock_uart_baud)].ns += next - now;
+		now = next;
+	}
+	link_stats(&p->after);
+}
+
+static void report(const char *label, phase_t *p){
+	link_stats_t *a = &p->after, *b = &p->before;
+	at_rate_t *r;
+	u64 total = 0;
+	bool first = true;
+	u32 i;
+
+	for (i = 0; i < MSG_RATES; i++)
+		total += p->at[i].ns;
+	for (i = MSG_RATES; i-- > 0;){
+		r = &p->at[i];
+		if (r->ns == 0)
+			continue;
+		printf("%-16s %7lu baud %5.1f%% %8.0f rt/s %9.0f B/s  intact %5.1f%%", first ? label : "",
+				(unsigned long) msg_rates[i], 100.0 * r->ns / total, r->intact * 1e9 / r->ns,
+				r->intact * sizeof(update_response_t) * 1e9 / r->ns,
+				r->requests ? 100.0 * r->intact / r->requests : 0.0);
+		if (first)
+			printf("  framing %4lu resync %5lu fallbacks %lu", (unsigned long)(a->framing - b->framing),
+					(unsigned long)(a->resync - b->resync), (unsigned long)(a->fallbacks - b->fallbacks));
+		printf("\n");
+		first = false;
+	}
+}
+
+int main(int argc, char *argv[]){
+	static const double bers[] = { 1e-6, 1e-5, 1e-4 };
+	u64 settle, measure;
+	int sv[2], opt, i;
+	long seed = 1;
+	char label[32];
+	phase_t p;
+
+	while ((opt = getopt(argc, argv, "d:s:")) != -1){
+		switch (opt){
+		case 'd': seconds = atof(optarg); break;
+		case 's': seed = atol(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-d seconds per phase] [-s seed]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0){
+		perror("link_sim");
+		return 1;
+	}
+	fcntl(sv[0], F_SETFL, O_NONBLOCK);
+	fcntl(sv[1], F_SETFL, O_NONBLOCK);
+	mock_uart_fd = sv[0];
+	line_fd = sv[1];
+	mock_uart_baud = LINK_BAUD;
+	mock_xtime = counts;
+	srand(seed);
+	srand48(seed);
+
+	gic_init();
+	link_init(ID, on_msg, on_raw);
+
+	settle = (u64) POLL_NS * (LINK_HOLD_POLLS + 3 * LINK_NEGOTIATE_POLLS);
+	measure = (u64)(seconds * NS);
+	for (i = 0; i < MSG_RATES; i++){
+		sub_rates = (2 << i) - 1;		/* the substation's limit */
+		memset(&p, 0, sizeof(p));
+		link_renegotiate();
+		run(settle, &p);
+		memset(&p, 0, sizeof(p));
+		run(measure, &p);
+		snprintf(label, sizeof(label), "limit %lu", (unsigned long) msg_rates[i]);
+		report(label, &p);
+	}
+	for (i = 0; i < (int)(sizeof(bers) / sizeof(bers[0])); i++){
+		ber = bers[i];
+		memset(&p, 0, sizeof(p));
+		run(measure, &p);
+		snprintf(label, sizeof(label), "ber %g", bers[i]);
+		report(label, &p);
+		ber = 0;
+		memset(&p, 0, sizeof(p));
+		link_renegotiate();
+		run(settle, &p);
+	}
+	ber = 1e-3;					/* a long cable: clean up to 115200 */
+	ber_above = 115200;
+	memset(&p, 0, sizeof(p));
+	link_renegotiate();
+	run(settle * 4, &p);
+	memset(&p, 0, sizeof(p));
+	run(measure, &p);
+	report("cable 115200", &p);
+	printf("substation saw %lu framing errors\n", (unsigned long) sub_framing);
+	return 0;
+}
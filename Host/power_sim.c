@@ -0,0 +1,319 @@
+/*
+ * power_sim.c -- energy and wake-up latency of the power manager
+ *
+ * Runs Library/crossing.c and Library/power.c (with POWER_SCALE) in
+ * virtual time on one simulated core. The mock SLCR holds the cpu clock
+ * divisor; while it is raised every cycle the core spends takes that much
+ * longer and the global timer counts that much slower, which power.c's
+ * XTime_GetTime wrapper has to make up for.
+ *
+ * Interrupts: the 1 kHz gate loop, the 1 Hz crossing tick, the train
+ * switch and the pedestrian button. One that comes while IRQs are masked,
+ * in WFI for instance, runs as soon as they are unmasked. Each one costs
+ * its full-speed time times the divisor. A train edge costs PRE_NS to
+ * reach the train callback, which boosts the clock, then FAST_NS for the
+ * fast path; its latency is from the edge to the end of the fast path.
+ * The main loop does PASS_NS of work every 100 ms, then, as the firmware
+ * does, either spins until the next pass (busy, the old usleep), waits in
+ * WFI (wfi), or also lets power_poll drop the clock (scale).
+ *
+ * Each scenario replays a day's traffic (trains every so many minutes,
+ * each on the sensor for TRAIN_S, and pedestrian requests) for each
+ * policy, and reports the residency per power state, the estimated
+ * energy and mean power (c.f. POWER_MW), and the train latency against
+ * the busy loop.
+ *
+ * gcc -O2 -Wall -DPOWER_SCALE -IHost/bsp -IHost -ILibrary -I. -o power_sim Host/power_sim.c \
+ *     Host/bsp/mock.c Library/crossing.c Library/power.c -Wl,--wrap=XTime_GetTime -lm
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+
+#include "config.h"
+#include "crossing.h"
+#include "power.h"
+#include "xtime_l.h"
+
+#define ARM_CLK_CTRL 0xF8000120		/* c.f. power.c */
+#define APER_CLK_CTRL 0xF800012C
+#define FULL_DIV 2					/* 1333 MHz pll / 2 */
+#define APER_RESET 0x01FFCCCD		/* every peripheral clock on */
+
+#define NS 1000000000ull
+#define GATE_PERIOD_NS 1000000ull	/* c.f. GATE_RATE */
+#define TICK_PERIOD_NS NS			/* c.f. FREQ */
+#define POLL_NS 100000000ull		/* c.f. POLL_US */
+#define GATE_NS 6000ull				/* pid step and its xadc read */
+#define TICK_NS 20000ull			/* crossing tick and the snapshot */
+#define PASS_NS 400000ull			/* main loop pass */
+#define PRE_NS 1500ull				/* train edge to the train callback */
+#define FAST_NS 2000ull				/* fast path */
+#define CALLBACK_NS 30000ull		/* switch or button callback, with its printf */
+#define RESCALE_NS 3000ull			/* both ttcs re-programmed */
+#define WFI_EXIT_NS 100ull
+#define TRAIN_S 60
+
+enum { BUSY, WFI, SCALE, POLICIES };
+static const char *policies[POLICIES] = { "busy", "wfi", "scale" };
+
+typedef struct {
+	const char *label;
+	double train_min;			/* between trains */
+	double walk_min;			/* between pedestrian requests, 0 for none */
+} scenario_t;
+
+static const scenario_t scenarios[] = {
+	{ "night",     30,   0 },
+	{ "rural",     20,  15 },
+	{ "day",       10,   2 },
+	{ "rush",       4, 0.5 },
+};
+
+static double hours = 24;
+
+/* the simulated core */
+static u64 now = 0;				/* virtual ns */
+static u32 clk_ctrl = FULL_DIV << 8;
+static u32 aper = APER_RESET;
+static u32 factor = 1;			/* clock divided by */
+static u64 raw = 0;				/* global timer at raw_ns */
+static u64 raw_ns = 0;
+static bool in_irq = false;
+
+/* events */
+static u64 next_gate, next_tick, next_train, next_walk;
+static bool train_on;
+static crossing_t crossing;
+static const scenario_t *scenario;
+
+/* results */
+static u64 lat_sum, lat_max;
+static u32 lats;
+
+static u64 counts(u64 at){
+	u64 d = at - raw_ns;
+
+	return raw + (d / NS * COUNTS_PER_SECOND + d % NS * COUNTS_PER_SECOND / NS) / factor;
+}
+
+/* the global timer, under power.c's wrapper */
+static u64 timer(void){
+	return counts(now);
+}
+
+static u32 reg_read(UINTPTR addr){
+	return addr == ARM_CLK_CTRL ? clk_ctrl : addr == APER_CLK_CTRL ? aper : 0;
+}
+
+static void reg_write(UINTPTR addr, u32 value){
+	if (addr == ARM_CLK_CTRL){
+		raw = counts(now);
+		raw_ns = now;
+		clk_ctrl = value;
+		factor = ((value >> 8) & 0x3F) / FULL_DIV;
+	} else if (addr == APER_CLK_CTRL){
+		aper = value;
+	}
+}
+
+/*
+ * <ns> of full-speed work, in one piece
+ */
+static void cost(u64 ns){
+	now += ns * factor;
+}
+
+static double expo(double mean_ns){
+	return -mean_ns * log1p(-drand48());
+}
+
+static u64 next_event(void){
+	u64 t = next_gate < next_tick ? next_gate : next_tick;
+
+	if (next_train < t)
+		t = next_train;
+	if (next_walk < t)
+		t = next_walk;
+	return t;
+}
+
+/*
+ * the handlers of every interrupt due by now
+ */
+static void run_due(void){
+	u64 edge, t;
+
+	if (in_irq)
+		return;
+	in_irq = true;
+	while ((t = next_event()) <= now){
+		if (next_train == t){			/* the earliest first, the train port ahead of a tie */
+			edge = next_train;
+			cost(PRE_NS);
+			power_boost();
+			if (crossing_train_edge(&crossing)){
+				cost(FAST_NS);
+				lat_sum += now - edge;
+				lat_max = now - edge > lat_max ? now - edge : lat_max;
+				lats++;
+			}
+			crossing_train(&crossing);
+			cost(CALLBACK_NS);
+			train_on = !train_on;
+			next_train = train_on ? edge + TRAIN_S * NS : edge + (u64) expo(scenario->train_min * 60e9);
+		} else if (next_gate == t){
+			cost(GATE_NS);
+			next_gate += GATE_PERIOD_NS;
+		} else if (next_tick == t){
+			crossing_tick(&crossing);
+			cost(TICK_NS);
+			next_tick += TICK_PERIOD_NS;
+		} else {
+			crossing_button(&crossing);
+			cost(CALLBACK_NS);
+			next_walk += (u64) expo(scenario->walk_min * 60e9);
+		}
+	}
+	in_irq = false;
+}
+
+static void unmasked(void){
+	run_due();
+}
+
+/* the core sleeps until the next interrupt */
+static void wait(void){
+	u64 t = next_event();
+
+	if (t > now)
+		now = t;
+	now += WFI_EXIT_NS;
+}
+
+/*
+ * <ns> of full-speed work, taking interrupts as they come
+ */
+static void busy(u64 ns){
+	u64 left = ns * factor, step, t;
+
+	while (left != 0){
+		t = next_event();
+		step = t > now && t - now < left ? t - now : left;
+		if (t <= now)
+			step = 0;
+		now += step;
+		left -= step;
+		run_due();
+	}
+}
+
+/* crossing outputs; the timers follow the clock */
+static void sim_signal(crossing_t *c, u32 aspect){ }
+static void sim_gate(crossing_t *c, s32 pos){ }
+static void sim_request(crossing_t *c, bool on){ }
+static s32 sim_wheel(crossing_t *c){ return 0; }
+static u32 sim_green(crossing_t *c){ return TRAFFIC_TMR; }
+static u32 sim_walk(crossing_t *c){ return PEDESTRIAN_TMR; }
+static u32 sim_yellow(crossing_t *c){ return LIGHT_TMR; }
+static u32 sim_hold(crossing_t *c){ return PEDESTRIAN_TMR; }
+static void sim_enter(crossing_t *c){ power_steady(c->state == TRAFFIC_ON); }
+static void sim_scaled(u32 slow){ cost(RESCALE_NS); }
+
+static const crossing_ops_t ops = {
+	sim_signal, sim_gate, sim_request, sim_wheel,
+	sim_green, sim_walk, sim_yellow, sim_hold, sim_enter
+};
+
+static void run(const scenario_t *s, u32 policy, power_stats_t *out){
+	u64 end, deadline;
+	XTime t;
+
+	scenario = s;
+	srand48(1);				/* the same day for each policy */
+	lat_sum = lat_max = lats = 0;
+	train_on = false;
+	next_gate = now + GATE_PERIOD_NS;
+	next_tick = now + TICK_PERIOD_NS;
+	next_train = now + (u64) expo(s->train_min * 60e9);
+	next_walk = s->walk_min > 0 ? now + (u64) expo(s->walk_min * 60e9) : ~0ull;
+	aper = APER_RESET;
+	crossing_init(&crossing, &ops);
+	power_init(policy == BUSY ? APER_RESET : POWER_APER_USED, sim_scaled);
+
+	end = now + (u64)(hours * 3600e9);
+	deadline = now;
+	while (now < end){
+		deadline += POLL_NS;
+		crossing_run(&crossing);
+		if (policy == SCALE)
+			power_poll();
+		busy(PASS_NS);
+		if (policy == BUSY){
+			if (deadline > now)
+				busy(deadline - now);
+		} else {
+			XTime_GetTime(&t);
+			power_idle(t + (deadline > now ? (deadline - now) * COUNTS_PER_SECOND / NS : 0));
+		}
+		if (deadline < now)
+			deadline = now;
+	}
+	power_stats(out);
+	power_steady(false);		/* full speed for the next run */
+}
+
+int main(int argc, char *argv[]){
+	scenario_t custom = { "custom", 10, 2 };
+	bool one = false;
+	power_stats_t p;
+	u64 total, base_mean = 0, uj[POLICIES];
+	u32 i, k, policy;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "h:t:w:")) != -1){
+		switch (opt){
+		case 'h': hours = atof(optarg); break;
+		case 't': custom.train_min = atof(optarg); one = true; break;
+		case 'w': custom.walk_min = atof(optarg); one = true; break;
+		default:
+			fprintf(stderr, "usage: %s [-h hours] [-t minutes between trains] [-w minutes between requests]\n", argv[0]);
+			return 1;
+		}
+	}
+	mock_reg_read = reg_read;
+	mock_reg_write = reg_write;
+	mock_unmask = unmasked;
+	mock_wfi = wait;
+	mock_xtime = timer;
+
+	printf("%.0f h per run; power by state %s mW, %u mW per peripheral clock\n", hours, "{run, wfi, slow, slow wfi}",
+			POWER_APER_MW);
+	printf("%-8s %-6s %6s %6s %6s %6s %9s %7s %6s %6s %12s %8s\n", "scenario", "policy", "run", "wfi", "slow",
+			"s.wfi", "energy", "power", "slows", "trains", "latency mean", "max");
+	for (i = 0; i < (one ? 1 : sizeof(scenarios) / sizeof(scenarios[0])); i++){
+		const scenario_t *s = one ? &custom : &scenarios[i];
+
+		for (policy = 0; policy < POLICIES; policy++){
+			run(s, policy, &p);
+			uj[policy] = p.uj;
+			if (policy == BUSY)
+				base_mean = lats ? lat_sum / lats : 0;
+			for (total = 0, k = 0; k < POWER_STATES; k++)
+				total += p.ns[k];
+			printf("%-8s %-6s", s->label, policies[policy]);
+			for (k = 0; k < POWER_STATES; k++)
+				printf(" %5.1f%%", 100.0 * p.ns[k] / total);
+			printf(" %7.0f J %5.0f mW %6lu %6lu %6.2f us %+5.2f %6.2f us\n", p.uj / 1e6,
+					p.uj * 1e6 / total, (unsigned long) p.slows, (unsigned long) lats,
+					(lats ? lat_sum / lats : 0) / 1e3, ((lats ? (double)(lat_sum / lats) : 0) - base_mean) / 1e3,
+					lat_max / 1e3);
+		}
+		printf("%-8s saves %.1f%% with wfi and clock gating, %.1f%% with scaling as well\n", s->label,
+				100.0 - 100.0 * uj[WFI] / uj[BUSY], 100.0 - 100.0 * uj[SCALE] / uj[BUSY]);
+	}
+	return 0;
+}
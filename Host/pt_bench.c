@@ -0,0 +1,246 @@
+/*
+ * pt_bench.c -- protothreads against threads for the crossing sequences
+ *
+ * Runs the same sequence, written as straight-line code with timed and
+ * event waits ("yellow for 3 ticks, wait for the train, hold 20 ticks"),
+ * as TASKS coroutines on Library/pt.h and as TASKS POSIX threads, each
+ * resumed once per tick by a scheduler loop, as the main loop does. A
+ * thread blocks on a semaphore at each wait and hands back on another,
+ * which is what a task switch costs on an RTOS as well. Each design
+ * reports the time per resume and the memory per task: the pt_t for a
+ * coroutine; for a thread, the stack it touched (its stack is filled with
+ * a pattern first; glibc keeps the thread's descriptor there too) against
+ * the stack it reserves, and RTOS_STACK words as the FreeRTOS build gives
+ * each task. Both designs must take the same steps; the exit status is 1
+ * if they do not.
+ *
+ * It then times crossing_run on Library/crossing.c itself over the same
+ * ticks, with trains, pedestrians and maintenance, as the firmware runs it.
+ *
+ * gcc -O2 -Wall -IHost/bsp -IHost -ILibrary -I. -o pt_bench Host/pt_bench.c \
+ *     Host/bsp/mock.c Library/crossing.c -lpthread
+ *
+ * usage: pt_bench [-t ticks]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+
+#include "pt.h"
+#include "config.h"
+#include "crossing.h"
+
+#define TASKS 8
+#define THREAD_STACK (64 * 1024)	/* reserved per thread; PTHREAD_STACK_MIN is the floor */
+#define FILL 0xA5
+#define RTOS_STACK_WORDS 1024		/* c.f. RTOS_STACK */
+#define RTOS_TCB 100				/* about, for a FreeRTOS task control block */
+
+static u32 now;					/* ticks */
+static volatile bool trains[TASKS];	/* the events the sequences wait on */
+static u32 steps[2][TASKS];		/* sequence steps taken, by design */
+
+static u64 now_ns(void){
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* the events: a train for task <i> every 50 + i ticks */
+static void events(void){
+	u32 i;
+
+	for (i = 0; i < TASKS; i++)
+		trains[i] = now % (50 + i) == 0 ? true : trains[i];
+}
+
+/*
+ * the sequence as a coroutine
+ */
+static pt_t pts[TASKS];
+
+static PT_THREAD(sequence(pt_t *pt, u32 i)){
+	PT_BEGIN(pt);
+	for(;;){
+		PT_AWAIT_TIMEOUT(pt, now, 3, false);		/* yellow */
+		steps[0][i]++;
+		PT_AWAIT_EVENT(pt, trains[i]);				/* red, gate down */
+		trains[i] = false;
+		steps[0][i]++;
+		PT_AWAIT_TIMEOUT(pt, now, 20, false);		/* after the train */
+		steps[0][i]++;
+	}
+	PT_END(pt);
+}
+
+/*
+ * the sequence as a thread
+ */
+typedef struct {
+	pthread_t thread;
+	sem_t go, done;
+	u32 i;
+	u8 *stack;
+} task_t;
+
+static task_t tasks[TASKS];
+static volatile bool stopping = false;
+
+/* hand back to the scheduler until it resumes this task */
+static void block(task_t *t){
+	sem_post(&t->done);
+	sem_wait(&t->go);
+	if (stopping)
+		pthread_exit(NULL);
+}
+
+static void *task_main(void *arg){
+	task_t *t = arg;
+	u32 deadline;
+
+	sem_wait(&t->go);
+	for(;;){
+		for (deadline = now + 3; (s32)(now - deadline) < 0; )
+			block(t);							/* yellow */
+		steps[1][t->i]++;
+		while (!trains[t->i])
+			block(t);							/* red, gate down */
+		trains[t->i] = false;
+		steps[1][t->i]++;
+		for (deadline = now + 20; (s32)(now - deadline) < 0; )
+			block(t);							/* after the train */
+		steps[1][t->i]++;
+	}
+	return NULL;
+}
+
+/* bytes of <t>'s stack written since it was filled */
+static u32 touched(const task_t *t){
+	u32 n;
+
+	for (n = 0; n < THREAD_STACK && t->stack[n] == FILL; n++)
+		;
+	return THREAD_STACK - n;		/* it grows down */
+}
+
+/* crossing outputs */
+static void sim_signal(crossing_t *c, u32 a){ }
+static void sim_gate(crossing_t *c, s32 pos){ }
+static void sim_request(crossing_t *c, bool on){ }
+static s32 sim_wheel(crossing_t *c){ return 0; }
+static u32 sim_green(crossing_t *c){ return TRAFFIC_TMR; }
+static u32 sim_walk(crossing_t *c){ return PEDESTRIAN_TMR; }
+static u32 sim_yellow(crossing_t *c){ return LIGHT_TMR; }
+static u32 sim_hold(crossing_t *c){ return PEDESTRIAN_TMR; }
+static void sim_enter(crossing_t *c){ }
+
+static const crossing_ops_t ops = {
+	sim_signal, sim_gate, sim_request, sim_wheel,
+	sim_green, sim_walk, sim_yellow, sim_hold, sim_enter
+};
+
+int main(int argc, char *argv[]){
+	static crossing_t crossing;
+	u32 ticks = 100000, i, t, max_stack = 0, mismatch = 0;
+	u64 t0, pt_ns, thread_ns, run_ns, runs;
+	pthread_attr_t attr;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:")) != -1){
+		switch (opt){
+		case 't': ticks = atoi(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-t ticks]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	/* coroutines */
+	for (i = 0; i < TASKS; i++)
+		PT_INIT(&pts[i]);
+	memset((void *) trains, 0, sizeof(trains));
+	t0 = now_ns();
+	for (now = 0; now < ticks; now++){
+		events();
+		for (i = 0; i < TASKS; i++)
+			sequence(&pts[i], i);
+	}
+	pt_ns = now_ns() - t0;
+
+	/* threads */
+	memset((void *) trains, 0, sizeof(trains));
+	pthread_attr_init(&attr);
+	for (i = 0; i < TASKS; i++){
+		tasks[i].i = i;
+		tasks[i].stack = malloc(THREAD_STACK);
+		if (tasks[i].stack == NULL){
+			perror("pt_bench");
+			return 2;
+		}
+		memset(tasks[i].stack, FILL, THREAD_STACK);
+		sem_init(&tasks[i].go, 0, 0);
+		sem_init(&tasks[i].done, 0, 0);
+		pthread_attr_setstack(&attr, tasks[i].stack, THREAD_STACK);
+		if (pthread_create(&tasks[i].thread, &attr, task_main, &tasks[i]) != 0){
+			perror("pt_bench");
+			return 2;
+		}
+	}
+	t0 = now_ns();
+	for (now = 0; now < ticks; now++){
+		events();
+		for (i = 0; i < TASKS; i++){
+			sem_post(&tasks[i].go);
+			sem_wait(&tasks[i].done);
+		}
+	}
+	thread_ns = now_ns() - t0;
+	stopping = true;
+	for (i = 0; i < TASKS; i++){
+		sem_post(&tasks[i].go);
+		pthread_join(tasks[i].thread, NULL);
+		t = touched(&tasks[i]);
+		max_stack = t > max_stack ? t : max_stack;
+		if (steps[0][i] != steps[1][i])
+			mismatch++;
+	}
+
+	printf("%u tasks, %u ticks, %u steps each\n", TASKS, ticks, steps[0][0]);
+	printf("%-12s %12s %14s %16s\n", "design", "ns/resume", "bytes/task", "reserved/task");
+	printf("%-12s %12.1f %14u %16u\n", "protothread", (double) pt_ns / ticks / TASKS, (unsigned) sizeof(pt_t),
+			(unsigned) sizeof(pt_t));
+	printf("%-12s %12.1f %14u %16u\n", "pthread", (double) thread_ns / ticks / TASKS, max_stack, THREAD_STACK);
+	printf("%-12s %12s %14s %16u\n", "freertos", "-", "-", RTOS_STACK_WORDS * 4 + RTOS_TCB);
+
+	/* the crossing's own sequences */
+	crossing_init(&crossing, &ops);
+	runs = 0;
+	t0 = now_ns();
+	for (now = 0; now < ticks; now++){
+		if (now % 3600 == 100 || now % 3600 == 160)
+			crossing_train(&crossing);		/* arrives, leaves */
+		if (now % 700 == 5)
+			crossing_button(&crossing);
+		if (now % 86400 == 40000 || now % 86400 == 40600)
+			crossing_key(&crossing);		/* maintenance on, off */
+		crossing_tick(&crossing);
+		crossing_run(&crossing);
+		runs++;
+	}
+	run_ns = now_ns() - t0;
+	printf("crossing_run: %.1f ns a pass, %u bytes of coroutine state (crossing_t %u)\n", (double) run_ns / runs,
+			(unsigned)(2 * sizeof(pt_t)), (unsigned) sizeof(crossing_t));
+
+	if (mismatch){
+		printf("%u tasks took different steps\n", mismatch);
+		return 1;
+	}
+	printf("both designs took the same steps\n");
+	return 0;
+}
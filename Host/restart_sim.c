@@ -0,0 +1,178 @@
+/*
+ * restart_sim.c -- warm restart test for the watchdog records
+ *
+ * Runs the controller's restart path (c.f. boot_early in Library/boot.c)
+ * against the mock drivers in a child process that then saves a new state
+ * as fast as it can, the way publish() does on every event. The parent kills the child at a random time, often in the
+ * middle of a save, and starts another one on the same shared page at the
+ * OCM address, which is what survives a watchdog reset on the board.
+ *
+ * Each restart checks that the restored record is self-consistent and is
+ * the last completed save or the one in progress, and reports the time
+ * from restart to safe outputs and the register writes it took. Boot rom
+ * and FSBL time is not included.
+ *
+ * gcc -O2 -Wall -IHost/bsp -IHost -ILibrary -I. -o restart_sim Host/restart_sim.c \
+ *     Host/bsp/mock.c Library/watchdog.c Library/led.c Library/servo.c
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "config.h"
+#include "crossing.h"
+#include "led.h"
+#include "servo.h"
+#include "watchdog.h"
+
+#define REBOOT_WDT 0x00070000	/* c.f. watchdog.c */
+#define PAGE 4096
+
+typedef struct {
+	volatile s32 done;		/* last completed save */
+	volatile int ready;		/* child has reported its restart */
+	volatile int warm;
+	volatile int consistent;
+	volatile s32 restored;
+	volatile u64 ns;		/* restart to safe outputs */
+	volatile u64 writes;	/* register writes on the way */
+} shared_t;
+
+/* the drivers read the configuration; the host has no flash to load it from */
+static const config_t defaults = {
+	TRAFFIC_TMR, PEDESTRIAN_TMR, LIGHT_TMR, FREQ, ID,
+	(u32)(MAXDUTY * 1000000), (u32)(MINDUTY * 1000000), POT_SCALE, 0, MARGIN_MS
+};
+const config_t * volatile config = &defaults;
+
+static shared_t *shared;
+
+static u64 now_ns(void){
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*
+ * the state saved as the <n>th; every field follows from the count in gate
+ */
+static void state_of(s32 n, watchdog_state_t *s){
+	memset(s, 0, sizeof(*s));
+	s->state = n % CROSSING_STATES;
+	s->traincoming = n >> 1 & 1;
+	s->prewarned = s->traincoming && (n >> 2 & 1);
+	s->keyflag = n >> 3 & 1;
+	s->btnpressed = n >> 4 & 1;
+	s->gate = n;
+}
+
+/*
+ * one life of the controller: restart, then save until killed
+ */
+static void child(int first){
+	watchdog_state_t last, expect;
+	u64 start;
+	s32 n = 0;
+
+	mock_reg_in = first ? 0 : REBOOT_WDT;
+	mmio_writes = 0;
+	start = now_ns();
+	shared->warm = watchdog_init(&last);
+	if (shared->warm){
+		led_init();
+		led_set(RED, LED_ON);
+		servo_init();
+		servo_set_pos(last.traincoming ? CROSSING_CLOSED : (u32) last.gate & (CROSSING_CLOSED - 1));
+	}
+	shared->ns = now_ns() - start;
+	shared->writes = mmio_writes;
+
+	if (shared->warm){
+		state_of(last.gate, &expect);
+		shared->restored = last.gate;
+		shared->consistent = memcmp(&last, &expect, sizeof(last)) == 0 &&
+				(last.gate == shared->done || last.gate == shared->done + 1);
+		n = last.gate + 1;
+	}
+	shared->ready = 1;
+
+	for(;;){
+		watchdog_state_t s;
+
+		state_of(n, &s);
+		watchdog_save(&s);
+		shared->done = n++;
+	}
+}
+
+static int compare(const void *a, const void *b){
+	u64 x = *(const u64 *) a, y = *(const u64 *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+int main(int argc, char *argv[]){
+	int restarts = 1000, maxus = 2000, opt, i, warm = 0, consistent = 0;
+	u64 *ns, sum = 0, writes = 0;
+	void *ocm;
+
+	while ((opt = getopt(argc, argv, "n:u:")) != -1){
+		switch (opt){
+		case 'n': restarts = atoi(optarg); break;
+		case 'u': maxus = atoi(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-n restarts] [-u max us before the kill]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	ocm = mmap((void *)(UINTPTR) WATCHDOG_OCM_ADDR, PAGE, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+	shared = mmap(NULL, PAGE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	ns = calloc(restarts, sizeof(*ns));
+	if (ocm != (void *)(UINTPTR) WATCHDOG_OCM_ADDR || shared == MAP_FAILED || ns == NULL){
+		perror("restart_sim");
+		return 1;
+	}
+	srand(1);
+	shared->done = -1;
+
+	for (i = 0; i <= restarts; i++){
+		pid_t pid;
+
+		shared->ready = 0;
+		if ((pid = fork()) == 0)
+			child(i == 0);
+		while (!shared->ready)
+			;
+		usleep(rand() % maxus);
+		kill(pid, SIGKILL);
+		waitpid(pid, NULL, 0);
+		if (i == 0)
+			continue;	/* the cold boot */
+
+		ns[i - 1] = shared->ns;
+		sum += shared->ns;
+		writes += shared->writes;
+		warm += shared->warm;
+		consistent += shared->warm && shared->consistent;
+		if (shared->warm && !shared->consistent)
+			printf("restart %d: restored save %d, last completed %d\n", i, shared->restored, shared->done);
+	}
+
+	qsort(ns, restarts, sizeof(*ns), compare);
+	printf("restarts %d, warm %d, consistent %d (%.1f%%), last save %d\n", restarts, warm, consistent,
+			100.0 * consistent / restarts, shared->done);
+	printf("restart to safe outputs: min %.2f avg %.2f max %.2f p99 %.2f us, %.1f register writes\n",
+			ns[0] / 1000.0, sum / 1000.0 / restarts, ns[restarts - 1] / 1000.0,
+			ns[restarts * 99 / 100] / 1000.0, (double) writes / restarts);
+	return consistent == restarts ? 0 : 1;
+}
@@ -0,0 +1,461 @@
+/*
+ * rtos_bench.c -- bare-metal against FreeRTOS: interrupt to actuation, cpu
+ *
+ * Runs Library/crossing.c in virtual time on one simulated core, arranged
+ * as each build arranges it (c.f. railwayCrossing.c), over the same hour
+ * of ttc ticks, trains, button presses and maintenance, with each edge
+ * landing anywhere in the main loop period.
+ *
+ * bare-metal: the handlers raise flags and the main loop runs crossing_run
+ * at the top of each pass, then comms_poll and telemetry_poll, and idles
+ * for POLL_US after it is done.
+ *
+ * FreeRTOS: the handlers also notify the control task, which preempts the
+ * comms and telemetry tasks; those two are released every POLL_US by the
+ * kernel tick. Each change of task costs SWITCH_NS and each kernel tick
+ * TICK_NS.
+ *
+ * Interrupts preempt either, train port first. The train fast path
+ * commands red and the gate from its handler in both builds. Any other
+ * light, gate or request lamp command is made by crossing_run; its latency
+ * is from the last edge handled before that run to the end of the run.
+ * For each build and comms load it reports those latencies by source, the
+ * cpu busy and the part of it spent in the kernel. The exit status is 1
+ * if the FreeRTOS build is not ahead at the 99th percentile for every
+ * source the control task serves.
+ *
+ * The costs are estimates for the 667 MHz Cortex-A9; -s and -k take the
+ * switch and tick costs measured on the target.
+ *
+ * gcc -O2 -Wall -IHost/bsp -IHost -ILibrary -I. -o rtos_bench Host/rtos_bench.c \
+ *     Host/bsp/mock.c Library/crossing.c
+ *
+ * usage: rtos_bench [-d seconds] [-s switch ns] [-k tick ns]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "config.h"
+#include "crossing.h"
+
+#define NS 1000000000ull
+#define POLL_NS 100000000ull	/* main loop period (c.f. POLL_US) */
+#define TTC_NS (NS / FREQ)		/* sequence clock */
+#define KTICK_NS 1000000ull		/* kernel tick (configTICK_RATE_HZ 1000) */
+#define ENTRY_NS 1000ull		/* interrupt entry and exit */
+#define FAST_NS 500ull			/* fast path: the gate and one register write */
+#define HANDLER_NS 20000ull		/* switch callback, publish and printf */
+#define TTC_CB_NS 3000ull		/* ttc callback */
+#define RUN_NS 5000ull			/* crossing_run, blocked again at once */
+#define ACT_NS 10000ull			/* each light, gate or lamp command it makes */
+#define TELEMETRY_NS 500000ull	/* telemetry_poll */
+#define TRAIN_NS (180 * NS)		/* between trains */
+#define TRAIN_IN_NS (25 * NS)	/* arrival to leaving */
+#define BTN_NS (37 * NS)		/* between presses */
+#define KEY_NS (900 * NS)		/* between maintenance visits */
+#define KEY_IN_NS (60 * NS)		/* maintenance on to off */
+
+/* interrupt sources, by priority */
+enum { SRC_TRAIN, SRC_KEY, SRC_BTN, SRC_TTC, SRC_KTICK, SOURCES, SRC_FAST = SOURCES, KINDS };
+
+static const char *kinds[KINDS] = { "train", "key", "button", "ttc", "-", "train fast" };
+
+/* work */
+enum { W_RUN, W_COMMS, W_TELEMETRY };
+
+typedef struct {
+	const char *name;
+	u8 work[3];					/* stages of one pass */
+	u32 stages;
+	bool periodic;				/* released every POLL_NS; else by notification */
+	u32 stage;
+	bool ready;
+	bool notified;
+	u64 left;					/* work left in this stage, 0 before it starts */
+	u64 release;
+	u64 busy;
+} task_t;
+
+typedef struct {
+	u64 *ns;
+	u32 n;
+} samples_t;
+
+typedef struct {				/* one build and load */
+	samples_t lat[KINDS];
+	u64 isr_ns;
+	u64 kernel_ns;				/* kernel ticks and task switches */
+	u64 busy_ns;
+	u32 switches;
+	u32 entered;				/* states */
+} result_t;
+
+static u64 now;
+static u64 end;
+static u64 comms_ns;
+static u64 switch_ns = 2000;	/* about, for a FreeRTOS context switch */
+static u64 tick_ns = 1500;		/* about, for the tick interrupt */
+static bool rtos;
+static crossing_t crossing;
+static result_t *result;
+static task_t tasks[3];
+static u32 ntasks;
+static task_t *current;			/* NULL when idle */
+static u64 next[SOURCES];		/* next edge of each source */
+static bool on[SOURCES];		/* train present, maintenance on */
+static u64 cause;				/* last edge handled since crossing_run, 0 if none */
+static u32 cause_kind;
+static bool in_run;
+static u32 acts;				/* commands made by the current run */
+static u64 seed;
+
+static u64 random64(void){
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return seed;
+}
+
+static void sample(u32 kind, u64 ns){
+	samples_t *s = &result->lat[kind];
+
+	s->ns = realloc(s->ns, (s->n + 1) * sizeof(u64));
+	if (s->ns == NULL){
+		perror("rtos_bench");
+		exit(2);
+	}
+	s->ns[s->n++] = ns;
+}
+
+/* crossing outputs: the commands a run makes are its actuations */
+static void sim_command(void){
+	if (in_run)
+		acts++;
+}
+
+static void sim_signal(crossing_t *c, u32 a){ sim_command(); }
+static void sim_gate(crossing_t *c, s32 pos){ sim_command(); }
+static void sim_request(crossing_t *c, bool lamp){ sim_command(); }
+static s32 sim_wheel(crossing_t *c){ return CROSSING_CLOSED; }
+static u32 sim_green(crossing_t *c){ return TRAFFIC_TMR; }
+static u32 sim_walk(crossing_t *c){ return PEDESTRIAN_TMR; }
+static u32 sim_yellow(crossing_t *c){ return LIGHT_TMR; }
+static u32 sim_hold(crossing_t *c){ return PEDESTRIAN_TMR; }
+
+static void sim_enter(crossing_t *c){
+	result->entered++;
+}
+
+static const crossing_ops_t ops = {
+	sim_signal, sim_gate, sim_request, sim_wheel,
+	sim_green, sim_walk, sim_yellow, sim_hold, sim_enter
+};
+
+/*
+ * wake the control task (c.f. wake in railwayCrossing.c)
+ */
+static void notify(void){
+	if (!rtos)
+		return;
+	if (tasks[0].ready)
+		tasks[0].notified = true;	/* runs again when this pass is done */
+	tasks[0].ready = true;
+}
+
+/*
+ * the handler of <src>, for its edge at <edge>; returns its cost
+ */
+static u64 handle(u32 src, u64 edge){
+	u32 i;
+
+	switch (src){
+	case SRC_TRAIN:
+		if (crossing_train_edge(&crossing))
+			sample(SRC_FAST, now + ENTRY_NS + FAST_NS - edge);
+		crossing_train(&crossing);
+		break;
+	case SRC_KEY:
+		crossing_key(&crossing);
+		break;
+	case SRC_BTN:
+		crossing_button(&crossing);
+		break;
+	case SRC_TTC:
+		crossing_tick(&crossing);
+		break;
+	case SRC_KTICK:
+		for (i = 0; i < ntasks; i++){
+			if (tasks[i].periodic && !tasks[i].ready && tasks[i].release <= edge)
+				tasks[i].ready = true;
+		}
+		return tick_ns;
+	}
+	cause = edge;
+	cause_kind = src;
+	notify();
+	return ENTRY_NS + (src == SRC_TTC ? TTC_CB_NS : HANDLER_NS);
+}
+
+/*
+ * schedule the edge after the one at <edge> of <src>
+ */
+static void reschedule(u32 src, u64 edge){
+	switch (src){
+	case SRC_TRAIN:
+		on[src] = !on[src];
+		next[src] = edge + (on[src] ? TRAIN_IN_NS : TRAIN_NS - TRAIN_IN_NS);
+		break;
+	case SRC_KEY:
+		on[src] = !on[src];
+		next[src] = edge + (on[src] ? KEY_IN_NS : KEY_NS - KEY_IN_NS);
+		break;
+	case SRC_BTN:
+		next[src] = edge + BTN_NS + random64() % POLL_NS;
+		break;
+	case SRC_TTC:
+		next[src] = edge + TTC_NS;
+		break;
+	case SRC_KTICK:
+		next[src] = rtos ? edge + KTICK_NS : ~0ull;
+		break;
+	}
+}
+
+/*
+ * the interrupt the core would take now, or SOURCES
+ */
+static u32 taken(void){
+	u32 src;
+
+	for (src = 0; src < SOURCES; src++){
+		if (next[src] <= now)
+			return src;
+	}
+	return SOURCES;
+}
+
+static u64 next_edge(void){
+	u64 t = end;
+	u32 src;
+
+	for (src = 0; src < SOURCES; src++)
+		t = next[src] < t ? next[src] : t;
+	return t;
+}
+
+/*
+ * the task to run: the first ready, by priority
+ */
+static task_t *pick(void){
+	u32 i;
+
+	for (i = 0; i < ntasks; i++){
+		if (!rtos && !tasks[i].ready && tasks[i].release <= now)
+			tasks[i].ready = true;		/* power_idle returns */
+		if (tasks[i].ready)
+			return &tasks[i];
+	}
+	return NULL;
+}
+
+/*
+ * start the stage <t> is at
+ */
+static void begin(task_t *t){
+	switch (t->work[t->stage]){
+	case W_RUN:
+		acts = 0;
+		in_run = true;
+		crossing_run(&crossing);
+		in_run = false;
+		t->left = RUN_NS + acts * ACT_NS;
+		break;
+	case W_COMMS:
+		t->left = comms_ns;
+		break;
+	case W_TELEMETRY:
+		t->left = TELEMETRY_NS;
+		break;
+	}
+}
+
+/*
+ * <t>'s stage is done: the next, or block
+ */
+static void finish(task_t *t){
+	if (t->work[t->stage] == W_RUN){
+		if (acts != 0 && cause != 0)
+			sample(cause_kind, now - cause);
+		cause = 0;
+	}
+	if (++t->stage < t->stages)
+		return;
+	t->stage = 0;
+	if (t->periodic){
+		t->ready = false;
+		t->release = rtos ? t->release + POLL_NS : now + POLL_NS;	/* vTaskDelayUntil, or power_idle */
+	} else {
+		t->ready = t->notified;		/* ulTaskNotifyTake */
+		t->notified = false;
+	}
+}
+
+/*
+ * one build for <ns> with <comms> ns of comms_poll a pass
+ */
+static void run(bool with_rtos, u64 comms, u64 ns, result_t *r){
+	static const task_t bare[] = {
+		{ "main", { W_RUN, W_COMMS, W_TELEMETRY }, 3, true },
+	};
+	static const task_t threads[] = {
+		{ "control",   { W_RUN },       1, false },
+		{ "comms",     { W_COMMS },     1, true },
+		{ "telemetry", { W_TELEMETRY }, 1, true },
+	};
+	u64 cost, step, until;
+	u32 src, i;
+	task_t *t;
+
+	rtos = with_rtos;
+	comms_ns = comms;
+	result = r;
+	memset(r, 0, sizeof(*r));
+	ntasks = rtos ? 3 : 1;
+	memcpy(tasks, rtos ? threads : bare, ntasks * sizeof(task_t));
+	for (i = 0; i < ntasks; i++)
+		tasks[i].ready = true;
+	current = NULL;
+	cause = 0;
+	crossing_init(&crossing, &ops);
+
+	/* the same edges for every run, landing anywhere in a pass */
+	seed = 0x9E3779B97F4A7C15ull;
+	now = 0;
+	end = ns;
+	memset(on, 0, sizeof(on));
+	next[SRC_TRAIN] = 60 * NS + random64() % POLL_NS;
+	next[SRC_KEY] = 500 * NS + random64() % POLL_NS;
+	next[SRC_BTN] = 5 * NS + random64() % POLL_NS;
+	next[SRC_TTC] = random64() % POLL_NS;
+	next[SRC_KTICK] = rtos ? 0 : ~0ull;
+
+	while (now < end){
+		/* interrupts first */
+		if ((src = taken()) != SOURCES){
+			cost = handle(src, next[src]);
+			reschedule(src, next[src]);
+			now += cost;
+			r->isr_ns += cost;
+			if (src == SRC_KTICK)
+				r->kernel_ns += cost;
+			continue;
+		}
+
+		/* a change of task */
+		t = pick();
+		if (rtos && t != current){
+			now += switch_ns;
+			r->kernel_ns += switch_ns;
+			r->switches++;
+		}
+		current = t;
+		if (t == NULL){
+			until = next_edge();
+			if (!rtos && tasks[0].release < until)
+				until = tasks[0].release;
+			now = until > now ? until : now;
+			continue;
+		}
+
+		/* run it up to the next edge */
+		if (t->left == 0)
+			begin(t);
+		until = next_edge();
+		step = until > now ? until - now : 0;
+		step = t->left < step ? t->left : step;
+		now += step;
+		t->left -= step;
+		t->busy += step;
+		if (t->left == 0)
+			finish(t);
+	}
+	for (i = 0; i < ntasks; i++)
+		r->busy_ns += tasks[i].busy;
+	r->busy_ns += r->isr_ns + (u64) r->switches * switch_ns;
+}
+
+static int compare(const void *a, const void *b){
+	u64 x = *(const u64 *) a, y = *(const u64 *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+int main(int argc, char *argv[]){
+	static const u64 loads[] = { 2000000ull, 30000000ull };	/* comms_poll a pass: light, a flash write */
+	static result_t results[2][2];
+	u64 seconds = 3600;
+	u32 b, l, k, behind = 0;
+	samples_t *s, *p;
+	result_t *r;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "d:s:k:")) != -1){
+		switch (opt){
+		case 'd': seconds = atoi(optarg); break;
+		case 's': switch_ns = atoi(optarg); break;
+		case 'k': tick_ns = atoi(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-d seconds] [-s switch ns] [-k tick ns]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	printf("%lu s, ttc %u Hz, main loop %lu ms; kernel tick %lu Hz at %lu ns, task switch %lu ns\n",
+			(unsigned long) seconds, FREQ, (unsigned long)(POLL_NS / 1000000), (unsigned long)(NS / KTICK_NS),
+			(unsigned long) tick_ns, (unsigned long) switch_ns);
+	printf("%-9s %8s %-11s %6s %10s %10s %10s\n", "build", "comms ms", "source", "n", "p50 us", "p99 us", "max us");
+	for (b = 0; b < 2; b++){
+		for (l = 0; l < 2; l++){
+			r = &results[b][l];
+			run(b == 1, loads[l], seconds * NS, r);
+			for (k = 0; k < KINDS; k++){
+				s = &r->lat[k];
+				if (s->n == 0)
+					continue;
+				qsort(s->ns, s->n, sizeof(u64), compare);
+				printf("%-9s %8lu %-11s %6u %10.1f %10.1f %10.1f\n", b ? "freertos" : "bare", (unsigned long)(loads[l] / 1000000),
+						kinds[k], s->n, s->ns[s->n / 2] / 1e3, s->ns[s->n * 99 / 100] / 1e3, s->ns[s->n - 1] / 1e3);
+			}
+		}
+	}
+
+	printf("\n%-9s %8s %8s %10s %12s %7s\n", "build", "comms ms", "cpu %", "kernel %", "switches/s", "states");
+	for (b = 0; b < 2; b++){
+		for (l = 0; l < 2; l++){
+			r = &results[b][l];
+			printf("%-9s %8lu %8.2f %10.3f %12.1f %7u\n", b ? "freertos" : "bare", (unsigned long)(loads[l] / 1000000),
+					100.0 * r->busy_ns / (seconds * NS), 100.0 * r->kernel_ns / (seconds * NS),
+					(double) r->switches / seconds, r->entered);
+		}
+	}
+
+	/* the control task against the main loop */
+	for (l = 0; l < 2; l++){
+		for (k = 0; k < SRC_KTICK; k++){
+			s = &results[0][l].lat[k];
+			p = &results[1][l].lat[k];
+			if (s->n != 0 && p->n != 0 && p->ns[p->n * 99 / 100] >= s->ns[s->n * 99 / 100])
+				behind++;
+		}
+	}
+
+	if (behind){
+		printf("freertos behind at p99 for %u sources\n", behind);
+		return 1;
+	}
+	printf("freertos ahead at p99 for every source the control task serves\n");
+	return 0;
+}
@@ -0,0 +1,147 @@
+/*
+ * snapshot_bench.c -- seqlock throughput and torn read check
+ *
+ * Runs Library/snapshot.c with one writer thread publishing as fast as it
+ * can and reader threads copying the record in a loop, as the controller
+ * and the telemetry, console and substation handlers do. The writer takes
+ * the mock IRQ mask as on the target; the readers take nothing.
+ *
+ * Every field of the n'th record is derived from n, and its version is n,
+ * so a reader can tell a copy made up of two publishes from a whole one.
+ * Versions must also never go backwards for a reader. The tool reports
+ * publishes and reads per second and the retries the seqlock took, and
+ * exits 1 on any torn or stale snapshot.
+ *
+ * gcc -O2 -Wall -IHost/bsp -IHost -ILibrary -I. -o snapshot_bench Host/snapshot_bench.c \
+ *     Host/bsp/mock.c Library/snapshot.c -lpthread
+ *
+ * usage: snapshot_bench [-d seconds] [-r readers]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+
+#define READERS_MAX 16
+
+typedef struct {
+	pthread_t thread;
+	u64 reads;
+	u64 torn;
+	u64 stale;
+} reader_t;
+
+static volatile int running = 1;
+static volatile u64 publishes = 0;
+
+/*
+ * the n'th record; every field depends on n
+ */
+static void pattern(snapshot_t *s, u32 n){
+	s->state = n;
+	s->mode = n >> 8;
+	s->traincoming = n >> 16;
+	s->keyflag = n >> 24;
+	s->btnpressed = ~n;
+	s->pedcrossed = ~n >> 8;
+	s->link = n * 7;
+	s->health = n * 13;
+	s->timercnt = (int) n;
+	s->gate = (s32) ~n;
+}
+
+static bool whole(const snapshot_t *s){
+	snapshot_t want;
+
+	pattern(&want, s->version);
+	return s->state == want.state && s->mode == want.mode && s->traincoming == want.traincoming &&
+			s->keyflag == want.keyflag && s->btnpressed == want.btnpressed &&
+			s->pedcrossed == want.pedcrossed && s->link == want.link && s->health == want.health &&
+			s->timercnt == want.timercnt && s->gate == want.gate;
+}
+
+static void *writer_main(void *arg){
+	snapshot_t s;
+	u32 n;
+
+	for (n = 1; running; n++){
+		pattern(&s, n);		/* the store numbers it n as well */
+		snapshot_publish(&s);
+	}
+	publishes = n - 1;
+	return NULL;
+}
+
+static void *reader_main(void *arg){
+	reader_t *r = arg;
+	snapshot_t s;
+	u32 last = 0;
+
+	while (running){
+		snapshot_read(&s);
+		r->reads++;
+		if (s.version == 0)
+			continue;		/* nothing published yet */
+		if (!whole(&s))
+			r->torn++;
+		if (s.version < last)
+			r->stale++;
+		last = s.version;
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[]){
+	reader_t readers[READERS_MAX] = { { 0 } };
+	double seconds = 2.0;
+	u32 nreaders = 2, i;
+	u64 reads = 0, torn = 0, stale = 0;
+	pthread_t writer;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "d:r:")) != -1){
+		switch (opt){
+		case 'd': seconds = atof(optarg); break;
+		case 'r': nreaders = atoi(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-d seconds] [-r readers]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (nreaders < 1 || nreaders > READERS_MAX){
+		fprintf(stderr, "%s: 1 to %d readers\n", argv[0], READERS_MAX);
+		return 2;
+	}
+
+	for (i = 0; i < nreaders; i++)
+		pthread_create(&readers[i].thread, NULL, reader_main, &readers[i]);
+	pthread_create(&writer, NULL, writer_main, NULL);
+	usleep((useconds_t)(seconds * 1e6));
+	running = 0;
+	pthread_join(writer, NULL);
+	for (i = 0; i < nreaders; i++){
+		pthread_join(readers[i].thread, NULL);
+		reads += readers[i].reads;
+		torn += readers[i].torn;
+		stale += readers[i].stale;
+	}
+
+	printf("1 writer, %u readers, %.1f s\n", nreaders, seconds);
+	printf("publishes %12.0f /s\n", publishes / seconds);
+	printf("reads     %12.0f /s  (%.0f per reader)\n", reads / seconds, reads / seconds / nreaders);
+	printf("retries   %12lu      (%.3f%% of reads)\n", (unsigned long) snapshot_retries(),
+			reads ? 100.0 * snapshot_retries() / reads : 0);
+	printf("torn      %12lu\nstale     %12lu\n", (unsigned long) torn, (unsigned long) stale);
+	if (torn || stale){
+		printf("FAIL: inconsistent snapshots\n");
+		return 1;
+	}
+	printf("every snapshot whole and in order\n");
+	return 0;
+}
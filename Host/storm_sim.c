@@ -0,0 +1,249 @@
+/*
+ * storm_sim.c -- interrupt storms against the gic budgets
+ *
+ * Runs Library/io.c and Library/gic.c in virtual time on one simulated
+ * core. A source's edge latches it pending at the mock GIC (an edge on a
+ * source still pending merges with it, as on the real line); while it is
+ * enabled the core takes it at once, preempting the control loop, train
+ * port first, and runs its handler through gic_dispatch. A handler costs
+ * ENTRY_NS, plus callback_ns for each switch callback it makes, which
+ * stand in for change_state and the printf behind it.
+ *
+ * The control loop needs WORK_NS of the core every 1 ms pass, and every
+ * POLL_NS it also calls gic_poll, as the main loop does. A pass that is
+ * held up by interrupts finishes late; the next one starts when it is
+ * done. One still running when a phase ends counts as late by then. A train edge every 20 ms measures the time from the edge to the
+ * train callback.
+ *
+ * Each phase (idle, a chattering button, a chattering maintenance key on
+ * the train's switch port) runs with the budgets off and then on, and
+ * reports how late the control loop passes finish, the core spent in
+ * handlers, the train latency, the callbacks that got through, and the
+ * storms and polled runs.
+ *
+ * gcc -O2 -Wall -IHost/bsp -IHost -ILibrary -I. -o storm_sim Host/storm_sim.c \
+ *     Host/bsp/mock.c Library/io.c Library/gic.c
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "gic.h"
+#include "io.h"
+#include "xtime_l.h"
+
+#define LOOP_NS 1000000ull		/* control loop period */
+#define WORK_NS 200000ull		/* its work per pass */
+#define POLL_NS 100000000ull	/* main loop period (c.f. POLL_US) */
+#define POLL_COST_NS 2000ull	/* gic_poll, before any handler it runs */
+#define ENTRY_NS 1000ull		/* interrupt entry, handler and exit */
+#define TRAIN_NS 20000000ull	/* between train edges */
+#define KEY_SW 0x2				/* maintenance key switch bit */
+#define PHASE_NS 2000000000ull
+#define SAMPLES (PHASE_NS / LOOP_NS + 1)
+#define NS 1000000000ull
+
+typedef struct {
+	const char *label;
+	u32 flood;					/* interrupt id chattering, or 0 */
+} phase_t;
+
+static const phase_t phases[] = {
+	{ "idle",   0 },
+	{ "button", XPAR_FABRIC_GPIO_1_VEC_ID },
+	{ "key",    XPAR_FABRIC_GPIO_2_VEC_ID },
+};
+
+#define PHASES (sizeof(phases) / sizeof(phases[0]))
+
+typedef struct {				/* one phase's measurements */
+	u64 late[SAMPLES];			/* pass end after its deadline */
+	u32 passes;
+	u64 behind;					/* the pass still running at the end, so far */
+	u64 isr_ns;					/* core in handlers */
+	u64 train_max;				/* edge to train callback */
+	u32 trains;
+	u32 btns;					/* callbacks that got through */
+	u32 sws;
+} result_t;
+
+static result_t *result;
+static u64 now = 0;				/* virtual ns */
+static u64 charge;				/* cost of the code running now */
+static u64 train_edge = 0;
+static u64 rate = 50000;		/* flood edges per second */
+static u64 callback_ns = 20000;	/* cost of a switch callback */
+
+static u64 counts(void){
+	return now / NS * COUNTS_PER_SECOND + now % NS * COUNTS_PER_SECOND / NS;
+}
+
+/* callbacks */
+static void btn_callback(u32 btn){
+	result->btns++;
+	charge += callback_ns;
+}
+
+static void sw_callback(u32 sw){
+	result->sws++;
+	charge += callback_ns;
+}
+
+static void train_callback(u64 entry){
+	u64 at = now + charge;
+
+	if (train_edge != 0){
+		if (at - train_edge > result->train_max)
+			result->train_max = at - train_edge;
+		result->trains++;
+		train_edge = 0;
+	}
+}
+
+/*
+ * the next interrupt the core would take, or 0
+ */
+static u32 taken(void){
+	static const u32 ids[] = { XPAR_FABRIC_GPIO_2_VEC_ID, XPAR_FABRIC_GPIO_1_VEC_ID };	/* by priority */
+	u32 i;
+
+	for (i = 0; i < 2; i++){
+		if (mock_gic_enabled[ids[i]] && mock_gic_pending[ids[i]])
+			return ids[i];
+	}
+	return 0;
+}
+
+/*
+ * one phase of <ns> with <flood> chattering
+ */
+static void run(u32 flood, u64 ns, result_t *r){
+	static u64 next_train = TRAIN_NS, next_pass = LOOP_NS, deadline, left = 0;	/* across phases */
+	u64 end = now + ns, period = NS / rate, next_flood = now, step, next;
+	u32 id;
+
+	result = r;
+	while (now < end){
+		/* edges up to now */
+		while (next_train <= now){
+			mock_gpio_in[XPAR_AXI_GPIO_2_DEVICE_ID] ^= IO_TRAIN_SW;
+			mock_gic_pending[XPAR_FABRIC_GPIO_2_VEC_ID] = 1;
+			train_edge = next_train;
+			next_train += TRAIN_NS;
+		}
+		while (flood != 0 && next_flood <= now){
+			if (flood == XPAR_FABRIC_GPIO_1_VEC_ID)
+				mock_gpio_in[XPAR_AXI_GPIO_1_DEVICE_ID] ^= 0x1;
+			else
+				mock_gpio_in[XPAR_AXI_GPIO_2_DEVICE_ID] ^= KEY_SW;
+			mock_gic_pending[flood] = 1;
+			next_flood += period;
+		}
+
+		/* interrupts first */
+		if ((id = taken()) != 0){
+			mock_gic_pending[id] = 0;		/* acknowledged */
+			charge = ENTRY_NS;
+			gic_dispatch(id);
+			now += charge;
+			r->isr_ns += charge;
+			continue;
+		}
+
+		/* a control loop pass starts at its deadline, or when the last is done */
+		if (left == 0 && now >= next_pass){
+			deadline = next_pass;
+			next_pass += LOOP_NS;
+			left = WORK_NS;
+			if (deadline % POLL_NS == 0){
+				charge = POLL_COST_NS;
+				gic_poll();
+				left += charge;
+			}
+		}
+
+		/* run it, or idle, up to the next edge */
+		next = next_train < end ? next_train : end;
+		if (flood != 0 && next_flood < next)
+			next = next_flood;
+		if (left != 0){
+			step = left < next - now ? left : next - now;
+			left -= step;
+			now += step;
+			if (left == 0 && r->passes < SAMPLES)
+				r->late[r->passes++] = now - deadline;
+		} else {
+			now = next_pass < next ? next_pass : next;
+		}
+	}
+	r->behind = left != 0 ? now - deadline : now > next_pass ? now - next_pass : 0;
+}
+
+static int compare(const void *a, const void *b){
+	u64 x = *(const u64 *) a, y = *(const u64 *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+int main(int argc, char *argv[]){
+	static result_t results[2][PHASES], calm;
+	gic_source_t src[GIC_SOURCES];
+	u32 limits, p, i, n, storms, polled;
+	result_t *r;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "c:r:")) != -1){
+		switch (opt){
+		case 'c': callback_ns = atoi(optarg) * 1000ull; break;
+		case 'r': rate = atoi(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-r flood edges/s] [-c callback us]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	mock_xtime = counts;
+	result = &calm;
+	gic_init();
+	io_btn_init(btn_callback);
+	io_sw_init(sw_callback);
+	io_train_init(train_callback);
+
+	printf("flood %lu edges/s, callbacks %lu us, control loop %lu us every %lu us, budgets %u/%u per %u ms\n",
+			(unsigned long) rate, (unsigned long)(callback_ns / 1000), (unsigned long)(WORK_NS / 1000),
+			(unsigned long)(LOOP_NS / 1000), IO_BTN_BUDGET, IO_SW_BUDGET, GIC_WINDOW_MS);
+	printf("%-7s %-7s %6s %29s %6s %10s %6s %6s %6s %6s %6s\n", "budgets", "flood", "passes", "late p50/p99/max",
+			"isr", "train max", "trains", "btns", "sws", "storms", "polled");
+	for (limits = 0; limits < 2; limits++){
+		gic_limit(XPAR_FABRIC_GPIO_1_VEC_ID, limits ? IO_BTN_BUDGET : 0, false);
+		gic_limit(XPAR_FABRIC_GPIO_2_VEC_ID, limits ? IO_SW_BUDGET : 0, true);
+		for (p = 0; p < PHASES; p++){
+			n = gic_sources(src, GIC_SOURCES);
+			for (storms = polled = i = 0; i < n; i++){
+				storms -= src[i].storms;
+				polled -= src[i].polled;
+			}
+			r = &results[limits][p];
+			run(phases[p].flood, PHASE_NS, r);
+			run(0, POLL_NS * (GIC_CALM + 2), &calm);	/* the storm ends */
+			n = gic_sources(src, GIC_SOURCES);
+			for (i = 0; i < n; i++){
+				storms += src[i].storms;
+				polled += src[i].polled;
+			}
+
+			r->late[r->passes++] = r->behind;
+			qsort(r->late, r->passes, sizeof(u64), compare);
+			printf("%-7s %-7s %6lu %8.0f %8.0f %8.0f us %5.1f%% %7.1f us %6lu %6lu %6lu %6lu %6lu\n",
+					limits ? "on" : "off", phases[p].label, (unsigned long) r->passes - 1,
+					r->late[r->passes / 2] / 1e3, r->late[r->passes * 99 / 100] / 1e3,
+					r->late[r->passes - 1] / 1e3, 100.0 * r->isr_ns / PHASE_NS, r->train_max / 1e3,
+					(unsigned long) r->trains,
+					(unsigned long) r->btns, (unsigned long) r->sws, (unsigned long) storms,
+					(unsigned long) polled);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,393 @@
+/*
+ * substation_sim.c -- high fan-in substation stand-in for Linux
+ *
+ * One epoll-driven server speaks the controller protocol (Library/msg.h)
+ * to hundreds of synthetic controllers over SOCK_SEQPACKET socketpairs,
+ * and optionally to external controllers over pseudo-terminals using the
+ * same type-word framing as link.c. Reports aggregate messages/sec, round
+ * trip latency percentiles and per-client fairness.
+ *
+ * gcc -O2 -Wall -IHost -ILibrary -o substation_sim Host/substation_sim.c -lpthread -lm
+ *
+ * usage: substation_sim [-n clients] [-t threads] [-r rate_hz] [-d seconds] [-p ptys]
+ *        rate 0 runs every client closed-loop (next request on each reply)
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "msg.h"
+
+#define MAX_EVENTS 256
+#define HIST_US 100000		/* latency histogram span (1 us buckets) */
+#define PTY_BUF 512
+
+typedef struct {
+	int fd;
+	int id;
+	u64 sent_ns;			/* 0 while nothing is outstanding */
+	u64 next_ns;			/* next paced send */
+	u64 done;				/* completed round trips */
+	u64 late;				/* paced sends skipped while one was outstanding */
+} client_t;
+
+typedef struct {
+	int fd;
+	int stream;				/* pty: needs framing */
+	u8 buf[PTY_BUF];
+	u32 have;
+} conn_t;
+
+typedef struct {
+	client_t *clients;
+	int count;
+	u32 *hist;				/* per thread; merged at the end */
+	u64 overflow;
+	u64 max_us;
+} worker_t;
+
+static int nclients = 200;
+static int nthreads = 4;
+static int rate = 10;
+static int seconds = 10;
+static int nptys = 0;
+static volatile int running = 1;
+
+static int values[MSG_VALUES];
+static u64 served = 0;
+
+static u64 now_ns(void){
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* the reference for controller clocks (c.f. time_sync_t) */
+static u64 wall_ns(void){
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (u64) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*
+ * size of a controller-to-substation message; 0 if unknown
+ */
+static u32 request_size(const u8 *msg, u32 have){
+	int type;
+
+	if (have < sizeof(int))
+		return sizeof(int);
+	memcpy(&type, msg, sizeof(int));
+	switch(type){
+	case PING:
+	case STATE_RESYNC:
+		return sizeof(ping_t);
+	case UPDATE:
+		return sizeof(update_request_t);
+	case CONFIG_GET:
+	case CONFIG_SET:
+		return sizeof(config_msg_t);
+	case TIME_SYNC:
+		return sizeof(time_sync_t);
+	}
+	return 0;
+}
+
+/*
+ * answer one message from a controller
+ */
+static void serve(int fd, const u8 *msg){
+	update_request_t req;
+	update_response_t resp;
+	state_full_t full;
+	time_sync_t sync;
+	u64 received = wall_ns();
+	int i, sum = 0;
+
+	memcpy(&req, msg, sizeof(int) * 2);
+	switch(req.type){
+	case PING:
+		if (write(fd, msg, sizeof(ping_t)) < 0)
+			perror("write");
+		break;
+	case UPDATE:
+		memcpy(&req, msg, sizeof(req));
+		values[(unsigned) req.id % MSG_VALUES] = req.value;
+		resp.type = UPDATE;
+		resp.id = req.id;
+		for (i = 0; i < MSG_VALUES; i++)
+			sum += values[i];
+		resp.average = sum / MSG_VALUES;
+		memcpy(resp.values, values, sizeof(values));
+		if (write(fd, &resp, sizeof(resp)) < 0)
+			perror("write");
+		break;
+	case STATE_RESYNC:
+		full.type = STATE_FULL;
+		full.version = 0;
+		memcpy(full.values, values, sizeof(values));
+		if (write(fd, &full, sizeof(full)) < 0)
+			perror("write");
+		break;
+	case TIME_SYNC:
+		memcpy(&sync, msg, sizeof(sync));
+		sync.t2 = received;
+		sync.t3 = wall_ns();
+		if (write(fd, &sync, sizeof(sync)) < 0)
+			perror("write");
+		break;
+	}
+	served++;
+}
+
+/*
+ * read and serve whatever is pending on <c>
+ */
+static void service(conn_t *c){
+	u8 dgram[MSG_MAX];
+	ssize_t n;
+	u32 need;
+
+	if (!c->stream){
+		while ((n = read(c->fd, dgram, sizeof(dgram))) > 0){
+			if ((u32) n >= request_size(dgram, n))
+				serve(c->fd, dgram);
+		}
+		return;
+	}
+	while ((n = read(c->fd, c->buf + c->have, sizeof(c->buf) - c->have)) > 0){
+		c->have += n;
+		for (;;){
+			need = request_size(c->buf, c->have);
+			if (need == 0){				/* resync by one byte */
+				memmove(c->buf, c->buf + 1, --c->have);
+				continue;
+			}
+			if (c->have < need || c->have < sizeof(int))
+				break;
+			serve(c->fd, c->buf);
+			c->have -= need;
+			memmove(c->buf, c->buf + need, c->have);
+		}
+	}
+}
+
+/*
+ * send the next request of <cl>
+ */
+static void client_send(client_t *cl, u64 t){
+	update_request_t req = { UPDATE, cl->id, cl->id & 0xFF };
+
+	if (write(cl->fd, &req, sizeof(req)) == sizeof(req))
+		cl->sent_ns = t;
+}
+
+/*
+ * synthetic controllers: one epoll set per thread
+ */
+static void *worker(void *arg){
+	worker_t *w = arg;
+	struct epoll_event ev, events[MAX_EVENTS];
+	u8 buf[MSG_MAX];
+	u64 t, period = rate > 0 ? 1000000000ull / rate : 0, us;
+	int ep = epoll_create1(0), i, n, timeout;
+	client_t *cl;
+
+	for (i = 0; i < w->count; i++){
+		ev.events = EPOLLIN;
+		ev.data.ptr = &w->clients[i];
+		epoll_ctl(ep, EPOLL_CTL_ADD, w->clients[i].fd, &ev);
+		w->clients[i].next_ns = now_ns() + (period ? (period * i) / w->count : 0);
+	}
+	while (running){
+		t = now_ns();
+		timeout = period ? 1 : 10;
+		for (i = 0; i < w->count; i++){
+			cl = &w->clients[i];
+			if (!period){
+				if (!cl->sent_ns)
+					client_send(cl, t);
+			} else if (t >= cl->next_ns){
+				if (cl->sent_ns)
+					cl->late++;
+				else
+					client_send(cl, t);
+				cl->next_ns += period;
+			}
+		}
+		n = epoll_wait(ep, events, MAX_EVENTS, timeout);
+		t = now_ns();
+		for (i = 0; i < n; i++){
+			cl = events[i].data.ptr;
+			while (read(cl->fd, buf, sizeof(buf)) > 0){
+				if (!cl->sent_ns)
+					continue;
+				us = (t - cl->sent_ns) / 1000;
+				if (us < HIST_US)
+					w->hist[us]++;
+				else
+					w->overflow++;
+				if (us > w->max_us)
+					w->max_us = us;
+				cl->sent_ns = 0;
+				cl->done++;
+				if (!period)
+					client_send(cl, t);
+			}
+		}
+	}
+	close(ep);
+	return NULL;
+}
+
+/*
+ * open a raw pseudo-terminal for an external controller
+ */
+static int open_pty(void){
+	struct termios tio;
+	int fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+
+	if (fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0)
+		return -1;
+	tcgetattr(fd, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(fd, TCSANOW, &tio);
+	printf("controller pty: %s\n", ptsname(fd));
+	return fd;
+}
+
+/*
+ * returns the latency at <pct> percent over the merged histogram
+ */
+static u64 percentile(const u32 *hist, u64 total, double pct){
+	u64 want = (u64) ceil(total * pct / 100.0), seen = 0;
+	u32 us;
+
+	for (us = 0; us < HIST_US; us++){
+		seen += hist[us];
+		if (seen >= want && want > 0)
+			return us;
+	}
+	return HIST_US;
+}
+
+int main(int argc, char **argv){
+	struct epoll_event ev, events[MAX_EVENTS];
+	pthread_t *threads;
+	worker_t *workers;
+	client_t *clients;
+	conn_t *conns;
+	u32 *hist;
+	u64 start, elapsed, total = 0, overflow = 0, max_us = 0, lo = ~0ull, hi = 0, late = 0;
+	double sum = 0, sumsq = 0;
+	int opt, ep, i, j, n, sv[2], nconns;
+
+	while ((opt = getopt(argc, argv, "n:t:r:d:p:")) != -1){
+		switch(opt){
+		case 'n': nclients = atoi(optarg); break;
+		case 't': nthreads = atoi(optarg); break;
+		case 'r': rate = atoi(optarg); break;
+		case 'd': seconds = atoi(optarg); break;
+		case 'p': nptys = atoi(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-n clients] [-t threads] [-r rate_hz] [-d seconds] [-p ptys]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (nthreads < 1 || nthreads > nclients)
+		nthreads = nclients > 0 ? nclients : 1;
+
+	ep = epoll_create1(0);
+	nconns = nclients + nptys;
+	conns = calloc(nconns, sizeof(conn_t));
+	clients = calloc(nclients, sizeof(client_t));
+	for (i = 0; i < nclients; i++){
+		if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0, sv) < 0){
+			perror("socketpair");
+			return 1;
+		}
+		conns[i].fd = sv[0];
+		clients[i].fd = sv[1];
+		clients[i].id = i;
+	}
+	for (i = 0; i < nptys; i++){
+		conns[nclients + i].fd = open_pty();
+		conns[nclients + i].stream = 1;
+		if (conns[nclients + i].fd < 0){
+			perror("pty");
+			return 1;
+		}
+	}
+	for (i = 0; i < nconns; i++){
+		ev.events = EPOLLIN;
+		ev.data.ptr = &conns[i];
+		epoll_ctl(ep, EPOLL_CTL_ADD, conns[i].fd, &ev);
+	}
+
+	threads = calloc(nthreads, sizeof(pthread_t));
+	workers = calloc(nthreads, sizeof(worker_t));
+	for (i = 0, j = 0; i < nthreads; i++){
+		workers[i].clients = &clients[j];
+		workers[i].count = nclients / nthreads + (i < nclients % nthreads);
+		workers[i].hist = calloc(HIST_US, sizeof(u32));
+		j += workers[i].count;
+		pthread_create(&threads[i], NULL, worker, &workers[i]);
+	}
+
+	start = now_ns();
+	while (now_ns() - start < (u64) seconds * 1000000000ull){
+		n = epoll_wait(ep, events, MAX_EVENTS, 100);
+		for (i = 0; i < n; i++)
+			service(events[i].data.ptr);
+	}
+	running = 0;
+	elapsed = now_ns() - start;
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+
+	hist = calloc(HIST_US, sizeof(u32));
+	for (i = 0; i < nthreads; i++){
+		for (j = 0; j < HIST_US; j++)
+			hist[j] += workers[i].hist[j];
+		overflow += workers[i].overflow;
+		if (workers[i].max_us > max_us)
+			max_us = workers[i].max_us;
+	}
+	for (i = 0; i < nclients; i++){
+		total += clients[i].done;
+		late += clients[i].late;
+		sum += clients[i].done;
+		sumsq += (double) clients[i].done * clients[i].done;
+		if (clients[i].done < lo)
+			lo = clients[i].done;
+		if (clients[i].done > hi)
+			hi = clients[i].done;
+	}
+
+	printf("clients %d threads %d rate %d Hz duration %.1f s\n", nclients, nthreads, rate, elapsed / 1e9);
+	printf("served %llu msgs (%.0f msgs/s), round trips %llu, late %llu\n",
+			(unsigned long long) served, served / (elapsed / 1e9),
+			(unsigned long long) total, (unsigned long long) late);
+	printf("latency us: p50 %llu p99 %llu p99.9 %llu max %llu (>%d us: %llu)\n",
+			(unsigned long long) percentile(hist, total - overflow, 50),
+			(unsigned long long) percentile(hist, total - overflow, 99),
+			(unsigned long long) percentile(hist, total - overflow, 99.9),
+			(unsigned long long) max_us, HIST_US, (unsigned long long) overflow);
+	if (nclients > 0)
+		printf("fairness: jain %.4f, per-client min %llu max %llu\n",
+				sumsq > 0 ? (sum * sum) / (nclients * sumsq) : 1.0,
+				(unsigned long long) lo, (unsigned long long) hi);
+	return 0;
+}
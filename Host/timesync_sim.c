@@ -0,0 +1,195 @@
+/*
+ * timesync_sim.c -- substation time sync convergence and residual error
+ *
+ * Runs Library/timesync.c in virtual time against a substation clock that
+ * is the reference. The controller's global timer is a crystal off by a
+ * set drift, wandering in a random walk, that started at a random offset.
+ * Every TIMESYNC_POLLS main loop polls the controller stamps a request.
+ * The request and the reply each take half the base delay, plus or minus
+ * half the asymmetry, plus exponential jitter. Now and then one of them
+ * also waits behind a long message (a spike), and some exchanges are
+ * lost. The substation takes 50 us to turn a request round.
+ *
+ * For each scenario it reports how long the disciplined clock takes to
+ * converge (to stay within the scenario's bound from then on), and the
+ * error against the reference after that: rms, p99 and max, sampled four
+ * times per exchange. It also reports the learnt frequency correction
+ * against the one that cancels the drift. The asymmetry shows up as a
+ * bias of half its size, which no two-way exchange can see.
+ *
+ * gcc -O2 -Wall -IHost/bsp -IHost -ILibrary -I. -o timesync_sim Host/timesync_sim.c \
+ *     Host/bsp/mock.c Library/timesync.c -lm
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+
+#include "msg.h"
+#include "timesync.h"
+#include "xtime_l.h"
+
+#define POLL_NS 100000000ull	/* firmware main loop (c.f. POLL_US) */
+#define TURN_NS 50000			/* substation turnaround */
+#define CHECKS 4				/* error samples per exchange */
+#define NS 1000000000ull
+
+typedef struct {
+	const char *label;
+	double delay_us;			/* base round trip */
+	double jitter_us;			/* mean exponential jitter, each way */
+	double asym_us;				/* outbound minus return */
+	double spike;				/* chance a message waits behind a long one */
+	double spike_us;
+	double loss;				/* chance an exchange is lost */
+	double ppm;					/* crystal drift */
+	double wander;				/* drift random walk, ppb per sqrt(s) */
+	double within_us;			/* converged once the error stays within this */
+} scenario_t;
+
+/* round trips: two 32-byte time_sync_t at the uart rate, or a lan */
+static const scenario_t scenarios[] = {
+	{ "udp lan",      200,   20,   0, 0.02,   2000, 0.01,  30,  0,  50 },
+	{ "udp busy",     400,  150,   0, 0.20,  10000, 0.05,  30,  5, 200 },
+	{ "uart 921600",  750,   10,   0, 0.10,   1500, 0.01,  30,  5,  50 },
+	{ "uart 115200", 5600,   50,   0, 0.10,  11500, 0.01,  30,  5, 100 },
+	{ "uart 9600",  67000,  200,   0, 0.10, 137500, 0.01,  30,  5, 250 },
+	{ "fast crystal", 200,   20,   0, 0.02,   2000, 0.01, 200,  5,  50 },
+	{ "asymmetric",   200,   20, 100, 0.02,   2000, 0.01,  30,  5, 100 },
+};
+
+static double hours = 2;
+
+/* virtual time */
+static u64 ref_ns;				/* the substation clock */
+static double local_ns;			/* the crystal, in its own ns */
+static double drift_ppb;
+
+static u64 local_counts(void){
+	u64 ns = (u64) local_ns;
+
+	return ns / NS * COUNTS_PER_SECOND + ns % NS * COUNTS_PER_SECOND / NS;
+}
+
+static double gauss(void){
+	return sqrt(-2 * log(1 - drand48())) * cos(2 * M_PI * drand48());
+}
+
+static double expo(double mean){
+	return -mean * log(1 - drand48());
+}
+
+/*
+ * move both clocks to reference time <to>
+ */
+static void advance(u64 to, const scenario_t *s){
+	double dt = (to - ref_ns) / 1e9;
+
+	drift_ppb += s->wander * sqrt(dt) * gauss();
+	local_ns += (to - ref_ns) * (1 + drift_ppb / 1e9);
+	ref_ns = to;
+}
+
+/*
+ * one way across the network
+ */
+static u64 one_way(const scenario_t *s, double half_us){
+	double us = half_us + expo(s->jitter_us);
+
+	if (drand48() < s->spike)
+		us += drand48() * s->spike_us;
+	return (u64)(us * 1000);
+}
+
+static int compare(const void *a, const void *b){
+	double x = *(const double *) a, y = *(const double *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void run(const scenario_t *s){
+	u64 interval = TIMESYNC_POLLS * POLL_NS, exchanges = (u64)(hours * 3600e9 / interval);
+	u64 i, k, sent, arrive, n = 0, converged = 0;
+	double *err = malloc(exchanges * CHECKS * sizeof(double)), e, rms = 0;
+	time_sync_t m;
+	timesync_stats_t st;
+
+	ref_ns = 0;
+	local_ns = drand48() * 3600e9;	/* up an hour or so before the substation knew */
+	drift_ppb = s->ppm * 1000;
+	timesync_init(7);
+
+	for (i = 0; i < exchanges; i++){
+		sent = i * interval;
+		advance(sent, s);
+		timesync_request(&m);
+		arrive = sent + one_way(s, (s->delay_us + s->asym_us) / 2);
+		m.t2 = arrive;
+		m.t3 = arrive + TURN_NS;
+		arrive = m.t3 + one_way(s, (s->delay_us - s->asym_us) / 2);
+		if (drand48() >= s->loss && arrive < sent + interval){
+			advance(arrive, s);
+			timesync_reply(&m);
+		}
+		for (k = 1; k <= CHECKS; k++){	/* the error between exchanges */
+			advance(sent + interval * k / (CHECKS + 1), s);
+			e = (double)(s64)(timesync_now() - ref_ns) / 1000;
+			err[n++] = fabs(e);
+			if (fabs(e) > s->within_us)
+				converged = n;		/* the last miss so far */
+		}
+	}
+
+	timesync_stats(&st);
+	for (i = converged; i < n; i++)
+		rms += err[i] * err[i];
+	rms = converged < n ? sqrt(rms / (n - converged)) : NAN;
+	qsort(err + converged, n - converged, sizeof(double), compare);
+	printf("%-13s %4.0f us %7.1f s %7.1f %7.1f %7.1f us %8ld ppb (want %7.0f) %5lu %4lu %2lu %2lu\n",
+			s->label, s->within_us, converged < n ? converged * interval / (double) CHECKS / 1e9 : NAN, rms,
+			converged < n ? err[converged + (n - converged) * 99 / 100] : NAN,
+			converged < n ? err[n - 1] : NAN, (long) st.freq,
+			-drift_ppb / (1 + drift_ppb / 1e9), (unsigned long) st.samples, (unsigned long) st.rejected,
+			(unsigned long) st.steps, (unsigned long) st.tc);
+	free(err);
+}
+
+int main(int argc, char *argv[]){
+	scenario_t custom = { "custom", 200, 20, 0, 0.02, 2000, 0.01, 30, 5, 100 };
+	bool one = false;
+	int opt;
+	u32 i;
+
+	while ((opt = getopt(argc, argv, "a:d:e:h:j:k:l:p:s:w:")) != -1){
+		one |= opt != 'h';
+		switch (opt){
+		case 'a': custom.asym_us = atof(optarg); break;
+		case 'd': custom.delay_us = atof(optarg); break;
+		case 'e': custom.within_us = atof(optarg); break;
+		case 'h': hours = atof(optarg); break;
+		case 'j': custom.jitter_us = atof(optarg); break;
+		case 'l': custom.loss = atof(optarg); break;
+		case 'p': custom.ppm = atof(optarg); break;
+		case 's': custom.spike = atof(optarg); break;
+		case 'k': custom.spike_us = atof(optarg); break;
+		case 'w': custom.wander = atof(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-h hours] [-e bound us] [-d delay us] [-j jitter us] "
+					"[-a asymmetry us] [-s spike chance] [-k spike us] [-l loss] [-p ppm] [-w wander ppb/sqrt(s)]\n", argv[0]);
+			return 1;
+		}
+	}
+	mock_xtime = local_counts;
+	srand48(1);
+	printf("%-13s %7s %9s %7s %7s %10s %8s %17s %5s %4s %2s %2s\n", "scenario", "within", "converge",
+			"rms", "p99", "max", "freq", "", "used", "rej", "st", "tc");
+	if (one){
+		run(&custom);
+		return 0;
+	}
+	for (i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+		run(&scenarios[i]);
+	return 0;
+}
@@ -0,0 +1,275 @@
+/*
+ * timing_sim.c -- adaptive signal timing against the fixed plan
+ *
+ * Runs Library/crossing.c in virtual time with its phase lengths from
+ * either the configured plan ("fixed") or Library/timing.c ("adaptive"),
+ * as railwayCrossing.c wires them. Vehicles and pedestrians arrive at
+ * random at the scenario's rates. Vehicles leave one per SAT_HEADWAY_S
+ * on green. A pedestrian presses the button on arrival, unless the
+ * pedestrian phase is on, and all those waiting cross in that phase.
+ * Trains arrive at random and hold the island switch for TRAIN_S. The
+ * main loop passes every 100 ms.
+ *
+ * Each scenario runs at 1 Hz and at 10 Hz with the plan in ticks scaled to
+ * match. Half-way through, the plan's green is doubled and the engine is
+ * started again on it, as the firmware does when the configuration
+ * changes. The tool reports vehicle and pedestrian throughput, mean waits
+ * for both, and the vehicles still queued at the end. Any adaptive phase,
+ * in seconds, outside its bounds around the plan in force is a violation.
+ * The adaptive plan fails if its vehicle queue diverges (more than
+ * DIVERGED_S of arrivals left at the end) or if vehicles wait more than
+ * WORSE_PCT longer on it than on the fixed plan. The exit status is 1 on
+ * any violation or failure.
+ *
+ * gcc -O2 -Wall -IHost/bsp -IHost -ILibrary -I. -o timing_sim Host/timing_sim.c \
+ *     Host/bsp/mock.c Library/crossing.c Library/timing.c -lm
+ *
+ * usage: timing_sim [-h hours]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+
+#include "config.h"
+#include "crossing.h"
+#include "timing.h"
+
+#define STEP_S 0.1				/* c.f. POLL_US */
+#define SAT_HEADWAY_S 2.0		/* vehicles leaving on green */
+#define TRAIN_S 40.0			/* island switch on */
+#define QUEUE 65536
+#define DIVERGED_S 600			/* arrivals still queued at the end */
+#define WORSE_PCT 10			/* vehicle wait over the fixed plan's */
+
+enum { FIXED, ADAPTIVE, PLANS };
+static const char *plans[PLANS] = { "fixed", "adaptive" };
+
+typedef struct {
+	const char *label;
+	double vehicles_h;
+	double pedestrians_h;
+	double trains_h;
+} scenario_t;
+
+static const scenario_t scenarios[] = {
+	{ "quiet", 300, 20, 2 },
+	{ "moderate", 600, 120, 3 },
+	{ "heavy", 600, 400, 3 },
+	{ "trains", 400, 200, 40 },
+};
+#define SCENARIOS (sizeof(scenarios) / sizeof(scenarios[0]))
+
+static const u32 freqs[] = { 1, 10 };
+#define FREQS (sizeof(freqs) / sizeof(freqs[0]))
+
+typedef struct {
+	u32 vehicles, pedestrians;
+	u32 queued;					/* vehicles at the end */
+	double vehicle_wait_s, pedestrian_wait_s;
+	u32 violations;
+} result_t;
+
+static crossing_t crossing;
+static u32 plan, freq;
+static u32 green, walk;			/* the plan in force (ticks) */
+static u32 aspect;
+static result_t *res;
+static u64 seed;
+
+static double uniform(void){
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return (seed >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* <v> ticks is within <lo>..<hi> percent of <base> ticks, to a tick */
+static void bound(u32 v, u32 base, u32 lo, u32 hi){
+	if (v + 1 < base * lo / 100 || v > base * hi / 100 + 1)
+		res->violations++;
+}
+
+/* crossing outputs, as railwayCrossing.c */
+static void sim_signal(crossing_t *c, u32 a){ if (a != SIGNAL_OFF) aspect = a; }
+static void sim_gate(crossing_t *c, s32 pos){ }
+static void sim_request(crossing_t *c, bool on){ }
+static s32 sim_wheel(crossing_t *c){ return 0; }
+static u32 sim_yellow(crossing_t *c){ return LIGHT_TMR * freq / FREQ; }
+static u32 sim_hold(crossing_t *c){ return walk; }
+static void sim_enter(crossing_t *c){ timing_state(c->state); }
+
+static u32 sim_green(crossing_t *c){
+	u32 v;
+
+	if (plan == FIXED)
+		return green;
+	v = timing_green();
+	bound(v, green, TIMING_GREEN_MIN, TIMING_GREEN_MAX);
+	return v;
+}
+
+static u32 sim_walk(crossing_t *c){
+	u32 v;
+
+	if (plan == FIXED)
+		return walk;
+	v = timing_pedestrian();
+	bound(v, walk, TIMING_PED_MIN, TIMING_PED_MAX);
+	return v;
+}
+
+static const crossing_ops_t ops = {
+	sim_signal, sim_gate, sim_request, sim_wheel,
+	sim_green, sim_walk, sim_yellow, sim_hold, sim_enter
+};
+
+/* next arrival after <t> at <rate_h> an hour */
+static double next(double t, double rate_h){
+	return t - log(1 - uniform()) * 3600 / rate_h;
+}
+
+static void run(const scenario_t *s, double hours, result_t *r){
+	static double vq[QUEUE], pq[QUEUE];	/* arrival times waiting */
+	u32 vhead = 0, vtail = 0, phead = 0, ptail = 0;
+	double t, end = hours * 3600, tick = 0, vnext, pnext, tnext, leave = -1, served = 0;
+	bool changed = false;
+
+	memset(r, 0, sizeof(*r));
+	res = r;
+	seed = 0x9E3779B97F4A7C15ull;	/* the same traffic for each plan */
+	green = TRAFFIC_TMR * freq / FREQ;
+	walk = PEDESTRIAN_TMR * freq / FREQ;
+	timing_init(green, walk, LIGHT_TMR * freq / FREQ, freq);
+	crossing_init(&crossing, &ops);
+	aspect = SIGNAL_GREEN;
+	vnext = next(0, s->vehicles_h);
+	pnext = next(0, s->pedestrians_h);
+	tnext = next(0, s->trains_h);
+
+	for (t = 0; t < end; t += STEP_S){
+		if (!changed && t >= end / 2){
+			green *= 2;		/* the plan changed (c.f. comms_poll) */
+			timing_init(green, walk, LIGHT_TMR * freq / FREQ, freq);
+			changed = true;
+		}
+		while (vnext <= t){
+			vq[vtail++ % QUEUE] = vnext;
+			vnext = next(vnext, s->vehicles_h);
+		}
+		while (pnext <= t){
+			if (crossing.state == PEDESTRIAN){
+				r->pedestrians++;		/* walks straight across */
+			} else {
+				pq[ptail++ % QUEUE] = pnext;
+				crossing_button(&crossing);
+				timing_button();
+			}
+			pnext = next(pnext, s->pedestrians_h);
+		}
+		if (leave < 0 && tnext <= t){
+			crossing_train(&crossing);		/* arrived */
+			timing_train();
+			leave = t + TRAIN_S;
+		} else if (leave >= 0 && t >= leave){
+			crossing_train(&crossing);		/* left */
+			leave = -1;
+			tnext = next(t, s->trains_h);
+		}
+
+		if (t >= tick){
+			crossing_tick(&crossing);
+			timing_tick();
+			tick += 1.0 / freq;
+		}
+		crossing_run(&crossing);
+
+		if (aspect == SIGNAL_GREEN){
+			served += STEP_S / SAT_HEADWAY_S;
+			for (; served >= 1 && vhead != vtail; served -= 1){
+				r->vehicle_wait_s += t - vq[vhead++ % QUEUE];
+				r->vehicles++;
+			}
+			if (vhead == vtail && served > 1)
+				served = 1;
+		} else {
+			served = 0;
+		}
+		if (crossing.state == PEDESTRIAN){
+			for (; phead != ptail; phead++){
+				r->pedestrian_wait_s += t - pq[phead % QUEUE];
+				r->pedestrians++;
+			}
+		}
+	}
+	r->queued = vtail - vhead;
+}
+
+/*
+ * returns why the adaptive plan served vehicles worse than the fixed one
+ * in <r>, or NULL
+ */
+static const char *worse(const scenario_t *s, const result_t *r){
+	double fixed = r[FIXED].vehicles ? r[FIXED].vehicle_wait_s / r[FIXED].vehicles : 0;
+	double adaptive = r[ADAPTIVE].vehicles ? r[ADAPTIVE].vehicle_wait_s / r[ADAPTIVE].vehicles : 0;
+
+	if (r[ADAPTIVE].queued > s->vehicles_h * DIVERGED_S / 3600)
+		return "vehicle queue diverges";
+	if (adaptive > fixed * (100 + WORSE_PCT) / 100)
+		return "vehicles wait longer than on the fixed plan";
+	return NULL;
+}
+
+int main(int argc, char *argv[]){
+	double hours = 24;
+	result_t r[PLANS];
+	u32 s, f, p, violations = 0, failed = 0;
+	const char *why;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "h:")) != -1){
+		switch (opt){
+		case 'h':
+			hours = strtod(optarg, NULL);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-h hours]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	printf("%.0f h per run, plan green %u s, walk %u s, yellow %u s; green doubled half-way\n", hours,
+			TRAFFIC_TMR / FREQ, PEDESTRIAN_TMR / FREQ, LIGHT_TMR / FREQ);
+	printf("%-8s %5s %-8s %10s %11s %7s %10s %11s %10s\n", "scenario", "tick", "plan", "vehicles/h",
+			"veh wait", "queued", "peds/h", "ped wait", "violations");
+	for (s = 0; s < SCENARIOS; s++){
+		for (f = 0; f < FREQS; f++){
+			freq = freqs[f];
+			for (p = 0; p < PLANS; p++){
+				plan = p;
+				run(&scenarios[s], hours, &r[p]);
+				printf("%-8s %3u Hz %-8s %10.1f %9.1f s %7u %10.1f %9.1f s %10u\n", scenarios[s].label, freq,
+						plans[p], r[p].vehicles / hours, r[p].vehicles ? r[p].vehicle_wait_s / r[p].vehicles : 0,
+						r[p].queued, r[p].pedestrians / hours,
+						r[p].pedestrians ? r[p].pedestrian_wait_s / r[p].pedestrians : 0, r[p].violations);
+				violations += r[p].violations;
+			}
+			why = worse(&scenarios[s], r);
+			if (why != NULL){
+				printf("  FAIL: %s\n", why);
+				failed++;
+			}
+		}
+	}
+	if (violations)
+		printf("%u adaptive phases outside their bounds\n", violations);
+	else
+		printf("every adaptive phase within its bounds\n");
+	if (failed)
+		printf("%u runs where the adaptive plan served vehicles worse than the fixed plan\n", failed);
+	else
+		printf("the adaptive plan served vehicles at least as well as the fixed plan in every run\n");
+	return violations || failed ? 1 : 0;
+}
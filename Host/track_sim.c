@@ -0,0 +1,330 @@
+/*
+ * track_sim.c -- gate closed time with trains tracked by the approach sensors
+ *
+ * Runs Library/crossing.c and Library/track.c in virtual time against a
+ * double-track line with the sensors of railwayCrossing.c, each on the
+ * track in. Trains enter ENTER_M out in either direction at 10 to 40 m/s
+ * (or slower freight), one per track at a time as block signalling
+ * allows, and may change speed by up to a fraction of it every 500 m. The
+ * "single" scenario has one track, sensors that see both ways and one
+ * train on the line at a time. The island switch is on
+ * while a train is within ISLAND_M of the road. The gate takes GATE_NS to
+ * travel; the crossing ticks at 1 Hz and the main loop passes every
+ * 100 ms, as in the firmware.
+ *
+ * Two policies see the same trains. "switch" is the single train switch
+ * before this: on from the outermost sensor until the train has cleared
+ * the island, with the full hold (PEDESTRIAN_TMR ticks) before opening.
+ * "track" feeds the sensor strikes and the island switch to track.c,
+ * starts closing when a train is due (c.f. approach in railwayCrossing.c)
+ * and opens after TRACK_HOLD once the crossing is clear.
+ *
+ * For each scenario the tool reports the time the gate is not fully open
+ * per train, the time it is down before the train reaches the road, and
+ * the least of those. Any train that reaches the road less than the
+ * margin after the gate came fully down is a violation, and the exit
+ * status is 1.
+ *
+ * gcc -O2 -Wall -IHost/bsp -IHost -ILibrary -I. -o track_sim Host/track_sim.c \
+ *     Host/bsp/mock.c Library/crossing.c Library/track.c -lm
+ *
+ * usage: track_sim [-h hours] [-m margin_ms]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+
+#include "config.h"
+#include "crossing.h"
+#include "track.h"
+#include "xtime_l.h"
+
+#define NS 1000000000ull
+#define STEP_NS 10000000ull			/* motion step */
+#define POLL_NS 100000000ull		/* c.f. POLL_US */
+#define TICK_NS NS					/* c.f. FREQ */
+#define GATE_NS 3500000000ull		/* full travel of the gate */
+#define ISLAND_M 20.0
+#define ENTER_M 3000.0				/* trains enter and leave this far out */
+#define CHANGE_M 500.0				/* a new target speed this often */
+#define NONE (~0ull)
+
+/* c.f. railwayCrossing.c; on a single track each sees both ways */
+static const track_pos_t sensors[] = { { -2000, 1 }, { -800, 1 }, { 800, -1 }, { 2000, -1 } };
+#define SENSORS (sizeof(sensors) / sizeof(sensors[0]))
+
+enum { SWITCH, TRACK, POLICIES };
+static const char *policies[POLICIES] = { "switch", "track" };
+
+typedef struct {
+	const char *label;
+	double headway_s;			/* mean between trains each way */
+	double vmin, vmax;			/* entry speed (m/s) */
+	double vary;				/* speed change every CHANGE_M, fraction of the entry speed */
+	bool single;				/* one track: one train on the line at a time */
+} scenario_t;
+
+static const scenario_t scenarios[] = {
+	{ "steady", 900, 10, 40, 0, false },
+	{ "varying", 900, 10, 40, 0.2, false },
+	{ "busy", 240, 10, 40, 0.2, false },
+	{ "freight", 900, 5, 15, 0.2, false },
+	{ "single", 600, 10, 40, 0.2, true },
+};
+#define SCENARIOS (sizeof(scenarios) / sizeof(scenarios[0]))
+
+/* a train; p is the position of its front in its own direction, the road at 0 */
+typedef struct {
+	bool on;
+	s32 dir;
+	double p, len;
+	double v0, vs, vt, from;	/* entry speed; speed from <from> on, heading for vt */
+	u64 wait;					/* next entry on this track */
+} train_t;
+
+typedef struct {
+	u32 trains;
+	double closed_s;			/* gate not fully open */
+	double ahead_s;				/* gate down to the train at the road, summed */
+	double least_s;
+	u32 violations;
+	track_stats_t track;
+} result_t;
+
+static crossing_t crossing;
+static u32 policy;
+static u64 now;
+static u32 margin_ms = MARGIN_MS;
+static u64 seed;
+
+/* the gate: position 0 open to 1 down, moving at 1/GATE_NS */
+static double gate_pos;
+static s32 gate_target;
+static u64 gate_down;		/* fully down since; NONE while not */
+
+static double uniform(void){
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return (seed >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static u64 ticks(u64 ns){
+	return ns / NS * COUNTS_PER_SECOND + ns % NS * COUNTS_PER_SECOND / NS;
+}
+
+/* crossing outputs */
+static void sim_signal(crossing_t *c, u32 aspect){ }
+static void sim_gate(crossing_t *c, s32 pos){ gate_target = pos; }
+static void sim_request(crossing_t *c, bool on){ }
+static s32 sim_wheel(crossing_t *c){ return 0; }
+static u32 sim_green(crossing_t *c){ return TRAFFIC_TMR; }
+static u32 sim_walk(crossing_t *c){ return PEDESTRIAN_TMR; }
+static u32 sim_yellow(crossing_t *c){ return LIGHT_TMR; }
+static void sim_enter(crossing_t *c){ }
+
+static u32 sim_hold(crossing_t *c){
+	return policy == TRACK && track_clear(ticks(now)) ? TRACK_HOLD : PEDESTRIAN_TMR;
+}
+
+static const crossing_ops_t ops = {
+	sim_signal, sim_gate, sim_request, sim_wheel,
+	sim_green, sim_walk, sim_yellow, sim_hold, sim_enter
+};
+
+/* the switch the crossing sees changed at <at> (c.f. main_sw_callback) */
+static void island(bool on, u64 at){
+	if (crossing_train_edge(&crossing))
+		gate_target = CROSSING_CLOSED;		/* fast path */
+	switch (crossing_train(&crossing)){
+	case CROSSING_ARRIVED:
+		if (policy == TRACK)
+			track_island(true, ticks(at));
+		break;
+	case CROSSING_LEFT:
+		if (policy == TRACK)
+			track_island(false, ticks(at));
+		break;
+	}
+}
+
+/* c.f. approach in railwayCrossing.c */
+static void approach(void){
+	static bool tracked = false;
+	bool due = track_poll(ticks(now), LIGHT_TMR * 1000 / FREQ + TRACK_GATE_MS + 3 * POLL_NS / 1000000 + margin_ms);
+
+	if (due)
+		crossing_due(&crossing);
+	else if (tracked)
+		crossing_upstream(&crossing, false);
+	tracked = due;
+}
+
+/* the front of <t> passed <p> during this step; returns when */
+static bool passed(const train_t *t, double before, double p, u64 *at){
+	if (before >= p || t->p < p)
+		return false;
+	*at = now + (u64)((p - before) / (t->p - before) * STEP_NS);
+	return true;
+}
+
+static void run(const scenario_t *s, u64 hours, result_t *r){
+	track_pos_t place[SENSORS];
+	train_t trains[2];
+	u32 occupied = 0, k, i;
+	u64 next_tick = 0, next_pass = 0, end = hours * 3600 * NS, at;
+
+	memset(r, 0, sizeof(*r));
+	r->least_s = 1e9;
+	seed = 0x9E3779B97F4A7C15ull;	/* the same trains for each policy */
+	memset(trains, 0, sizeof(trains));
+	for (k = 0; k < 2; k++){
+		trains[k].dir = k ? -1 : 1;
+		trains[k].wait = (u64)(-log(1 - uniform()) * s->headway_s * NS);
+	}
+	for (i = 0; i < SENSORS; i++){
+		place[i] = sensors[i];
+		if (s->single)
+			place[i].dir = 0;
+	}
+	crossing_init(&crossing, &ops);
+	track_init(place, SENSORS);
+	gate_pos = 0;
+	gate_target = CROSSING_OPEN;
+	gate_down = NONE;
+
+	for (now = 0; now < end; now += STEP_NS){
+		for (k = 0; k < 2; k++){
+			train_t *t = &trains[k];
+			double before, v;
+			bool was, is;
+
+			if (!t->on){
+				if (now < t->wait || (s->single && trains[!k].on))
+					continue;
+				t->on = true;
+				t->p = -ENTER_M;
+				t->len = 100 + 600 * uniform();
+				t->v0 = t->vs = t->vt = s->vmin + (s->vmax - s->vmin) * uniform();
+				t->from = t->p;
+				r->trains++;
+			}
+			if (t->p - t->from >= CHANGE_M){
+				t->vs = t->vt;
+				t->vt = t->v0 * (1 + s->vary * (2 * uniform() - 1));
+				if (t->vt > TRACK_MAX_MPS)
+					t->vt = TRACK_MAX_MPS;
+				t->from = t->p;
+			}
+			v = t->vs + (t->vt - t->vs) * (t->p - t->from) / CHANGE_M;
+			before = t->p;
+			t->p += v * STEP_NS / NS;
+
+			for (i = 0; i < SENSORS; i++)
+				if ((s->single || sensors[i].dir == t->dir) && passed(t, before, sensors[i].x * t->dir, &at)
+						&& policy == TRACK)
+					track_sensor(i, ticks(at), false);
+			if (passed(t, before, 0, &at)){
+				double ahead = gate_down == NONE ? -1 : (double)(at - gate_down) / NS;
+
+				r->ahead_s += ahead > 0 ? ahead : 0;
+				if (ahead < r->least_s)
+					r->least_s = ahead;
+				if (ahead * 1000 < margin_ms)
+					r->violations++;
+			}
+
+			/* the switch: the island, or the whole approach for the old one */
+			was = before > (policy == TRACK ? -ISLAND_M : sensors[0].x) && before - t->len < ISLAND_M;
+			is = t->p > (policy == TRACK ? -ISLAND_M : sensors[0].x) && t->p - t->len < ISLAND_M;
+			if (was != is){
+				occupied += is ? 1 : -1;
+				if (occupied == (is ? 1 : 0))
+					island(is, now);
+			}
+			if (t->p - t->len > ENTER_M){
+				t->on = false;
+				t->wait = now + (u64)(-log(1 - uniform()) * s->headway_s * NS);
+			}
+		}
+
+		if (now >= next_tick){
+			crossing_tick(&crossing);
+			next_tick += TICK_NS;
+		}
+		if (now >= next_pass){
+			crossing_run(&crossing);
+			if (policy == TRACK)
+				approach();
+			next_pass += POLL_NS;
+		}
+
+		/* the gate */
+		if (gate_target == CROSSING_CLOSED){
+			gate_pos += (double) STEP_NS / GATE_NS;
+			if (gate_pos >= 1){
+				gate_pos = 1;
+				if (gate_down == NONE)
+					gate_down = now;
+			}
+		} else {
+			gate_pos -= (double) STEP_NS / GATE_NS;
+			if (gate_pos < 0)
+				gate_pos = 0;
+			gate_down = NONE;
+		}
+		if (gate_pos > 0)
+			r->closed_s += (double) STEP_NS / NS;
+	}
+	track_stats(&r->track);
+}
+
+int main(int argc, char *argv[]){
+	u64 hours = 24;
+	result_t r[POLICIES];
+	u32 s, p, failed = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "h:m:")) != -1){
+		switch (opt){
+		case 'h':
+			hours = strtoull(optarg, NULL, 0);
+			break;
+		case 'm':
+			margin_ms = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-h hours] [-m margin_ms]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	printf("%lu h per run, margin %u ms, gate %.1f s, sensors at", (unsigned long) hours, margin_ms,
+			(double) GATE_NS / NS);
+	for (p = 0; p < SENSORS; p++)
+		printf(" %d", (int) sensors[p].x);
+	printf(" m\n");
+	printf("%-8s %-6s %6s %12s %12s %9s %10s %9s %9s\n", "scenario", "policy", "trains", "closed/train",
+			"ahead/train", "least", "violations", "untracked", "stale");
+	for (s = 0; s < SCENARIOS; s++){
+		for (p = 0; p < POLICIES; p++){
+			policy = p;
+			run(&scenarios[s], hours, &r[p]);
+			printf("%-8s %-6s %6u %10.1f s %10.1f s %7.1f s %10u %9u %9u\n", scenarios[s].label, policies[p],
+					r[p].trains, r[p].closed_s / r[p].trains, r[p].ahead_s / r[p].trains, r[p].least_s,
+					r[p].violations, r[p].track.untracked, r[p].track.stale);
+			failed += r[p].violations;
+		}
+		printf("%-8s closed %.1f%% less per train\n", scenarios[s].label,
+				100.0 * (1 - r[TRACK].closed_s / r[SWITCH].closed_s));
+	}
+	if (failed){
+		printf("%u trains reached the road less than %u ms after the gate was down\n", failed, margin_ms);
+		return 1;
+	}
+	printf("every train found the gate down at least %u ms\n", margin_ms);
+	return 0;
+}
@@ -3,11 +3,26 @@
  */
 
 #include "adc.h"
+#include "config.h"
+#include "gic.h"
 
-#define CHANNELS XADCPS_SEQ_CH_TEMP | XADCPS_SEQ_CH_VCCINT | XADCPS_SEQ_CH_AUX14
+#define CHANNELS XADCPS_SEQ_CH_TEMP | XADCPS_SEQ_CH_VCCINT | XADCPS_SEQ_CH_VCCAUX | XADCPS_SEQ_CH_AUX14 | XADCPS_SEQ_CH_AUX15
 
 
 static XAdcPs adc_port;		/* adc port for temperature */
+static void (*local_alarm_callback)(u32 alarms);
+
+/*
+ * control is passed to this function when an xadc alarm fires
+ */
+static void adc_alarm_handler(void *devicep){
+	u32 status = XAdcPs_IntrGetStatus(&adc_port);
+
+	XAdcPs_IntrClear(&adc_port, status);
+	if (local_alarm_callback != NULL){
+		local_alarm_callback(status);
+	}
+}
 
 /*
  * initialize the adc module
@@ -21,7 +36,7 @@ void adc_init(void){
 		printf("ADC Test Failed!\n");
 	}
 	XAdcPs_SetSequencerMode(&adc_port, XADCPS_SEQ_MODE_SAFE);	/* set sequencer to safe mode first*/
-	XAdcPs_SetAlarmEnables(&adc_port, 0);		/* enable alarms */
+	XAdcPs_SetAlarmEnables(&adc_port, 0);		/* alarms off until adc_alarm_init */
 	XAdcPs_SetSeqChEnables(&adc_port, CHANNELS);
 	XAdcPs_SetSequencerMode(&adc_port, XADCPS_SEQ_MODE_CONTINPASS);	/* set sequencer to continuous pass mode */
 
@@ -51,8 +66,65 @@ float adc_get_vccint(void){
  */
 float adc_get_pot(void){
 	u32 potadc = XAdcPs_GetAdcData(&adc_port, XADCPS_CH_AUX_MAX-1);
-	float potvcc = XAdcPs_RawToVoltage(potadc)/2.97; /* voltage range 0-1V */
+	float potvcc = XAdcPs_RawToVoltage(potadc)/(config->potscale/100.0f); /* voltage range 0-1V */
 	return potvcc;
 
 }
 
+
+/*
+ * get the gate position feedback as a Q16 fraction of travel (0 open, 1 << 16 closed)
+ */
+u32 adc_get_gate(void){
+	u32 raw = XAdcPs_GetAdcData(&adc_port, XADCPS_CH_AUX_MAX);	/* aux 15 */
+	u32 pos = (u32)((u64) raw * 300 / config->potscale);	/* same correction as the pot */
+	return pos > (1 << 16) ? (1 << 16) : pos;
+}
+
+/*
+ * get the raw 16-bit conversion of <channel> (c.f. XADCPS_CH_*)
+ */
+u16 adc_get_raw(u8 channel){
+	return XAdcPs_GetAdcData(&adc_port, channel);
+}
+
+/*
+ * set alarm threshold register <which> (c.f. XADCPS_ATR_*) to <raw>
+ */
+void adc_alarm_threshold(u8 which, u16 raw){
+	XAdcPs_SetAlarmThreshold(&adc_port, which, raw);
+}
+
+/*
+ * enable the <alarms> (c.f. XADCPS_CFR1_ALM_*) and deliver their interrupts
+ * (c.f. XADCPS_INTX_*) to the callback
+ */
+void adc_alarm_init(u16 alarms, void (*alarm_callback)(u32 status)){
+	local_alarm_callback = alarm_callback;
+	XAdcPs_SetSequencerMode(&adc_port, XADCPS_SEQ_MODE_SAFE);
+	XAdcPs_SetAlarmEnables(&adc_port, alarms);
+	XAdcPs_SetSequencerMode(&adc_port, XADCPS_SEQ_MODE_CONTINPASS);
+	XAdcPs_IntrClear(&adc_port, XADCPS_INTX_ALL_MASK);
+	gic_connect(XPAR_XADCPS_INT_ID, (Xil_ExceptionHandler)adc_alarm_handler, &adc_port);
+}
+
+/*
+ * unmask (<on>) or mask the alarm interrupts in <mask> (c.f. XADCPS_INTX_*)
+ */
+void adc_alarm_mask(u32 mask, bool on){
+	if (on){
+		XAdcPs_IntrClear(&adc_port, mask);
+		XAdcPs_IntrEnable(&adc_port, mask);
+	} else {
+		XAdcPs_IntrDisable(&adc_port, mask);
+	}
+}
+
+/*
+ * close down the alarm interrupt
+ */
+void adc_alarm_close(void){
+	XAdcPs_IntrDisable(&adc_port, XADCPS_INTX_ALL_MASK);
+	gic_disconnect(XPAR_XADCPS_INT_ID);
+	local_alarm_callback = NULL;
+}
@@ -4,6 +4,7 @@
 #pragma once
 
 #include <stdio.h>
+#include <stdbool.h>
 #include "xadcps.h"
 #include "xparameters.h"  	/* constants used by the hardware */
 #include "xil_types.h"		/* types used by xilinx */
@@ -28,3 +29,34 @@ float adc_get_vccint(void);
  */
 float adc_get_pot(void);
 
+
+/*
+ * get the gate position feedback as a Q16 fraction of travel (0 open, 1 << 16 closed)
+ */
+u32 adc_get_gate(void);
+
+/*
+ * get the raw 16-bit conversion of <channel> (c.f. XADCPS_CH_*)
+ */
+u16 adc_get_raw(u8 channel);
+
+/*
+ * set alarm threshold register <which> (c.f. XADCPS_ATR_*) to <raw>
+ */
+void adc_alarm_threshold(u8 which, u16 raw);
+
+/*
+ * enable the <alarms> (c.f. XADCPS_CFR1_ALM_*) and deliver their interrupts
+ * (c.f. XADCPS_INTX_*) to the callback; interrupts start masked
+ */
+void adc_alarm_init(u16 alarms, void (*alarm_callback)(u32 status));
+
+/*
+ * unmask (<on>) or mask the alarm interrupts in <mask> (c.f. XADCPS_INTX_*)
+ */
+void adc_alarm_mask(u32 mask, bool on);
+
+/*
+ * close down the alarm interrupt
+ */
+void adc_alarm_close(void);
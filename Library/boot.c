@@ -0,0 +1,89 @@
+/*
+ * boot.c -- safe outputs first, and boot stage times
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "boot.h"
+#include "gate.h"			/* GATE_ONE */
+#include "led.h"
+#include "platform.h"
+#include "servo.h"
+#include "xil_cache.h"
+#include "xtime_l.h"		/* global timer */
+
+#ifdef BOOT_XIP
+extern u8 __lazy_start[], __lazy_end[], __lazy_load[];	/* c.f. lscript_xip.ld */
+#define LAZY_BYTES ((u32)(__lazy_end - __lazy_start))
+#else
+#define LAZY_BYTES 0
+#endif
+
+static XTime stamps[BOOT_STAGES];
+static watchdog_state_t last;
+static bool warm = false;
+
+/*
+ * before main; calls nothing outside the objects lscript_xip.ld keeps in flash
+ */
+static void boot_early(void){
+	boot_stage(BOOT_ENTRY);
+	init_platform();
+	warm = watchdog_init(&last);
+	led_init();
+	led_set(RED, LED_ON);
+	servo_init();
+	if (warm)
+		servo_set_pos(last.traincoming ? GATE_ONE : (u32) last.gate);
+	boot_stage(BOOT_SAFE);
+
+#ifdef BOOT_XIP
+	memcpy(__lazy_start, __lazy_load, LAZY_BYTES);
+	Xil_DCacheFlushRange((UINTPTR) __lazy_start, LAZY_BYTES);	/* out to DDR, then fetch it fresh */
+	Xil_ICacheInvalidate();
+#endif
+	boot_stage(BOOT_COPIED);
+}
+
+static void (*const boot_preinit)(void) __attribute__((section(".preinit_array"), used)) = boot_early;
+
+/*
+ * stamp
+ */
+void boot_stage(u32 stage){
+	if (stage < BOOT_STAGES)
+		XTime_GetTime(&stamps[stage]);
+}
+
+/*
+ * state from before a watchdog reset
+ */
+bool boot_warm(watchdog_state_t *out){
+	if (warm)
+		*out = last;
+	return warm;
+}
+
+static unsigned long us(XTime t){
+	return (unsigned long)(t * 1000000 / COUNTS_PER_SECOND);
+}
+
+/*
+ * stage times
+ */
+void boot_print(void){
+	XTime copy = stamps[BOOT_COPIED] - stamps[BOOT_SAFE];
+
+#ifdef BOOT_XIP
+	printf("Boot (xip): ");
+#else
+	printf("Boot (ddr): ");
+#endif
+	printf("entry %lu us, safe +%lu us, copied %lu KB +%lu us",
+			us(stamps[BOOT_ENTRY]), us(stamps[BOOT_SAFE] - stamps[BOOT_ENTRY]),
+			(unsigned long) LAZY_BYTES / 1024, us(stamps[BOOT_COPIED] - stamps[BOOT_ENTRY]));
+	if (LAZY_BYTES != 0 && copy != 0)
+		printf(" (%lu KB/s)", (unsigned long)((u64) LAZY_BYTES * COUNTS_PER_SECOND / 1024 / copy));
+	printf(", main +%lu us, ready +%lu us\n", us(stamps[BOOT_MAIN] - stamps[BOOT_ENTRY]),
+			us(stamps[BOOT_READY] - stamps[BOOT_ENTRY]));
+}
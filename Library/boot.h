@@ -0,0 +1,45 @@
+/*
+ * boot.h -- safe outputs first, and boot stage times
+ *
+ * The BSP's start-up runs boot.c's fast path from the .preinit_array,
+ * before main and before any constructor. It brings up the platform
+ * (caches and uart, so main does not), reads the watchdog records and
+ * drives red and the gate: after a watchdog reset the gate goes back
+ * to its last target (closed if a train was coming), after a cold boot the
+ * servo starts at its rest duty. With BOOT_XIP and Hardware/lscript_xip.ld
+ * the fast path runs in place from the QSPI flash, and copies the rest of
+ * the image to DDR once the outputs are safe; with lscript.ld the FSBL has
+ * copied the whole image before it started.
+ *
+ * Each stage is stamped from the global timer, which the BSP's start-up
+ * restarts from 0, so the boot rom, the FSBL and the bitstream are not
+ * counted.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include "xil_types.h"		/* types used by xilinx */
+#include "watchdog.h"
+
+/* boot stages (c.f. boot_stage) */
+#define BOOT_ENTRY 0		/* fast path started */
+#define BOOT_SAFE 1			/* red and the gate driven */
+#define BOOT_COPIED 2		/* the rest of the image in DDR */
+#define BOOT_MAIN 3			/* main entered */
+#define BOOT_READY 4		/* hardware_init done */
+#define BOOT_STAGES 5
+
+/*
+ * stamp <stage> now
+ */
+void boot_stage(u32 stage);
+
+/*
+ * returns true after a watchdog reset, with the last saved state in <last>
+ */
+bool boot_warm(watchdog_state_t *last);
+
+/*
+ * print the stage times and the copy rate
+ */
+void boot_print(void);
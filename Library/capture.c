@@ -0,0 +1,129 @@
+/*
+ * capture.c -- timestamped input events
+ */
+
+#include <string.h>
+#include "capture.h"
+#include "xtime_l.h"		/* global timer */
+#include "xpseudo_asm.h"	/* cpsr access */
+#include "xreg_cortexa9.h"
+
+#define NS 1000000000ull
+
+static const char *names[CAPTURE_KINDS] = { "request", "train arrived", "train left", "walk" };
+static capture_record_t records[CAPTURE_RECORDS];
+static u32 head = 0;			/* records written */
+static u64 pressed;				/* first unserved request, ns */
+static u64 arrived;
+static bool on = false;			/* train on the sensor */
+static capture_stats_t stats;
+
+/*
+ * global timer ticks to ns
+ */
+static u64 ns(u64 ticks){
+	return ticks / COUNTS_PER_SECOND * NS + ticks % COUNTS_PER_SECOND * NS / COUNTS_PER_SECOND;
+}
+
+/*
+ * fold a closed span into <span>; returns it in ns
+ */
+static u64 fold(capture_span_t *span, u64 from, u64 to){
+	u64 d = to - from;
+
+	if (span->count == 0 || d < span->min_ns)
+		span->min_ns = d;
+	if (d > span->max_ns)
+		span->max_ns = d;
+	span->sum_ns += d;
+	span->count++;
+	return d;
+}
+
+/*
+ * clear
+ */
+void capture_init(void){
+	memset(&stats, 0, sizeof(stats));
+	head = 0;
+	on = false;
+}
+
+/*
+ * record an event
+ */
+u64 capture_event(u32 kind, u64 at, bool late){
+	u32 cpsr = mfcpsr();
+	capture_record_t *r;
+	u64 t = ns(at), span = 0;
+
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);	/* from handlers and the sequences */
+	r = &records[head++ % CAPTURE_RECORDS];
+	r->ns = t;
+	r->kind = kind;
+	r->late = late;
+	stats.events++;
+	stats.late += late;
+
+	switch (kind){
+	case CAPTURE_PRESS:
+		if (!stats.waiting){
+			stats.waiting = true;
+			pressed = t;
+		}
+		break;
+	case CAPTURE_WALK:
+		if (stats.waiting){
+			stats.waiting = false;
+			span = fold(&stats.wait, pressed, t);
+		}
+		break;
+	case CAPTURE_ARRIVED:
+		on = true;
+		arrived = t;
+		break;
+	case CAPTURE_LEFT:
+		if (on){
+			on = false;
+			span = fold(&stats.occupancy, arrived, t);
+		}
+		break;
+	}
+	mtcpsr(cpsr);
+	return span;
+}
+
+/*
+ * the most recent records
+ */
+u32 capture_records(capture_record_t *out, u32 max){
+	u32 cpsr = mfcpsr();
+	u32 n, i;
+
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);
+	n = head < CAPTURE_RECORDS ? head : CAPTURE_RECORDS;
+	if (n > max)
+		n = max;
+	for (i = 0; i < n; i++)
+		out[i] = records[(head - n + i) % CAPTURE_RECORDS];
+	mtcpsr(cpsr);
+	return n;
+}
+
+/*
+ * statistics
+ */
+void capture_stats(capture_stats_t *out){
+	u32 cpsr = mfcpsr();
+
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);
+	*out = stats;
+	mtcpsr(cpsr);
+}
+
+/*
+ * event names
+ */
+const char *capture_name(u32 kind){
+	return kind < CAPTURE_KINDS ? names[kind] : "?";
+}
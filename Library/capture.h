@@ -0,0 +1,73 @@
+/*
+ * capture.h -- timestamped input events
+ *
+ * The GPIO handlers read the global timer as they are entered (c.f.
+ * io_entry), so each pedestrian request and train sensor edge carries the
+ * time it was taken to within the interrupt latency, not the next TTC
+ * tick. The events go into a ring of records, and the spans between them
+ * are folded into running statistics as they close: the pedestrian wait,
+ * from the first request to the start of the walk phase, and the train
+ * occupancy, from arrival to leaving. A stamp taken from gic_poll during
+ * a button storm is the poll's time; its record is marked late.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include "xil_types.h"		/* types used by xilinx */
+
+/* events */
+#define CAPTURE_PRESS 0			/* pedestrian request */
+#define CAPTURE_ARRIVED 1		/* train onto the sensor */
+#define CAPTURE_LEFT 2			/* train off it */
+#define CAPTURE_WALK 3			/* walk phase started */
+#define CAPTURE_KINDS 4
+
+#define CAPTURE_RECORDS 32		/* most recent events kept */
+
+typedef struct {
+	u64 ns;					/* local time of the stamp (c.f. timesync_local) */
+	u8 kind;
+	bool late;				/* not stamped at interrupt entry */
+} capture_record_t;
+
+typedef struct {
+	u32 count;
+	u64 min_ns;
+	u64 max_ns;
+	u64 sum_ns;
+} capture_span_t;
+
+typedef struct {
+	capture_span_t wait;		/* first request to walk */
+	capture_span_t occupancy;	/* train arrived to left */
+	u32 events;
+	u32 late;
+	bool waiting;				/* a request not yet served */
+} capture_stats_t;
+
+/*
+ * clear the records and the statistics
+ */
+void capture_init(void);
+
+/*
+ * record event <kind> stamped at global timer <at>; returns the span it
+ * closes in ns (a wait or an occupancy), 0 if none
+ */
+u64 capture_event(u32 kind, u64 at, bool late);
+
+/*
+ * copy up to <max> of the most recent records, oldest first, into <out>;
+ * returns how many
+ */
+u32 capture_records(capture_record_t *out, u32 max);
+
+/*
+ * copy the statistics into <out>
+ */
+void capture_stats(capture_stats_t *out);
+
+/*
+ * returns the name of event <kind>
+ */
+const char *capture_name(u32 kind);
@@ -0,0 +1,236 @@
+/*
+ * config.c -- runtime-tunable configuration store
+ */
+
+#include <stdio.h>			/* printf for errors */
+#include <stdbool.h>
+#include <stddef.h>			/* offsetof */
+#include <string.h>
+#include "config.h"
+#include "flash.h"
+#include "msg.h"
+#include "servo.h"
+#include "xpseudo_asm.h"	/* cpsr access */
+#include "xreg_cortexa9.h"
+
+#define MAGIC 0x33474643	/* "CFG3" */
+
+typedef struct {
+	const char *name;
+	u32 offset;
+	u32 min;
+	u32 max;
+} config_key_t;
+
+typedef struct {
+	u32 magic;
+	config_t values;
+	u32 check;
+} record_t;
+
+static const config_t defaults = {
+	TRAFFIC_TMR, PEDESTRIAN_TMR, LIGHT_TMR, FREQ, ID,
+	(u32)(MAXDUTY * 1000000), (u32)(MINDUTY * 1000000), POT_SCALE,
+	MSG_VALUES, MARGIN_MS
+};
+
+static const config_key_t keys[CONFIG_KEYS] = {
+	{ "traffic",	offsetof(config_t, traffic),	1, 600 },
+	{ "pedestrian",	offsetof(config_t, pedestrian),	1, 600 },
+	{ "light",		offsetof(config_t, light),		1, 60 },
+	{ "freq",		offsetof(config_t, freq),		1, 100 },
+	{ "id",			offsetof(config_t, id),			0, MSG_VALUES - 1 },
+	{ "maxduty",	offsetof(config_t, maxduty),	50000, 125000 },
+	{ "minduty",	offsetof(config_t, minduty),	25000, 100000 },
+	{ "potscale",	offsetof(config_t, potscale),	100, 400 },
+	{ "upstream",	offsetof(config_t, upstream),	0, MSG_VALUES },
+	{ "margin",		offsetof(config_t, margin),		1000, 60000 },
+};
+
+/* the flash store, a step per main loop pass */
+enum { IDLE, ERASING, PROGRAMMING };
+
+static config_t bank[2];
+const config_t * volatile config = &defaults;
+static volatile bool dirty = false;
+static volatile bool changed = false;	/* published since the last poll */
+static bool persist = false;		/* flash is usable */
+static u32 store = IDLE;
+static record_t rec;				/* being written */
+static u32 written;					/* bytes of it programmed */
+
+/*
+ * checksum over the values
+ */
+static u32 checksum(const config_t *c){
+	const u32 *w = (const u32*) c;
+	u32 sum = MAGIC;
+	u32 i;
+
+	for (i = 0; i < sizeof(config_t) / sizeof(u32); i++)
+		sum = (sum << 1 | sum >> 31) ^ w[i];
+	return ~sum;
+}
+
+/*
+ * returns true if every value of <c> is in range
+ */
+static bool valid(const config_t *c){
+	u32 i, v;
+
+	for (i = 0; i < CONFIG_KEYS; i++){
+		v = *(const u32*)((const u8*) c + keys[i].offset);
+		if (v < keys[i].min || v > keys[i].max)
+			return false;
+	}
+	return c->minduty < c->maxduty;
+}
+
+/*
+ * copy the active values into <out>; the writers mask IRQs, so a copy
+ * with them masked cannot see a bank being reused
+ */
+static void current(config_t *out){
+	u32 cpsr = mfcpsr();
+
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);
+	*out = *config;
+	mtcpsr(cpsr);
+}
+
+/*
+ * copy <c> into the inactive bank and make it active
+ */
+static void publish(const config_t *c){
+	config_t *pending = (config == &bank[0]) ? &bank[1] : &bank[0];
+
+	*pending = *c;
+	__sync_synchronize();
+	config = pending;
+}
+
+/*
+ * load the defaults and any valid overrides persisted in flash
+ */
+void config_init(void){
+	publish(&defaults);
+#ifdef BOOT_XIP
+	/*
+	 * the code around us is fetched through the linear window, which the
+	 * qspi leaves while it is driven in I/O mode: read the record through
+	 * the window and keep changes in memory only
+	 */
+	memcpy(&rec, (const void *)(XPAR_PS7_QSPI_LINEAR_0_S_AXI_BASEADDR + CONFIG_FLASH_OFFSET), sizeof(rec));
+	if (rec.magic == MAGIC && rec.check == checksum(&rec.values) && valid(&rec.values))
+		publish(&rec.values);
+	printf("Config: xip image, changes are not persisted\n");
+	return;
+#endif
+	if (flash_init() != XST_SUCCESS){
+		printf("Config: flash unavailable, using defaults\n");
+		return;
+	}
+	persist = true;
+	flash_read(CONFIG_FLASH_OFFSET, &rec, sizeof(rec));
+	if (rec.magic == MAGIC && rec.check == checksum(&rec.values) && valid(&rec.values))
+		publish(&rec.values);
+}
+
+/*
+ * get the value of <key>
+ */
+s32 config_get(u32 key, u32 *value){
+	if (key >= CONFIG_KEYS)
+		return XST_FAILURE;
+	*value = *(const u32*)((const u8*) config + keys[key].offset);
+	return XST_SUCCESS;
+}
+
+/*
+ * set <key> to <value> and publish the update atomically
+ */
+s32 config_set(u32 key, u32 value){
+	config_t next;
+	u32 cpsr;
+
+	if (key >= CONFIG_KEYS)
+		return XST_FAILURE;
+	cpsr = mfcpsr();
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);	/* one writer at a time */
+	next = *config;
+	*(u32*)((u8*) &next + keys[key].offset) = value;
+	if (!valid(&next)){
+		mtcpsr(cpsr);
+		return XST_FAILURE;
+	}
+	publish(&next);
+	dirty = changed = true;
+	mtcpsr(cpsr);
+	return XST_SUCCESS;
+}
+
+/*
+ * restore the defaults
+ */
+void config_reset(void){
+	u32 cpsr = mfcpsr();
+
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);
+	publish(&defaults);
+	dirty = changed = true;
+	mtcpsr(cpsr);
+}
+
+/*
+ * returns the name of <key>
+ */
+const char *config_name(u32 key){
+	return key < CONFIG_KEYS ? keys[key].name : NULL;
+}
+
+/*
+ * persist pending changes to flash, a step at a time; returns true if
+ * values were published since the last call
+ */
+bool config_poll(void){
+	u32 cpsr = mfcpsr();
+	u32 n;
+	bool was;
+
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);
+	was = changed;
+	changed = false;
+	mtcpsr(cpsr);
+	if (!persist)
+		return was;
+
+	switch (store){
+	case IDLE:
+		if (!dirty)
+			break;
+		dirty = false;		/* a change from here on writes again */
+		rec.magic = MAGIC;
+		current(&rec.values);
+		rec.check = checksum(&rec.values);
+		flash_erase(CONFIG_FLASH_OFFSET);
+		written = 0;
+		store = ERASING;
+		break;
+	case ERASING:
+	case PROGRAMMING:
+		if (flash_busy())
+			break;
+		if (written == sizeof(rec)){
+			store = IDLE;
+			break;
+		}
+		n = sizeof(rec) - written;
+		if (n > FLASH_PAGE - (CONFIG_FLASH_OFFSET + written) % FLASH_PAGE)
+			n = FLASH_PAGE - (CONFIG_FLASH_OFFSET + written) % FLASH_PAGE;
+		flash_program(CONFIG_FLASH_OFFSET + written, (const u8*) &rec + written, n);
+		written += n;
+		store = PROGRAMMING;
+		break;
+	}
+	return was;
+}
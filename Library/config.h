@@ -0,0 +1,97 @@
+/*
+ * config.h -- runtime-tunable configuration store
+ *
+ * Defaults live in .rodata; overrides are persisted to QSPI flash and can be
+ * read and written over the substation link (c.f. config_msg_t in msg.h).
+ * Updates are staged in the inactive copy and published with a single
+ * pointer store, so the hot path reads a value as config->field with no
+ * locking. A reader always sees each field either before or after an update.
+ *
+ * Built with BOOT_XIP the image runs from the QSPI linear window, which is
+ * lost while the flash is driven in I/O mode: overrides already in flash
+ * are read through the window, and changes are kept in memory only.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include "xil_types.h"		/* types used by xilinx */
+
+/* default timing (TTC ticks) and identity */
+#define TRAFFIC_TMR 10
+#define PEDESTRIAN_TMR 10  //@ 1/10TH seconds per interrupt
+#define LIGHT_TMR 3
+#define FREQ 1
+#define ID 21
+#define POT_SCALE 297		/* pot voltage correction (1/100) */
+#define MARGIN_MS 5000		/* gate down this long before a tracked train (c.f. track.h) */
+
+/* keys */
+#define CONFIG_TRAFFIC 0		/* minimum green the adaptive timing works around (ticks) */
+#define CONFIG_PEDESTRIAN 1		/* pedestrian phase it works around, and train-gone wait (ticks) */
+#define CONFIG_LIGHT 2			/* yellow (ticks) */
+#define CONFIG_FREQ 3			/* ttc frequency (Hz, applied at boot) */
+#define CONFIG_ID 4				/* controller id on the line */
+#define CONFIG_MAXDUTY 5		/* servo duty at closed (ppm) */
+#define CONFIG_MINDUTY 6		/* servo duty at open (ppm) */
+#define CONFIG_POTSCALE 7		/* pot voltage correction (1/100) */
+#define CONFIG_UPSTREAM 8		/* id of the upstream crossing; MSG_VALUES for none */
+#define CONFIG_MARGIN 9			/* gate down before a tracked train arrives (ms) */
+#define CONFIG_KEYS 10
+
+#define CONFIG_FLASH_OFFSET 0xFF0000	/* last 64K of the 16M QSPI */
+
+typedef struct {
+	u32 traffic;
+	u32 pedestrian;
+	u32 light;
+	u32 freq;
+	u32 id;
+	u32 maxduty;
+	u32 minduty;
+	u32 potscale;
+	u32 upstream;
+	u32 margin;
+} config_t;
+
+/*
+ * the active configuration; read fields directly (config->light)
+ */
+extern const config_t * volatile config;
+
+/*
+ * load the defaults and any valid overrides persisted in flash
+ */
+void config_init(void);
+
+/*
+ * get the value of <key>
+ *
+ * returns XST_SUCCESS on success; XST_FAILURE if <key> is invalid
+ */
+s32 config_get(u32 key, u32 *value);
+
+/*
+ * set <key> to <value> and publish the update atomically; safe from
+ * thread or interrupt context
+ *
+ * returns XST_SUCCESS on success; XST_FAILURE if <key> or <value> is invalid
+ */
+s32 config_set(u32 key, u32 value);
+
+/*
+ * restore the defaults
+ */
+void config_reset(void);
+
+/*
+ * returns the name of <key>; NULL if <key> is invalid
+ */
+const char *config_name(u32 key);
+
+/*
+ * persist pending changes to flash (call from the main loop); each call
+ * takes one step of the erase and program and does not wait on the flash
+ *
+ * returns true if values were published since the last call
+ */
+bool config_poll(void);
@@ -0,0 +1,287 @@
+/*
+ * console.c -- operator console on UART1
+ */
+
+#include <stdio.h>			/* vsnprintf */
+#include <stdarg.h>
+#include <string.h>
+#include "console.h"
+#include "gic.h"
+#include "xuartps.h"
+#include "xparameters.h"	/* constants used by the hardware */
+#include "xpseudo_asm.h"	/* cpsr access */
+#include "xreg_cortexa9.h"
+
+#define PROMPT "> "
+
+static XUartPs uart;
+static const console_cmd_t *commands;
+static u32 ncommands;
+
+static u8 tx[CONSOLE_TX];		/* transmit ring */
+static volatile u32 tx_head = 0;	/* next byte queued */
+static volatile u32 tx_tail = 0;	/* next byte to send */
+static volatile u32 tx_sending = 0;	/* bytes handed to the driver */
+static u32 dropped = 0;
+
+static char edit[CONSOLE_LINE + 1];	/* line being typed (interrupt side) */
+static u32 edit_len = 0;
+static bool was_cr = false;
+static char line[CONSOLE_LINE + 1];	/* line being run (main loop side) */
+static volatile bool pending = false;
+static volatile bool stop = false;
+
+static const console_cmd_t *running;	/* command in progress */
+static u32 argc;
+static char *argv[CONSOLE_ARGS];
+static u32 step;
+
+/*
+ * hand the oldest contiguous run of the ring to the driver; IRQs masked
+ */
+static void kick(void){
+	u32 tail = tx_tail & (CONSOLE_TX - 1);
+	u32 n = tx_head - tx_tail;
+
+	if (tx_sending != 0 || n == 0)
+		return;
+	if (n > CONSOLE_TX - tail)
+		n = CONSOLE_TX - tail;		/* up to the wrap; the rest goes next */
+	tx_sending = n;
+	XUartPs_Send(&uart, &tx[tail], n);
+}
+
+/*
+ * queue; IRQs masked
+ */
+static u32 put(const u8 *buf, u32 len){
+	u32 room = CONSOLE_TX - (tx_head - tx_tail);
+	u32 i;
+
+	if (len > room){
+		dropped += len - room;
+		len = room;
+	}
+	for (i = 0; i < len; i++)
+		tx[(tx_head + i) & (CONSOLE_TX - 1)] = buf[i];
+	tx_head += len;
+	kick();
+	return len;
+}
+
+static void puts_irq(const char *s){
+	put((const u8 *) s, strlen(s));
+}
+
+/*
+ * edit the line with <c>; runs in the receive interrupt
+ */
+static void edit_byte(u8 c){
+	u8 echo = c;
+
+	if (c == '\n' && was_cr){		/* \r\n counts once */
+		was_cr = false;
+		return;
+	}
+	was_cr = c == '\r';
+	switch (c){
+	case '\r':
+	case '\n':
+		puts_irq("\r\n");
+		if (pending){				/* still running the last one */
+			puts_irq("busy\r\n");
+			return;
+		}
+		memcpy(line, edit, edit_len + 1);
+		edit_len = 0;
+		edit[0] = '\0';
+		pending = true;
+		break;
+	case 0x03:						/* ^C */
+		stop = true;
+		edit_len = 0;
+		edit[0] = '\0';
+		puts_irq("^C\r\n" PROMPT);
+		break;
+	case 0x15:						/* ^U */
+		while (edit_len > 0){
+			edit[--edit_len] = '\0';
+			puts_irq("\b \b");
+		}
+		break;
+	case 0x08:						/* backspace */
+	case 0x7F:						/* delete */
+		if (edit_len > 0){
+			edit[--edit_len] = '\0';
+			puts_irq("\b \b");
+		}
+		break;
+	default:
+		if (c < ' ' || c > '~' || edit_len >= CONSOLE_LINE){
+			echo = '\a';
+		} else {
+			edit[edit_len++] = c;
+			edit[edit_len] = '\0';
+		}
+		put(&echo, 1);
+		break;
+	}
+}
+
+/*
+ * uart1 handler
+ */
+static void console_handler(void *CallBackRef, u32 Event, u32 EventData){
+	u8 byte;
+
+	switch (Event){
+	case XUARTPS_EVENT_RECV_DATA:
+	case XUARTPS_EVENT_RECV_TOUT:
+		while (XUartPs_Recv(&uart, &byte, 1) == 1)
+			edit_byte(byte);
+		break;
+	case XUARTPS_EVENT_SENT_DATA:
+		tx_tail += tx_sending;
+		tx_sending = 0;
+		kick();
+		break;
+	}
+}
+
+/*
+ * split the line into tokens in place
+ */
+static u32 tokenize(char *s, char *out[]){
+	u32 n = 0;
+
+	for(;;){
+		while (*s == ' ' || *s == '\t')
+			*s++ = '\0';
+		if (*s == '\0' || n == CONSOLE_ARGS)
+			return n;
+		out[n++] = s;
+		while (*s != '\0' && *s != ' ' && *s != '\t')
+			s++;
+	}
+}
+
+/*
+ * built-in: one command per step
+ */
+static bool help(u32 argc, char *argv[], u32 step){
+	if (step < ncommands)
+		console_printf("%-10s %s\r\n", commands[step].name, commands[step].help);
+	return step + 1 < ncommands;
+}
+
+static const console_cmd_t help_cmd = { "help", "list the commands", help };
+
+/*
+ * initialize
+ */
+void console_init(const console_cmd_t *cmds, u32 ncmds){
+	XUartPs_Config *uartConfig;
+
+	commands = cmds;
+	ncommands = ncmds;
+	uartConfig = XUartPs_LookupConfig(XPAR_PS7_UART_1_DEVICE_ID);
+	XUartPs_CfgInitialize(&uart, uartConfig, uartConfig->BaseAddress);
+	XUartPs_SetInterruptMask(&uart, XUARTPS_IXR_RXOVR | XUARTPS_IXR_TOUT);
+	XUartPs_SetFifoThreshold(&uart, 1);
+	XUartPs_SetRecvTimeout(&uart, 8);
+	XUartPs_SetHandler(&uart, console_handler, &uart);
+	gic_limit(XPAR_XUARTPS_1_INTR, CONSOLE_IRQ_BUDGET, false);
+	gic_connect(XPAR_XUARTPS_1_INTR, (Xil_ExceptionHandler) XUartPs_InterruptHandler, &uart);
+	console_printf(PROMPT);
+}
+
+/*
+ * run steps while the ring has room
+ */
+void console_poll(void){
+	u32 i, steps;
+
+	if (stop){						/* ^C: drop the command */
+		stop = false;
+		running = NULL;
+		pending = false;
+	}
+	if (running == NULL){
+		if (!pending)
+			return;
+		argc = tokenize(line, argv);
+		if (argc == 0){
+			pending = false;
+			console_printf(PROMPT);
+			return;
+		}
+		running = strcmp(argv[0], "help") == 0 ? &help_cmd : NULL;
+		for (i = 0; running == NULL && i < ncommands; i++){
+			if (strcmp(argv[0], commands[i].name) == 0)
+				running = &commands[i];
+		}
+		if (running == NULL){
+			console_printf("%s: unknown command (try help)\r\n" PROMPT, argv[0]);
+			pending = false;
+			return;
+		}
+		step = 0;
+	}
+	for (steps = 0; steps < CONSOLE_STEPS; steps++){
+		if (CONSOLE_TX - (tx_head - tx_tail) < CONSOLE_CHUNK)
+			return;					/* wait for the ring to drain */
+		if (!running->run(argc, argv, step++)){
+			running = NULL;
+			pending = false;
+			console_printf(PROMPT);
+			return;
+		}
+	}
+}
+
+/*
+ * queue formatted output
+ */
+u32 console_printf(const char *fmt, ...){
+	char buf[CONSOLE_CHUNK];
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+	if (n < 0)
+		return 0;
+	if (n >= (int) sizeof(buf)){
+		dropped += n - (sizeof(buf) - 1);
+		n = sizeof(buf) - 1;
+	}
+	return console_write((const u8 *) buf, n);
+}
+
+/*
+ * queue raw bytes
+ */
+u32 console_write(const u8 *buf, u32 len){
+	u32 cpsr = mfcpsr();
+	u32 n;
+
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);
+	n = put(buf, len);
+	mtcpsr(cpsr);
+	return n;
+}
+
+/*
+ * dropped output
+ */
+u32 console_dropped(void){
+	return dropped;
+}
+
+/*
+ * close
+ */
+void console_close(void){
+	gic_disconnect(XPAR_XUARTPS_1_INTR);
+}
@@ -0,0 +1,66 @@
+/*
+ * console.h -- operator console on UART1
+ *
+ * The receive interrupt edits one line in place (backspace, ^U erases
+ * the line, ^C stops a running command) and echoes it. Enter hands the
+ * line to console_poll, which splits it into tokens in place and runs
+ * the matching entry of a constant command table. Output goes through
+ * a transmit ring drained by the UART interrupt. A command that prints
+ * more than CONSOLE_CHUNK bytes does so in steps. console_poll runs a
+ * step only when the ring has room for it, and at most CONSOLE_STEPS per
+ * call, so a long dump never holds up the main loop or waits on the
+ * UART. Nothing is allocated.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include "xil_types.h"		/* types used by xilinx */
+
+#define CONSOLE_LINE 80			/* longest command line */
+#define CONSOLE_ARGS 8			/* most tokens on a line */
+#define CONSOLE_TX 2048			/* transmit ring (power of 2) */
+#define CONSOLE_CHUNK 160		/* most one command step may print */
+#define CONSOLE_STEPS 16		/* most steps run per console_poll */
+#define CONSOLE_IRQ_BUDGET 256	/* uart interrupts per GIC_WINDOW_MS before polling */
+
+typedef struct {
+	const char *name;
+	const char *help;
+	/*
+	 * run step <step> (0 first) of the command; returns true if there
+	 * are more steps. argv points into the line, which stays put until
+	 * the last step.
+	 */
+	bool (*run)(u32 argc, char *argv[], u32 step);
+} console_cmd_t;
+
+/*
+ * initialize UART1 with the <ncmds> commands in <cmds>; "help" lists them
+ */
+void console_init(const console_cmd_t *cmds, u32 ncmds);
+
+/*
+ * run the next steps of the pending command, if any (main loop only)
+ */
+void console_poll(void);
+
+/*
+ * queue formatted output; returns the bytes queued (output that does not
+ * fit in the ring is dropped and counted)
+ */
+u32 console_printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+/*
+ * queue <len> raw bytes (safe from interrupt context)
+ */
+u32 console_write(const u8 *buf, u32 len);
+
+/*
+ * returns the output bytes dropped for want of room in the ring
+ */
+u32 console_dropped(void);
+
+/*
+ * disconnect the console interrupt
+ */
+void console_close(void);
@@ -0,0 +1,234 @@
+/*
+ * crossing.c -- the crossing sequences, free of hardware
+ *
+ * Each sequence is a coroutine (c.f. pt.h) reading as straight-line code;
+ * the sequence clock is c->ticks.
+ */
+
+#include "crossing.h"
+
+static const char *names[CROSSING_STATES] = {
+	"TRAFFIC_ON", "YELLOW", "PEDESTRIAN", "TRAIN_COMING", "TRAIN_GONE", "MAINTENANCE"
+};
+
+/*
+ * a train is near, or came and went before the sequences ran
+ */
+static inline bool train(const crossing_t *c){
+	return c->traincoming || c->arrived;
+}
+
+/*
+ * enter <state> (sequences only)
+ */
+static void enter(crossing_t *c, u8 state){
+	c->state = state;
+	c->entered = c->ticks;
+	c->ops->enter(c);
+}
+
+/*
+ * train: red and gate down until the train clears, then hold before opening
+ */
+static PT_THREAD(train_seq(crossing_t *c)){
+	PT_BEGIN(&c->seq);
+	do {
+		enter(c, TRAIN_COMING);
+		c->arrived = 0;
+		c->ops->signal(c, SIGNAL_RED);
+		c->ops->gate(c, CROSSING_CLOSED);
+		PT_AWAIT_EVENT(&c->seq, !c->traincoming);
+		enter(c, TRAIN_GONE);
+		PT_AWAIT_TIMEOUT(&c->seq, c->ticks, c->ops->hold(c), c->traincoming);
+	} while (c->traincoming);
+	c->ops->gate(c, CROSSING_OPEN);
+	PT_END(&c->seq);
+}
+
+/*
+ * pedestrian: red for the walk phase unless a train or the key cuts it short
+ */
+static PT_THREAD(pedestrian_seq(crossing_t *c)){
+	PT_BEGIN(&c->seq);
+	enter(c, PEDESTRIAN);
+	c->btnpressed = 0;
+	c->ops->request(c, false);
+	c->ops->signal(c, SIGNAL_RED);
+	PT_AWAIT_TIMEOUT(&c->seq, c->ticks, c->ops->walk(c), train(c) || c->keyflag);
+	c->pedcrossed = !train(c) && !c->keyflag;
+	PT_END(&c->seq);
+}
+
+/*
+ * maintenance: red with blue flashing, gate follows the wheel until the key is removed
+ */
+static PT_THREAD(maintenance_seq(crossing_t *c)){
+	PT_BEGIN(&c->seq);
+	enter(c, MAINTENANCE);
+	while (c->keyflag){
+		c->ops->gate(c, c->ops->wheel(c));
+		c->ops->signal(c, SIGNAL_RED);
+		if ((c->ticks - c->entered) % 2 == 0){		/* every other tick */
+			c->blue = !c->blue;
+			c->ops->signal(c, c->blue ? SIGNAL_OFF : SIGNAL_BLUE);
+		}
+		PT_AWAIT_TIMEOUT(&c->seq, c->ticks, 1, !c->keyflag);
+	}
+	if (c->btnpressed)
+		c->ops->request(c, true);
+	if (c->traincoming)
+		c->arrived = 1;		/* the switch left the gate down: no yellow */
+	else
+		c->ops->gate(c, CROSSING_OPEN);		/* not where the wheel left it */
+	PT_END(&c->seq);
+}
+
+/*
+ * crossing: green until there is demand, then yellow and the requested sequence
+ */
+static PT_THREAD(crossing_thread(crossing_t *c)){
+	PT_BEGIN(&c->pt);
+	for(;;){
+		if (!train(c) && !c->keyflag){		/* no green while a train or the key is waiting */
+			enter(c, TRAFFIC_ON);
+			c->ops->signal(c, SIGNAL_GREEN);
+			PT_AWAIT_TIMEOUT(&c->pt, c->ticks, c->ops->green(c), train(c) || c->keyflag);	/* minimum green */
+			PT_AWAIT_EVENT(&c->pt, c->btnpressed || train(c) || c->keyflag);
+		}
+
+		for(;;){
+			/* yellow first unless the signal is already red for a train */
+			if (!c->arrived && !(c->state == PEDESTRIAN && c->traincoming)){
+				enter(c, YELLOW);
+				c->ops->signal(c, SIGNAL_YELLOW);
+				PT_AWAIT_TIMEOUT(&c->pt, c->ticks, c->ops->yellow(c), c->arrived);
+			}
+			if (train(c)){
+				PT_SPAWN(&c->pt, &c->seq, train_seq(c));
+				break;
+			} else if (c->keyflag){
+				PT_SPAWN(&c->pt, &c->seq, maintenance_seq(c));
+			} else if (c->btnpressed){
+				PT_SPAWN(&c->pt, &c->seq, pedestrian_seq(c));
+			} else {
+				break;
+			}
+		}
+	}
+	PT_END(&c->pt);
+}
+
+/*
+ * start in TRAFFIC_ON
+ */
+void crossing_init(crossing_t *c, const crossing_ops_t *ops){
+	c->ops = ops;
+	c->ticks = c->entered = 0;
+	c->state = TRAFFIC_ON;
+	c->keyflag = c->traincoming = c->btnpressed = 0;
+	c->prewarned = c->arrived = c->pedcrossed = c->blue = 0;
+	PT_INIT(&c->pt);
+	PT_INIT(&c->seq);
+}
+
+/*
+ * resume
+ */
+void crossing_resume(crossing_t *c, u8 traincoming, u8 prewarned, u8 keyflag, u8 btnpressed){
+	c->traincoming = traincoming;
+	c->prewarned = traincoming && prewarned;
+	c->keyflag = keyflag;
+	c->btnpressed = btnpressed;
+	c->arrived = traincoming;		/* the gate may be down: no yellow, no green */
+}
+
+/*
+ * advance the sequences
+ */
+void crossing_run(crossing_t *c){
+	crossing_thread(c);
+}
+
+/*
+ * one sequence clock tick
+ */
+void crossing_tick(crossing_t *c){
+	c->ticks++;
+}
+
+/*
+ * pedestrian button
+ */
+void crossing_button(crossing_t *c){
+	c->btnpressed = 1;
+	if (c->state == MAINTENANCE || c->state == TRAIN_COMING)
+		c->ops->request(c, true);		/* queued until the sequence ends */
+}
+
+/*
+ * maintenance key switch
+ */
+void crossing_key(crossing_t *c){
+	c->keyflag = (c->state == MAINTENANCE) ? 0 : 1;
+}
+
+/*
+ * the fast path is skipped for the manual gate and for a leaving train
+ */
+bool crossing_train_edge(const crossing_t *c){
+	return !(c->state == MAINTENANCE || (c->traincoming && !c->prewarned));
+}
+
+/*
+ * train sensor switch
+ */
+u32 crossing_train(crossing_t *c){
+	if (c->state == MAINTENANCE){
+		c->traincoming = !c->traincoming;
+		c->ops->gate(c, c->traincoming ? CROSSING_CLOSED : CROSSING_OPEN);
+		return CROSSING_MANUAL;
+	}
+	if (c->traincoming && !c->prewarned){
+		c->traincoming = 0;
+		return CROSSING_LEFT;
+	}
+	c->prewarned = 0;		/* a pre-warned train has now arrived */
+	c->traincoming = 1;
+	c->arrived = 1;
+	return CROSSING_ARRIVED;
+}
+
+/*
+ * upstream train flag
+ */
+bool crossing_upstream(crossing_t *c, bool train){
+	if (train && !c->traincoming && c->state != MAINTENANCE && c->state != TRAIN_GONE){
+		c->prewarned = 1;
+		c->traincoming = 1;
+		return true;
+	}
+	if (!train && c->prewarned){
+		c->prewarned = 0;
+		c->traincoming = 0;
+		return true;
+	}
+	return false;
+}
+
+/*
+ * a tracked train is due
+ */
+bool crossing_due(crossing_t *c){
+	if (c->traincoming || c->state == MAINTENANCE)
+		return false;
+	c->prewarned = 1;
+	c->traincoming = 1;
+	return true;
+}
+
+/*
+ * state names
+ */
+const char *crossing_name(u32 state){
+	return state < CROSSING_STATES ? names[state] : "?";
+}
@@ -0,0 +1,123 @@
+/*
+ * crossing.h -- the crossing sequences, free of hardware
+ *
+ * All controller state lives in a crossing_t so that it can be copied and
+ * compared; lights, gate and phase lengths are reached through
+ * crossing_ops_t. The firmware runs one instance (c.f. railwayCrossing.c)
+ * and Host/crossing_explore.c builds this file natively to search every
+ * reachable state.
+ *
+ * The event functions are called from interrupt handlers and only raise
+ * flags; crossing_run advances the sequences from the main loop.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include "xil_types.h"		/* types used by xilinx */
+#include "pt.h"
+
+/* states */
+#define TRAFFIC_ON 		0
+#define YELLOW 			1
+#define PEDESTRIAN 		2
+#define TRAIN_COMING 	3
+#define TRAIN_GONE 		4
+#define MAINTENANCE 	5
+#define CROSSING_STATES 6
+
+/* traffic signal aspects */
+#define SIGNAL_OFF 0
+#define SIGNAL_GREEN 1
+#define SIGNAL_YELLOW 2
+#define SIGNAL_RED 3
+#define SIGNAL_BLUE 4
+
+/* gate targets (Q16, c.f. gate.h) */
+#define CROSSING_OPEN 0
+#define CROSSING_CLOSED (1 << 16)
+
+/* crossing_train results */
+#define CROSSING_MANUAL 0		/* maintenance: the switch moved the gate */
+#define CROSSING_ARRIVED 1
+#define CROSSING_LEFT 2
+
+typedef struct crossing crossing_t;
+
+typedef struct {
+	void (*signal)(crossing_t *c, u32 aspect);
+	void (*gate)(crossing_t *c, s32 pos);		/* Q16 target, 0 open */
+	void (*request)(crossing_t *c, bool on);	/* pedestrian request lamp */
+	s32 (*wheel)(crossing_t *c);		/* maintenance wheel, Q16 */
+	u32 (*green)(crossing_t *c);		/* phase lengths in ticks */
+	u32 (*walk)(crossing_t *c);
+	u32 (*yellow)(crossing_t *c);
+	u32 (*hold)(crossing_t *c);			/* wait after a train before opening */
+	void (*enter)(crossing_t *c);		/* state changed */
+} crossing_ops_t;
+
+struct crossing {
+	const crossing_ops_t *ops;
+	volatile u32 ticks;		/* ticks since start: the sequence clock */
+	u32 entered;			/* tick the current state was entered */
+	u8 state;
+	volatile u8 keyflag;
+	volatile u8 traincoming;
+	volatile u8 btnpressed;
+	volatile u8 prewarned;	/* traincoming was raised by the upstream crossing */
+	volatile u8 arrived;	/* a local train took the fast path to red */
+	u8 pedcrossed;
+	u8 blue;				/* maintenance flash phase */
+	pt_t pt;				/* crossing sequence */
+	pt_t seq;				/* train, pedestrian or maintenance sequence */
+};
+
+/*
+ * start <c> in TRAFFIC_ON
+ */
+void crossing_init(crossing_t *c, const crossing_ops_t *ops);
+
+/*
+ * resume with the flags of an earlier run (c.f. watchdog.h); any train,
+ * prewarned or not, goes straight to the train sequence
+ */
+void crossing_resume(crossing_t *c, u8 traincoming, u8 prewarned, u8 keyflag, u8 btnpressed);
+
+/*
+ * advance the sequences until they next block
+ */
+void crossing_run(crossing_t *c);
+
+/*
+ * events
+ */
+void crossing_tick(crossing_t *c);
+void crossing_button(crossing_t *c);
+void crossing_key(crossing_t *c);
+
+/*
+ * train sensor edge; returns true if the gate and signal may be forced
+ * closed before the event is handled (the fast path)
+ */
+bool crossing_train_edge(const crossing_t *c);
+
+/*
+ * train sensor switch; returns one of the CROSSING_ results
+ */
+u32 crossing_train(crossing_t *c);
+
+/*
+ * the upstream crossing's train flag; returns true if it changed traincoming
+ */
+bool crossing_upstream(crossing_t *c, bool train);
+
+/*
+ * a tracked train is due (c.f. track.h): raise traincoming as the upstream
+ * flag does, also while the gate waits to open after a train; clear it
+ * with crossing_upstream. returns true if it changed traincoming
+ */
+bool crossing_due(crossing_t *c);
+
+/*
+ * returns the name of <state>
+ */
+const char *crossing_name(u32 state);
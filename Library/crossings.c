@@ -0,0 +1,92 @@
+/*
+ * crossings.c -- replicated table of the other crossings on the line
+ */
+
+#include <string.h>
+#include "crossings.h"
+
+static void (*local_train_callback)(bool train);
+
+static int values[MSG_VALUES];
+static u16 version = 0;
+static bool synced = false;
+static u32 watched = MSG_VALUES;
+static bool train = false;		/* last MSG_TRAIN seen on the watched crossing */
+
+/*
+ * report a change of the watched crossing's train flag
+ */
+static void check_watch(void){
+	bool now;
+
+	if (watched >= MSG_VALUES)
+		return;
+	now = (values[watched] & MSG_TRAIN) != 0;
+	if (now != train){
+		train = now;
+		if (local_train_callback != NULL)
+			local_train_callback(now);
+	}
+}
+
+/*
+ * initialize the table
+ */
+void crossings_init(u32 watch, void (*train_callback)(bool train)){
+	local_train_callback = train_callback;
+	memset(values, 0, sizeof(values));
+	version = 0;
+	synced = false;
+	train = false;
+	watched = watch;
+}
+
+/*
+ * watch crossing <watch>
+ */
+void crossings_watch(u32 watch){
+	watched = watch;
+	train = false;
+	check_watch();
+}
+
+/*
+ * apply a delta
+ */
+s32 crossings_delta(const state_delta_t *delta){
+	u32 i;
+
+	if (!synced || delta->version != (u16)(version + 1) || delta->count > MSG_VALUES){
+		synced = false;
+		return XST_FAILURE;
+	}
+	for (i = 0; i < delta->count; i++){
+		if (delta->entries[i].index < MSG_VALUES)
+			values[delta->entries[i].index] = delta->entries[i].value;
+	}
+	version = delta->version;
+	check_watch();
+	return XST_SUCCESS;
+}
+
+/*
+ * replace the table with a full snapshot
+ */
+void crossings_full(const state_full_t *full){
+	memcpy(values, full->values, sizeof(values));
+	version = (u16) full->version;
+	synced = true;
+	check_watch();
+}
+
+int crossings_get(u32 index){
+	return index < MSG_VALUES ? values[index] : 0;
+}
+
+bool crossings_synced(void){
+	return synced;
+}
+
+u32 crossings_version(void){
+	return version;
+}
@@ -0,0 +1,51 @@
+/*
+ * crossings.h -- replicated table of the other crossings on the line
+ *
+ * Kept current by STATE_DELTA messages carrying only changed slots; a
+ * version gap or a fresh boot requires a STATE_FULL resync (c.f. msg.h).
+ */
+#pragma once
+
+#include <stdbool.h>
+#include "xil_types.h"		/* types used by xilinx */
+#include "xstatus.h"		/* XST_SUCCESS */
+#include "msg.h"
+
+/*
+ * initialize the table (unsynchronised) providing a callback run when the
+ * MSG_TRAIN flag of crossing <watch> changes
+ */
+void crossings_init(u32 watch, void (*train_callback)(bool train));
+
+/*
+ * watch crossing <watch>; MSG_VALUES watches none
+ */
+void crossings_watch(u32 watch);
+
+/*
+ * apply a delta
+ *
+ * returns XST_SUCCESS on success; XST_FAILURE on a version gap or while
+ * unsynchronised, in which case a resync should be requested
+ */
+s32 crossings_delta(const state_delta_t *delta);
+
+/*
+ * replace the table with a full snapshot
+ */
+void crossings_full(const state_full_t *full);
+
+/*
+ * returns the value of crossing <index>; 0 if unknown
+ */
+int crossings_get(u32 index);
+
+/*
+ * returns true once a full snapshot has been applied and no gap seen since
+ */
+bool crossings_synced(void);
+
+/*
+ * returns the table version
+ */
+u32 crossings_version(void);
@@ -0,0 +1,110 @@
+/*
+ * eth.c -- UDP transport to the substation over the PS Ethernet (GEM)
+ */
+
+#include <stdio.h>			/* printf for errors */
+#include <string.h>
+#include "eth.h"
+#include "msg.h"
+#include "lwip/init.h"
+#include "lwip/udp.h"
+#include "lwip/timeouts.h"
+#include "netif/xadapter.h"
+
+static void (*local_eth_callback)(const u8 *msg, u32 len);
+
+static struct netif netif;			/* the GEM network interface */
+static struct udp_pcb *pcb;			/* substation endpoint */
+static ip_addr_t substation;
+static bool ready = false;
+static u8 bounce[MSG_MAX];			/* only used for chained pbufs */
+
+/*
+ * control is passed to this function when a datagram arrives
+ */
+static void eth_recv(void *arg, struct udp_pcb *upcb, struct pbuf *p,
+		const ip_addr_t *addr, u16_t port){
+	if (p == NULL)
+		return;
+	if (p->len == p->tot_len){
+		local_eth_callback(p->payload, p->len);	/* zero-copy: hand out the rx buffer */
+	} else if (p->tot_len <= sizeof(bounce)){
+		pbuf_copy_partial(p, bounce, p->tot_len, 0);
+		local_eth_callback(bounce, p->tot_len);
+	}
+	pbuf_free(p);
+}
+
+/*
+ * initialize the GEM and the UDP endpoint
+ */
+s32 eth_init(void (*eth_callback)(const u8 *msg, u32 len)){
+	ip_addr_t ip, mask, gw;
+	unsigned char mac[] = ETH_MAC;
+
+	local_eth_callback = eth_callback;
+	ETH_IP(&ip);
+	ETH_NETMASK(&mask);
+	ETH_GW(&gw);
+	ETH_SUBSTATION(&substation);
+
+	lwip_init();
+	if (xemac_add(&netif, &ip, &mask, &gw, mac, XPAR_XEMACPS_0_BASEADDR) == NULL){
+		printf("Ethernet init failed\n");
+		return XST_FAILURE;
+	}
+	netif_set_default(&netif);
+	netif_set_up(&netif);
+
+	pcb = udp_new();
+	if (pcb == NULL || udp_bind(pcb, IP_ADDR_ANY, ETH_PORT) != ERR_OK)
+		return XST_FAILURE;
+	udp_recv(pcb, eth_recv, NULL);
+	ready = true;
+	return XST_SUCCESS;
+}
+
+/*
+ * service the GEM receive path and lwIP timers
+ */
+void eth_poll(void){
+	if (!ready)
+		return;
+	xemacif_input(&netif);
+	sys_check_timeouts();
+}
+
+/*
+ * send <len> bytes of <msg> to the substation
+ */
+s32 eth_send(const void *msg, u32 len){
+	struct pbuf *p;
+	err_t err;
+
+	if (!ready)
+		return XST_FAILURE;
+	p = pbuf_alloc(PBUF_TRANSPORT, len, PBUF_RAM);
+	if (p == NULL)
+		return XST_FAILURE;
+	memcpy(p->payload, msg, len);
+	err = udp_sendto(pcb, p, &substation, ETH_PORT);
+	pbuf_free(p);
+	return err == ERR_OK ? XST_SUCCESS : XST_FAILURE;
+}
+
+/*
+ * returns true if the PHY reports link
+ */
+bool eth_link_up(void){
+	return ready && netif_is_link_up(&netif);
+}
+
+/*
+ * close the UDP endpoint
+ */
+void eth_close(void){
+	if (pcb != NULL)
+		udp_remove(pcb);
+	pcb = NULL;
+	ready = false;
+}
@@ -0,0 +1,52 @@
+/*
+ * eth.h -- UDP transport to the substation over the PS Ethernet (GEM)
+ *
+ * Uses the lwIP raw API (NO_SYS); received datagrams are handed to the
+ * callback straight out of the receive pbuf without copying.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include "xparameters.h"  	/* constants used by the hardware */
+#include "xil_types.h"		/* types used by xilinx */
+
+/* controller network settings */
+#define ETH_IP(a)		IP4_ADDR(a, 192, 168, 1, 21)
+#define ETH_NETMASK(a)	IP4_ADDR(a, 255, 255, 255, 0)
+#define ETH_GW(a)		IP4_ADDR(a, 192, 168, 1, 1)
+#define ETH_MAC			{ 0x00, 0x0a, 0x35, 0x00, 0x01, 0x15 }
+
+/* substation endpoint */
+#define ETH_SUBSTATION(a)	IP4_ADDR(a, 192, 168, 1, 10)
+#define ETH_PORT 		6200
+
+/*
+ * initialize the GEM and the UDP endpoint, providing a callback for
+ * received datagrams
+ *
+ * <msg> is only valid for the duration of the callback
+ * returns XST_SUCCESS on success; otherwise XST_FAILURE
+ */
+s32 eth_init(void (*eth_callback)(const u8 *msg, u32 len));
+
+/*
+ * service the GEM receive path and lwIP timers (call from the main loop)
+ */
+void eth_poll(void);
+
+/*
+ * send <len> bytes of <msg> to the substation
+ *
+ * returns XST_SUCCESS on success; otherwise XST_FAILURE
+ */
+s32 eth_send(const void *msg, u32 len);
+
+/*
+ * returns true if the PHY reports link
+ */
+bool eth_link_up(void);
+
+/*
+ * close the UDP endpoint
+ */
+void eth_close(void);
@@ -0,0 +1,98 @@
+/*
+ * flash.c -- QSPI flash access for persistent records
+ */
+
+#include <string.h>
+#include "flash.h"
+
+/* flash commands */
+#define WRITE_ENABLE 0x06
+#define SUBSECTOR_ERASE 0x20
+#define PAGE_PROGRAM 0x02
+#define READ 0x03
+#define READ_STATUS 0x05
+#define STATUS_BUSY 0x01
+
+#define HDR 4		/* command + 24-bit address */
+
+static XQspiPs qspi;
+static u8 txbuf[HDR + FLASH_PAGE];
+static u8 rxbuf[HDR + FLASH_PAGE];
+
+/*
+ * fill the command header
+ */
+static void header(u8 cmd, u32 offset){
+	txbuf[0] = cmd;
+	txbuf[1] = (u8)(offset >> 16);
+	txbuf[2] = (u8)(offset >> 8);
+	txbuf[3] = (u8)offset;
+}
+
+static void write_enable(void){
+	u8 cmd = WRITE_ENABLE;
+	XQspiPs_PolledTransfer(&qspi, &cmd, NULL, 1);
+}
+
+/*
+ * initialize the qspi controller
+ */
+s32 flash_init(void){
+	XQspiPs_Config *config = XQspiPs_LookupConfig(XPAR_XQSPIPS_0_DEVICE_ID);
+
+	if (config == NULL || XQspiPs_CfgInitialize(&qspi, config, config->BaseAddress) != XST_SUCCESS)
+		return XST_FAILURE;
+	XQspiPs_SetOptions(&qspi, XQSPIPS_FORCE_SSELECT_OPTION | XQSPIPS_MANUAL_START_OPTION | XQSPIPS_HOLD_B_DRIVE_OPTION);
+	XQspiPs_SetClkPrescaler(&qspi, XQSPIPS_CLK_PRESCALE_8);
+	XQspiPs_SetSlaveSelect(&qspi);
+	return XST_SUCCESS;
+}
+
+/*
+ * read <len> bytes at flash <offset> into <buf>
+ */
+void flash_read(u32 offset, void *buf, u32 len){
+	u32 n;
+
+	while (len > 0){
+		n = len > FLASH_PAGE ? FLASH_PAGE : len;
+		header(READ, offset);
+		XQspiPs_PolledTransfer(&qspi, txbuf, rxbuf, HDR + n);
+		memcpy(buf, rxbuf + HDR, n);
+		buf = (u8*) buf + n;
+		offset += n;
+		len -= n;
+	}
+}
+
+/*
+ * start erasing the subsector at <offset>
+ */
+void flash_erase(u32 offset){
+	write_enable();
+	header(SUBSECTOR_ERASE, offset);
+	XQspiPs_PolledTransfer(&qspi, txbuf, NULL, HDR);
+}
+
+/*
+ * start programming <buf> at <offset>
+ */
+void flash_program(u32 offset, const void *buf, u32 len){
+	if (len > FLASH_PAGE)
+		len = FLASH_PAGE;
+	write_enable();
+	header(PAGE_PROGRAM, offset);
+	memcpy(txbuf + HDR, buf, len);
+	XQspiPs_PolledTransfer(&qspi, txbuf, NULL, HDR + len);
+}
+
+/*
+ * one status read
+ */
+bool flash_busy(void){
+	u8 cmd[2] = { READ_STATUS, 0 };
+	u8 status[2];
+
+	XQspiPs_PolledTransfer(&qspi, cmd, status, 2);
+	return (status[1] & STATUS_BUSY) != 0;
+}
@@ -0,0 +1,46 @@
+/*
+ * flash.h -- QSPI flash access for persistent records
+ *
+ * Polled I/O mode from the main loop. An erase or a program is started
+ * and left to run in the flash; poll flash_busy until it is done before
+ * starting the next, so no call waits on the flash. I/O mode takes the
+ * controller off the linear window, so an image that runs in place
+ * (BOOT_XIP) must not call these at all.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include "xqspips.h"		/* ps qspi details */
+#include "xparameters.h"  	/* constants used by the hardware */
+#include "xil_types.h"		/* types used by xilinx */
+
+#define FLASH_SUBSECTOR 4096	/* erase granularity */
+#define FLASH_PAGE 256			/* program granularity */
+
+/*
+ * initialize the qspi controller
+ *
+ * returns XST_SUCCESS on success; otherwise XST_FAILURE
+ */
+s32 flash_init(void);
+
+/*
+ * read <len> bytes at flash <offset> into <buf>
+ */
+void flash_read(u32 offset, void *buf, u32 len);
+
+/*
+ * start erasing the subsector at <offset>
+ */
+void flash_erase(u32 offset);
+
+/*
+ * start programming <len> (<= FLASH_PAGE) bytes of <buf> at <offset>,
+ * inside one page of an erased subsector
+ */
+void flash_program(u32 offset, const void *buf, u32 len);
+
+/*
+ * returns true while an erase or program is still running
+ */
+bool flash_busy(void);
@@ -0,0 +1,163 @@
+/*
+ * gate.c -- closed-loop gate position controller
+ */
+
+#include <stdbool.h>
+#include "gate.h"
+#include "gic.h"
+#include "adc.h"
+#include "servo.h"
+#include "watchdog.h"
+#include "xtime_l.h"		/* global timer for loop timing */
+
+static void (*local_gate_callback)(u32 event, u32 settle_ms);
+static XTtcPs ttcPort;		/* loop timer instance */
+static u32 clock;			/* its input clock at full cpu speed */
+
+static volatile s32 target = GATE_OPEN;
+static volatile s32 position = GATE_OPEN;
+static s32 integral = 0;
+static s32 preverr = 0;
+static u32 moving = 0;		/* ticks since the target last changed */
+static u32 inband = 0;		/* consecutive ticks inside GATE_TOL */
+static bool confirmed = true;
+static u32 maxloop = 0;
+
+/*
+ * saturate <v> to [lo,hi]
+ */
+static inline s32 clamp(s32 v, s32 lo, s32 hi){
+	return v < lo ? lo : (v > hi ? hi : v);
+}
+
+/*
+ * one PID step; runs at GATE_RATE
+ */
+static void gate_handler(void *devicePtr){
+	XTime start, end;
+	s32 err, out;
+	s64 acc;
+
+	XTime_GetTime(&start);
+	position = (s32) adc_get_gate();
+	err = target - position;
+
+	/*
+	 * the servo holds whatever it is commanded, so the target is fed
+	 * forward and the PID only trims the error left by the linkage;
+	 * proportional + derivative on error, integral with conditional integration
+	 */
+	acc = ((s64) target << 16) + (s64) GATE_KP * err + (s64) GATE_KD * (err - preverr) + ((s64) integral << 16);
+	out = (s32)(acc >> 16);
+	preverr = err;
+	if ((out < GATE_ONE || err < 0) && (out > 0 || err > 0) && err < GATE_IBAND && err > -GATE_IBAND){	/* anti-windup: near the target, not pushing into a rail */
+		integral = clamp(integral + (s32)(((s64) GATE_KI * err) >> 16), -GATE_IMAX, GATE_IMAX);
+	}
+	servo_set_pos(clamp(out, 0, GATE_ONE));
+
+	/* confirm once the position stays inside the band */
+	moving++;
+	if (err < GATE_TOL && err > -GATE_TOL){
+		inband++;
+	} else {
+		inband = 0;
+	}
+	if (!confirmed && inband >= GATE_SETTLE_TICKS && (target == GATE_OPEN || target == GATE_CLOSED)){
+		confirmed = true;
+		if (local_gate_callback != NULL)
+			local_gate_callback(target == GATE_CLOSED ? GATE_CLOSED_CONFIRMED : GATE_OPEN_CONFIRMED,
+					(moving - GATE_SETTLE_TICKS) * 1000 / GATE_RATE);
+	}
+
+	XTtcPs_ClearInterruptStatus(&ttcPort, XTTCPS_IXR_INTERVAL_MASK);
+	watchdog_alive(WATCHDOG_GATE);
+	XTime_GetTime(&end);
+	if ((u32)(end - start) > maxloop)
+		maxloop = (u32)(end - start);
+}
+
+/*
+ * initialize the gate loop
+ */
+void gate_init(void (*gate_callback)(u32 event, u32 settle_ms)){
+	XTtcPs_Config* ttcConfig;
+	u8 prescaler;
+	XInterval interval;
+
+	local_gate_callback = gate_callback;
+	position = (s32) adc_get_gate();
+	target = position;
+
+	ttcConfig = XTtcPs_LookupConfig(XPAR_XTTCPS_1_DEVICE_ID);
+	XTtcPs_CfgInitialize(&ttcPort, ttcConfig, ttcConfig->BaseAddress);
+	clock = ttcPort.Config.InputClockHz;
+	XTtcPs_DisableInterrupts(&ttcPort, XTTCPS_IXR_INTERVAL_MASK);
+
+	/*connect interrupt handler to gic */
+	gic_connect(XPAR_XTTCPS_1_INTR, (XExceptionHandler)gate_handler, &ttcPort);
+
+	XTtcPs_CalcIntervalFromFreq(&ttcPort, GATE_RATE, &interval, &prescaler);
+	XTtcPs_SetPrescaler(&ttcPort, prescaler);
+	XTtcPs_SetInterval(&ttcPort, interval);
+	XTtcPs_SetOptions(&ttcPort, XTTCPS_OPTION_INTERVAL_MODE);
+
+	XTtcPs_EnableInterrupts(&ttcPort, XTTCPS_IXR_INTERVAL_MASK);
+	XTtcPs_Start(&ttcPort);
+}
+
+/*
+ * set the target position
+ */
+void gate_set(s32 pos){
+	pos = clamp(pos, GATE_OPEN, GATE_CLOSED);
+	if (pos != target){
+		target = pos;
+		moving = 0;
+		inband = 0;
+		confirmed = false;
+	}
+}
+
+void gate_open(void){
+	gate_set(GATE_OPEN);
+}
+
+void gate_close(void){
+	gate_set(GATE_CLOSED);
+}
+
+/*
+ * returns the last measured position
+ */
+s32 gate_position(void){
+	return position;
+}
+
+/*
+ * returns the worst-case loop execution time
+ */
+u32 gate_max_loop(void){
+	return maxloop;
+}
+
+/*
+ * keep GATE_RATE with the cpu clock divided
+ */
+void gate_rescale(u32 slow){
+	u8 prescaler;
+	XInterval interval;
+
+	ttcPort.Config.InputClockHz = clock / slow;
+	XTtcPs_CalcIntervalFromFreq(&ttcPort, GATE_RATE, &interval, &prescaler);
+	XTtcPs_SetPrescaler(&ttcPort, prescaler);
+	XTtcPs_SetInterval(&ttcPort, interval);
+}
+
+/*
+ * stop the loop
+ */
+void gate_stop(void){
+	XTtcPs_Stop(&ttcPort);
+	XTtcPs_DisableInterrupts(&ttcPort, XTTCPS_IXR_INTERVAL_MASK);
+	gic_disconnect(XPAR_XTTCPS_1_INTR);
+}
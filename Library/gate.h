@@ -0,0 +1,71 @@
+/*
+ * gate.h -- closed-loop gate position controller
+ *
+ * Runs a fixed-point PID at GATE_RATE from TTC0 timer 1, reading the gate
+ * position feedback through the XADC (c.f. adc_get_gate) and driving the
+ * servo. Positions are Q16 fractions: 0 is open, GATE_ONE is closed.
+ * The target is fed forward to the servo and the PID corrects around it.
+ */
+#pragma once
+
+#include <stdio.h>
+#include "xttcps.h"
+#include "xparameters.h"  	/* constants used by the hardware */
+#include "xil_types.h"		/* types used by xilinx */
+
+#define GATE_RATE 1000				/* control loop frequency (Hz) */
+#define GATE_ONE (1 << 16)			/* Q16 1.0 */
+#define GATE_OPEN 0
+#define GATE_CLOSED GATE_ONE
+#define GATE_TOL (GATE_ONE / 50)	/* confirmation band: 2% of travel */
+#define GATE_SETTLE_TICKS 20		/* ticks inside the band to confirm */
+
+/* PID gains (Q16) */
+#define GATE_KP (GATE_ONE * 3 / 2)
+#define GATE_KI (GATE_ONE / 40)
+#define GATE_KD (GATE_ONE / 4)
+#define GATE_IMAX (GATE_ONE / 8)	/* integrator clamp */
+#define GATE_IBAND (GATE_TOL * 2)	/* the integrator runs inside it */
+
+/* gate events */
+#define GATE_OPEN_CONFIRMED 0
+#define GATE_CLOSED_CONFIRMED 1
+
+/*
+ * initialize the gate loop providing a callback for confirmed events
+ *
+ * the callback runs in interrupt context with the settle time in ms
+ */
+void gate_init(void (*gate_callback)(u32 event, u32 settle_ms));
+
+/*
+ * set the target position (Q16, clamped to [GATE_OPEN,GATE_CLOSED])
+ */
+void gate_set(s32 target);
+
+/*
+ * drive the gate fully open / closed
+ */
+void gate_open(void);
+void gate_close(void);
+
+/*
+ * returns the last measured position (Q16)
+ */
+s32 gate_position(void);
+
+/*
+ * returns the worst-case loop execution time in global timer ticks
+ */
+u32 gate_max_loop(void);
+
+/*
+ * keep GATE_RATE with the cpu clock, which also clocks the loop timer,
+ * divided by <slow> (c.f. power.h)
+ */
+void gate_rescale(u32 slow);
+
+/*
+ * stop the loop and close down its timer
+ */
+void gate_stop(void);
@@ -3,13 +3,98 @@
  *
  * Caroline Vanacore
  */
+#include <stddef.h>
 #include "gic.h"
+#include "xtime_l.h"		/* global timer */
+#include "xpseudo_asm.h"	/* cpsr access */
+#include "xreg_cortexa9.h"
+
+#define WINDOW ((XTime) COUNTS_PER_SECOND * GIC_WINDOW_MS / 1000)
+
+/* a budgeted source: its handler runs behind guard() */
+typedef struct {
+	gic_source_t s;
+	Xil_InterruptHandler handler;
+	void *ref;
+	XTime window;		/* start of the current window */
+	u32 arrivals;		/* in it */
+	u32 since;			/* since the last gic_poll */
+	u32 quiet;			/* gic_polls in a row within the budget */
+} source_t;
 
 /*
  * Private Variables hidden by this module
  */
-static XScuGic gic;					/* the gic instance */
+#ifdef CROSSING_FREERTOS
+extern XScuGic xInterruptController;	/* owned by the kernel port */
+#else
+static XScuGic gic_instance;		/* the gic instance */
 static XScuGic_Config *gic_config;	/* the gic configuration */
+#endif
+static XScuGic *gic;
+static source_t sources[GIC_SOURCES];
+static u32 nsources = 0;
+
+/*
+ * the budgeted source for an interrupt id, or NULL
+ */
+static source_t *find(u32 id) {
+	u32 i;
+
+	for (i = 0; i < nsources; i++){
+		if (sources[i].s.id == id)
+			return &sources[i];
+	}
+	return NULL;
+}
+
+/*
+ * count an interrupt against its budget, then run its handler; over
+ * budget, the source is masked (unless exempt) until gic_poll finds it calm
+ */
+static void guard(void *ref) {
+	source_t *src = ref;
+	XTime now;
+
+	XTime_GetTime(&now);
+	if (now - src->window >= WINDOW){
+		src->window = now;
+		src->arrivals = 0;
+	}
+	src->arrivals++;
+	src->since++;
+	src->s.count++;
+	if (src->arrivals > src->s.peak)
+		src->s.peak = src->arrivals;
+	if (src->s.budget != 0 && src->arrivals > src->s.budget && !src->s.storming){
+		src->s.storming = true;
+		src->s.storms++;
+		src->quiet = 0;
+		if (!src->s.exempt)
+			XScuGic_Disable(gic, src->s.id);
+	}
+	src->handler(src->ref);
+}
+
+/*
+ * is interrupt <id> pending at the distributor (masked sources still latch)
+ */
+static bool pending(u32 id) {
+	return (XScuGic_DistReadReg(gic, XSCUGIC_PENDING_SET_OFFSET + (id / 32) * 4) >> (id % 32)) & 1;
+}
+
+/*
+ * end a storm: unmask the source, or catch up on the work an exempt one shed
+ */
+static void release(source_t *src) {
+	src->s.storming = false;
+	if (src->s.exempt){
+		src->handler(src->ref);
+		src->s.polled++;
+	} else {
+		XScuGic_Enable(gic, src->s.id);
+	}
+}
 
 
 /*
@@ -20,43 +105,159 @@ static XScuGic_Config *gic_config;	/* the gic configuration */
  * Initialize the gic
  */
 s32 gic_init(void) {
+#ifdef CROSSING_FREERTOS
+	/* the scheduler has initialized the gic and owns the irq vector */
+	gic = &xInterruptController;
+	return XST_SUCCESS;
+#else
+	gic = &gic_instance;
 	/* lookup the gic */
 	gic_config = XScuGic_LookupConfig(XPAR_PS7_SCUGIC_0_DEVICE_ID);
 	/* initialize it */
-	if(XScuGic_CfgInitialize(&gic,gic_config,gic_config->CpuBaseAddress) != XST_SUCCESS)
+	if(XScuGic_CfgInitialize(gic,gic_config,gic_config->CpuBaseAddress) != XST_SUCCESS)
 		return XST_FAILURE;
 	/* register the exception handler */
-	Xil_ExceptionRegisterHandler(XIL_EXCEPTION_ID_INT,(Xil_ExceptionHandler)XScuGic_InterruptHandler,&gic);
+	Xil_ExceptionRegisterHandler(XIL_EXCEPTION_ID_INT,(Xil_ExceptionHandler)XScuGic_InterruptHandler,gic);
 	/* enable exceptions */
 	Xil_ExceptionEnable();
 	return XST_SUCCESS;
+#endif
 }
 
 /*
  * Connect an interrupt id to handler and device
  */
 s32 gic_connect(u32 id, Xil_InterruptHandler handler,  void *devp) {
-	/* associate handler with the interrupt id */
-	if(XScuGic_Connect(&gic,id,handler,devp) != XST_SUCCESS)
+	source_t *src = find(id);
+
+	/* associate handler with the interrupt id, behind the guard if budgeted */
+	if (src != NULL){
+		src->handler = handler;
+		src->ref = devp;
+		src->s.storming = false;
+		src->arrivals = src->since = src->quiet = 0;
+		handler = guard;
+		devp = src;
+	}
+	if(XScuGic_Connect(gic,id,handler,devp) != XST_SUCCESS)
 		return XST_FAILURE;
 	/* enable the interrupt at the gic */
-	XScuGic_Enable(&gic, id);
+	XScuGic_Enable(gic, id);
+	return XST_SUCCESS;
+}
+
+/*
+ * Set the priority of an interrupt id, keeping its trigger type
+ */
+void gic_set_priority(u32 id, u8 priority) {
+	u8 oldpriority, trigger;
+	XScuGic_GetPriorityTriggerType(gic, id, &oldpriority, &trigger);
+	XScuGic_SetPriorityTriggerType(gic, id, priority, trigger);
+}
+
+/*
+ * Run the handler connected to an interrupt id
+ */
+void gic_dispatch(u32 id) {
+	XScuGic_VectorTableEntry *entry = &gic->Config->HandlerTable[id];
+	entry->Handler(entry->CallBackRef);
+}
+
+/*
+ * Give an interrupt id a budget
+ */
+s32 gic_limit(u32 id, u32 budget, bool exempt) {
+	source_t *src = find(id);
+	u32 cpsr = mfcpsr();
+
+	if (src == NULL){
+		if (nsources == GIC_SOURCES)
+			return XST_FAILURE;
+		src = &sources[nsources++];
+		src->s.id = id;
+	}
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);	/* the guard updates it */
+	src->s.budget = budget;
+	src->s.exempt = exempt;
+	if (budget == 0 && src->s.storming && src->handler != NULL)
+		release(src);
+	mtcpsr(cpsr);
 	return XST_SUCCESS;
 }
 
+/*
+ * Is an interrupt id over its budget
+ */
+bool gic_storm(u32 id) {
+	source_t *src = find(id);
+
+	return src != NULL && src->s.storming;
+}
+
+/*
+ * Serve throttled sources, with irqs masked as their handlers expect
+ */
+void gic_poll(void) {
+	source_t *src;
+	u32 cpsr = mfcpsr();
+	u32 i, id;
+
+	for (i = 0; i < nsources; i++){
+		src = &sources[i];
+		id = src->s.id;
+		mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);
+		if (src->s.storming && !src->s.exempt && pending(id)){
+			/* cleared first: an edge while the handler runs pends it again */
+			XScuGic_DistWriteReg(gic, XSCUGIC_PENDING_CLR_OFFSET + (id / 32) * 4, 1u << (id % 32));
+			src->handler(src->ref);
+			src->s.polled++;
+			src->since++;
+		}
+		if (src->s.storming){
+			src->quiet = src->since <= src->s.budget ? src->quiet + 1 : 0;
+			if (src->quiet >= GIC_CALM)
+				release(src);
+		}
+		src->since = 0;
+		mtcpsr(cpsr);
+	}
+}
+
+/*
+ * Copy the budgeted sources
+ */
+u32 gic_sources(gic_source_t *out, u32 max) {
+	u32 cpsr = mfcpsr();
+	u32 i;
+
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);
+	for (i = 0; i < nsources && i < max; i++)
+		out[i] = sources[i].s;
+	mtcpsr(cpsr);
+	return i;
+}
+
 /*
  * Disconnect an interrupt id
  */
 void gic_disconnect(u32 id) {
-	XScuGic_Disconnect(&gic,id);
-	XScuGic_Disable(&gic,id);
+	source_t *src = find(id);
+
+	XScuGic_Disconnect(gic,id);
+	XScuGic_Disable(gic,id);
+	if (src != NULL){
+		src->handler = NULL;
+		src->s.storming = false;
+	}
 }
 
 /*
  * Close the gic
  */
 void gic_close(void) {
+#ifndef CROSSING_FREERTOS
 	Xil_ExceptionRemoveHandler(XIL_EXCEPTION_ID_INT);
-	XScuGic_Stop(&gic);
+	XScuGic_Stop(gic);
+#endif
 }
 
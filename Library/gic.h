@@ -5,11 +5,27 @@
 
 #include "xparameters.h"    /* device details */
 #include "xil_exception.h"  /* exception handling */
+#include <stdbool.h>
 #include "xil_types.h"		/* types used by xilinx */
 #include "xscugic.h"		/* gic details */
 #include "xgpio.h"			/* axi gpio details */
 #include "xuartps.h"		/* ps uart details */
 
+#define GIC_SOURCES 8			/* interrupts that can be given a budget */
+#define GIC_WINDOW_MS 10		/* budget window */
+#define GIC_CALM 5				/* polls in a row within budget that end a storm */
+
+typedef struct {
+	u32 id;
+	u32 budget;				/* interrupts per window; 0 for no limit */
+	bool exempt;			/* never masked (c.f. gic_limit) */
+	bool storming;			/* over budget and not yet calm */
+	u32 count;				/* interrupts taken */
+	u32 polled;				/* handler runs from gic_poll */
+	u32 storms;				/* times over budget */
+	u32 peak;				/* most interrupts in one window */
+} gic_source_t;
+
 /*
  * Initialize the gic
  *
@@ -24,6 +40,48 @@ s32 gic_init(void);
  */
 s32 gic_connect(u32 id, Xil_InterruptHandler handler,  void *devp);
 
+/*
+ * Set the priority of interrupt <id> (0 highest, steps of 8; default 0xA0)
+ */
+void gic_set_priority(u32 id, u8 priority);
+
+/*
+ * Run the handler connected to interrupt <id> in the caller's context, as
+ * the gic would (benchmarks and event injection); <id> must be connected
+ */
+void gic_dispatch(u32 id);
+
+/*
+ * Give interrupt <id> a budget of <budget> interrupts per GIC_WINDOW_MS
+ * (0 for no limit); call before gic_connect, or again to change it.
+ *
+ * A source over budget is masked at the gic and its handler run from
+ * gic_poll whenever it is pending. The storm ends once GIC_CALM polls in
+ * a row have each seen no more than one window's budget; a masked source
+ * is then unmasked, and masked again within a window if it is still
+ * storming. An <exempt> source is never masked: it keeps interrupting,
+ * and its handler may shed non-critical work while gic_storm says so;
+ * it is run once more from gic_poll when the storm ends.
+ *
+ * returns XST_SUCCESS on success; XST_FAILURE if GIC_SOURCES are in use
+ */
+s32 gic_limit(u32 id, u32 budget, bool exempt);
+
+/*
+ * returns true while interrupt <id> is over its budget
+ */
+bool gic_storm(u32 id);
+
+/*
+ * Serve throttled sources and let calm ones back (main loop)
+ */
+void gic_poll(void);
+
+/*
+ * Copy the budgeted sources into <out> (at most <max>); returns how many
+ */
+u32 gic_sources(gic_source_t *out, u32 max);
+
 /*
  * Disconnect an interrupt id
  *
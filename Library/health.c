@@ -0,0 +1,161 @@
+/*
+ * health.c -- die temperature and supply rail monitoring
+ */
+
+#include "health.h"
+#include "adc.h"
+#include "xtime_l.h"		/* global timer */
+#include "xpseudo_asm.h"	/* cpsr access */
+#include "xreg_cortexa9.h"
+
+#define ALARMS (XADCPS_INTX_ALM0_MASK | XADCPS_INTX_ALM1_MASK | XADCPS_INTX_ALM2_MASK | XADCPS_INTX_OT_MASK)
+
+static health_t health;
+static volatile u32 active = 0;		/* alarm interrupts masked until they clear */
+static lat_t reaction;
+
+/* fixed-point conversions (c.f. XAdcPs_RawToTemperature/RawToVoltage) */
+static inline s32 raw_to_mc(u16 raw){
+	return (s32)(((s64) raw * 503975) >> 16) - 273150;
+}
+
+static inline s32 raw_to_mv(u16 raw){
+	return (s32)(((u32) raw * 3000) >> 16);
+}
+
+static inline u16 mc_to_raw(s32 mc){
+	return (u16)((((s64) mc + 273150) << 16) / 503975);
+}
+
+static inline u16 mv_to_raw(s32 mv){
+	return (u16)(((u32) mv << 16) / 3000);
+}
+
+/*
+ * fold a sample into <s>
+ */
+static void sample(health_stat_t *s, s32 v){
+	s->last = v;
+	if (v < s->min)
+		s->min = v;
+	if (v > s->max)
+		s->max = v;
+	s->avg += (v - s->avg) / 8;
+}
+
+static void stat_init(health_stat_t *s, s32 v){
+	s->last = s->min = s->max = s->avg = v;
+}
+
+/*
+ * recompute the level from the active alarms and the temperature
+ */
+static void update_level(void){
+	if (active)
+		health.level = HEALTH_HOT;
+	else if (health.temp.last >= HEALTH_TEMP_WARN)
+		health.level = HEALTH_WARM;
+	else
+		health.level = HEALTH_OK;
+}
+
+/*
+ * alarm interrupt: shed load now, re-arm from health_poll
+ */
+static void health_alarm(u32 status){
+	XTime entry, done;
+
+	XTime_GetTime(&entry);
+	status &= ALARMS;
+	adc_alarm_mask(status, false);		/* level alarms: hold off until clear */
+	active |= status;
+	health.alarms++;
+	health.level = HEALTH_HOT;
+	XTime_GetTime(&done);
+	lat_add(&reaction, done - entry);
+}
+
+/*
+ * program the alarm thresholds and enable the alarm interrupts
+ */
+void health_init(void){
+	stat_init(&health.temp, raw_to_mc(adc_get_raw(XADCPS_CH_TEMP)));
+	stat_init(&health.vccint, raw_to_mv(adc_get_raw(XADCPS_CH_VCCINT)));
+	stat_init(&health.vccaux, raw_to_mv(adc_get_raw(XADCPS_CH_VCCAUX)));
+	lat_reset(&reaction);
+
+	adc_alarm_threshold(XADCPS_ATR_TEMP_UPPER, mc_to_raw(HEALTH_TEMP_ALARM));
+	adc_alarm_threshold(XADCPS_ATR_TEMP_LOWER, mc_to_raw(HEALTH_TEMP_CLEAR));
+	adc_alarm_threshold(XADCPS_ATR_VCCINT_UPPER, mv_to_raw(HEALTH_VCCINT_MAX));
+	adc_alarm_threshold(XADCPS_ATR_VCCINT_LOWER, mv_to_raw(HEALTH_VCCINT_MIN));
+	adc_alarm_threshold(XADCPS_ATR_VCCAUX_UPPER, mv_to_raw(HEALTH_VCCAUX_MAX));
+	adc_alarm_threshold(XADCPS_ATR_VCCAUX_LOWER, mv_to_raw(HEALTH_VCCAUX_MIN));
+
+	adc_alarm_init(XADCPS_CFR1_ALM_TEMP_MASK | XADCPS_CFR1_ALM_VCCINT_MASK | XADCPS_CFR1_ALM_VCCAUX_MASK, health_alarm);
+	adc_alarm_mask(ALARMS, true);
+	update_level();
+}
+
+/*
+ * sample the sensors and re-arm cleared alarms
+ */
+void health_poll(void){
+	u32 clear = 0;
+	u32 cpsr;
+
+	sample(&health.temp, raw_to_mc(adc_get_raw(XADCPS_CH_TEMP)));
+	sample(&health.vccint, raw_to_mv(adc_get_raw(XADCPS_CH_VCCINT)));
+	sample(&health.vccaux, raw_to_mv(adc_get_raw(XADCPS_CH_VCCAUX)));
+
+	if (health.temp.last < HEALTH_TEMP_CLEAR)
+		clear |= XADCPS_INTX_ALM0_MASK | XADCPS_INTX_OT_MASK;
+	if (health.vccint.last >= HEALTH_VCCINT_MIN && health.vccint.last <= HEALTH_VCCINT_MAX)
+		clear |= XADCPS_INTX_ALM1_MASK;
+	if (health.vccaux.last >= HEALTH_VCCAUX_MIN && health.vccaux.last <= HEALTH_VCCAUX_MAX)
+		clear |= XADCPS_INTX_ALM2_MASK;
+
+	cpsr = mfcpsr();
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);	/* active is shared with health_alarm */
+	clear &= active;
+	if (clear){
+		active &= ~clear;
+		adc_alarm_mask(clear, true);
+	}
+	update_level();
+	mtcpsr(cpsr);
+}
+
+u32 health_level(void){
+	return health.level;
+}
+
+/*
+ * returns n: non-essential periodic work should run every n-th time
+ */
+u32 health_divider(void){
+	switch(health.level){
+	case HEALTH_WARM:
+		return 2;
+	case HEALTH_HOT:
+		return 10;
+	}
+	return 1;
+}
+
+/*
+ * copy the statistics into <out>
+ */
+void health_get(health_t *out){
+	*out = health;
+}
+
+const lat_t *health_reaction(void){
+	return &reaction;
+}
+
+/*
+ * disable the alarm interrupts
+ */
+void health_close(void){
+	adc_alarm_close();
+}
@@ -0,0 +1,76 @@
+/*
+ * health.h -- die temperature and supply rail monitoring
+ *
+ * XADC hardware alarms interrupt on over-temperature and rail excursions;
+ * the main loop samples the sensors for min/max/avg statistics (fixed
+ * point: milli-degrees C and mV) and re-arms alarms once they clear.
+ */
+#pragma once
+
+#include "xil_types.h"		/* types used by xilinx */
+#include "lat.h"
+
+/* health levels */
+#define HEALTH_OK 0
+#define HEALTH_WARM 1		/* approaching the thermal limit: shed some load */
+#define HEALTH_HOT 2		/* alarm active: shed all non-essential load */
+
+/* limits */
+#define HEALTH_TEMP_WARN 70000		/* mC */
+#define HEALTH_TEMP_ALARM 85000
+#define HEALTH_TEMP_CLEAR 75000		/* alarm hysteresis */
+#define HEALTH_VCCINT_MIN 950		/* mV */
+#define HEALTH_VCCINT_MAX 1050
+#define HEALTH_VCCAUX_MIN 1710
+#define HEALTH_VCCAUX_MAX 1890
+
+typedef struct {
+	s32 last;
+	s32 min;
+	s32 max;
+	s32 avg;		/* ewma, alpha 1/8 */
+} health_stat_t;
+
+typedef struct {
+	health_stat_t temp;		/* mC */
+	health_stat_t vccint;	/* mV */
+	health_stat_t vccaux;	/* mV */
+	u32 alarms;				/* alarm interrupts since boot */
+	u32 level;
+} health_t;
+
+/*
+ * program the alarm thresholds and enable the alarm interrupts
+ */
+void health_init(void);
+
+/*
+ * sample the sensors and re-arm cleared alarms (call from the main loop)
+ */
+void health_poll(void);
+
+/*
+ * returns the current level {HEALTH_OK,HEALTH_WARM,HEALTH_HOT}
+ */
+u32 health_level(void);
+
+/*
+ * returns n: non-essential periodic work (console, statistics, time sync)
+ * should run every n-th time; the substation updates are not that
+ */
+u32 health_divider(void);
+
+/*
+ * copy the statistics into <out>
+ */
+void health_get(health_t *out);
+
+/*
+ * returns the alarm interrupt to load-shed latency histogram
+ */
+const lat_t *health_reaction(void);
+
+/*
+ * disable the alarm interrupts
+ */
+void health_close(void);
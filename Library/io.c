@@ -9,25 +9,38 @@
 #include "xparameters.h"  	/* constants used by the hardware */
 #include "xil_types.h"		/* types used by xilinx */
 #include "gic.h"
+#include "io.h"
+#include "xtime_l.h"		/* global timer */
+#ifdef CROSSING_PLIO
+#include "plio.h"
+#endif
 
 
 static void (*local_btn_callback)(u32 btn);
 static void (*local_sw_callback)(u32 sw);
+static void (*local_train_callback)(u64 entry);
 
-static XGpio btnport;	       /* btn GPIO port instance */
-static XGpio swport;		   /* sw GPIO port instance */
-static u32 prevState = 0;
+static XTime entry = 0;		   /* global timer at entry of the handler running, 0 outside */
+static bool entry_late = false;
 
 #define CHANNEL1 0x1
 #define BTNMASK 0XFF
 #define SWMASK BTNMASK
 
+#ifndef CROSSING_PLIO
+
+static XGpio btnport;	       /* btn GPIO port instance */
+static XGpio swport;		   /* sw GPIO port instance */
+static u32 prevState = 0;
+
 /*
  * control is passed to this function when a button is pushed
  *
  * devicep -- ptr to the device that caused the interrupt
  */
 static void btn_handler(void *devicep) {
+	XTime_GetTime(&entry);
+	entry_late = gic_storm(XPAR_FABRIC_GPIO_1_VEC_ID);	/* run from gic_poll */
 	u32 btnstate = XGpio_DiscreteRead(&btnport, CHANNEL1);
 
 	/* create interrupt only when pressing and not releasing */
@@ -35,16 +48,38 @@ static void btn_handler(void *devicep) {
 		local_btn_callback(btnstate);
 	}
 	XGpio_InterruptClear(&btnport, XGPIO_IR_CH1_MASK);
-
+	entry = 0;
 }
 
 
 static void sw_handler(void *devicep) {
+	XTime outer = entry;	/* a button handler it preempted (FreeRTOS nests) */
+	bool outer_late = entry_late;
+	XTime_GetTime(&entry);
+	entry_late = false;		/* never polled */
 	u32 switchState = XGpio_DiscreteRead(&swport, CHANNEL1);
 
 	u32 swmask = switchState ^prevState;
 	int i = 0;
 
+	/* train sensor first, before any other switch work */
+	if ((swmask & IO_TRAIN_SW) && local_train_callback != NULL){
+		local_train_callback(entry);
+	}
+
+	/* other switches chattering: only the train bit is taken, and the rest
+	 * stay changed for the run at the end of the storm */
+	if (gic_storm(XPAR_FABRIC_GPIO_2_VEC_ID)){
+		swmask &= IO_TRAIN_SW;
+		switchState = (prevState & ~IO_TRAIN_SW) | (switchState & IO_TRAIN_SW);
+		if (swmask == 0){
+			XGpio_InterruptClear(&swport, XGPIO_IR_CH1_MASK);
+			entry = outer;
+			entry_late = outer_late;
+			return;
+		}
+	}
+
 	while (i < 4){
 		if (swmask & (1 << i)){
 			break;
@@ -57,6 +92,8 @@ static void sw_handler(void *devicep) {
 	XGpio_InterruptClear(&swport, XGPIO_IR_CH1_MASK); /* clear interrupt */
 
 	prevState = switchState; /* update the current switch state to previous state */
+	entry = outer;
+	entry_late = outer_late;
 }
 
 
@@ -70,7 +107,8 @@ void io_btn_init(void (*btn_callback)(u32 btn)){
 
 	XGpio_InterruptDisable(&btnport, XGPIO_IR_CH1_MASK);  //Disable interrupts
 
-	/* connect handler to gic */
+	/* connect handler to gic, polled while it chatters */
+	gic_limit(XPAR_FABRIC_GPIO_1_VEC_ID, IO_BTN_BUDGET, false);
 	gic_connect(XPAR_FABRIC_GPIO_1_VEC_ID , (XExceptionHandler)btn_handler,  &btnport);
 
 	XGpio_InterruptEnable(&btnport, XGPIO_IR_CH1_MASK); /* enable interrupts on channel (c.f. table 2.1) */
@@ -101,7 +139,8 @@ void io_sw_init(void (*sw_callback)(u32 sw)){
 
 	XGpio_InterruptDisable(&swport, XGPIO_IR_CH1_MASK);  /* Disable interrupt for connection to gic */
 
-	/* connect handler to gic */
+	/* connect handler to gic, never masked: it carries the train sensor */
+	gic_limit(XPAR_FABRIC_GPIO_2_VEC_ID, IO_SW_BUDGET, true);
 	gic_connect(XPAR_FABRIC_GPIO_2_VEC_ID , (XExceptionHandler)sw_handler,  &swport);
 
 	XGpio_InterruptEnable(&swport, XGPIO_IR_CH1_MASK); /* enable interrupts on channel (c.f. table 2.1) */
@@ -117,6 +156,118 @@ void io_sw_close(void){
 	XGpio_InterruptDisable(&swport, XGPIO_IR_CH1_MASK); /* enable interrupts on channel (c.f. table 2.1) */
 	gic_disconnect(XPAR_FABRIC_GPIO_2_VEC_ID);	 /* disconnect the interrupts (c.f. gic.h) */
 	local_sw_callback = NULL; //clear callback function
+	local_train_callback = NULL;
 }
 
 
+
+/*
+ * register the train-sensor fast path
+ */
+void io_train_init(void (*train_callback)(u64 entry)){
+	local_train_callback = train_callback;
+	gic_set_priority(XPAR_FABRIC_GPIO_2_VEC_ID, IO_TRAIN_PRIORITY);
+}
+
+#else
+
+static u32 users = 0;		/* buttons and switches share the block's interrupt */
+static u32 btnstate = 0;
+
+/*
+ * control is passed to this function when the block has changes queued:
+ * each is handled as the gpio handlers would, stamped when its pin moved
+ */
+static void plio_handler(void *devicep) {
+	u32 n = plio_count();
+	plio_event_t ev;
+
+	entry_late = false;		/* never polled */
+	while (n-- > 0 && plio_event(&ev)){
+		entry = ev.at;
+		if (ev.input < PLIO_SW_SHIFT){
+			btnstate = ev.level ? btnstate | 1 << ev.input : btnstate & ~(1 << ev.input);
+			if (ev.level && local_btn_callback != NULL){
+				local_btn_callback(btnstate);	/* only when pressing */
+			}
+			continue;
+		}
+		if (ev.input == PLIO_SW_SHIFT && local_train_callback != NULL){
+			local_train_callback(entry);	/* train sensor first */
+		}
+		if (local_sw_callback != NULL){
+			local_sw_callback(ev.input - PLIO_SW_SHIFT);
+		}
+	}
+	entry = 0;
+}
+
+/*
+ * connect the block's interrupt for the first user
+ */
+static void plio_open(void){
+	if (users++ > 0){
+		return;
+	}
+	if (!plio_init()){
+		printf("crossing_io block not found\r\n");
+		return;
+	}
+	btnstate = plio_state() & PLIO_BTNS;
+
+	/* never masked: it carries the train sensor, and the block filters the chatter */
+	gic_limit(PLIO_VEC_ID, IO_SW_BUDGET, true);
+	gic_connect(PLIO_VEC_ID, (XExceptionHandler)plio_handler, NULL);
+	plio_ctrl(PLIO_CTRL_EVENTS | PLIO_CTRL_IRQ, true);
+}
+
+/*
+ * disconnect it after the last
+ */
+static void plio_close(void){
+	if (users == 0 || --users > 0){
+		return;
+	}
+	plio_ctrl(PLIO_CTRL_EVENTS | PLIO_CTRL_IRQ, false);
+	gic_disconnect(PLIO_VEC_ID);
+}
+
+void io_btn_init(void (*btn_callback)(u32 btn)){
+	local_btn_callback = btn_callback;
+	plio_open();
+}
+
+void io_btn_close(void){
+	plio_close();
+	local_btn_callback = NULL;
+}
+
+void io_sw_init(void (*sw_callback)(u32 sw)){
+	local_sw_callback = sw_callback;
+	plio_open();
+}
+
+void io_sw_close(void){
+	plio_close();
+	local_sw_callback = NULL;
+	local_train_callback = NULL;
+}
+
+void io_train_init(void (*train_callback)(u64 entry)){
+	local_train_callback = train_callback;
+	gic_set_priority(PLIO_VEC_ID, IO_TRAIN_PRIORITY);
+}
+
+#endif
+
+/*
+ * the entry stamp of the gpio handler running
+ */
+bool io_entry(u64 *at){
+	if (entry == 0){
+		XTime_GetTime(at);
+		return false;
+	}
+	*at = entry;
+	return !entry_late;
+}
@@ -1,6 +1,9 @@
 /*
  * io.h -- switch and button module interface
  *
+ * built with CROSSING_PLIO, the buttons and switches come through the
+ * crossing_io block (c.f. plio.h) instead of the AXI GPIO ports: filtered,
+ * behind one interrupt, with the same callbacks
  */
 #pragma once
 
@@ -11,6 +14,17 @@
 #include "xil_types.h"		/* types used by xilinx */
 #include "gic.h"
 
+#define IO_TRAIN_SW 0x1			/* train sensor switch bit */
+#define IO_BTN_BUDGET 8			/* button interrupts per GIC_WINDOW_MS before polling */
+#define IO_SW_BUDGET 8			/* switch interrupts per window before the other switches are shed */
+#ifdef CROSSING_FREERTOS
+#include "FreeRTOS.h"
+/* highest priority still allowed to notify tasks */
+#define IO_TRAIN_PRIORITY (configMAX_API_CALL_INTERRUPT_PRIORITY << portPRIORITY_SHIFT)
+#else
+#define IO_TRAIN_PRIORITY 0x08	/* gic priority of the switch interrupt */
+#endif
+
 /*
  * initialize the btns providing a callback
  */
@@ -24,6 +38,10 @@ void io_btn_close(void);
 
 /*
  * initialize the switches providing a callback
+ *
+ * the switch interrupt is exempt from masking (c.f. gic_limit): over
+ * IO_SW_BUDGET, changes of the other switches wait for the storm to end,
+ * while train switch edges are still handled at once
  */
 void io_sw_init(void (*sw_callback)(u32 sw));
 
@@ -32,3 +50,23 @@ void io_sw_init(void (*sw_callback)(u32 sw));
  */
 void io_sw_close(void);
 
+/*
+ * register the train-sensor fast path, run on every train switch edge ahead
+ * of the switch callback with the global timer value at interrupt entry
+ *
+ * the switch interrupt is raised to IO_TRAIN_PRIORITY
+ */
+void io_train_init(void (*train_callback)(u64 entry));
+
+
+/*
+ * the global timer at entry of the button or switch handler running, for
+ * its callback to stamp the event with (c.f. capture.h)
+ *
+ * returns false if <at> is not the interrupt's entry: the handler was run
+ * from gic_poll during a storm, or the caller is not in a handler (an
+ * injected event), where it is the current time
+ *
+ * built with CROSSING_PLIO, it is when the pin moved, stamped by the block
+ */
+bool io_entry(u64 *at);
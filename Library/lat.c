@@ -0,0 +1,77 @@
+/*
+ * lat.c -- latency histograms
+ */
+
+#include <string.h>
+#include "lat.h"
+#include "xtime_l.h"		/* COUNTS_PER_SECOND */
+
+/*
+ * clear <lat>
+ */
+void lat_reset(lat_t *lat){
+	memset(lat, 0, sizeof(*lat));
+	lat->min_ns = 0xFFFFFFFF;
+}
+
+/*
+ * add a sample
+ */
+void lat_add(lat_t *lat, u64 ticks){
+	u32 ns = (u32)((ticks * 1000000000ull) / COUNTS_PER_SECOND);
+
+	lat->count++;
+	lat->sum_ns += ns;
+	if (ns < lat->min_ns)
+		lat->min_ns = ns;
+	if (ns > lat->max_ns)
+		lat->max_ns = ns;
+	if (ns / LAT_BIN_NS < LAT_BINS)
+		lat->bins[ns / LAT_BIN_NS]++;
+	else
+		lat->overflow++;
+}
+
+/*
+ * returns the <pct> percentile in ns
+ */
+u32 lat_percentile(const lat_t *lat, u32 pct){
+	u32 want = (lat->count * pct + 99) / 100;
+	u32 seen = 0;
+	u32 i;
+
+	if (lat->count == 0)
+		return 0;
+	for (i = 0; i < LAT_BINS; i++){
+		seen += lat->bins[i];
+		if (seen >= want)
+			return (i + 1) * LAT_BIN_NS;	/* upper edge of the bucket */
+	}
+	return lat->max_ns;
+}
+
+/*
+ * format a summary
+ */
+u32 lat_format(const lat_t *lat, const char *name, char *buf, u32 len){
+	int n;
+
+	if (lat->count == 0)
+		n = snprintf(buf, len, "%s: no samples", name);
+	else
+		n = snprintf(buf, len, "%s: n %lu min %lu avg %lu max %lu p99 %lu ns", name,
+				(unsigned long) lat->count, (unsigned long) lat->min_ns,
+				(unsigned long)(lat->sum_ns / lat->count), (unsigned long) lat->max_ns,
+				(unsigned long) lat_percentile(lat, 99));
+	return n < 0 ? 0 : (u32) n < len ? (u32) n : len - 1;
+}
+
+/*
+ * print a summary
+ */
+void lat_print(const lat_t *lat, const char *name){
+	char buf[LAT_LINE];
+
+	lat_format(lat, name, buf, sizeof(buf));
+	printf("%s\n", buf);
+}
@@ -0,0 +1,49 @@
+/*
+ * lat.h -- latency histograms
+ *
+ * Samples are global timer ticks (c.f. xtime_l.h), binned in LAT_BIN_NS
+ * buckets; anything beyond the last bucket lands in the overflow count.
+ */
+#pragma once
+
+#include <stdio.h>
+#include "xil_types.h"		/* types used by xilinx */
+
+#define LAT_BINS 128
+#define LAT_BIN_NS 100		/* bucket width */
+#define LAT_LINE 112		/* room for a summary line */
+
+typedef struct {
+	u32 count;
+	u32 min_ns;
+	u32 max_ns;
+	u64 sum_ns;
+	u32 overflow;
+	u32 bins[LAT_BINS];
+} lat_t;
+
+/*
+ * clear <lat>
+ */
+void lat_reset(lat_t *lat);
+
+/*
+ * add a sample of <ticks> global timer ticks
+ */
+void lat_add(lat_t *lat, u64 ticks);
+
+/*
+ * returns the <pct> (0-100) percentile in ns, to bucket resolution
+ */
+u32 lat_percentile(const lat_t *lat, u32 pct);
+
+/*
+ * format "<name>: n min avg max p99" (ns) into <buf> of <len> bytes;
+ * returns its length
+ */
+u32 lat_format(const lat_t *lat, const char *name, char *buf, u32 len);
+
+/*
+ * print "<name>: n min avg max p99" (ns)
+ */
+void lat_print(const lat_t *lat, const char *name);
@@ -42,7 +42,7 @@ void led_init(void){
     XGpio_Initialize(&port, XPAR_AXI_GPIO_0_DEVICE_ID);	/* initialize device AXI_GPIO_0 */
     XGpio_SetDataDirection(&port, CHANNEL1, OUTPUT);	    /* set tristate buffer to output */
 
-    XGpio_Initialize(&port2, XPAR_AXI_GPIO_0_DEVICE_ID);	/* initialize device AXI_GPIO_ */
+    XGpio_Initialize(&port2, XPAR_AXI_GPIO_3_DEVICE_ID);	/* initialize device AXI_GPIO_3: the rgb led */
     XGpio_SetDataDirection(&port2, CHANNEL1, OUTPUT);	    /* set tristate buffer to output */
 
     XGpioPs_Config *config;
@@ -109,6 +109,24 @@ void led_set(u32 led, bool tostate){								/* GPIO port connected to the leds *
     XGpio_DiscreteWrite(&port, CHANNEL1, ledstate);
 }
 
+/*
+ * Update the shadow of <led>'s port as led_set would, without writing the
+ * port; returns the value for the port
+ */
+u32 led_shadow(u32 led, bool tostate){
+    if (led <= 3){
+        ledstate = tostate ? ledstate | 1 << led : ledstate & ~(1 << led);
+        return ledstate;
+    }
+    switch (led){
+    case 5: rgbstate = tostate ? 2 : 0; break;	/* Red */
+    case 6: rgbstate = tostate ? 1 : 0; break;	/* Green */
+    case 7: rgbstate = tostate ? 4 : 0; break;	/* Blue */
+    case 8: rgbstate = tostate ? 6 : 0; break;	/* Yellow */
+    }
+    return rgbstate;
+}
+
 /*
  * Get the status of <led>
  *
@@ -36,6 +36,15 @@ void led_init(void);
  */
 void led_set(u32 led, bool tostate);
 
+/*
+ * Update the shadow of <led>'s port as led_set would, without writing
+ * the port (for regs.h, which writes it)
+ *
+ * <led> is 0-3 or an rgb colour
+ * returns the value for the port
+ */
+u32 led_shadow(u32 led, bool tostate);
+
 /*
  * Get the status of <led>
  *
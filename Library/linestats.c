@@ -0,0 +1,228 @@
+/*
+ * linestats.c -- line-wide statistics over substation update payloads
+ */
+
+#include <string.h>
+#include "linestats.h"
+
+#if defined(__ARM_NEON) && !defined(LINESTATS_SCALAR)
+#include <arm_neon.h>
+#elif defined(__SSE2__) && !defined(LINESTATS_SCALAR)
+#include <emmintrin.h>
+#endif
+
+#define VALUE (MSG_TRAIN - 1)	/* the part of a value that counts */
+#define BLOCK 8					/* history rows per kernel call */
+
+static update_response_t ring[LINESTATS_HISTORY];
+static u32 pushed = 0;
+
+/*
+ * start <s> empty
+ */
+static void clear(linestats_t *s){
+	memset(s, 0, sizeof(*s));
+	s->min = 0xFFFFFFFF;
+}
+
+/*
+ * slots <from>.. of one row, one at a time; also the kernels' tail
+ */
+static void row_scalar(const int *values, u32 from, u32 threshold, linestats_t *s){
+	u32 i, v;
+
+	for (i = from; i < MSG_VALUES; i++){
+		v = values[i] & VALUE;
+		if (v < s->min)
+			s->min = v;
+		if (v > s->max)
+			s->max = v;
+		s->sum += v;
+		s->sumsq += v * v;
+		s->above |= (u32)(v >= threshold) << i;
+		s->trains |= (u32)((values[i] & MSG_TRAIN) != 0) << i;
+	}
+}
+
+/*
+ * scalar rows
+ */
+void linestats_rows_scalar(const update_response_t *r, u32 n, u32 threshold, linestats_t *out){
+	u32 k;
+
+	for (k = 0; k < n; k++){
+		clear(&out[k]);
+		out[k].count = MSG_VALUES;
+		row_scalar(r[k].values, 0, threshold, &out[k]);
+	}
+}
+
+#if defined(__ARM_NEON) && !defined(LINESTATS_SCALAR)
+/*
+ * neon rows: four slots per vector, seven vectors and a scalar tail
+ */
+void linestats_rows(const update_response_t *r, u32 n, u32 threshold, linestats_t *out){
+	static const u32 bits[4] = { 1, 2, 4, 8 };
+	const uint32x4_t value = vdupq_n_u32(VALUE), train = vdupq_n_u32(MSG_TRAIN);
+	const uint32x4_t over = vdupq_n_u32(threshold), first = vld1q_u32(bits);
+	uint32x4_t raw, v, mn, mx, sum, sq, above, trains, w;
+	uint32x2_t d;
+	u32 i, k;
+
+	for (k = 0; k < n; k++){
+		const u32 *p = (const u32 *) r[k].values;
+
+		mn = vdupq_n_u32(0xFFFFFFFF);
+		mx = sum = sq = above = trains = vdupq_n_u32(0);
+		w = first;					/* the slot bits of this vector */
+		for (i = 0; i + 4 <= MSG_VALUES; i += 4){
+			raw = vld1q_u32(p + i);
+			v = vandq_u32(raw, value);
+			mn = vminq_u32(mn, v);
+			mx = vmaxq_u32(mx, v);
+			sum = vaddq_u32(sum, v);
+			sq = vmlaq_u32(sq, v, v);
+			above = vorrq_u32(above, vandq_u32(vcgeq_u32(v, over), w));
+			trains = vorrq_u32(trains, vandq_u32(vtstq_u32(raw, train), w));
+			w = vshlq_n_u32(w, 4);
+		}
+
+		/* across the lanes */
+		d = vpmin_u32(vget_low_u32(mn), vget_high_u32(mn));
+		out[k].min = vget_lane_u32(vpmin_u32(d, d), 0);
+		d = vpmax_u32(vget_low_u32(mx), vget_high_u32(mx));
+		out[k].max = vget_lane_u32(vpmax_u32(d, d), 0);
+		d = vadd_u32(vget_low_u32(sum), vget_high_u32(sum));
+		out[k].sum = vget_lane_u32(vpadd_u32(d, d), 0);
+		d = vadd_u32(vget_low_u32(sq), vget_high_u32(sq));
+		out[k].sumsq = vget_lane_u32(vpadd_u32(d, d), 0);
+		d = vorr_u32(vget_low_u32(above), vget_high_u32(above));
+		out[k].above = vget_lane_u32(d, 0) | vget_lane_u32(d, 1);
+		d = vorr_u32(vget_low_u32(trains), vget_high_u32(trains));
+		out[k].trains = vget_lane_u32(d, 0) | vget_lane_u32(d, 1);
+		out[k].count = MSG_VALUES;
+		row_scalar(r[k].values, i, threshold, &out[k]);
+	}
+}
+#elif defined(__SSE2__) && !defined(LINESTATS_SCALAR)
+/*
+ * sse2 rows: four slots per vector, seven vectors and a scalar tail. A
+ * value fits in the low half of its lane, so the 16-bit min/max and
+ * multiply-add work on the 32-bit lanes.
+ */
+void linestats_rows(const update_response_t *r, u32 n, u32 threshold, linestats_t *out){
+	const __m128i value = _mm_set1_epi32(VALUE), train = _mm_set1_epi32(MSG_TRAIN);
+	const __m128i under = _mm_set1_epi32((int)(threshold < VALUE + 1 ? threshold : VALUE + 1) - 1);
+	__m128i raw, v, mn, mx, sum, sq;
+	u32 i, k, above, trains;
+
+	for (k = 0; k < n; k++){
+		const int *p = r[k].values;
+
+		mn = _mm_set1_epi32(0x7FFF);
+		mx = sum = sq = _mm_setzero_si128();
+		above = trains = 0;
+		for (i = 0; i + 4 <= MSG_VALUES; i += 4){
+			raw = _mm_loadu_si128((const __m128i *)(p + i));
+			v = _mm_and_si128(raw, value);
+			mn = _mm_min_epi16(mn, v);
+			mx = _mm_max_epi16(mx, v);
+			sum = _mm_add_epi32(sum, v);
+			sq = _mm_add_epi32(sq, _mm_madd_epi16(v, v));
+			above |= (u32) _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(v, under))) << i;
+			trains |= (u32) _mm_movemask_ps(_mm_castsi128_ps(
+					_mm_cmpeq_epi32(_mm_and_si128(raw, train), train))) << i;
+		}
+
+		/* across the lanes */
+		mn = _mm_min_epi16(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(1, 0, 3, 2)));
+		mn = _mm_min_epi16(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(2, 3, 0, 1)));
+		mx = _mm_max_epi16(mx, _mm_shuffle_epi32(mx, _MM_SHUFFLE(1, 0, 3, 2)));
+		mx = _mm_max_epi16(mx, _mm_shuffle_epi32(mx, _MM_SHUFFLE(2, 3, 0, 1)));
+		sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+		sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+		sq = _mm_add_epi32(sq, _mm_shuffle_epi32(sq, _MM_SHUFFLE(1, 0, 3, 2)));
+		sq = _mm_add_epi32(sq, _mm_shuffle_epi32(sq, _MM_SHUFFLE(2, 3, 0, 1)));
+		out[k].count = MSG_VALUES;
+		out[k].min = _mm_cvtsi128_si32(mn);
+		out[k].max = _mm_cvtsi128_si32(mx);
+		out[k].sum = _mm_cvtsi128_si32(sum);
+		out[k].sumsq = _mm_cvtsi128_si32(sq);
+		out[k].above = above;
+		out[k].trains = trains;
+		row_scalar(p, i, threshold, &out[k]);
+	}
+}
+#else
+void linestats_rows(const update_response_t *r, u32 n, u32 threshold, linestats_t *out){
+	linestats_rows_scalar(r, n, threshold, out);
+}
+#endif
+
+/*
+ * merge
+ */
+void linestats_merge(linestats_t *into, const linestats_t *add){
+	into->count += add->count;
+	if (add->min < into->min)
+		into->min = add->min;
+	if (add->max > into->max)
+		into->max = add->max;
+	into->sum += add->sum;
+	into->sumsq += add->sumsq;
+	into->above |= add->above;
+	into->trains |= add->trains;
+}
+
+/*
+ * mean, Q8
+ */
+u32 linestats_mean(const linestats_t *s){
+	return s->count == 0 ? 0 : (u32)(((u64) s->sum << 8) / s->count);
+}
+
+/*
+ * population variance, Q8
+ */
+u32 linestats_variance(const linestats_t *s){
+	u64 n = s->count;
+
+	if (n == 0)
+		return 0;
+	return (u32)(((n * s->sumsq - (u64) s->sum * s->sum) << 8) / (n * n));
+}
+
+/*
+ * keep a response
+ */
+void linestats_push(const update_response_t *r){
+	ring[pushed++ & (LINESTATS_HISTORY - 1)] = *r;
+}
+
+/*
+ * newest response
+ */
+bool linestats_latest(u32 threshold, linestats_t *out){
+	if (pushed == 0)
+		return false;
+	linestats_rows(&ring[(pushed - 1) & (LINESTATS_HISTORY - 1)], 1, threshold, out);
+	return true;
+}
+
+/*
+ * over the history
+ */
+void linestats_history(u32 threshold, linestats_t *out, u32 *n_out){
+	linestats_t rows[BLOCK];
+	u32 n = pushed < LINESTATS_HISTORY ? pushed : LINESTATS_HISTORY;
+	u32 i, k, m;
+
+	clear(out);
+	for (i = 0; i < n; i += m){
+		m = n - i < BLOCK ? n - i : BLOCK;
+		linestats_rows(&ring[i], m, threshold, rows);
+		for (k = 0; k < m; k++)
+			linestats_merge(out, &rows[k]);
+	}
+	*n_out = n;
+}
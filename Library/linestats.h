@@ -0,0 +1,63 @@
+/*
+ * linestats.h -- line-wide statistics over substation update payloads
+ *
+ * Min, max, sum and sum of squares of the values[] of update_response_t
+ * messages, with masks of the slots at or over a threshold and of those
+ * flagged MSG_TRAIN. A value is its low byte (the MSG_TRAIN flag and
+ * anything above it are dropped), so a message's sums fit in 32 bits, and
+ * so do those of the whole history ring. Statistics merge, so the history
+ * is the merge of its rows.
+ *
+ * The row kernel uses NEON on the A9 and SSE2 on an x86 host, four slots
+ * per instruction, and a scalar loop elsewhere or with LINESTATS_SCALAR.
+ * The scalar loop is always built for comparison (linestats_rows_scalar).
+ */
+#pragma once
+
+#include <stdbool.h>
+#include "xil_types.h"		/* types used by xilinx */
+#include "msg.h"
+
+#define LINESTATS_HISTORY 64	/* responses kept (power of 2) */
+
+typedef struct {
+	u32 count;				/* values */
+	u32 min;
+	u32 max;
+	u32 sum;
+	u32 sumsq;
+	u32 above;				/* bit i: slot i at or over the threshold */
+	u32 trains;				/* bit i: slot i flagged MSG_TRAIN */
+} linestats_t;
+
+/*
+ * statistics of each of the <n> responses at <r> into <out>
+ */
+void linestats_rows(const update_response_t *r, u32 n, u32 threshold, linestats_t *out);
+void linestats_rows_scalar(const update_response_t *r, u32 n, u32 threshold, linestats_t *out);
+
+/*
+ * merge <add> into <into>; masks are or'ed
+ */
+void linestats_merge(linestats_t *into, const linestats_t *add);
+
+/*
+ * returns the mean / population variance of <s>, Q8
+ */
+u32 linestats_mean(const linestats_t *s);
+u32 linestats_variance(const linestats_t *s);
+
+/*
+ * keep <r> in the history ring (from the link callback)
+ */
+void linestats_push(const update_response_t *r);
+
+/*
+ * statistics of the newest response; returns false if there is none
+ */
+bool linestats_latest(u32 threshold, linestats_t *out);
+
+/*
+ * statistics over the history ring, in <n_out> the responses it held
+ */
+void linestats_history(u32 threshold, linestats_t *out, u32 *n_out);
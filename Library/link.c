@@ -0,0 +1,429 @@
+/*
+ * link.c -- transport-agnostic substation link
+ *
+ * UART0 frames are delimited by the leading type word (c.f. msg_size);
+ * UDP datagrams are whole messages.
+ */
+
+#include <stdio.h>			/* printf for errors */
+#include <string.h>
+#include "link.h"
+#include "msg.h"
+#include "eth.h"
+#include "gic.h"
+#include "xpseudo_asm.h"	/* cpsr access */
+#include "xreg_cortexa9.h"
+
+/* uart rate negotiation states */
+#define SPEED_BASE 0			/* at LINK_BAUD */
+#define SPEED_OFFERED 1			/* offer sent; waiting for the accept */
+#define SPEED_COMMIT 2			/* commit queued; switch once it has left */
+#define SPEED_VERIFY 3			/* switched; waiting for the ping echo */
+#define SPEED_UP 4				/* at the negotiated rate */
+#define SPEED_HOLD 5			/* fell back; quiet until the substation has too */
+
+static void (*local_msg_callback)(const u8 *msg, u32 len);
+static void (*local_raw_callback)(u8 byte);
+
+static XUartPs uartp0;			/* substation uart instance */
+
+static union {					/* uart frame being assembled */
+	update_response_t aligned;
+	u8 bytes[MSG_MAX];
+} frame;
+static u32 frame_i = 0;
+static u32 frame_len = 0;
+
+static u8 tx[LINK_TX];			/* uart transmit ring; the driver sends from it */
+static volatile u32 tx_head = 0;	/* next byte queued */
+static volatile u32 tx_tail = 0;	/* next byte to send */
+static volatile u32 tx_sending = 0;	/* bytes handed to the driver */
+
+static u32 local_id;
+static volatile bool passthrough = false;
+static volatile u32 active = LINK_UART;
+static u32 misses = 0;			/* udp requests sent since the last udp reply */
+static u32 retry = 0;			/* polls since falling back to uart */
+
+static volatile u32 speed = SPEED_BASE;
+static u32 speed_polls = 0;		/* polls in the current speed state */
+static u32 rate = 0;			/* msg_rates index in use */
+static u32 rate_cap = MSG_RATES;	/* rates from here up are not offered */
+static bool renegotiate = true;	/* offer at the next chance */
+static link_speed_t accepted;
+static volatile bool accept_seen = false;
+static volatile bool echo_seen = false;
+static link_stats_t stats = { LINK_BAUD };
+static link_stats_t window;		/* stats at the start of the error window */
+
+
+/*
+ * hand the oldest contiguous run of the ring to the driver; IRQs masked
+ */
+static void kick(void){
+	u32 tail = tx_tail & (LINK_TX - 1);
+	u32 n = tx_head - tx_tail;
+
+	if (tx_sending != 0 || n == 0)
+		return;
+	if (n > LINK_TX - tail)
+		n = LINK_TX - tail;			/* up to the wrap; the rest goes next */
+	tx_sending = n;
+	XUartPs_Send(&uartp0, &tx[tail], n);
+}
+
+/*
+ * queue all <len> bytes of <buf> or none, so a frame is never cut short;
+ * returns false if there was no room
+ */
+static bool put(const void *buf, u32 len){
+	u32 cpsr = mfcpsr();
+	u32 i;
+
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);	/* main loop and message callbacks */
+	if (len > LINK_TX - (tx_head - tx_tail)){
+		stats.tx_full++;
+		mtcpsr(cpsr);
+		return false;
+	}
+	for (i = 0; i < len; i++)
+		tx[(tx_head + i) & (LINK_TX - 1)] = ((const u8*) buf)[i];
+	tx_head += len;
+	stats.tx_bytes += len;
+	kick();
+	mtcpsr(cpsr);
+	return true;
+}
+
+/*
+ * returns true once everything queued has left the uart
+ */
+static bool tx_idle(void){
+	return tx_head == tx_tail && XUartPs_IsTransmitEmpty(&uartp0);
+}
+
+/*
+ * take the negotiation messages out of the uart stream; returns true if
+ * <msg> was one
+ */
+static bool speed_msg(const u8 *msg, u32 len){
+	int type;
+
+	memcpy(&type, msg, sizeof(int));
+	if (type == LINK_ACCEPT && speed == SPEED_OFFERED){
+		memcpy(&accepted, msg, sizeof(accepted));
+		accept_seen = true;
+		return true;
+	}
+	if (type == PING && speed == SPEED_VERIFY){
+		echo_seen = true;
+		return true;
+	}
+	return type == LINK_ACCEPT;
+}
+
+/*
+ * add a byte to the uart frame, delivering it once complete
+ */
+static void frame_byte(u8 byte){
+	frame.bytes[frame_i++] = byte;
+	while (frame_i >= sizeof(int) && (frame_len == 0 || frame_i >= frame_len)){
+		frame_len = msg_size(frame.bytes, frame_i);	/* may grow once a header is complete */
+		if (frame_len == 0){		/* not a frame start: slide by one byte */
+			memmove(frame.bytes, frame.bytes + 1, --frame_i);
+			stats.resync++;
+			continue;
+		}
+		if (frame_i < frame_len)
+			break;
+		stats.frames++;
+		if (!speed_msg(frame.bytes, frame_len))
+			local_msg_callback(frame.bytes, frame_len);
+		frame_i -= frame_len;		/* keep any bytes left over from a resync */
+		memmove(frame.bytes, frame.bytes + frame_len, frame_i);
+		frame_len = 0;
+	}
+}
+
+/*
+ * uart0 handler
+ */
+static void uart_0_handler(void *CallBackRef, u32 Event, u32 EventData){
+	u8 byte;
+	XUartPs* uart0 = (XUartPs*) CallBackRef;
+
+	switch (Event){
+	case XUARTPS_EVENT_RECV_DATA:
+	case XUARTPS_EVENT_RECV_TOUT:
+		break;
+	case XUARTPS_EVENT_PARE_FRAME_BRKE:
+		stats.framing++;
+		return;
+	case XUARTPS_EVENT_RECV_ORERR:
+		stats.overrun++;
+		return;
+	case XUARTPS_EVENT_SENT_DATA:
+		tx_tail += tx_sending;
+		tx_sending = 0;
+		kick();
+		return;
+	default:
+		return;
+	}
+	while (XUartPs_Recv(uart0, &byte, 1) == 1){
+		stats.rx_bytes++;
+		if (passthrough)
+			local_raw_callback(byte);
+		else
+			frame_byte(byte);
+	}
+}
+
+/*
+ * udp receive callback
+ */
+static void eth_msg(const u8 *msg, u32 len){
+	if (len < sizeof(int) || len < msg_size(msg, len))
+		return;
+	misses = 0;
+	if (active == LINK_UART){
+		printf("Substation link: UDP\n");
+		active = LINK_UDP;
+	}
+	local_msg_callback(msg, len);
+}
+
+/*
+ * initialize the link
+ */
+void link_init(u32 id, void (*msg_callback)(const u8 *msg, u32 len),
+		void (*raw_callback)(u8 byte)){
+	local_id = id;
+	local_msg_callback = msg_callback;
+	local_raw_callback = raw_callback;
+
+	XUartPs_Config* config0 = XUartPs_LookupConfig(XPAR_PS7_UART_0_DEVICE_ID);
+	XUartPs_CfgInitialize(&uartp0, config0, config0->BaseAddress);
+	XUartPs_SetInterruptMask(&uartp0, XUARTPS_IXR_RXOVR | XUARTPS_IXR_TOUT |
+			XUARTPS_IXR_FRAMING | XUARTPS_IXR_PARITY | XUARTPS_IXR_OVER);
+	XUartPs_SetFifoThreshold(&uartp0, 1);
+	XUartPs_SetHandler(&uartp0, uart_0_handler, &uartp0);
+	XUartPs_SetBaudRate(&uartp0, LINK_BAUD);
+	gic_limit(XPAR_XUARTPS_0_INTR, LINK_IRQ_BUDGET, false);	/* a noisy line is polled */
+	gic_connect(XPAR_XUARTPS_0_INTR, (Xil_ExceptionHandler)XUartPs_InterruptHandler,(void*) &uartp0);
+
+	if (eth_init(eth_msg) == XST_SUCCESS)
+		active = LINK_UDP;
+}
+
+/*
+ * switch the uart to msg_rates[<index>]; the receive settings apply above
+ * the base rate
+ */
+static void set_rate(u32 index, u8 fifo, u8 timeout){
+	u32 cpsr = mfcpsr();
+
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);	/* no receive mid-switch */
+	XUartPs_SetBaudRate(&uartp0, msg_rates[index]);
+	XUartPs_SetFifoThreshold(&uartp0, index == 0 ? 1 : fifo);
+	XUartPs_SetRecvTimeout(&uartp0, index == 0 ? 0 : timeout);
+	frame_i = 0;
+	frame_len = 0;
+	rate = index;
+	stats.baud = msg_rates[index];
+	mtcpsr(cpsr);
+}
+
+/*
+ * back to the base rate, staying quiet until the substation has timed out
+ * too; <cap> stops the failed rate being offered again and offers the
+ * rates below it once the hold is over
+ */
+static void fall_back(bool cap){
+	if (cap){
+		rate_cap = rate;
+		renegotiate = true;
+		stats.fallbacks++;
+		printf("Substation link: %lu baud failed, back to %u\n", (unsigned long) msg_rates[rate], LINK_BAUD);
+	}
+	set_rate(0, 1, 0);
+	speed = SPEED_HOLD;
+	speed_polls = 0;
+}
+
+/*
+ * queue a negotiation message at the current rate
+ */
+static void speed_send(int type, int rates, int fifo, int timeout){
+	link_speed_t m;
+
+	m.type = type;
+	m.id = (int) local_id;
+	m.rates = rates;
+	m.fifo = fifo;
+	m.timeout = timeout;
+	put(&m, sizeof(m));
+}
+
+/*
+ * step the uart rate negotiation (c.f. link_speed_t)
+ */
+static void speed_poll(void){
+	ping_t probe;
+	u32 errors, i;
+
+	speed_polls++;
+	switch (speed){
+	case SPEED_BASE:
+		if (passthrough || active != LINK_UART || (!renegotiate && speed_polls < LINK_RENEGOTIATE_POLLS) ||
+				!tx_idle())
+			break;
+		renegotiate = false;
+		accept_seen = false;
+		speed_send(LINK_OFFER, LINK_RATES & ((1 << rate_cap) - 1), LINK_FIFO, LINK_RX_TIMEOUT);
+		speed = SPEED_OFFERED;
+		speed_polls = 0;
+		break;
+	case SPEED_OFFERED:
+		if (accept_seen && tx_idle()){
+			for (i = 1; i < rate_cap && accepted.rates != (1 << i); i++)
+				;
+			if (i < rate_cap){		/* a single rate we offered, above the base */
+				speed_send(LINK_COMMIT, accepted.rates, accepted.fifo, accepted.timeout);
+				speed = SPEED_COMMIT;
+			} else {
+				speed = SPEED_BASE;
+			}
+			speed_polls = 0;
+		} else if (speed_polls >= LINK_NEGOTIATE_POLLS){
+			speed = SPEED_BASE;
+			speed_polls = 0;
+		}
+		break;
+	case SPEED_COMMIT:
+		if (!tx_idle())
+			break;					/* the commit is still going out */
+		for (i = 1; accepted.rates != (1 << i); i++)
+			;
+		set_rate(i, accepted.fifo, accepted.timeout);
+		echo_seen = false;
+		speed = SPEED_VERIFY;
+		speed_polls = 0;
+		probe.type = PING;
+		probe.id = (int) local_id;
+		put(&probe, sizeof(probe));
+		break;
+	case SPEED_VERIFY:
+		if (echo_seen){
+			stats.negotiations++;
+			printf("Substation link: %lu baud\n", (unsigned long) msg_rates[rate]);
+			window = stats;
+			speed = SPEED_UP;
+			speed_polls = 0;
+		} else if (speed_polls >= LINK_NEGOTIATE_POLLS){
+			fall_back(true);
+		}
+		break;
+	case SPEED_UP:
+		if (active != LINK_UART || speed_polls < LINK_WINDOW_POLLS)
+			break;
+		errors = (stats.framing - window.framing) + (stats.overrun - window.overrun) +
+				(stats.resync - window.resync);
+		if (errors > LINK_MAX_ERRORS ||
+				(stats.frames == window.frames && stats.tx_bytes != window.tx_bytes)){
+			fall_back(true);		/* noisy, or talking to no one */
+			break;
+		}
+		window = stats;
+		speed_polls = 0;
+		break;
+	case SPEED_HOLD:
+		if (speed_polls >= LINK_HOLD_POLLS){
+			speed = SPEED_BASE;
+			speed_polls = 0;
+		}
+		break;
+	}
+}
+
+/*
+ * service the transports and the fallback logic
+ */
+void link_poll(void){
+	ping_t probe;
+
+	speed_poll();
+	eth_poll();
+	if (active == LINK_UART && eth_link_up() && ++retry >= LINK_RETRY_POLLS){
+		retry = 0;
+		probe.type = PING;
+		probe.id = local_id;
+		eth_send(&probe, sizeof(probe));	/* an answer promotes udp (c.f. eth_msg) */
+	}
+}
+
+/*
+ * send <len> bytes of <msg> on the active transport
+ */
+s32 link_send(const void *msg, u32 len){
+	if (active == LINK_UDP){
+		if (eth_link_up() && misses < LINK_MAX_MISSES && eth_send(msg, len) == XST_SUCCESS){
+			misses++;
+			return XST_SUCCESS;
+		}
+		printf("Substation link: UART\n");
+		active = LINK_UART;
+		retry = 0;
+	}
+	if (speed != SPEED_BASE && speed != SPEED_UP)
+		return XST_FAILURE;		/* negotiating: the ends may not agree on the rate */
+	return put(msg, len) ? XST_SUCCESS : XST_FAILURE;
+}
+
+/*
+ * send a raw byte to the substation uart
+ */
+void link_send_raw(u8 byte){
+	put(&byte, 1);
+}
+
+/*
+ * while <on>, uart bytes are passed to the raw callback
+ */
+void link_set_passthrough(bool on){
+	passthrough = on;
+	frame_i = 0;
+	frame_len = 0;
+}
+
+/*
+ * returns the active transport
+ */
+u32 link_active(void){
+	return active;
+}
+
+/*
+ * line statistics
+ */
+void link_stats(link_stats_t *out){
+	*out = stats;
+}
+
+/*
+ * renegotiate
+ */
+void link_renegotiate(void){
+	rate_cap = MSG_RATES;
+	renegotiate = true;
+	if (speed == SPEED_UP)
+		fall_back(false);
+}
+
+/*
+ * close the link
+ */
+void link_close(void){
+	eth_close();
+	gic_disconnect(XPAR_XUARTPS_0_INTR);
+}
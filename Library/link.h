@@ -0,0 +1,102 @@
+/*
+ * link.h -- transport-agnostic substation link
+ *
+ * Carries the messages in msg.h over UDP when the Ethernet link is up and
+ * the substation answers, and falls back to PS UART0 otherwise. On the
+ * UART the link negotiates the highest rate both ends support (c.f.
+ * link_speed_t), and drops back to LINK_BAUD when line errors rise or the
+ * substation goes quiet.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include "xparameters.h"  	/* constants used by the hardware */
+#include "xil_types.h"		/* types used by xilinx */
+#include "xuartps.h"		/* ps uart details */
+
+/* transports */
+#define LINK_UART 0
+#define LINK_UDP 1
+
+#define LINK_BAUD 9600			/* substation uart baud rate */
+#define LINK_MAX_MISSES 5		/* unanswered udp requests before falling back */
+#define LINK_RETRY_POLLS 100	/* polls between udp probes while on uart */
+
+/* uart rate negotiation */
+#define LINK_RATES 0xFF			/* rates this end supports (bits of msg_rates) */
+#define LINK_FIFO 16			/* receive fifo trigger above LINK_BAUD */
+#define LINK_RX_TIMEOUT 8		/* receive timeout above LINK_BAUD (4 bit periods) */
+#define LINK_NEGOTIATE_POLLS 10	/* to wait for an accept or the ping echo */
+#define LINK_WINDOW_POLLS 10	/* line error window */
+#define LINK_MAX_ERRORS 4		/* line errors per window before falling back */
+#define LINK_SILENT_MS 1000		/* substation: back to LINK_BAUD after this long without a frame */
+#define LINK_HOLD_POLLS 20		/* silence after falling back; longer than LINK_SILENT_MS */
+#define LINK_RENEGOTIATE_POLLS 600	/* between offers at LINK_BAUD */
+#define LINK_IRQ_BUDGET 128		/* uart interrupts per GIC_WINDOW_MS before polling */
+#define LINK_TX 1024			/* uart transmit ring (power of 2) */
+
+typedef struct {
+	u32 baud;				/* current uart rate */
+	u32 tx_bytes;
+	u32 rx_bytes;
+	u32 frames;				/* complete messages received */
+	u32 framing;			/* framing, parity and break errors (one driver event) */
+	u32 overrun;			/* receive fifo overruns */
+	u32 resync;				/* bytes skipped looking for a frame start */
+	u32 negotiations;		/* rate changes that verified */
+	u32 fallbacks;			/* returns to LINK_BAUD */
+	u32 tx_full;			/* messages and raw bytes refused for want of ring space */
+} link_stats_t;
+
+/*
+ * initialize the link for controller <id> providing a callback for complete
+ * messages and a callback for raw bytes received while in passthrough
+ *
+ * <msg> is only valid for the duration of the callback
+ */
+void link_init(u32 id, void (*msg_callback)(const u8 *msg, u32 len),
+		void (*raw_callback)(u8 byte));
+
+/*
+ * service the transports and the fallback logic (call from the main loop)
+ */
+void link_poll(void);
+
+/*
+ * send <len> bytes of <msg> on the active transport; the uart copies the
+ * message into its transmit ring, so <msg> may go once this returns
+ *
+ * returns XST_SUCCESS on success; otherwise XST_FAILURE
+ */
+s32 link_send(const void *msg, u32 len);
+
+/*
+ * send a raw byte to the substation uart (operator passthrough)
+ */
+void link_send_raw(u8 byte);
+
+/*
+ * while <on>, uart bytes are passed to the raw callback instead of being framed
+ */
+void link_set_passthrough(bool on);
+
+/*
+ * returns the active transport {LINK_UART,LINK_UDP}
+ */
+u32 link_active(void);
+
+/*
+ * copy the uart line statistics into <out>
+ */
+void link_stats(link_stats_t *out);
+
+/*
+ * offer every supported rate again at the next poll, leaving a
+ * negotiated rate first
+ */
+void link_renegotiate(void);
+
+/*
+ * close the link
+ */
+void link_close(void);
@@ -0,0 +1,143 @@
+/*
+ * msg.h -- substation protocol messages
+ *
+ * Shared by every transport that carries substation traffic (c.f. link.h)
+ */
+#pragma once
+
+#include <stddef.h>			/* offsetof */
+#include <string.h>
+#include "xil_types.h"		/* types used by xilinx */
+
+/* message types */
+#define CONFIGURE 0
+#define PING 1
+#define UPDATE 2
+#define CONFIG_GET 3
+#define CONFIG_SET 4
+#define STATE_DELTA 5
+#define STATE_FULL 6
+#define STATE_RESYNC 7
+#define LINK_OFFER 8		/* uart rate negotiation (c.f. link_speed_t) */
+#define LINK_ACCEPT 9
+#define LINK_COMMIT 10
+#define TIME_SYNC 11		/* c.f. time_sync_t */
+
+#define MSG_VALUES 30		/* controllers on the line */
+#define MSG_MAX sizeof(update_response_t)	/* largest message on the wire */
+#define MSG_TRAIN 0x100		/* value flag: a train is at that crossing */
+
+typedef struct {
+	int type; /* must be assigned to PING */
+	int id; /* must be assigned to your id */
+} ping_t;
+
+typedef struct {
+	int type; /* must be assigned to UPDATE */
+	int id; /* must be assigned to your id */
+	int value; /* state, or'ed with MSG_TRAIN while a train is present */
+} update_request_t;
+
+typedef struct {
+	int type;
+	int id;
+	int average;
+	int values[MSG_VALUES];
+} update_response_t;
+
+typedef struct {
+	int type; /* CONFIG_GET or CONFIG_SET; echoed in the reply */
+	int id; /* controller id */
+	int key; /* c.f. config.h */
+	int value; /* value to set; current value in the reply */
+	int status; /* reply: 0 on success, -1 on a bad key or value */
+} config_msg_t;
+
+/* changed line values only; the substation sends these instead of
+ * resending every slot (c.f. crossings.h) */
+typedef struct {
+	u8 index;
+	u8 pad;
+	s16 value;
+} delta_entry_t;
+
+typedef struct {
+	int type; /* STATE_DELTA */
+	u16 version; /* table version after applying; must be ours + 1 */
+	u8 count; /* entries that follow */
+	u8 pad;
+	delta_entry_t entries[MSG_VALUES];
+} state_delta_t;
+
+#define DELTA_HDR offsetof(state_delta_t, entries)
+
+/* uart rates a link_speed_t can name: bit i of rates is msg_rates[i] */
+#define MSG_RATES 8
+static const u32 msg_rates[MSG_RATES] = { 9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600 };
+
+/* uart rate negotiation, at the current rate: the controller offers the
+ * rates it supports, the substation accepts the highest one both support
+ * (a single bit; 0 to stay), and the controller commits. Each end
+ * switches once the commit is on the wire, and the controller then pings
+ * at the new rate; either end returns to the base rate on silence. */
+typedef struct {
+	int type; /* LINK_OFFER, LINK_ACCEPT or LINK_COMMIT */
+	int id;
+	int rates; /* bits of msg_rates */
+	int fifo; /* receive fifo trigger level above the base rate */
+	int timeout; /* receive timeout above the base rate (4 bit periods) */
+} link_speed_t;
+
+/* two-way time transfer (c.f. timesync.h): the controller sends t1, its
+ * clock when sending; the substation returns the message with t2 and t3,
+ * its clock on receiving the request and on sending the reply. Request
+ * and reply are the same size so the wire time is the same both ways. */
+typedef struct {
+	int type; /* TIME_SYNC */
+	int id;
+	u64 t1; /* ns */
+	u64 t2;
+	u64 t3;
+} time_sync_t;
+
+/* full table, sent in answer to a STATE_RESYNC ping_t */
+typedef struct {
+	int type; /* STATE_FULL */
+	int version;
+	int values[MSG_VALUES];
+} state_full_t;
+
+/*
+ * returns the size of the received message starting at <msg> given the
+ * <have> (>= sizeof(int)) bytes received so far; 0 if it is not valid
+ *
+ * variable-length messages report their header size until it is complete
+ */
+static inline u32 msg_size(const u8 *msg, u32 have){
+	int type;
+	u8 count;
+
+	memcpy(&type, msg, sizeof(int));
+	switch(type){
+	case PING:
+	case STATE_RESYNC:
+		return sizeof(ping_t);
+	case UPDATE:
+		return sizeof(update_response_t);
+	case CONFIG_GET:
+	case CONFIG_SET:
+		return sizeof(config_msg_t);
+	case STATE_DELTA:
+		if (have < DELTA_HDR)
+			return DELTA_HDR;
+		count = ((const state_delta_t*) msg)->count;
+		return count <= MSG_VALUES ? DELTA_HDR + count * sizeof(delta_entry_t) : 0;
+	case STATE_FULL:
+		return sizeof(state_full_t);
+	case LINK_ACCEPT:
+		return sizeof(link_speed_t);
+	case TIME_SYNC:
+		return sizeof(time_sync_t);
+	}
+	return 0;
+}
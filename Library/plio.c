@@ -0,0 +1,130 @@
+/*
+ * plio.c -- the crossing_io block in the PL
+ */
+
+#include "plio.h"
+#include "xil_io.h"			/* register access */
+#include "xtime_l.h"		/* global timer */
+#include "xpseudo_asm.h"	/* cpsr access */
+#include "xreg_cortexa9.h"
+
+#define RECALIBRATE_S 60
+#define STAMP_BITS 48
+
+static u64 cycles0;			/* the block's cycle counter */
+static XTime global0;		/* and the global timer at the same moment */
+
+static u32 in(u32 reg){
+	return Xil_In32(PLIO_BASEADDR + reg);
+}
+
+static void out(u32 reg, u32 value){
+	Xil_Out32(PLIO_BASEADDR + reg, value);
+}
+
+/*
+ * pair the cycle counter with the global timer: the global timer either
+ * side of the read, halved
+ */
+static void calibrate(void){
+	u32 cpsr = mfcpsr();
+	XTime before, after;
+	u32 lo;
+
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);
+	XTime_GetTime(&before);
+	lo = in(PLIO_TIME_LO);		/* latches the top half */
+	XTime_GetTime(&after);
+	cycles0 = (u64) in(PLIO_TIME_HI) << 32 | lo;
+	global0 = before + (after - before) / 2;
+	mtcpsr(cpsr);
+}
+
+/*
+ * <cycles> of the block as global timer counts
+ */
+static u64 counts(u64 cycles){
+	return cycles / PLIO_CLK_HZ * COUNTS_PER_SECOND + cycles % PLIO_CLK_HZ * COUNTS_PER_SECOND / PLIO_CLK_HZ;
+}
+
+/*
+ * the global timer at <stamp> (its low STAMP_BITS): within half their
+ * span of the pairing, before or after it
+ */
+static u64 global(u64 stamp){
+	s64 d = (s64)((stamp - cycles0) << (64 - STAMP_BITS)) >> (64 - STAMP_BITS);
+
+	return d < 0 ? global0 - counts(-d) : global0 + counts(d);
+}
+
+/*
+ * check for the block and pair the clocks
+ */
+bool plio_init(void){
+	if (in(PLIO_ID) != PLIO_MAGIC)
+		return false;
+	calibrate();
+	return true;
+}
+
+/*
+ * control bits
+ */
+void plio_ctrl(u32 bits, bool on){
+	u32 cpsr = mfcpsr();
+	u32 ctrl;
+
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);	/* from io.c and servo.c */
+	ctrl = in(PLIO_CTRL);
+	out(PLIO_CTRL, on ? ctrl | bits : ctrl & ~bits);
+	mtcpsr(cpsr);
+}
+
+/*
+ * events queued; pairs the clocks again once a minute has passed
+ */
+u32 plio_count(void){
+	u32 status = in(PLIO_STATUS);
+	XTime now;
+
+	if (status & 0x100)
+		out(PLIO_STATUS, 0x100);	/* overflow: the flag only */
+	XTime_GetTime(&now);
+	if (now - global0 > (u64) RECALIBRATE_S * COUNTS_PER_SECOND)
+		calibrate();
+	return status & 0x1F;
+}
+
+/*
+ * the oldest event
+ */
+bool plio_event(plio_event_t *ev){
+	u32 lo = in(PLIO_EVT_LO);
+	u32 hi = in(PLIO_EVT_HI);	/* takes it off the queue */
+
+	if (!(hi & 0x80000000))
+		return false;
+	ev->input = hi >> 24 & 0x7;
+	ev->level = hi >> 30 & 0x1;
+	ev->at = global((u64)(hi & 0xFFFF) << 32 | lo);
+	return true;
+}
+
+/*
+ * filtered levels
+ */
+u32 plio_state(void){
+	return in(PLIO_STATE) & 0xFF;
+}
+
+/*
+ * servo pwm
+ */
+void plio_pwm(u32 period, u32 compare){
+	out(PLIO_PWM_PERIOD, period);
+	out(PLIO_PWM_COMPARE, compare);
+}
+
+void plio_compare(u32 compare){
+	out(PLIO_PWM_COMPARE, compare);
+}
@@ -0,0 +1,94 @@
+/*
+ * plio.h -- the crossing_io block in the PL (c.f. Hardware/ip/crossing_io.v)
+ *
+ * The block filters the buttons and switches, stamps each change as its
+ * pin moves and queues it behind one interrupt, and drives the servo pwm.
+ * Built with CROSSING_PLIO, io.c and servo.c use it in place of the AXI
+ * GPIO ports and the AXI timer, with the same interfaces.
+ *
+ * Stamps are the block's cycle counter. They are turned into global timer
+ * counts from a pair of readings of both, which is taken again when a
+ * minute has passed so the two clocks' nominal rates cannot drift apart.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include "xparameters.h"  	/* constants used by the hardware */
+#include "xil_types.h"		/* types used by xilinx */
+
+#ifdef XPAR_CROSSING_IO_0_BASEADDR
+#define PLIO_BASEADDR XPAR_CROSSING_IO_0_BASEADDR
+#define PLIO_VEC_ID XPAR_FABRIC_CROSSING_IO_0_IRQ_INTR
+#else
+#define PLIO_BASEADDR 0x43C10000	/* after xadc_wiz_0 at 0x43C00000 on M_AXI_GP0 */
+#define PLIO_VEC_ID 63				/* IRQ_F2P[2]: [0] and [1] are axi_gpio_1 and 2 */
+#endif
+#define PLIO_CLK_HZ 50000000		/* FCLK_CLK0, as the axi timer (c.f. servo.h) */
+
+/* registers */
+#define PLIO_ID 0x00
+#define PLIO_CTRL 0x04
+#define PLIO_STATUS 0x08
+#define PLIO_STATE 0x0C
+#define PLIO_DEBOUNCE 0x10
+#define PLIO_HOLDOFF 0x14
+#define PLIO_THRESHOLD 0x18
+#define PLIO_URGENT 0x1C
+#define PLIO_EVT_LO 0x20
+#define PLIO_EVT_HI 0x24
+#define PLIO_TIME_LO 0x28
+#define PLIO_TIME_HI 0x2C
+#define PLIO_PWM_PERIOD 0x30
+#define PLIO_PWM_COMPARE 0x34
+
+#define PLIO_MAGIC 0x43494F31		/* "CIO1" */
+
+/* PLIO_CTRL */
+#define PLIO_CTRL_EVENTS 0x1
+#define PLIO_CTRL_IRQ 0x2
+#define PLIO_CTRL_PWM 0x4
+#define PLIO_CTRL_FLUSH 0x8
+
+/* inputs */
+#define PLIO_BTNS 0x0F				/* BTN0-3 */
+#define PLIO_SW_SHIFT 4				/* SW0-3 follow; SW0 is the train sensor */
+
+typedef struct {
+	u8 input;				/* 0-3 buttons, 4-7 switches */
+	u8 level;				/* it changed to */
+	u64 at;					/* when its pin moved (global timer) */
+} plio_event_t;
+
+/*
+ * check that the block is there and pair its clock with the global timer;
+ * returns false if it is not
+ */
+bool plio_init(void);
+
+/*
+ * turn the PLIO_CTRL <bits> <on> or off
+ */
+void plio_ctrl(u32 bits, bool on);
+
+/*
+ * returns the number of events queued; a full queue drops the events
+ * after it, and the filtered levels are then only in plio_state
+ */
+u32 plio_count(void);
+
+/*
+ * take the oldest event into <ev>; returns false if there is none
+ */
+bool plio_event(plio_event_t *ev);
+
+/*
+ * returns the filtered levels of the inputs, a bit each
+ */
+u32 plio_state(void);
+
+/*
+ * the servo pwm: <period> and high time <compare> in PLIO_CLK_HZ cycles,
+ * taken at the start of the next period
+ */
+void plio_pwm(u32 period, u32 compare);
+void plio_compare(u32 compare);
@@ -0,0 +1,214 @@
+/*
+ * power.c -- idle, clock gating and cpu clock scaling
+ */
+
+#include <string.h>
+#include "power.h"
+#include "xil_io.h"
+#include "xtime_l.h"		/* global timer */
+#include "xpseudo_asm.h"	/* cpsr access, wfi */
+#include "xreg_cortexa9.h"
+
+#define SLCR_LOCK 0xF8000004
+#define SLCR_UNLOCK 0xF8000008
+#define SLCR_LOCK_KEY 0x767B
+#define SLCR_UNLOCK_KEY 0xDF0D
+#define ARM_CLK_CTRL 0xF8000120
+#define ARM_CLK_DIVISOR 0x00003F00	/* bits 13:8 */
+#define ARM_CLK_SHIFT 8
+#define APER_CLK_CTRL 0xF800012C
+#define TICK_LOAD 0xF8F00600		/* private timer: the FreeRTOS tick */
+
+#define NS 1000000000ull
+#define STEADY ((XTime) COUNTS_PER_SECOND * POWER_STEADY_MS / 1000)
+
+static const u32 mw[POWER_STATES] = POWER_MW;
+static void (*local_scaled)(u32 slow);
+static u32 divisor;			/* full speed */
+static u32 slow = 1;		/* it is divided by now */
+static u32 state = POWER_RUN;
+static XTime since;			/* in this state */
+static bool steady = false;
+static XTime steady_since;
+static power_stats_t stats;
+#ifdef CROSSING_FREERTOS
+static u32 tick_load;
+#endif
+
+#ifdef POWER_SCALE
+void __real_XTime_GetTime(XTime *t);
+static XTime raw_base = 0;	/* global timer at the last clock change */
+static XTime time_base = 0;	/* full-rate time then */
+
+/*
+ * global time at the full rate (linked in place of XTime_GetTime)
+ */
+void __wrap_XTime_GetTime(XTime *t){
+	u32 cpsr = mfcpsr();
+	XTime raw;
+
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);	/* the bases move in pairs */
+	__real_XTime_GetTime(&raw);
+	*t = time_base + (raw - raw_base) * slow;
+	mtcpsr(cpsr);
+}
+#endif
+
+/*
+ * close the time in the current state (IRQs masked)
+ */
+static void account(void){
+	XTime now, d;
+
+	XTime_GetTime(&now);
+	d = now - since;
+	stats.ns[state] += d / COUNTS_PER_SECOND * NS + d % COUNTS_PER_SECOND * NS / COUNTS_PER_SECOND;
+	since = now;
+}
+
+/*
+ * divide the cpu clock by <by> (IRQs masked)
+ */
+static void set_clock(u32 by){
+	u32 ctrl;
+
+	account();
+#ifdef POWER_SCALE
+	__wrap_XTime_GetTime(&time_base);
+#endif
+	Xil_Out32(SLCR_UNLOCK, SLCR_UNLOCK_KEY);
+	ctrl = Xil_In32(ARM_CLK_CTRL) & ~ARM_CLK_DIVISOR;
+	Xil_Out32(ARM_CLK_CTRL, ctrl | (divisor * by) << ARM_CLK_SHIFT);
+	Xil_Out32(SLCR_LOCK, SLCR_LOCK_KEY);
+#ifdef POWER_SCALE
+	__real_XTime_GetTime(&raw_base);
+#endif
+#ifdef CROSSING_FREERTOS
+	Xil_Out32(TICK_LOAD, tick_load / by);
+#endif
+	slow = by;
+	state = (state & POWER_WFI) | (by > 1 ? POWER_SLOW : 0);
+	if (local_scaled != NULL)
+		local_scaled(by);
+}
+
+/*
+ * gate unused clocks
+ */
+void power_init(u32 keep, void (*scaled)(u32 slow)){
+	memset(&stats, 0, sizeof(stats));
+	local_scaled = scaled;
+	divisor = (Xil_In32(ARM_CLK_CTRL) & ARM_CLK_DIVISOR) >> ARM_CLK_SHIFT;
+	if (divisor == 0)
+		divisor = 1;
+#ifdef CROSSING_FREERTOS
+	tick_load = Xil_In32(TICK_LOAD);
+#endif
+
+	Xil_Out32(SLCR_UNLOCK, SLCR_UNLOCK_KEY);
+	stats.aper = Xil_In32(APER_CLK_CTRL) & keep;
+	Xil_Out32(APER_CLK_CTRL, stats.aper);
+	Xil_Out32(SLCR_LOCK, SLCR_LOCK_KEY);
+
+	state = POWER_RUN;
+	XTime_GetTime(&since);
+}
+
+/*
+ * one wait
+ */
+void power_wfi(void){
+	u32 cpsr = mfcpsr();
+
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);	/* a pending interrupt still ends the wait */
+	account();
+	state |= POWER_WFI;
+	dsb();
+	wfi();
+	account();
+	state &= ~POWER_WFI;
+	stats.wakes++;
+	mtcpsr(cpsr);							/* its handler runs here */
+}
+
+/*
+ * wait out the main loop period
+ */
+void power_idle(u64 until){
+	XTime now;
+
+	for (XTime_GetTime(&now); now < until; XTime_GetTime(&now))
+		power_wfi();
+}
+
+/*
+ * steady or not
+ */
+void power_steady(bool on){
+	u32 cpsr = mfcpsr();
+
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);
+	if (on && !steady)
+		XTime_GetTime(&steady_since);
+	steady = on;
+	if (!on && slow != 1)
+		set_clock(1);
+	mtcpsr(cpsr);
+}
+
+/*
+ * full speed
+ */
+void power_boost(void){
+	u32 cpsr = mfcpsr();
+
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);
+	if (slow != 1){
+		set_clock(1);
+		stats.boosts++;
+	}
+	XTime_GetTime(&steady_since);			/* steady again from here */
+	mtcpsr(cpsr);
+}
+
+/*
+ * slow down when steady
+ */
+void power_poll(void){
+#ifdef POWER_SCALE
+	u32 cpsr = mfcpsr();
+	XTime now;
+
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);
+	XTime_GetTime(&now);
+	if (steady && slow == 1 && now - steady_since >= STEADY){
+		set_clock(POWER_SLOW_DIV);
+		stats.slows++;
+	}
+	mtcpsr(cpsr);
+#endif
+}
+
+/*
+ * residency and energy
+ */
+void power_stats(power_stats_t *out){
+	u32 cpsr = mfcpsr();
+	u64 ns = 0, pj = 0;
+	u32 i, clocks = 0;
+
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);
+	account();
+	*out = stats;
+	out->slow = slow;
+	mtcpsr(cpsr);
+
+	for (i = 0; i < POWER_STATES; i++){
+		ns += out->ns[i];
+		pj += out->ns[i] * mw[i];			/* ns x mW */
+	}
+	for (i = out->aper; i != 0; i &= i - 1)
+		clocks++;
+	pj += ns * clocks * POWER_APER_MW;
+	out->uj = pj / 1000000;
+}
@@ -0,0 +1,111 @@
+/*
+ * power.h -- idle, clock gating and cpu clock scaling
+ *
+ * The core sleeps in WFI whenever the main loop (or the FreeRTOS idle
+ * task) has nothing to do; any interrupt wakes it, and with IRQs masked
+ * across the WFI the time is accounted before the handler runs. The AMBA
+ * clocks of PS peripherals the controller does not use are gated off in
+ * the SLCR at start.
+ *
+ * With POWER_SCALE the cpu clock divisor is raised POWER_SLOW_DIV times
+ * once the crossing has been in a steady state for POWER_STEADY_MS, and
+ * put back at once from the train interrupts and on any state change.
+ * The divisor also slows the TTCs, the private timers and the global
+ * timer: the registered callback re-programs the TTC intervals, power.c
+ * re-programs the FreeRTOS tick, and the image is linked with
+ * -Wl,--wrap=XTime_GetTime so that global timer readings carry on at the
+ * full rate. The watchdog runs POWER_SLOW_DIV times longer while slow.
+ *
+ * Energy is estimated from the residency in each state at POWER_MW and
+ * POWER_APER_MW for each peripheral clock left running; the figures are
+ * estimates for the PS, not measurements.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include "xil_types.h"		/* types used by xilinx */
+
+/* power states (residency, c.f. power_stats) */
+#define POWER_RUN 0
+#define POWER_WFI 1			/* bit: waiting for an interrupt */
+#define POWER_SLOW 2		/* bit: cpu clock divided */
+#define POWER_SLOW_WFI 3
+#define POWER_STATES 4
+
+#define POWER_MW { 420, 250, 230, 170 }	/* by state */
+#define POWER_APER_MW 4		/* per AMBA peripheral clock running */
+
+#define POWER_SLOW_DIV 4
+#define POWER_STEADY_MS 2000
+
+/* APER_CLK_CTRL peripheral clocks */
+#define POWER_APER_DMA 0x00000001
+#define POWER_APER_USB0 0x00000004
+#define POWER_APER_USB1 0x00000008
+#define POWER_APER_GEM0 0x00000040
+#define POWER_APER_GEM1 0x00000080
+#define POWER_APER_SDI0 0x00000400
+#define POWER_APER_SDI1 0x00000800
+#define POWER_APER_SPI0 0x00004000
+#define POWER_APER_SPI1 0x00008000
+#define POWER_APER_CAN0 0x00010000
+#define POWER_APER_CAN1 0x00020000
+#define POWER_APER_I2C0 0x00040000
+#define POWER_APER_I2C1 0x00080000
+#define POWER_APER_UART0 0x00100000
+#define POWER_APER_UART1 0x00200000
+#define POWER_APER_GPIO 0x00400000
+#define POWER_APER_LQSPI 0x00800000
+#define POWER_APER_SMC 0x01000000
+
+/* the substation link, the console, the rgb led pin and the flash */
+#define POWER_APER_USED (POWER_APER_GEM0 | POWER_APER_UART0 | POWER_APER_UART1 | \
+		POWER_APER_GPIO | POWER_APER_LQSPI)
+
+typedef struct {
+	u64 ns[POWER_STATES];	/* residency */
+	u64 uj;					/* estimated energy */
+	u32 aper;				/* peripheral clocks running */
+	u32 slows;
+	u32 boosts;				/* back to full speed from an interrupt */
+	u32 wakes;
+	u32 slow;				/* current divisor factor */
+} power_stats_t;
+
+/*
+ * initialize; gates every peripheral clock outside <keep>. <scaled> is
+ * called, with IRQs masked, each time the cpu clock changes with the
+ * factor it is now divided by (1 at full speed)
+ */
+void power_init(u32 keep, void (*scaled)(u32 slow));
+
+/*
+ * sleep until an interrupt (the FreeRTOS idle task)
+ */
+void power_wfi(void);
+
+/*
+ * sleep until global time <until>, waking for each interrupt (the main loop)
+ */
+void power_idle(u64 until);
+
+/*
+ * the crossing entered a state it may stay in for long (<steady>) or not;
+ * leaving a steady state restores the clock
+ */
+void power_steady(bool steady);
+
+/*
+ * full speed now (interrupt handlers ahead of latency-critical work)
+ */
+void power_boost(void);
+
+/*
+ * slow the clock once steady for long enough (main loop)
+ */
+void power_poll(void);
+
+/*
+ * residency and estimated energy since initialization
+ */
+void power_stats(power_stats_t *out);
@@ -0,0 +1,95 @@
+/*
+ * pt.h -- stackless coroutines (protothreads)
+ *
+ * A coroutine is a function written as straight-line code whose blocking
+ * points save only a resume line (and a deadline for timeouts) in its
+ * pt_t; it needs no stack of its own. Locals do not survive a blocking
+ * point, so keep state in statics. At most one blocking point per line.
+ *
+ *	static PT_THREAD(blink(pt_t *pt, u32 now)){
+ *		PT_BEGIN(pt);
+ *		for(;;){
+ *			led_toggle(0);
+ *			PT_AWAIT_TIMEOUT(pt, now, 2, false);
+ *		}
+ *		PT_END(pt);
+ *	}
+ *
+ * The scheduler calls each coroutine with the current tick; it runs until
+ * its next blocking point and returns.
+ */
+#pragma once
+
+#include "xil_types.h"		/* types used by xilinx */
+
+typedef struct {
+	u16 lc;				/* resume point (source line); 0 at the start */
+	u32 deadline;		/* tick a pending timeout expires */
+} pt_t;
+
+/* coroutine return values */
+#define PT_WAITING 0
+#define PT_YIELDED 1
+#define PT_EXITED 2
+#define PT_ENDED 3
+
+#define PT_THREAD(decl) char decl
+
+/* saving the resume line falls through into its case on purpose */
+#if defined(__GNUC__) && __GNUC__ >= 7
+#define PT_FALLTHROUGH __attribute__((fallthrough))
+#else
+#define PT_FALLTHROUGH ((void) 0)
+#endif
+
+#define PT_INIT(pt) ((pt)->lc = 0)
+
+#define PT_BEGIN(pt) switch((pt)->lc) { case 0:
+
+#define PT_END(pt) } PT_INIT(pt); return PT_ENDED
+
+/*
+ * block until <cond> holds
+ */
+#define PT_AWAIT_EVENT(pt, cond)				\
+	do {										\
+		(pt)->lc = __LINE__; PT_FALLTHROUGH;	\
+		case __LINE__:							\
+		if (!(cond)) return PT_WAITING;			\
+	} while (0)
+
+/*
+ * block for <ticks> after <now>, or until <cond> holds
+ */
+#define PT_AWAIT_TIMEOUT(pt, now, ticks, cond)	\
+	do {										\
+		(pt)->deadline = (now) + (ticks);		\
+		PT_AWAIT_EVENT(pt, (s32)((now) - (pt)->deadline) >= 0 || (cond));	\
+	} while (0)
+
+/*
+ * give up the processor once
+ */
+#define PT_YIELD(pt)							\
+	do {										\
+		(pt)->lc = __LINE__;					\
+		return PT_YIELDED; case __LINE__:;		\
+	} while (0)
+
+/*
+ * run the child coroutine <thread> on <child> to completion
+ */
+#define PT_SPAWN(pt, child, thread)				\
+	do {										\
+		PT_INIT(child);							\
+		PT_AWAIT_EVENT(pt, (thread) >= PT_EXITED);	\
+	} while (0)
+
+/*
+ * leave the coroutine; the next call starts it again
+ */
+#define PT_EXIT(pt)								\
+	do {										\
+		PT_INIT(pt);							\
+		return PT_EXITED;						\
+	} while (0)
@@ -0,0 +1,66 @@
+/*
+ * regs.h -- leds and servo bound to their registers at compile time
+ *
+ * Header-only counterparts of led_set and servo_set for constant
+ * arguments. The port is chosen from xparameters.h base addresses and
+ * the duty is mapped to its register value by the compiler, so each call
+ * is one register write. A led write also updates its port's shadow in
+ * led.c (led_shadow), so led_set and regs_led_set can be mixed. An
+ * argument that is not a constant, or is out of range, fails the build.
+ * The ports must have been set up by led_init and servo_init.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include "xparameters.h"	/* base addresses */
+#include "xil_io.h"			/* register access */
+#include "xil_types.h"		/* types used by xilinx */
+#include "led.h"			/* led numbers and colours */
+#include "servo.h"			/* pwm period */
+
+/* ports */
+#define REGS_LEDS XPAR_AXI_GPIO_0_BASEADDR	/* leds 0-3 */
+#define REGS_RGB XPAR_AXI_GPIO_3_BASEADDR	/* rgb led */
+#define REGS_MIO XPAR_PS7_GPIO_0_BASEADDR	/* led 4 on MIO 7 */
+#ifdef CROSSING_PLIO
+#include "plio.h"
+#define REGS_SERVO PLIO_BASEADDR
+#define REGS_SERVO_HIGH PLIO_PWM_COMPARE	/* taken at the next period */
+#else
+#define REGS_SERVO XPAR_AXI_TIMER_0_BASEADDR
+#define REGS_SERVO_HIGH REGS_TMR_TLR1
+#endif
+
+/* registers (c.f. xgpio_l.h, xgpiops_hw.h, xtmrctr_l.h) */
+#define REGS_GPIO_DATA 0x00
+#define REGS_MIO_MASK_DATA_0_LSW 0x00	/* bank 0, pins 0-15: mask in the top half */
+#define REGS_TMR_TLR1 0x14				/* counter 1 load: the pwm high time */
+
+#define REGS_MIO_PIN 7
+
+/* fails the build unless <cond> is a true constant expression */
+#define REGS_CHECK(cond) ((void) sizeof(struct { _Static_assert(cond, #cond); int x; }))
+
+/*
+ * set <led> (a constant 0-8, as led_set; not ALL) to <on>
+ */
+#define regs_led_set(led, on) do { \
+		REGS_CHECK((led) <= Y_LED); \
+		if ((led) <= 3){ \
+			Xil_Out32(REGS_LEDS + REGS_GPIO_DATA, led_shadow(led, on)); \
+		} else if ((led) == 4){ \
+			Xil_Out32(REGS_MIO + REGS_MIO_MASK_DATA_0_LSW, \
+					(~(1u << REGS_MIO_PIN) & 0xFFFF) << 16 | (u32)((on) ? 1 : 0) << REGS_MIO_PIN); \
+		} else { \
+			Xil_Out32(REGS_RGB + REGS_GPIO_DATA, led_shadow(led, on)); \
+		} \
+	} while (0)
+
+/*
+ * set the servo to a constant duty of <ppm> parts per million of the
+ * period, within MINDUTY-MAXDUTY (SERVO_MIN_PPM-SERVO_MAX_PPM)
+ */
+#define regs_servo_duty(ppm) do { \
+		REGS_CHECK((ppm) >= SERVO_MIN_PPM && (ppm) <= SERVO_MAX_PPM); \
+		Xil_Out32(REGS_SERVO + REGS_SERVO_HIGH, (u32)((u64) SERVO_PERIOD_CNT * (ppm) / 1000000)); \
+	} while (0)
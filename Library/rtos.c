@@ -0,0 +1,105 @@
+/*
+ * rtos.c -- FreeRTOS build support
+ */
+
+#ifdef CROSSING_FREERTOS
+
+#include <stdio.h>
+#include "power.h"
+#include "rtos.h"
+#include "xtime_l.h"		/* global timer */
+
+static StaticTask_t tcbs[RTOS_TASKS];
+static StackType_t stacks[RTOS_TASKS][RTOS_STACK];
+static u32 created = 0;
+
+static StaticTask_t idle_tcb;
+static StackType_t idle_stack[configMINIMAL_STACK_SIZE];
+static StaticTask_t timer_tcb;
+static StackType_t timer_stack[configTIMER_TASK_STACK_DEPTH];
+
+/*
+ * create a task from the table
+ */
+TaskHandle_t rtos_task(const char *name, TaskFunction_t fn, UBaseType_t priority){
+	u32 i;
+
+	if (created == RTOS_TASKS){
+		printf("rtos: no room for task %s\n", name);
+		return NULL;
+	}
+	i = created++;
+	return xTaskCreateStatic(fn, name, RTOS_STACK, NULL, priority, stacks[i], &tcbs[i]);
+}
+
+/*
+ * notify a task, switching to it on return from the interrupt if it outranks the current one
+ */
+void rtos_wake_from_isr(TaskHandle_t task){
+	BaseType_t woken = pdFALSE;
+
+	if (task == NULL)
+		return;
+	vTaskNotifyGiveFromISR(task, &woken);
+	portYIELD_FROM_ISR(woken);
+}
+
+/*
+ * print the task statistics
+ */
+void rtos_stats(void){
+	static TaskStatus_t status[RTOS_TASKS + 2];		/* + idle and timer */
+	uint32_t total;
+	UBaseType_t n, i;
+
+	n = uxTaskGetSystemState(status, RTOS_TASKS + 2, &total);
+	total /= 100;		/* percent */
+	if (total == 0)
+		return;
+	for (i = 0; i < n; i++){
+		printf("%-10s prio %lu stack %5lu cpu %3lu%%\n", status[i].pcTaskName,
+				(unsigned long) status[i].uxCurrentPriority,
+				(unsigned long) status[i].usStackHighWaterMark,
+				(unsigned long)(status[i].ulRunTimeCounter / total));
+	}
+}
+
+/*
+ * the global timer is always running
+ */
+void rtos_stats_timer(void){
+}
+
+/*
+ * global timer scaled to RTOS_STATS_HZ
+ */
+u32 rtos_stats_count(void){
+	XTime now;
+
+	XTime_GetTime(&now);
+	return (u32)(now / (COUNTS_PER_SECOND / RTOS_STATS_HZ));
+}
+
+/*
+ * the idle task sleeps until the next interrupt (configUSE_IDLE_HOOK)
+ */
+void vApplicationIdleHook(void){
+	power_wfi();
+}
+
+/*
+ * kernel task memory (configSUPPORT_STATIC_ALLOCATION)
+ */
+void vApplicationGetIdleTaskMemory(StaticTask_t **tcb, StackType_t **stack, uint32_t *size){
+	*tcb = &idle_tcb;
+	*stack = idle_stack;
+	*size = configMINIMAL_STACK_SIZE;
+}
+
+void vApplicationGetTimerTaskMemory(StaticTask_t **tcb, StackType_t **stack, uint32_t *size){
+	*tcb = &timer_tcb;
+	*stack = timer_stack;
+	*size = configTIMER_TASK_STACK_DEPTH;
+}
+
+#endif
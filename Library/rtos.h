@@ -0,0 +1,49 @@
+/*
+ * rtos.h -- FreeRTOS build support
+ *
+ * Only built with CROSSING_FREERTOS defined (and the freertos BSP). Tasks
+ * come from fixed tables, so the kernel needs no heap:
+ *
+ *	#define configSUPPORT_STATIC_ALLOCATION 1
+ *	#define configGENERATE_RUN_TIME_STATS 1
+ *	#define configUSE_TRACE_FACILITY 1
+ *	#define configUSE_IDLE_HOOK 1
+ *	#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS() rtos_stats_timer()
+ *	#define portGET_RUN_TIME_COUNTER_VALUE() rtos_stats_count()
+ */
+#pragma once
+
+#ifdef CROSSING_FREERTOS
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "xil_types.h"		/* types used by xilinx */
+
+#define RTOS_TASKS 4		/* application tasks */
+#define RTOS_STACK 1024		/* words per task */
+#define RTOS_STATS_HZ 100000	/* run-time counter rate */
+
+/*
+ * create task <name> running <fn> at <priority>
+ *
+ * returns its handle; NULL once the table is full
+ */
+TaskHandle_t rtos_task(const char *name, TaskFunction_t fn, UBaseType_t priority);
+
+/*
+ * wake <task> from an interrupt handler (c.f. ulTaskNotifyTake)
+ */
+void rtos_wake_from_isr(TaskHandle_t task);
+
+/*
+ * print each task's stack headroom and share of the cpu since boot
+ */
+void rtos_stats(void);
+
+/*
+ * run-time statistics clock (c.f. portGET_RUN_TIME_COUNTER_VALUE)
+ */
+void rtos_stats_timer(void);
+u32 rtos_stats_count(void);
+
+#endif
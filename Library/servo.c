@@ -1,6 +1,21 @@
 #include "servo.h"
+#include "config.h"
 #define OPTIONS (XTC_PWM_ENABLE_OPTION | XTC_EXT_COMPARE_OPTION | XTC_DOWN_COUNT_OPTION)
 
+#ifdef CROSSING_PLIO
+#include "plio.h"
+
+/* the high time, taken at the next period: no cut or stretched pulse */
+#define HIGH(cnt) plio_compare(cnt)
+
+void servo_init(void){
+	plio_pwm(SERVO_PERIOD_CNT, SERVO_PERIOD_CNT * 0.075);
+	plio_ctrl(PLIO_CTRL_PWM, true);
+}
+#else
+
+#define HIGH(cnt) XTmrCtr_SetResetValue(&timer, 1, cnt)
+
 /* define timer stuff */
 static XTmrCtr timer;
 void servo_init(void){
@@ -17,18 +32,31 @@ void servo_init(void){
 	XTmrCtr_Start(&timer, 1);
 
 }
+#endif
 
 void servo_set(double dutycycle){
 //	u32 rst = CLOCK_FREQ * PERIOD* dutycycle;
 	double duty;
-	if (dutycycle > MAXDUTY){
-		duty = MAXDUTY;
+	double maxduty = config->maxduty / 1000000.0;
+	double minduty = config->minduty / 1000000.0;
+	if (dutycycle > maxduty){
+		duty = maxduty;
 	}
-	else if (dutycycle < MINDUTY){
-		duty = MINDUTY;
+	else if (dutycycle < minduty){
+		duty = minduty;
 	}
 	else{
 		duty = dutycycle;
 	}
-	XTmrCtr_SetResetValue(&timer, 1, CLOCK_FREQ * PERIOD * duty);
+	HIGH(CLOCK_FREQ * PERIOD * duty);
+}
+
+void servo_set_pos(u32 pos){
+	if (pos > (1 << 16)){
+		pos = 1 << 16;
+	}
+	const config_t *c = config;		/* one snapshot of the duty range */
+	u32 mincnt = (u32)((u64) SERVO_PERIOD_CNT * c->minduty / 1000000);
+	u32 maxcnt = (u32)((u64) SERVO_PERIOD_CNT * c->maxduty / 1000000);
+	HIGH(mincnt + (u32)(((u64)(maxcnt - mincnt) * pos) >> 16));
 }
@@ -13,6 +13,9 @@
 #define PERIOD	20/1000	/*period of pwm waveform */
 #define MAXDUTY 0.1019 //0.125
 #define MINDUTY 0.0556 //0325
+#define SERVO_MAX_PPM 101900	/* MAXDUTY, for constant duties (c.f. regs.h) */
+#define SERVO_MIN_PPM 55600		/* MINDUTY */
+#define SERVO_PERIOD_CNT (CLOCK_FREQ * PERIOD)	/* counts per pwm period */
 
 /*
  * Initialize the servo, setting the duty cycle to 7.5%
@@ -20,9 +23,16 @@
 void servo_init(void);
 
 /*
- * Set the dutycycle of the servo
+ * Set the dutycycle of the servo, clamped to the configured
+ * minduty/maxduty (c.f. config.h; defaults MINDUTY/MAXDUTY)
  */
 void servo_set(double dutycycle);
 
+/*
+ * Set the servo to a Q16 fraction <pos> of its travel (0 is minduty,
+ * 1 << 16 is maxduty) without floating point; safe from interrupt context
+ */
+void servo_set_pos(u32 pos);
+
 
 
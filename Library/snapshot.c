@@ -0,0 +1,55 @@
+/*
+ * snapshot.c -- versioned crossing state record
+ */
+
+#include "snapshot.h"
+#include "xpseudo_asm.h"	/* cpsr access */
+#include "xreg_cortexa9.h"
+
+static volatile u32 seq = 0;	/* odd while a write is in progress */
+static snapshot_t record;
+static volatile u32 retries = 0;
+
+/*
+ * publish a new record
+ *
+ * IRQs are masked so a thread-context publish cannot interleave with one
+ * from an interrupt handler; the previous mask is restored on exit.
+ */
+void snapshot_publish(const snapshot_t *s){
+	u32 cpsr = mfcpsr();
+
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);	/* set the I bit */
+	seq++;
+	__sync_synchronize();
+	record = *s;
+	record.version = (seq + 1) >> 1;
+	__sync_synchronize();
+	seq++;
+	mtcpsr(cpsr);
+}
+
+/*
+ * copy the current record into <out>
+ */
+void snapshot_read(snapshot_t *out){
+	u32 s1, s2;
+
+	for(;;){
+		s1 = seq;
+		__sync_synchronize();
+		*out = record;
+		__sync_synchronize();
+		s2 = seq;
+		if (!(s1 & 1) && s1 == s2)
+			return;
+		retries++;
+	}
+}
+
+/*
+ * returns the number of torn reads retried since boot
+ */
+u32 snapshot_retries(void){
+	return retries;
+}
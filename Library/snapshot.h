@@ -0,0 +1,44 @@
+/*
+ * snapshot.h -- versioned crossing state record
+ *
+ * The controller is the single writer; any number of readers (telemetry,
+ * console, substation handlers) take a consistent copy without locking,
+ * retrying only if a write raced with the copy (seqlock).
+ *
+ * Readers must not run in a context that preempts the writer (no reads
+ * from a higher-priority interrupt than the one publishing).
+ */
+#pragma once
+
+#include "xil_types.h"		/* types used by xilinx */
+
+typedef struct {
+	u32 version;		/* publishes since boot */
+	u8 state;			/* FSM state */
+	u8 mode;			/* substation mode {CONFIGURE,PING,UPDATE} */
+	u8 traincoming;
+	u8 keyflag;
+	u8 btnpressed;
+	u8 pedcrossed;
+	u8 link;			/* active transport {LINK_UART,LINK_UDP} */
+	u8 health;			/* {HEALTH_OK,HEALTH_WARM,HEALTH_HOT} */
+	int timercnt;		/* ticks in the current state */
+	s32 gate;			/* measured gate position (Q16) */
+} snapshot_t;
+
+/*
+ * publish a new record (single writer; safe from thread or interrupt context)
+ *
+ * <s>->version is assigned by the store
+ */
+void snapshot_publish(const snapshot_t *s);
+
+/*
+ * copy the current record into <out>, retrying if a publish raced the copy
+ */
+void snapshot_read(snapshot_t *out);
+
+/*
+ * returns the number of torn reads retried since boot
+ */
+u32 snapshot_retries(void);
@@ -0,0 +1,218 @@
+/*
+ * timesync.c -- substation time from two-way exchanges
+ */
+
+#include <string.h>
+#include "timesync.h"
+#include "xtime_l.h"		/* global timer */
+#include "xpseudo_asm.h"	/* cpsr access */
+#include "xreg_cortexa9.h"
+
+#define NS 1000000000ull
+#define CALM 4				/* quiet exchanges before the loop tightens */
+#define FLOOR_NS 1000		/* least jitter the loop adapts to */
+
+static u32 local_id;
+static u64 base_local;		/* local clock at the last correction */
+static u64 base_time;		/* disciplined clock then */
+static s64 freq = 0;		/* learnt frequency correction, ppb */
+static s64 slew = 0;		/* phase correction in progress, ppb */
+static u64 slew_ns = 0;		/* local ns it has left */
+static u64 last_local = 0;	/* local clock at the last accepted exchange */
+static u64 pending = 0;		/* t1 of the request in flight */
+static u64 delays[TIMESYNC_FILTER];	/* recent round trips */
+static u32 delay_i = 0;
+static u64 excess = 0;		/* mean delay over the recent least */
+static s64 last_offset = 0;	/* for the jitter; 0 after a step */
+static u32 calm = 0;		/* accepted offsets in a row within the jitter */
+static bool spiked = false;	/* the last offset was dropped as a spike */
+static bool stepped = false;
+static timesync_stats_t stats;
+
+/*
+ * <d> * <ppb> / 1e9 without overflow
+ */
+static s64 scale(u64 d, s64 ppb){
+	return (s64)(d / NS) * ppb + (s64)(d % NS) * ppb / (s64) NS;
+}
+
+/*
+ * the disciplined clock at local time <local>
+ */
+static u64 at(u64 local){
+	u64 d = local - base_local;
+
+	return base_time + d + scale(d, freq) + scale(d < slew_ns ? d : slew_ns, slew);
+}
+
+/*
+ * move the base to <local>, keeping the clock where it is
+ */
+static void rebase(u64 local){
+	u64 d = local - base_local;
+
+	base_time = at(local);
+	slew_ns -= d < slew_ns ? d : slew_ns;
+	base_local = local;
+}
+
+static s64 clamp(s64 x, s64 limit){
+	return x > limit ? limit : x < -limit ? -limit : x;
+}
+
+static u64 magnitude(s64 x){
+	return x < 0 ? -x : x;
+}
+
+/*
+ * start unsynced
+ */
+void timesync_init(u32 id){
+	local_id = id;
+	base_local = base_time = timesync_local();
+	freq = slew = 0;
+	slew_ns = last_local = pending = 0;
+	memset(delays, 0xFF, sizeof(delays));
+	delay_i = calm = 0;
+	excess = 0;
+	spiked = false;
+	last_offset = 0;
+	stepped = false;
+	memset(&stats, 0, sizeof(stats));
+	stats.tc = TIMESYNC_TC_MIN;
+}
+
+/*
+ * local clock
+ */
+u64 timesync_local(void){
+	XTime t;
+
+	XTime_GetTime(&t);
+	return t / COUNTS_PER_SECOND * NS + t % COUNTS_PER_SECOND * NS / COUNTS_PER_SECOND;
+}
+
+/*
+ * disciplined clock
+ */
+u64 timesync_now(void){
+	u32 cpsr = mfcpsr();
+	u64 t;
+
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);	/* the base moves in pairs */
+	t = at(timesync_local());
+	mtcpsr(cpsr);
+	return t;
+}
+
+/*
+ * new request
+ */
+void timesync_request(time_sync_t *out){
+	u32 cpsr = mfcpsr();
+
+	memset(out, 0, sizeof(*out));
+	out->type = TIME_SYNC;
+	out->id = (int) local_id;
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);
+	rebase(timesync_local());		/* keeps the interval to scale short */
+	out->t1 = pending = base_time;
+	mtcpsr(cpsr);
+}
+
+/*
+ * substation answer
+ */
+void timesync_reply(const time_sync_t *in){
+	u64 local, t4, delay, interval, bound;
+	s64 offset, rate;
+	u64 least;
+	u32 cpsr, i;
+
+	if (pending == 0 || in->t1 != pending)
+		return;						/* stale, or answered already */
+	pending = 0;
+	cpsr = mfcpsr();
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);
+	local = timesync_local();
+	t4 = at(local);
+	delay = (t4 - in->t1) - (in->t3 - in->t2);
+	if ((s64) delay < 0)
+		delay = 0;
+	offset = ((s64)(in->t2 - in->t1) + (s64)(in->t3 - t4)) / 2;
+
+	/* queueing on either leg skews the offset by up to the extra delay:
+	 * drop exchanges that waited longer than usual (an eighth of the
+	 * least delay, until there is a usual) */
+	delays[delay_i++ % TIMESYNC_FILTER] = delay;
+	for (least = delays[0], i = 1; i < TIMESYNC_FILTER; i++){
+		if (delays[i] < least)
+			least = delays[i];
+	}
+	bound = delay - least < 2 * excess + FLOOR_NS ? delay - least : 2 * excess + FLOOR_NS;
+	excess += ((s64) bound - (s64) excess) / 8;	/* clipped, so spikes do not inflate it */
+	if (stepped && delay - least > (delay_i > TIMESYNC_FILTER ? excess : least / 8) + FLOOR_NS){
+		stats.rejected++;
+		mtcpsr(cpsr);
+		return;
+	}
+
+	/* an offset far outside the jitter is dropped once; twice running, it is real */
+	bound = 2 * (stats.jitter > FLOOR_NS ? stats.jitter : FLOOR_NS);
+	if (stepped && magnitude(offset) > 4 * bound && !spiked){
+		spiked = true;
+		stats.rejected++;
+		mtcpsr(cpsr);
+		return;
+	}
+	spiked = false;
+
+	rebase(local);
+	if (!stepped || magnitude(offset) > TIMESYNC_STEP_NS){
+		base_time += offset;
+		slew = 0;
+		slew_ns = 0;
+		stepped = true;
+		stats.steps++;
+		stats.tc = TIMESYNC_TC_MIN;
+		calm = 0;
+		last_offset = 0;
+	} else {
+		interval = local - last_local;
+		stats.jitter += ((s64) magnitude(offset - last_offset) - (s64) stats.jitter) / 8;
+		last_offset = offset;
+		rate = offset * (s64) NS / (s64) interval;	/* ppb that would cancel it over one interval */
+		freq = clamp(freq + rate / (2 << (2 * stats.tc)), TIMESYNC_MAX_PPB);
+		slew = clamp(rate / (1 << stats.tc), TIMESYNC_MAX_PPB);
+		slew_ns = interval;
+
+		/* tighten while the offsets stay within the jitter, loosen when they do not */
+		if (magnitude(offset) > 2 * bound){
+			calm = 0;
+			if (stats.tc > TIMESYNC_TC_MIN)
+				stats.tc--;
+		} else if (magnitude(offset) <= bound && ++calm >= CALM){
+			calm = 0;
+			if (stats.tc < TIMESYNC_TC_MAX)
+				stats.tc++;
+		}
+	}
+	last_local = local;
+	stats.offset = offset;
+	stats.delay = delay;
+	stats.freq = (s32) freq;
+	stats.samples++;
+	stats.synced = magnitude(offset) < TIMESYNC_SYNCED_NS && stats.samples > 1;
+	mtcpsr(cpsr);
+}
+
+/*
+ * statistics
+ */
+void timesync_stats(timesync_stats_t *out){
+	u32 cpsr = mfcpsr();
+
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);
+	*out = stats;
+	mtcpsr(cpsr);
+}
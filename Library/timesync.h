@@ -0,0 +1,72 @@
+/*
+ * timesync.h -- substation time from two-way exchanges
+ *
+ * The global timer gives a monotonic 64-bit local clock (timesync_local).
+ * On top of it runs a disciplined clock that follows the substation
+ * (timesync_now). Each exchange (c.f. time_sync_t) gives an offset and a
+ * round-trip delay. Queueing on either leg skews the offset, so an
+ * exchange that took much longer than the least of the last
+ * TIMESYNC_FILTER is dropped, and so is a lone offset far outside the
+ * jitter. The rest steer the clock through a phase-locked loop: a phase
+ * correction slewed in over the next interval, plus a frequency correction
+ * that learns the crystal's drift. The loop tightens its time constant while
+ * the offsets stay within the jitter and loosens it when they do not. An
+ * offset beyond TIMESYNC_STEP_NS (and the first one) is stepped, the only
+ * time the disciplined clock jumps. All times are in ns.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include "xil_types.h"		/* types used by xilinx */
+#include "msg.h"
+
+#define TIMESYNC_POLLS 20		/* main loop polls between exchanges */
+#define TIMESYNC_FILTER 8		/* exchanges the least delay is taken over */
+#define TIMESYNC_STEP_NS 50000000	/* offsets beyond this are stepped, not slewed */
+#define TIMESYNC_MAX_PPB 500000	/* frequency correction limit (500 ppm) */
+#define TIMESYNC_TC_MIN 1		/* loop time constant, 2^tc exchanges */
+#define TIMESYNC_TC_MAX 5
+#define TIMESYNC_SYNCED_NS 1000000	/* offset under which the clock counts as synced */
+
+typedef struct {
+	s64 offset;				/* last accepted offset, substation - local */
+	u64 delay;				/* its round trip */
+	u64 jitter;				/* mean change of the offset between exchanges */
+	s32 freq;				/* frequency correction, ppb */
+	u32 tc;					/* loop time constant */
+	u32 samples;			/* exchanges accepted */
+	u32 rejected;			/* exchanges the clock filter passed over */
+	u32 steps;				/* clock steps */
+	bool synced;
+} timesync_stats_t;
+
+/*
+ * start unsynced, for controller <id>
+ */
+void timesync_init(u32 id);
+
+/*
+ * returns the local clock: ns since boot, monotonic
+ */
+u64 timesync_local(void);
+
+/*
+ * returns the disciplined clock: substation ns (local until the first
+ * exchange; safe from interrupt context)
+ */
+u64 timesync_now(void);
+
+/*
+ * fill <out> with a new request, stamped just before it is sent
+ */
+void timesync_request(time_sync_t *out);
+
+/*
+ * take the substation's answer to the last request
+ */
+void timesync_reply(const time_sync_t *in);
+
+/*
+ * copy the statistics into <out>
+ */
+void timesync_stats(timesync_stats_t *out);
@@ -0,0 +1,159 @@
+/*
+ * timing.c -- demand-adaptive signal timing
+ */
+
+#include <string.h>
+#include "timing.h"
+#include "xpseudo_asm.h"	/* cpsr access */
+#include "xreg_cortexa9.h"
+
+static s64 plan_green, cycle, yellow;	/* the configured plan (ticks) */
+static s64 lost;				/* green lost starting off (ticks) */
+static u32 green_min, green_max;	/* bounds (ticks) */
+static u32 ped_min, ped_max;
+static u32 window;				/* demand window (ticks) */
+static u32 train_soon;
+static u32 now = 0;				/* ticks since init */
+static u32 window_start = 0;
+static u32 window_presses = 0;
+static u32 last_train = 0;
+static u32 trains = 0;
+static u32 cur_state = 0;
+static u32 entered = 0;
+static timing_stats_t stats;
+
+/*
+ * recompute the phase lengths from the current statistics
+ */
+static void adjust(void){
+	u32 load = stats.ped_rate;		/* Q8 presses per window */
+	s64 g, p;
+
+	if (load > (TIMING_PED_SAT << 8))
+		load = TIMING_PED_SAT << 8;
+
+	/* heavier demand: serve pedestrians sooner and for longer */
+	stats.green = green_max - ((green_max - green_min) * load) / (TIMING_PED_SAT << 8);
+	stats.pedestrian = ped_min + ((ped_max - ped_min) * load) / (TIMING_PED_SAT << 8);
+
+	/* frequent trains would cut a long pedestrian phase short anyway */
+	if (stats.train_interval != 0 && stats.train_interval < train_soon)
+		stats.pedestrian = ped_min;
+
+	/*
+	 * vehicles get no less of the cycle (green, yellow, pedestrian) than
+	 * the plan gives them, less the green lost starting off each time, or
+	 * their queue outgrows the green: serve pedestrians sooner by
+	 * shortening their phase first, then lengthen the green to the floor
+	 */
+	g = stats.green;
+	p = stats.pedestrian;
+	if ((g - lost) * cycle < (plan_green - lost) * (g + p + yellow)){
+		p = (g - lost) * cycle / (plan_green - lost) - g - yellow;
+		if (p < (s64) ped_min)
+			p = ped_min;
+		if (p < (s64) stats.pedestrian)
+			stats.pedestrian = (u32) p;
+		g = (lost * cycle + (plan_green - lost) * (stats.pedestrian + yellow) + cycle - plan_green + lost - 1)
+				/ (cycle - plan_green + lost);
+		if (g > (s64) stats.green)
+			stats.green = (u32) g;
+	}
+}
+
+/*
+ * <pct> percent of <ticks>, at least one tick
+ */
+static u32 percent(u32 ticks, u32 pct){
+	u32 v = ticks * pct / 100;
+
+	return v != 0 ? v : 1;
+}
+
+/*
+ * initialize the engine
+ */
+void timing_init(u32 green, u32 pedestrian, u32 light, u32 freq){
+	u32 cpsr = mfcpsr();
+
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);	/* the ttc and button callbacks */
+	memset(&stats, 0, sizeof(stats));
+	stats.green = green;
+	stats.pedestrian = pedestrian;
+	plan_green = green;
+	yellow = light;
+	cycle = green + light + pedestrian;
+	lost = TIMING_LOST_S * freq < green ? TIMING_LOST_S * freq : green - 1;
+	green_min = percent(green, TIMING_GREEN_MIN);
+	green_max = percent(green, TIMING_GREEN_MAX);
+	ped_min = percent(pedestrian, TIMING_PED_MIN);
+	ped_max = percent(pedestrian, TIMING_PED_MAX);
+	window = TIMING_WINDOW_S * freq;
+	train_soon = TIMING_TRAIN_SOON_S * freq;
+	now = window_start = last_train = entered = 0;
+	window_presses = trains = cur_state = 0;
+	mtcpsr(cpsr);
+}
+
+/*
+ * advance the engine by one tick
+ */
+void timing_tick(void){
+	now++;
+	if (now - window_start >= window){
+		/* ewma with alpha 1/4 */
+		stats.ped_rate += ((s32)(window_presses << 8) - (s32) stats.ped_rate) / 4;
+		window_presses = 0;
+		window_start = now;
+		adjust();
+	}
+}
+
+/*
+ * record a pedestrian request
+ */
+void timing_button(void){
+	window_presses++;
+}
+
+/*
+ * record a train arrival
+ */
+void timing_train(void){
+	u32 interval = now - last_train;
+
+	if (trains > 0){
+		if (stats.train_interval == 0)
+			stats.train_interval = interval;
+		else
+			stats.train_interval += ((s32) interval - (s32) stats.train_interval) / 4;
+		adjust();
+	}
+	trains++;
+	last_train = now;
+}
+
+/*
+ * record entry into <state>
+ */
+void timing_state(u32 state){
+	if (cur_state < TIMING_STATES)
+		stats.residency[cur_state] += now - entered;
+	cur_state = state;
+	entered = now;
+}
+
+u32 timing_green(void){
+	return stats.green;
+}
+
+u32 timing_pedestrian(void){
+	return stats.pedestrian;
+}
+
+/*
+ * copy the statistics into <out>
+ */
+void timing_get(timing_stats_t *out){
+	*out = stats;
+}
@@ -0,0 +1,68 @@
+/*
+ * timing.h -- demand-adaptive signal timing
+ *
+ * Tracks pedestrian demand, train arrival intervals and state residency with
+ * O(1) updates per event, and derives the minimum green and pedestrian phase
+ * lengths from them within safety bounds around the configured plan. The
+ * green never serves vehicles for a smaller share of the cycle than the
+ * plan does, so vehicle capacity stays at least the plan's however heavy
+ * the pedestrian demand. All times are in TTC ticks; the window and train
+ * interval are set in seconds and turned into ticks at the TTC frequency.
+ */
+#pragma once
+
+#include "xil_types.h"		/* types used by xilinx */
+
+/* safety bounds on the adjusted phases (% of the configured plan) */
+#define TIMING_GREEN_MIN 50
+#define TIMING_GREEN_MAX 150
+#define TIMING_PED_MIN 70
+#define TIMING_PED_MAX 150
+
+#define TIMING_WINDOW_S 60		/* demand window */
+#define TIMING_PED_SAT 4		/* presses per window treated as saturated demand */
+#define TIMING_LOST_S 2			/* green lost to vehicles starting off, each cycle */
+#define TIMING_TRAIN_SOON_S 120	/* train interval below which the pedestrian phase is held at its minimum */
+#define TIMING_STATES 8			/* state residency slots */
+
+typedef struct {
+	u32 ped_rate;			/* presses per window, EWMA (Q8) */
+	u32 train_interval;		/* ticks between trains, EWMA; 0 until two trains */
+	u32 residency[TIMING_STATES];	/* ticks spent in each state */
+	u32 green;				/* current minimum green */
+	u32 pedestrian;			/* current pedestrian phase */
+} timing_stats_t;
+
+/*
+ * initialize the engine with the configured plan it starts from and
+ * adjusts around (minimum green, pedestrian phase and the yellow between
+ * them), at a TTC frequency of <freq> Hz; call again when the plan changes
+ */
+void timing_init(u32 green, u32 pedestrian, u32 light, u32 freq);
+
+/*
+ * advance the engine by one tick (call from the TTC callback)
+ */
+void timing_tick(void);
+
+/*
+ * record a pedestrian request / a train arrival
+ */
+void timing_button(void);
+void timing_train(void);
+
+/*
+ * record entry into <state>
+ */
+void timing_state(u32 state);
+
+/*
+ * returns the current minimum green / pedestrian phase length
+ */
+u32 timing_green(void);
+u32 timing_pedestrian(void);
+
+/*
+ * copy the statistics into <out>
+ */
+void timing_get(timing_stats_t *out);
@@ -0,0 +1,358 @@
+/*
+ * track.c -- train arrival estimates from the approach sensors
+ */
+
+#include <string.h>
+#include "track.h"
+#include "xtime_l.h"		/* global timer */
+#include "xpseudo_asm.h"	/* cpsr access */
+#include "xreg_cortexa9.h"
+
+#define MS (COUNTS_PER_SECOND / 1000)
+#define NONE (~0ull)
+#define REPEAT_MS 2000		/* a strike this soon at a train's last sensor is that train's again */
+#define REOPEN_S 30			/* a due train timed this much later lets the gate open meanwhile */
+
+static track_pos_t pos[TRACK_SENSORS];
+static u32 sensors = 0;
+static s32 outer[2];			/* last sensor on the way out, by direction (c.f. side); 0 for none */
+static track_train_t trains[TRACK_TRAINS];
+static u32 ntrains = 0;
+static bool full = false;		/* a train went untracked: due until the table empties */
+static u64 ahead = 0;			/* of the last poll */
+static bool known = false;		/* the last train off the island came past the sensors */
+static bool occupied = false;	/* the island switch is on */
+static u64 left = 0;			/* when it last went off */
+static track_stats_t stats;
+
+/*
+ * index into outer by direction
+ */
+static u32 side(s32 dir){
+	return dir > 0;
+}
+
+/*
+ * sensor <i> sees trains heading <dir>
+ */
+static bool sees(u32 i, s32 dir){
+	return pos[i].dir == 0 || pos[i].dir == dir;
+}
+
+static s32 dist(s32 a, s32 b){
+	return a > b ? a - b : b - a;
+}
+
+/*
+ * speed to assume for <t> from its last strike on (mm/s)
+ */
+static u64 speed(const track_train_t *t){
+	u64 v;
+
+	if (t->mmps == 0)
+		return TRACK_MAX_MPS * 1000ull;
+	v = (u64) t->mmps * TRACK_SPEEDUP / 100;
+	if (v > TRACK_MAX_MPS * 1000ull && t->mmps <= TRACK_MAX_MPS * 1000u)
+		v = TRACK_MAX_MPS * 1000ull;	/* no faster than the line allows */
+	return v;
+}
+
+/*
+ * time at which <t> could reach <x> at the earliest
+ */
+static u64 reach(const track_train_t *t, s32 x){
+	return t->at + (u64) dist(x, t->x) * 1000 * COUNTS_PER_SECOND / speed(t);
+}
+
+/*
+ * time at which timed <t> reaches the crossing at the latest
+ */
+static u64 latest(const track_train_t *t){
+	return t->at + (u64) dist(0, t->x) * 1000 * COUNTS_PER_SECOND * 100 / ((u64) t->mmps * TRACK_SLOWDOWN);
+}
+
+/*
+ * the sensor <t> strikes next
+ */
+static s32 next(const track_train_t *t){
+	s32 n = 0;
+	u32 i;
+
+	for (i = 0; i < sensors; i++)
+		if (sees(i, t->dir) && t->dir * (pos[i].x - t->x) > 0 && (n == 0 || dist(pos[i].x, t->x) < dist(n, t->x)))
+			n = pos[i].x;
+	return n;
+}
+
+/*
+ * how well <t> fits a train at <x> at <at>, best lowest: one timed, there
+ * within half its time from the last strike of when its speed says; then
+ * one not timed, nearest first; then the rest. NONE if it is coming and
+ * could not be there yet (one going away may have sped up any amount).
+ */
+static u64 fit(const track_train_t *t, s32 x, u64 at){
+	u64 expect, miss;
+
+	if (t->phase == TRACK_APPROACHING && reach(t, x) > at + TRACK_LATE_MS * MS)
+		return NONE;
+	if (t->mmps == 0)
+		return 1024 + dist(t->x, x);
+	expect = t->at + (u64) dist(x, t->x) * 1000 * COUNTS_PER_SECOND / t->mmps;
+	miss = (expect > at ? expect - at : at - expect) * 1024 / (expect - t->at + 1);
+	return miss <= 512 ? miss : 1ull << 20 | miss;
+}
+
+static void drop(u32 i){
+	trains[i] = trains[--ntrains];
+	if (ntrains == 0)
+		full = false;
+}
+
+/*
+ * due at the crossing within ahead of <now>; a train stays due once it is
+ * (a later estimate must not open the gate in front of it)
+ */
+static bool due(u64 now){
+	bool d = full;
+	u32 i;
+
+	for (i = 0; i < ntrains; i++){
+		if (trains[i].phase == TRACK_APPROACHING && trains[i].eta <= now + ahead)
+			trains[i].due = true;
+		d |= trains[i].phase == TRACK_ISLAND || (trains[i].phase == TRACK_APPROACHING && trains[i].due);
+	}
+	return d;
+}
+
+/*
+ * set up the sensors
+ */
+void track_init(const track_pos_t *sensor, u32 n){
+	u32 i;
+
+	sensors = n < TRACK_SENSORS ? n : TRACK_SENSORS;
+	outer[0] = outer[1] = 0;
+	for (i = 0; i < sensors; i++){
+		pos[i] = sensor[i];
+		if (sees(i, -1) && pos[i].x < outer[0])
+			outer[0] = pos[i].x;
+		if (sees(i, 1) && pos[i].x > outer[1])
+			outer[1] = pos[i].x;
+	}
+	ntrains = 0;
+	full = false;
+	known = false;
+	occupied = false;
+	left = 0;
+	memset(&stats, 0, sizeof(stats));
+}
+
+/*
+ * a sensor strike: a train it comes next for, the one due about then, or a new one
+ */
+void track_sensor(u32 sensor, u64 at, bool late){
+	u32 cpsr = mfcpsr();
+	track_train_t *t = 0;
+	u64 best = 0, d, eta;
+	u32 others = 0;				/* other trains it could be */
+	s32 x, dir;
+	u32 i;
+
+	if (sensor >= sensors)
+		return;
+	x = pos[sensor].x;
+	if (late)
+		at -= TRACK_LATE_MS * MS;	/* the earliest it could have been */
+
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);	/* from the handlers and the main loop */
+	for (i = 0; i < ntrains; i++){
+		track_train_t *c = &trains[i];
+
+		if (c->x == x && at - c->at < REPEAT_MS * MS)
+			goto out;				/* its next axle */
+		if (c->dir == 0 || !sees(sensor, c->dir) || next(c) != x)
+			continue;				/* not the one it comes to next */
+		if (c->phase == TRACK_APPROACHING && c->dir * x > 0 && !occupied && left < c->eta)
+			continue;				/* it would have come onto the island first */
+		d = fit(c, x, at);
+		if (d == NONE)
+			continue;
+		others += t != 0;
+		if (!t || d < best){
+			t = c;
+			best = d;
+		}
+	}
+	for (i = 0; others && i < ntrains; i++)
+		if (trains[i].phase == TRACK_APPROACHING && fit(&trains[i], x, at) != NONE)
+			trains[i].vague = true;
+
+	if (t){
+		if (!late && at > t->at && t->phase == TRACK_APPROACHING)
+			t->mmps = (u64) dist(x, t->x) * 1000 * COUNTS_PER_SECOND / (at - t->at);
+		t->x = x;
+		t->at = at;
+		if (t->phase == TRACK_APPROACHING && t->dir * x > 0)
+			t->phase = TRACK_PAST;	/* crossed with another train on the island */
+		if (t->phase == TRACK_PAST && x == outer[side(t->dir)]){
+			stats.departed++;
+			drop(t - trains);
+			goto out;
+		}
+	} else {
+		dir = pos[sensor].dir ? pos[sensor].dir : x < 0 ? 1 : -1;
+		if (dir * x >= 0){
+			stats.stray++;			/* on the way out: one lost */
+			goto out;
+		}
+		if (ntrains == TRACK_TRAINS){
+			stats.overflow++;
+			full = true;
+			goto out;
+		}
+		t = &trains[ntrains++];
+		t->x = x;
+		t->dir = dir;
+		t->at = at;
+		t->mmps = 0;
+		t->phase = TRACK_APPROACHING;
+		t->due = false;
+		t->vague = false;
+		stats.trains++;
+	}
+	if (t->phase == TRACK_APPROACHING){
+		eta = reach(t, 0);
+		if (t->vague && eta > t->eta)
+			goto out;
+		t->eta = eta;
+		if (!t->vague && eta > at + ahead + (u64) REOPEN_S * COUNTS_PER_SECOND)
+			t->due = false;			/* slower than it was thought */
+	}
+out:
+	mtcpsr(cpsr);
+}
+
+/*
+ * the island switch: the approaching train that fits best is on the road, then past it
+ */
+void track_island(bool on, u64 at){
+	u32 cpsr = mfcpsr();
+	track_train_t *t = 0;
+	u64 best = 0, f;
+	u32 i;
+
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);
+	occupied = on;
+	if (!on)
+		left = at;
+	for (i = 0; i < ntrains; i++){
+		track_train_t *c = &trains[i];
+
+		if (on && c->phase == TRACK_APPROACHING){
+			f = fit(c, 0, at);		/* taken if no other, faster than it could be or not */
+			if (!t || f < best){
+				t = c;
+				best = f;
+			}
+		}
+		if (!on && c->phase == TRACK_ISLAND)
+			t = c;
+	}
+
+	if (on){
+		if (!t){
+			stats.untracked++;
+			if (ntrains == TRACK_TRAINS){
+				full = true;
+				goto out;
+			}
+			t = &trains[ntrains++];
+			t->dir = 0;				/* unknown: its strikes on the way out are not its own */
+			t->mmps = 0;
+			t->due = true;
+			t->vague = true;
+		}
+		t->x = 0;
+		t->at = at;
+		t->eta = at;
+		t->phase = TRACK_ISLAND;
+	} else if (t){
+		stats.cleared++;
+		known = t->dir != 0;
+		if (!known || outer[side(t->dir)] * t->dir <= 0)
+			drop(t - trains);		/* nothing more to strike */
+		else
+			t->phase = TRACK_PAST;	/* its front at the road when it came on */
+	} else
+		known = false;
+out:
+	mtcpsr(cpsr);
+}
+
+/*
+ * drop trains not heard from; due?
+ */
+bool track_poll(u64 now, u32 ahead_ms){
+	u32 cpsr = mfcpsr();
+	bool d;
+	u32 i;
+
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);
+	ahead = (u64) ahead_ms * MS;
+	for (i = ntrains; i-- > 0;){
+		track_train_t *t = &trains[i];
+
+		if (t->phase == TRACK_APPROACHING && t->mmps && !occupied && left >= t->eta && now > latest(t)){
+			stats.shadowed++;		/* the island was on when it came, and went off after */
+			drop(i);
+		} else if (t->phase != TRACK_ISLAND && now > t->at + (u64) TRACK_STALE_S * COUNTS_PER_SECOND
+				&& (t->phase == TRACK_PAST || now > t->eta)){
+			if (t->phase == TRACK_PAST)
+				stats.departed++;
+			else
+				stats.stale++;
+			drop(i);
+		}
+	}
+	d = stats.due = due(now);
+	mtcpsr(cpsr);
+	return d;
+}
+
+/*
+ * clear?
+ */
+bool track_clear(u64 now){
+	u32 cpsr = mfcpsr();
+	bool d;
+
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);
+	d = known && !due(now);
+	mtcpsr(cpsr);
+	return d;
+}
+
+/*
+ * the trains
+ */
+u32 track_trains(track_train_t *out, u32 max){
+	u32 cpsr = mfcpsr();
+	u32 n;
+
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);
+	n = ntrains < max ? ntrains : max;
+	memcpy(out, trains, n * sizeof(*out));
+	mtcpsr(cpsr);
+	return n;
+}
+
+/*
+ * statistics
+ */
+void track_stats(track_stats_t *out){
+	u32 cpsr = mfcpsr();
+
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);
+	*out = stats;
+	mtcpsr(cpsr);
+}
@@ -0,0 +1,120 @@
+/*
+ * track.h -- train arrival estimates from the approach sensors
+ *
+ * Sensors sit at fixed positions along the line, in metres from the
+ * crossing: negative on one side, positive on the other. On double track
+ * each is on one direction's track and only sees trains heading that way;
+ * on single track (direction 0) block signalling keeps one train in the
+ * section. A train is picked up by the first sensor it strikes on its way
+ * in, which also gives its direction. Each later strike updates its speed, and the strike it is
+ * matched to is the one it would reach next, closest to when it would get
+ * there. From the speed comes a cautious arrival time: as if the train
+ * sped up by TRACK_SPEEDUP percent after its last sensor, or came at
+ * TRACK_MAX_MPS before two sensors have timed it. track_poll says a train
+ * is due once that time is less than the crossing needs to close, plus a
+ * safety margin, away. The crossing then starts closing (c.f.
+ * crossing_due) just in time, rather than when the first sensor strikes.
+ *
+ * The island switch at the crossing (c.f. crossing_train) tells when the
+ * train is on the road and when it has cleared it. Its direction tells
+ * which later strikes are its own on the way out, so they are not taken
+ * for a train coming the other way. Once a tracked train is off the
+ * island, with no other on it or due, the crossing is clear and can open
+ * after TRACK_HOLD rather than the full wait.
+ *
+ * Two trains on the road together make one island strike. The one left
+ * approaching is taken to have crossed if the island went off after it
+ * could have arrived and it has not come on by the time it would at
+ * TRACK_SLOWDOWN of its speed; a train that slows more than that, or one
+ * never timed, keeps the gate down until TRACK_STALE_S or it arrives.
+ *
+ * Times are global timer stamps, as taken by the handlers (c.f.
+ * capture.h).
+ */
+#pragma once
+
+#include <stdbool.h>
+#include "xil_types.h"		/* types used by xilinx */
+
+#define TRACK_SENSORS 8
+#define TRACK_TRAINS 4
+#define TRACK_MAX_MPS 45		/* line speed: a train not timed yet is assumed this fast */
+#define TRACK_SPEEDUP 150		/* % of its measured speed a train may reach after its last sensor */
+#define TRACK_SLOWDOWN 50		/* % of its measured speed a train is taken to keep at least */
+#define TRACK_LATE_MS 150		/* a late stamp (c.f. io_entry) may be this far after the strike */
+#define TRACK_STALE_S 600		/* a train not heard from for this long is dropped */
+#define TRACK_HOLD 2			/* ticks before opening once the crossing is clear (c.f. hold) */
+#define TRACK_GATE_MS 4000		/* gate closing time to allow, unless one measured is longer */
+
+typedef struct {
+	s32 x;					/* m from the crossing */
+	s32 dir;				/* trains it sees: +1 heading for positive x, -1 the other way, 0 both */
+} track_pos_t;
+
+/* train phases */
+#define TRACK_APPROACHING 0
+#define TRACK_ISLAND 1			/* on the road */
+#define TRACK_PAST 2			/* cleared it, still on the sensors */
+
+typedef struct {
+	s32 x;					/* position of its last strike (m) */
+	s32 dir;				/* +1 towards positive x, -1 the other way */
+	u64 at;					/* time of its last strike (global timer) */
+	u32 mmps;				/* measured speed (mm/s); 0 until timed */
+	u64 eta;				/* cautious arrival at the crossing (global timer) */
+	u8 phase;
+	bool due;				/* closing for it */
+	bool vague;				/* a strike it may have made went to another: its arrival only moves earlier */
+} track_train_t;
+
+typedef struct {
+	u32 trains;				/* picked up */
+	u32 cleared;			/* off the island */
+	u32 departed;			/* past their last sensor */
+	u32 untracked;			/* island strikes with no train expected */
+	u32 stale;				/* dropped without reaching the crossing */
+	u32 shadowed;			/* taken to have crossed with another on the island */
+	u32 overflow;			/* strikes with no room for a new train */
+	u32 stray;				/* strikes on the way out no train could have made */
+	bool due;				/* at the last poll */
+} track_stats_t;
+
+/*
+ * initialize with the positions of <n> sensors
+ */
+void track_init(const track_pos_t *sensor, u32 n);
+
+/*
+ * sensor <sensor> struck at global timer <at>; <late> if the stamp is not the
+ * interrupt's entry (c.f. io_entry)
+ */
+void track_sensor(u32 sensor, u64 at, bool late);
+
+/*
+ * the island switch went <on> (a train onto the road) or off at <at>
+ */
+void track_island(bool on, u64 at);
+
+/*
+ * returns true while a train is on the island or due at the crossing
+ * within <ahead_ms> of global timer <now> (the time to close plus the
+ * margin)
+ */
+bool track_poll(u64 now, u32 ahead_ms);
+
+/*
+ * returns true if the last train off the island was tracked in by the
+ * sensors, and no train is on the island or due within the last poll's
+ * <ahead_ms> of <now>
+ */
+bool track_clear(u64 now);
+
+/*
+ * copy up to <max> tracked trains into <out>; returns how many
+ */
+u32 track_trains(track_train_t *out, u32 max);
+
+/*
+ * copy the statistics into <out>
+ */
+void track_stats(track_stats_t *out);
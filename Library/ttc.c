@@ -13,6 +13,8 @@
 
 static void (*local_ttc_callback)(void);
 static XTtcPs ttcPort; /* define ttc instance */
+static u32 local_freq;
+static u32 clock;		/* ttc input clock at full cpu speed */
 
 
 static void ttc_handler(void* devicePtr){
@@ -33,9 +35,11 @@ void ttc_init(u32 freq, void (*ttc_callback)(void)){
 	XInterval interval;
 
 	local_ttc_callback = ttc_callback;
+	local_freq = freq;
 	ttcConfig = XTtcPs_LookupConfig(XPAR_XTTCPS_0_DEVICE_ID);
 
 	XTtcPs_CfgInitialize(&ttcPort, ttcConfig, ttcConfig->BaseAddress);
+	clock = ttcPort.Config.InputClockHz;
 
 	XTtcPs_DisableInterrupts(&ttcPort, XTTCPS_IXR_INTERVAL_MASK);
 
@@ -53,6 +57,19 @@ void ttc_init(u32 freq, void (*ttc_callback)(void)){
 
 }
 
+/*
+ * ttc_rescale -- keep the frequency with the cpu clock divided by <slow>
+ */
+void ttc_rescale(u32 slow){
+	u8 prescaler;
+	XInterval interval;
+
+	ttcPort.Config.InputClockHz = clock / slow;
+	XTtcPs_CalcIntervalFromFreq(&ttcPort, local_freq, &interval, &prescaler);
+	XTtcPs_SetPrescaler(&ttcPort, prescaler);
+	XTtcPs_SetInterval(&ttcPort, interval);
+}
+
 /*
  * ttc_start -- start the ttc
  */
@@ -16,6 +16,12 @@
  */
 void ttc_init(u32 freq, void (*ttc_callback)(void));
 
+/*
+ * ttc_rescale -- keep the frequency with the cpu clock, which also clocks
+ * the ttc, divided by <slow> (c.f. power.h)
+ */
+void ttc_rescale(u32 slow);
+
 /*
  * ttc_start -- start the ttc
  */
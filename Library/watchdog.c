@@ -0,0 +1,146 @@
+/*
+ * watchdog.c -- watchdog supervision and warm restart
+ */
+
+#include <stddef.h>			/* offsetof */
+#include "watchdog.h"
+#include "xscuwdt.h"
+#include "xparameters.h"	/* constants used by the hardware */
+#include "xil_io.h"
+#include "xil_cache.h"
+#include "xpseudo_asm.h"	/* cpsr access */
+#include "xreg_cortexa9.h"
+
+#define MAGIC 0x57444F47	/* "WDOG" */
+#define REBOOT_STATUS 0xF8000258	/* slcr: cause of the last reset */
+#define REBOOT_WDT 0x00070000		/* swdt, awdt0, awdt1 */
+#define WDT_LOAD ((u32)((u64) XPAR_PS7_CORTEXA9_0_CPU_CLK_FREQ_HZ / 2 / 1000 * WATCHDOG_TIMEOUT_MS))
+
+typedef struct {
+	u32 magic;
+	u32 sequence;		/* newest record wins */
+	u32 restarts;
+	watchdog_state_t state;
+	u32 check;
+} record_t;
+
+#define WATCHDOG_OCM ((record_t *) WATCHDOG_OCM_ADDR)
+
+static XScuWdt wdt;
+static volatile u32 alive = 0;
+static bool armed = false;
+static u32 sequence = 0;
+static u32 restarts = 0;
+
+/*
+ * checksum over everything up to the check word
+ */
+static u32 checksum(const record_t *r){
+	const u32 *w = (const u32 *) r;
+	u32 sum = MAGIC;
+	u32 i;
+
+	for (i = 0; i < offsetof(record_t, check) / sizeof(u32); i++)
+		sum = (sum << 5 | sum >> 27) ^ w[i];
+	return sum;
+}
+
+static bool valid(const record_t *r){
+	return r->magic == MAGIC && r->check == checksum(r);
+}
+
+/*
+ * initialize
+ */
+bool watchdog_init(watchdog_state_t *last){
+	XScuWdt_Config *wdtConfig;
+	record_t *r = WATCHDOG_OCM;
+	record_t *newest = NULL;
+	bool warm;
+
+	if (valid(&r[0]))
+		newest = &r[0];
+	if (valid(&r[1]) && (newest == NULL || (s32)(r[1].sequence - newest->sequence) > 0))
+		newest = &r[1];
+	warm = newest != NULL && (Xil_In32(REBOOT_STATUS) & REBOOT_WDT) != 0;
+	if (warm){
+		*last = newest->state;
+		sequence = newest->sequence;
+		restarts = newest->restarts + 1;
+	} else {
+		r[0].magic = r[1].magic = 0;	/* records from before a cold boot are stale */
+		Xil_DCacheFlushRange((UINTPTR) r, 2 * sizeof(*r));
+	}
+
+	wdtConfig = XScuWdt_LookupConfig(XPAR_SCUWDT_0_DEVICE_ID);
+	XScuWdt_CfgInitialize(&wdt, wdtConfig, wdtConfig->BaseAddr);
+	return warm;
+}
+
+/*
+ * arm
+ */
+void watchdog_start(void){
+	alive = 0;
+	XScuWdt_LoadWdt(&wdt, WDT_LOAD);
+	XScuWdt_SetWdMode(&wdt);
+	XScuWdt_Start(&wdt);
+	armed = true;
+}
+
+/*
+ * check in
+ */
+void watchdog_alive(u32 who){
+	u32 cpsr = mfcpsr();
+
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);
+	alive |= who;
+	mtcpsr(cpsr);
+}
+
+/*
+ * feed once everyone has checked in
+ */
+void watchdog_poll(void){
+	if (armed && (alive & WATCHDOG_ALL) == WATCHDOG_ALL){
+		alive = 0;
+		XScuWdt_RestartWdt(&wdt);
+	}
+}
+
+/*
+ * write the older slot and push it out of the cache, so a reset mid-write
+ * leaves the other slot intact
+ */
+void watchdog_save(const watchdog_state_t *s){
+	u32 cpsr = mfcpsr();
+	record_t *r;
+
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);
+	sequence++;
+	r = &WATCHDOG_OCM[sequence & 1];
+	r->magic = MAGIC;
+	r->sequence = sequence;
+	r->restarts = restarts;
+	r->state = *s;
+	r->check = checksum(r);
+	Xil_DCacheFlushRange((UINTPTR) r, sizeof(*r));
+	mtcpsr(cpsr);
+}
+
+/*
+ * warm restarts
+ */
+u32 watchdog_restarts(void){
+	return restarts;
+}
+
+/*
+ * disarm
+ */
+void watchdog_stop(void){
+	armed = false;
+	XScuWdt_SetTimerMode(&wdt);		/* leaves watchdog mode (disable sequence) */
+	XScuWdt_Stop(&wdt);
+}
@@ -0,0 +1,73 @@
+/*
+ * watchdog.h -- watchdog supervision and warm restart
+ *
+ * The A9 private watchdog is fed from the main loop only once every
+ * supervised subsystem has checked in since the last feed, so a hung
+ * interrupt handler, a stopped tick or a stuck main loop all end in a
+ * reset. The controller's last state is kept in on-chip memory, which a
+ * watchdog reset does not clear, as two checksummed records written
+ * alternately; after a watchdog reset the newest valid one is handed back
+ * so the crossing can drive safe outputs before the rest of the system is
+ * brought up.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include "xil_types.h"		/* types used by xilinx */
+
+/* supervised subsystems (c.f. watchdog_alive) */
+#define WATCHDOG_MAIN 0x1		/* main loop (control task on FreeRTOS) */
+#define WATCHDOG_TICK 0x2		/* ttc tick */
+#define WATCHDOG_GATE 0x4		/* gate control loop */
+#define WATCHDOG_ALL 0x7
+
+#define WATCHDOG_TIMEOUT_MS 3000	/* longer than the slowest check-in (1 Hz tick) */
+#ifndef WATCHDOG_OCM_ADDR
+#define WATCHDOG_OCM_ADDR 0xFFFF8000	/* high ocm, clear of the boot rom's use */
+#endif
+
+typedef struct {
+	u8 state;
+	u8 traincoming;
+	u8 prewarned;
+	u8 keyflag;
+	u8 btnpressed;
+	u8 pad[3];
+	s32 gate;			/* Q16 target */
+} watchdog_state_t;
+
+/*
+ * initialize; returns true after a watchdog reset, with the last saved
+ * state in <last>
+ */
+bool watchdog_init(watchdog_state_t *last);
+
+/*
+ * arm the watchdog (once initialization is done)
+ */
+void watchdog_start(void);
+
+/*
+ * subsystem <who> has made progress
+ */
+void watchdog_alive(u32 who);
+
+/*
+ * feed the watchdog if every subsystem has checked in (main loop only)
+ */
+void watchdog_poll(void);
+
+/*
+ * record <s> as the state to restore after a watchdog reset
+ */
+void watchdog_save(const watchdog_state_t *s);
+
+/*
+ * returns the number of warm restarts since the last cold boot
+ */
+u32 watchdog_restarts(void);
+
+/*
+ * disarm the watchdog
+ */
+void watchdog_stop(void);
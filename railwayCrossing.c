@@ -15,7 +15,6 @@
 #include <stdio.h>		/* getchar,printf */
 #include <stdlib.h>		/* strtod */
 #include <stdbool.h>		/* type bool */
-#include <unistd.h>		/* sleep */
 #include <string.h>
 
 #include "platform.h"
@@ -27,259 +26,891 @@
 #include "xgpio.h"		/* axi gpio interface */
 
 #include "adc.h"
+#include "boot.h"
+#include "capture.h"
+#include "config.h"
+#include "console.h"
+#include "crossing.h"
+#include "crossings.h"
+#include "gate.h"
 #include "gic.h"
+#include "health.h"
 #include "io.h"
+#include "lat.h"
 #include "led.h"
+#include "link.h"
+#include "linestats.h"
+#include "msg.h"
+#include "power.h"
+#include "regs.h"
+#include "rtos.h"
 #include "servo.h"
+#include "snapshot.h"
+#include "timesync.h"
+#include "timing.h"
+#include "track.h"
 #include "ttc.h"
+#include "watchdog.h"
+#include "xtime_l.h"		/* global timer */
+#include "xpseudo_asm.h"	/* cpsr access */
+#include "xreg_cortexa9.h"
 
 
 /* Define constants */
-#define CONFIGURE 0
-#define PING 1
-#define UPDATE 2
-#define FREQ 1
-#define ID 21
-
-/* Define STATES */
-#define TRAFFIC_ON 		0
-#define YELLOW 			1
-#define PEDESTRIAN 		2
-#define TRAIN_COMING 	3
-#define TRAIN_GONE 		4
-#define MAINTENANCE 	5
-
-/* Initialize iterators/Timers */
-#define TRAFFIC_TMR 10
-#define PEDESTRIAN_TMR 10  //@ 1/10TH seconds per interrupt
-#define LIGHT_TMR 3
-
-static int timercnt = 0; //timer counters
-static int bluecount = 0;
-static u8 t3min = 0;  //timer flags
-static u8 t30sec = 0;
-static u8 t20sec = 0;
-static u8 t3sec = 0;
-static float potvolt;
-static double duty;
-
-/* Crossing control flags */
-static u8 keyflag = 0;
-static u8 traincoming = 0;
-static u8 btnpressed = 0;
-static u8 pedcrossed = 0;
-
-
-/* global variables for data grams and uart drivers */
-static u8 ping_buffer[8];
-static u8 update_buffer[132];
-u8 mode = CONFIGURE;
-static int ping_i = 0;
-static int update_i = 0;
-
-u8 state = TRAFFIC_ON;
-
-typedef struct {
-	int type; /* must be assigned to PING */
-	int id; /* must be assigned to your id */
-} ping_t;
-
-typedef struct {
-	int type; /* must be assigned to UPDATE */
-	int id; /* must be assigned to your id */
-	int value; /* must be assigned to some value */
-} update_request_t;
-
-typedef struct {
-	int type;
-	int id;
-	int average;
-	int values[30];
-} update_response_t;
-
-update_response_t* received_update;
+#define POLL_US 100000		/* main loop period: 10 substation polls per second */
+
+#ifdef CROSSING_FREERTOS
+/* task priorities: the crossing preempts everything else */
+#define CONTROL_PRIORITY (configMAX_PRIORITIES - 1)
+#define COMMS_PRIORITY (configMAX_PRIORITIES - 2)
+#define TELEMETRY_PRIORITY (configMAX_PRIORITIES - 3)
+#define CONSOLE_PRIORITY (tskIDLE_PRIORITY + 1)
+#define STATS_S 60			/* console statistics period */
+#endif
+
+/* the crossing sequences (c.f. crossing.h), clocked by the ttc */
+static crossing_t crossing;
+static lat_t train_lat;		/* train edge to gate/red command */
+static s32 gate_target = CROSSING_OPEN;	/* last gate command, kept for a warm restart */
+static watchdog_state_t last;	/* state saved before a watchdog reset */
+static bool warm = false;
+static bool upstream = false;	/* the upstream crossing's train flag */
+static bool tracked = false;	/* a tracked train is due (c.f. track.h) */
+static u32 gate_ms = TRACK_GATE_MS;	/* gate closing time allowed for */
+static u32 tick_hz = FREQ;	/* ttc frequency, taken from the configuration at boot */
+
+/* approach sensors (m from the crossing, direction): BTN2, BTN3, SW2, SW3, each on the track in */
+static const track_pos_t sensors[] = { { -2000, 1 }, { -800, 1 }, { 800, -1 }, { 2000, -1 } };
+
+#ifdef CROSSING_FREERTOS
+static TaskHandle_t control_task;	/* runs the sequences when notified */
+#endif
+
+
+/* substation mode */
+static u8 mode = CONFIGURE;
 
 /* handles UART initialization */
 void uart_init();
 
-/* handles state changing */
-void change_state();
-
-/* uart0 handler */
-void uart_0_handler(void *CallBackRef, u32 Event, u32 EventData){
-	u8 buffer0;
-	XUartPs* uart0 = (XUartPs*) CallBackRef;
-	if (Event == XUARTPS_EVENT_RECV_DATA) {
-		XUartPs_Recv(uart0, &buffer0, 1);
-		if (mode == PING){
-			if (ping_i < sizeof(ping_t) - 1){//buffer is not full
-				ping_buffer[ping_i] = buffer0;
-				ping_i ++;
-			}
-			else{
-				printf("ping\n");
-				ping_i = 0;
-			}
-		}
-		else if (mode == UPDATE){
-			if (update_i < sizeof(update_response_t) - 1){//buffer is not full
-				update_buffer[update_i] = buffer0;
-				update_i ++;
-			}
-			else{
-				received_update = (update_response_t*) &update_buffer;
-				float potv = (float)(received_update->values[ID])/100;
-				duty = (double)((MAXDUTY-MINDUTY)*potv + MINDUTY);
-				servo_set(duty);
-				update_i = 0;
-			}
-		}
-	else{
-		XUartPs_Send(&uartp1, &buffer0, 1);
-		}
+/* hands flags raised by an interrupt handler to the sequences */
+static void wake(void){
+#ifdef CROSSING_FREERTOS
+	rtos_wake_from_isr(control_task);
+#endif
+}
+
+/* publishes the controller state for other subsystems (c.f. snapshot.h) */
+static void publish(void){
+	static u8 published = TRAFFIC_ON;
+	snapshot_t s;
+	watchdog_state_t w;
+
+	if (crossing.state != published){
+		timing_state(crossing.state);
+		published = crossing.state;
 	}
+
+	s.state = crossing.state;
+	s.mode = mode;
+	s.traincoming = crossing.traincoming;
+	s.keyflag = crossing.keyflag;
+	s.btnpressed = crossing.btnpressed;
+	s.pedcrossed = crossing.pedcrossed;
+	s.link = link_active();
+	s.health = health_level();
+	s.timercnt = (int)(crossing.ticks - crossing.entered);
+	s.gate = gate_position();
+	snapshot_publish(&s);
+
+	w.state = crossing.state;
+	w.traincoming = crossing.traincoming;
+	w.prewarned = crossing.prewarned;
+	w.keyflag = crossing.keyflag;
+	w.btnpressed = crossing.btnpressed;
+	w.gate = gate_target;
+	watchdog_save(&w);
 }
 
+/* answers a remote configuration get/set */
+static void config_request(const config_msg_t *request){
+	config_msg_t reply = *request;
+	u32 value;
 
-/* uart1 handler */
-void uart_1_handler(void *CallBackRef, u32 Event, u32 EventData){
-	u8 buffer;
-	XUartPs* uart1 = (XUartPs*) CallBackRef;
-	if (Event == XUARTPS_EVENT_RECV_DATA) {
-		XUartPs_Recv(uart1, &buffer, 1);
-		XUartPs_Send(&uartp0, &buffer, 1);
-		if (buffer == (u8)'\r'){
-			buffer = (u8) '\n';
-			XUartPs_Send(&uartp0, &buffer, 1);
-		}
+	reply.status = 0;
+	if (request->type == CONFIG_SET && config_set(request->key, request->value) != XST_SUCCESS){
+		reply.status = -1;
+	}
+	if (config_get(request->key, &value) != XST_SUCCESS){
+		reply.status = -1;
+	} else {
+		reply.value = value;
+	}
+	reply.id = config->id;
+	link_send(&reply, sizeof(reply));
+	if (request->key == CONFIG_UPSTREAM){
+		crossings_watch(config->upstream);
 	}
 }
 
+/* applies a line state delta, asking for the full table on a gap */
+static void state_delta(const state_delta_t *delta){
+	ping_t resync;
+
+	if (crossings_delta(delta) != XST_SUCCESS){
+		resync.type = STATE_RESYNC;
+		resync.id = config->id;
+		link_send(&resync, sizeof(resync));
+	}
+}
+
+/* prefixes an event line with the substation time (c.f. timesync.h) */
+static void stamp(void){
+	u64 t = timesync_now();
+
+	printf("[%lu.%06lu] ", (unsigned long)(t / 1000000000ull), (unsigned long)(t / 1000 % 1000000));
+}
+
+/* handles messages received from the substation (c.f. link.h) */
+void substation_callback(const u8 *msg, u32 len){
+	const update_response_t* received_update;
+	time_sync_t sync;
+
+	switch(((const ping_t*) msg)->type){
+	case (PING):
+		printf("ping\n");
+		break;
+	case (UPDATE):
+		received_update = (const update_response_t*) msg;
+		gate_set((received_update->values[config->id] & ~MSG_TRAIN) * GATE_ONE / 100);
+		linestats_push(received_update);
+		break;
+	case (STATE_DELTA):
+		state_delta((const state_delta_t*) msg);
+		break;
+	case (STATE_FULL):
+		crossings_full((const state_full_t*) msg);
+		break;
+	case (CONFIG_GET):
+	case (CONFIG_SET):
+		config_request((const config_msg_t*) msg);
+		break;
+	case (TIME_SYNC):
+		memcpy(&sync, msg, sizeof(sync));	/* the frame is only word aligned */
+		timesync_reply(&sync);
+		break;
+	}
+}
+
+/* forwards substation bytes to the console while configuring */
+void substation_raw_callback(u8 byte){
+	console_write(&byte, 1);
+}
+
 
 /* handles button call-backs */
 void main_btn_callback(u32 buttons) {
+	bool exact;
+	u64 at;
+
 	if (buttons == 1 || buttons == 2){
+		exact = io_entry(&at);
+		capture_event(CAPTURE_PRESS, at, !exact);
+		stamp();
 		printf("Request crossing\n");
-		btnpressed = 1;
-		if(state == MAINTENANCE || state == TRAIN_COMING){
-			led_set(4, LED_ON);
-		}else{
-			change_state();
-		}
+		crossing_button(&crossing);
+		timing_button();
+	} else if (buttons == 4 || buttons == 8){	// approach sensors
+		exact = io_entry(&at);
+		track_sensor(buttons >> 3, at, !exact);
 	}
+	publish();
+	wake();
 }
 
 
+/* train-sensor fast path: gate and red only, no formatting (c.f. io_train_init) */
+void main_train_callback(u64 entry){
+	XTime done;
+
+	power_boost();		/* full speed before anything else */
+	if(!crossing_train_edge(&crossing)){
+		return;		// manual gate, or the train is leaving
+	}
+	gate_close();		//CLOSE GATE
+	regs_led_set(RED, LED_ON);	/* one register write */
+	XTime_GetTime(&done);
+	lat_add(&train_lat, done - entry);
+}
+
+/* handles the upstream crossing's train flag (c.f. crossings.h) */
+void main_upstream_callback(bool train){
+	u32 cpsr = mfcpsr();
+	bool changed;
+
+	power_boost();
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);	/* may run from the main loop */
+	upstream = train;
+	changed = (train || !tracked) && crossing_upstream(&crossing, train);
+	publish();
+	mtcpsr(cpsr);
+	if (changed){		/* logged with IRQs back on */
+		stamp();
+		printf(train ? "Upstream train, pre-closing\n" : "Upstream train cleared before arriving\n");
+	}
+#ifdef CROSSING_FREERTOS
+	xTaskNotifyGive(control_task);
+#endif
+}
+
 /* handles switch call-backs */
 void main_sw_callback(u32 sw_value){
+	bool exact;
+	u64 at, ns;
+
 	led_toggle(sw_value);		//for debugging purposes
 	if (sw_value == 0) {			// Train coming switch
-		if(state == TRAIN_COMING){
-			printf("Train left\n");
-			traincoming = 0;
-			change_state();
-		}else if (state == MAINTENANCE){
-			if(!traincoming){
-				servo_set(MAXDUTY);		//CLOSE GATE
-				traincoming = 1;
-			} else{
-				servo_set(MINDUTY);		//OPEN GATE
-				traincoming = 0;
-			}
-		} else{
-			traincoming = 1;
-			if(state == PEDESTRIAN){
-				printf("Train arriving, closing gate!!!\n");
-				servo_set(MAXDUTY);		//CLOSE GATE
-			} else if(state == TRAFFIC_ON){
-				printf("Train arriving, changing light to yellow!\n");
-				led_set(Y_LED, LED_ON);
-				change_state();
-			}
+		exact = io_entry(&at);
+		switch (crossing_train(&crossing)){
+		case CROSSING_LEFT:
+			track_island(false, at);
+			ns = capture_event(CAPTURE_LEFT, at, !exact);
+			stamp();
+			printf("Train left after %lu.%03lu s\n", (unsigned long)(ns / 1000000000ull),
+					(unsigned long)(ns / 1000000 % 1000));
+			lat_print(&train_lat, "Train edge to gate");
+			break;
+		case CROSSING_ARRIVED:
+			track_island(true, at);
+			capture_event(CAPTURE_ARRIVED, at, !exact);
+			stamp();
+			printf("Train arriving, gate closing!!!\n");
+			timing_train();
+			break;
 		}
 	} else if (sw_value == 1){		// Maintenance Key Switch
-		if(state == MAINTENANCE){
-			keyflag = 0;
-			change_state();
-		} else {
-			keyflag = 1;
-		}
+		crossing_key(&crossing);
+	} else {						// approach sensors
+		exact = io_entry(&at);
+		track_sensor(sw_value, at, !exact);
+	}
+	publish();
+	wake();
+}
+
+/* handles confirmed gate positions */
+void main_gate_callback(u32 event, u32 settle_ms){
+	stamp();
+	if (event == GATE_CLOSED_CONFIRMED){
+		if (settle_ms > gate_ms)
+			gate_ms = settle_ms;	/* the slowest close seen */
+		printf("Gate closed confirmed (%lu ms)\n", (unsigned long) settle_ms);
+	} else {
+		printf("Gate open confirmed (%lu ms)\n", (unsigned long) settle_ms);
 	}
 }
 
 /*Handles ttc timer interrupts */
 void main_ttc_callback(void){
-	timercnt++;
-	switch(state){
-		case (TRAFFIC_ON):
-			if(timercnt == TRAFFIC_TMR){
-				t3min = 1;
-				change_state();
-			}
-			break;
-		case (YELLOW):
-			if(timercnt == LIGHT_TMR){
-				t3sec = 1;
-				change_state();
-			}
-			break;
-		case (PEDESTRIAN):
-			if(timercnt == PEDESTRIAN_TMR){
-				t30sec = 1;
-				change_state();
-			}
-			break;
-		case (TRAIN_GONE):
-			if(timercnt == PEDESTRIAN_TMR){
-				t20sec = 1;
-				change_state();
-			}
-			break;
-		case (MAINTENANCE):
-			potvolt = adc_get_pot();
-			duty = (double)((MAXDUTY-MINDUTY)*potvolt + MINDUTY);
-			servo_set(duty);
-			led_set(RED, LED_ON);
-
-			if(timercnt % 2 == 0){  //say every other second
-				bluecount++;    //increment the counter for blue light flash
-				if(bluecount % 2 == 0){
-					led_set(BLUE, LED_ON);
-				}else{
-					led_set(BLUE, LED_OFF);
-				}
-			}
-			break;
+	crossing_tick(&crossing);
+	watchdog_alive(WATCHDOG_TICK);
+	timing_tick();
+	publish();
+	wake();
+}
+
+/* runs an interrupt callback for the console as if its interrupt had fired */
+static void inject(void (*callback)(u32 arg), u32 arg){
+	u32 cpsr = mfcpsr();
+
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);
+	callback(arg);
+	mtcpsr(cpsr);
+#ifdef CROSSING_FREERTOS
+	xTaskNotifyGive(control_task);
+#endif
+}
+
+/* train switch as the io handler runs it: fast path first */
+static void inject_train(u32 arg){
+	XTime now;
+
+	XTime_GetTime(&now);
+	main_train_callback(now);
+	main_sw_callback(0);
+}
+
+/* sets the substation mode; configure passes the substation through to the console */
+static void set_mode(u8 to){
+	mode = to;
+	link_set_passthrough(mode == CONFIGURE);
+	publish();
+}
+
+/* console commands (c.f. console.h): each step prints at most one line */
+static bool cmd_status(u32 argc, char *argv[], u32 step){
+	snapshot_t s;
+
+	snapshot_read(&s);
+	console_printf("%s for %d ticks, mode %s, train %u, key %u, button %u, gate %ld/%u, link %s, health %u\r\n",
+			crossing_name(s.state), s.timercnt, s.mode == UPDATE ? "update" : "configure",
+			s.traincoming, s.keyflag, s.btnpressed, (long) s.gate, GATE_ONE,
+			s.link == LINK_UDP ? "udp" : "uart", s.health);
+	return false;
+}
+
+static bool cmd_counters(u32 argc, char *argv[], u32 step){
+	timing_stats_t t;
+	health_t h;
+	u32 i;
+
+	switch (step){
+	case 0:
+		console_printf("snapshot retries %lu, warm restarts %lu, gate loop max %lu ns, console dropped %lu\r\n",
+				(unsigned long) snapshot_retries(), (unsigned long) watchdog_restarts(),
+				(unsigned long)((u64) gate_max_loop() * 1000000000ull / COUNTS_PER_SECOND),
+				(unsigned long) console_dropped());
+		return true;
+	case 1:
+		timing_get(&t);
+		console_printf("green %lu, pedestrian %lu, presses %lu/256 per window, train interval %lu ticks\r\n",
+				(unsigned long) t.green, (unsigned long) t.pedestrian,
+				(unsigned long) t.ped_rate, (unsigned long) t.train_interval);
+		return true;
+	case 2:
+		timing_get(&t);
+		console_printf("residency:");
+		for (i = 0; i < CROSSING_STATES; i++)
+			console_printf(" %s %lu", crossing_name(i), (unsigned long) t.residency[i]);
+		console_printf("\r\n");
+		return true;
+	default:
+		health_get(&h);
+		console_printf("temp %ld (%ld-%ld) mC, vccint %ld mV, vccaux %ld mV, alarms %lu, level %lu\r\n",
+				(long) h.temp.avg, (long) h.temp.min, (long) h.temp.max, (long) h.vccint.avg,
+				(long) h.vccaux.avg, (unsigned long) h.alarms, (unsigned long) h.level);
+		return false;
 	}
 }
 
-/* Main function */
-int main()
-{
-    init_platform();
+static bool cmd_lat(u32 argc, char *argv[], u32 step){
+	char buf[LAT_LINE];
+	u32 bin = step - 2;
+
+	if (step < 2){
+		lat_format(step == 0 ? &train_lat : health_reaction(), step == 0 ? "train edge to gate" : "health alarm reaction",
+				buf, sizeof(buf));
+		console_printf("%s\r\n", buf);
+		return true;
+	}
+	if (bin < LAT_BINS && train_lat.bins[bin] != 0)
+		console_printf("  %5lu ns %lu\r\n", (unsigned long)((bin + 1) * LAT_BIN_NS), (unsigned long) train_lat.bins[bin]);
+	if (bin + 1 < LAT_BINS)
+		return true;
+	console_printf("  over   %lu\r\n", (unsigned long) train_lat.overflow);
+	return false;
+}
+
+static bool cmd_config(u32 argc, char *argv[], u32 step){
+	u32 key, value;
+
+	if (argc == 1){
+		config_get(step, &value);
+		console_printf("%-10s %lu\r\n", config_name(step), (unsigned long) value);
+		return step + 1 < CONFIG_KEYS;
+	}
+	for (key = 0; key < CONFIG_KEYS && strcmp(config_name(key), argv[1]) != 0; key++)
+		;
+	if (key == CONFIG_KEYS){
+		console_printf("%s: no such key\r\n", argv[1]);
+	} else if (argc == 2){
+		config_get(key, &value);
+		console_printf("%s %lu\r\n", argv[1], (unsigned long) value);
+	} else if (config_set(key, strtoul(argv[2], NULL, 0)) != XST_SUCCESS){
+		console_printf("%s: bad value %s\r\n", argv[1], argv[2]);
+	}
+	return false;
+}
+
+static bool cmd_button(u32 argc, char *argv[], u32 step){
+	inject(main_btn_callback, 1);
+	return false;
+}
+
+static bool cmd_train(u32 argc, char *argv[], u32 step){
+	inject(inject_train, 0);
+	return false;
+}
+
+static bool cmd_key(u32 argc, char *argv[], u32 step){
+	inject(main_sw_callback, 1);
+	return false;
+}
+
+static bool cmd_upstream(u32 argc, char *argv[], u32 step){
+	if (argc != 2 || (strcmp(argv[1], "on") != 0 && strcmp(argv[1], "off") != 0)){
+		console_printf("upstream on|off\r\n");
+		return false;
+	}
+	main_upstream_callback(strcmp(argv[1], "on") == 0);
+	return false;
+}
+
+static bool cmd_mode(u32 argc, char *argv[], u32 step){
+	if (argc == 2 && strcmp(argv[1], "configure") == 0){
+		set_mode(CONFIGURE);
+	} else if (argc == 2 && strcmp(argv[1], "update") == 0){
+		set_mode(UPDATE);
+	} else if (argc != 1){
+		console_printf("mode [configure|update]\r\n");
+		return false;
+	}
+	console_printf("mode %s\r\n", mode == UPDATE ? "update" : "configure");
+	return false;
+}
+
+static bool cmd_link(u32 argc, char *argv[], u32 step){
+	link_stats_t l;
+
+	if (argc == 2 && strcmp(argv[1], "renegotiate") == 0){
+		link_renegotiate();
+	} else if (argc != 1){
+		console_printf("link [renegotiate]\r\n");
+		return false;
+	}
+	link_stats(&l);
+	console_printf("uart %lu baud, tx %lu, rx %lu, frames %lu, framing %lu, overrun %lu, resync %lu, "
+			"negotiated %lu, fallbacks %lu, tx full %lu\r\n", (unsigned long) l.baud, (unsigned long) l.tx_bytes,
+			(unsigned long) l.rx_bytes, (unsigned long) l.frames, (unsigned long) l.framing,
+			(unsigned long) l.overrun, (unsigned long) l.resync, (unsigned long) l.negotiations,
+			(unsigned long) l.fallbacks, (unsigned long) l.tx_full);
+	return false;
+}
+
+static bool cmd_time(u32 argc, char *argv[], u32 step){
+	timesync_stats_t t;
+	u64 now = timesync_now();
+
+	timesync_stats(&t);
+	console_printf("%lu.%06lu %s, offset %ld ns, delay %lu ns, jitter %lu ns, freq %ld ppb, tc %lu, "
+			"used %lu, rejected %lu, steps %lu\r\n", (unsigned long)(now / 1000000000ull),
+			(unsigned long)(now / 1000 % 1000000), t.synced ? "synced" : "unsynced", (long) t.offset,
+			(unsigned long) t.delay, (unsigned long) t.jitter, (long) t.freq, (unsigned long) t.tc,
+			(unsigned long) t.samples, (unsigned long) t.rejected, (unsigned long) t.steps);
+	return false;
+}
+
+/* prints <s> with Q8 mean and variance */
+static void line_print(const char *label, const linestats_t *s){
+	u32 mean = linestats_mean(s), var = linestats_variance(s);
+
+	console_printf("%s min %lu, max %lu, mean %lu.%02lu, variance %lu.%02lu, above %08lx, trains %08lx\r\n",
+			label, (unsigned long) s->min, (unsigned long) s->max, (unsigned long)(mean >> 8),
+			(unsigned long)((mean & 0xFF) * 100 >> 8), (unsigned long)(var >> 8),
+			(unsigned long)((var & 0xFF) * 100 >> 8), (unsigned long) s->above, (unsigned long) s->trains);
+}
+
+static bool cmd_line(u32 argc, char *argv[], u32 step){
+	u32 threshold = 50, n;
+	linestats_t l, h;
+
+	if (argc == 2){
+		threshold = strtoul(argv[1], NULL, 0);
+	} else if (argc != 1){
+		console_printf("line [threshold]\r\n");
+		return false;
+	}
+	if (!linestats_latest(threshold, &l)){
+		console_printf("no updates yet\r\n");
+		return false;
+	}
+	linestats_history(threshold, &h, &n);
+	line_print("latest ", &l);
+	line_print("history", &h);
+	console_printf("history of %lu updates; above: slots at %lu or over\r\n",
+			(unsigned long) n, (unsigned long) threshold);
+	return false;
+}
+
+static bool cmd_irq(u32 argc, char *argv[], u32 step){
+	gic_source_t s[GIC_SOURCES];
+	u32 i, n = gic_sources(s, GIC_SOURCES);
+
+	for (i = 0; i < n; i++){
+		console_printf("irq %2lu: budget %lu/%u ms%s, %s, count %lu, peak %lu, storms %lu, polled %lu\r\n",
+				(unsigned long) s[i].id, (unsigned long) s[i].budget, GIC_WINDOW_MS,
+				s[i].exempt ? " (exempt)" : "", s[i].storming ? (s[i].exempt ? "shedding" : "polled") : "live",
+				(unsigned long) s[i].count, (unsigned long) s[i].peak, (unsigned long) s[i].storms,
+				(unsigned long) s[i].polled);
+	}
+	return false;
+}
+
+static bool cmd_send(u32 argc, char *argv[], u32 step){
+	u32 i;
+	const char *c;
+
+	for (i = 1; i < argc; i++){
+		for (c = argv[i]; *c != '\0'; c++)
+			link_send_raw((u8) *c);
+		link_send_raw(i + 1 < argc ? ' ' : '\r');
+	}
+	link_send_raw('\n');
+	return false;
+}
+
+static bool cmd_power(u32 argc, char *argv[], u32 step){
+	static const char *names[POWER_STATES] = { "run", "wfi", "slow", "slow wfi" };
+	power_stats_t p;
+	u64 total = 0;
+	u32 i;
+
+	power_stats(&p);
+	for (i = 0; i < POWER_STATES; i++)
+		total += p.ns[i];
+	for (i = 0; i < POWER_STATES; i++){
+		console_printf("%-8s %8lu ms %5lu.%lu%%\r\n", names[i], (unsigned long)(p.ns[i] / 1000000),
+				(unsigned long)(total ? p.ns[i] * 100 / total : 0),
+				(unsigned long)(total ? p.ns[i] * 1000 / total % 10 : 0));
+	}
+	console_printf("energy %lu mJ (%lu mW), clock /%lu, slows %lu, boosts %lu, wakes %lu, aper 0x%08lx\r\n",
+			(unsigned long)(p.uj / 1000), (unsigned long)(total ? p.uj * 1000000 / total : 0),
+			(unsigned long) p.slow, (unsigned long) p.slows, (unsigned long) p.boosts,
+			(unsigned long) p.wakes, (unsigned long) p.aper);
+	return false;
+}
+
+static void span_print(const char *label, const capture_span_t *s){
+	console_printf("%s: n %lu, min %lu.%03lu s, avg %lu.%03lu s, max %lu.%03lu s\r\n", label, (unsigned long) s->count,
+			(unsigned long)(s->min_ns / 1000000000ull), (unsigned long)(s->min_ns / 1000000 % 1000),
+			(unsigned long)(s->count ? s->sum_ns / s->count / 1000000000ull : 0),
+			(unsigned long)(s->count ? s->sum_ns / s->count / 1000000 % 1000 : 0),
+			(unsigned long)(s->max_ns / 1000000000ull), (unsigned long)(s->max_ns / 1000000 % 1000));
+}
+
+static bool cmd_capture(u32 argc, char *argv[], u32 step){
+	capture_record_t r[CAPTURE_RECORDS];
+	capture_stats_t c;
+	u32 n = capture_records(r, CAPTURE_RECORDS);
+	u64 t;
+
+	capture_stats(&c);
+	if (step == 0){
+		span_print("pedestrian wait", &c.wait);
+		return true;
+	}
+	if (step == 1){
+		span_print("train occupancy", &c.occupancy);
+		console_printf("%lu events, %lu late%s\r\n", (unsigned long) c.events, (unsigned long) c.late,
+				c.waiting ? ", a request waiting" : "");
+		return n != 0;
+	}
+	if (step - 2 >= n)
+		return false;		/* taken again each step; it may have shrunk */
+	t = r[step - 2].ns + (timesync_now() - timesync_local());	/* substation time */
+	console_printf("  [%lu.%06lu] %s%s\r\n", (unsigned long)(t / 1000000000ull), (unsigned long)(t / 1000 % 1000000),
+			capture_name(r[step - 2].kind), r[step - 2].late ? " (late)" : "");
+	return step - 1 < n;
+}
+
+static bool cmd_track(u32 argc, char *argv[], u32 step){
+	static const char *phases[] = { "approaching", "on the crossing", "past it" };
+	track_train_t t[TRACK_TRAINS];
+	track_stats_t s;
+	u32 n = track_trains(t, TRACK_TRAINS);
+	XTime now;
+	u64 ms;
+
+	if (step == 0){
+		track_stats(&s);
+		console_printf("%lu trains, %lu cleared, %lu departed, %lu untracked, %lu shadowed, %lu stale, %lu overflow%s; gate %lu ms, margin %lu ms\r\n",
+				(unsigned long) s.trains, (unsigned long) s.cleared, (unsigned long) s.departed,
+				(unsigned long) s.untracked, (unsigned long) s.shadowed, (unsigned long) s.stale, (unsigned long) s.overflow,
+				s.due ? ", due" : "", (unsigned long) gate_ms, (unsigned long) config->margin);
+		return n != 0;
+	}
+	if (step - 1 >= n)
+		return false;		/* taken again each step; a train may have gone */
+	XTime_GetTime(&now);
+	ms = t[step - 1].eta > now ? (t[step - 1].eta - now) / (COUNTS_PER_SECOND / 1000) : 0;
+	console_printf("  %s at %ld m heading %c, %lu.%03lu m/s, eta %lu.%03lu s\r\n", phases[t[step - 1].phase],
+			(long) t[step - 1].x, t[step - 1].dir > 0 ? '+' : t[step - 1].dir < 0 ? '-' : '?',
+			(unsigned long)(t[step - 1].mmps / 1000), (unsigned long)(t[step - 1].mmps % 1000),
+			(unsigned long)(ms / 1000), (unsigned long)(ms % 1000));
+	return step < n;
+}
+
+static const console_cmd_t commands[] = {
+	{ "status", "controller state", cmd_status },
+	{ "counters", "event, timing and health counters", cmd_counters },
+	{ "lat", "latency summaries and the train histogram", cmd_lat },
+	{ "config", "[key [value]]  show or set the configuration", cmd_config },
+	{ "button", "press the pedestrian button", cmd_button },
+	{ "train", "toggle the train switch", cmd_train },
+	{ "key", "toggle the maintenance key", cmd_key },
+	{ "upstream", "on|off  set the upstream train flag", cmd_upstream },
+	{ "mode", "[configure|update]  show or set the substation mode", cmd_mode },
+	{ "link", "[renegotiate]  uart line statistics", cmd_link },
+	{ "time", "substation time and sync statistics", cmd_time },
+	{ "line", "[threshold]  statistics over the recent substation updates", cmd_line },
+	{ "irq", "interrupt budgets and storms", cmd_irq },
+	{ "power", "residency per power state and estimated energy", cmd_power },
+	{ "capture", "pedestrian wait, train occupancy and the recent input events", cmd_capture },
+	{ "track", "tracked trains and their estimated arrival", cmd_track },
+	{ "send", "<text>  send a line to the substation", cmd_send },
+};
+
+/* crossing outputs */
+static void main_signal(crossing_t *c, u32 aspect){
+	static const u32 leds[] = { RED, GREEN, Y_LED, RED, BLUE };	/* by SIGNAL_ */
+
+	led_set(leds[aspect], aspect != SIGNAL_OFF);
+}
+
+static void main_gate(crossing_t *c, s32 pos){
+	gate_target = pos;
+	gate_set(pos);
+}
+
+static void main_request(crossing_t *c, bool on){
+	led_set(4, on);
+}
+
+static s32 main_wheel(crossing_t *c){
+	return (s32)(adc_get_pot() * GATE_ONE);
+}
+
+/* phase lengths: the configuration store and the adaptive timings (c.f. timing.h) */
+static u32 main_green(crossing_t *c){
+	return timing_green();
+}
+
+static u32 main_walk(crossing_t *c){
+	return timing_pedestrian();
+}
+
+static u32 main_yellow(crossing_t *c){
+	return config->light;
+}
+
+static u32 main_hold(crossing_t *c){
+	XTime now;
+
+	XTime_GetTime(&now);
+	return track_clear(now) ? TRACK_HOLD : config->pedestrian;	/* the train is known to be gone */
+}
+
+static void main_enter(crossing_t *c){
+	XTime now;
+
+	power_steady(c->state == TRAFFIC_ON);	/* the clock may drop while green holds */
+	if (c->state == PEDESTRIAN){
+		XTime_GetTime(&now);
+		capture_event(CAPTURE_WALK, now, false);	/* closes the wait */
+	}
+	publish();
+}
+
+static const crossing_ops_t crossing_ops = {
+	main_signal, main_gate, main_request, main_wheel,
+	main_green, main_walk, main_yellow, main_hold, main_enter
+};
+
+/* keeps the timers' rates with the cpu clock (c.f. power.h) */
+static void main_scaled(u32 slow){
+	ttc_rescale(slow);
+	gate_rescale(slow);
+}
+
+/* starts the timing engine again when its plan changes; its statistics
+ * survive changes to the other keys (c.f. timing.h) */
+static void replan(void){
+	static u32 traffic, pedestrian, light, hz;	/* the plan it runs on */
+	const config_t *c = config;	/* one publish */
+
+	if (c->traffic == traffic && c->pedestrian == pedestrian && c->light == light && tick_hz == hz)
+		return;
+	traffic = c->traffic;
+	pedestrian = c->pedestrian;
+	light = c->light;
+	hz = tick_hz;
+	timing_init(traffic, pedestrian, light, hz);	/* bounds follow the plan */
+}
+
+/* brings up the hardware and the substation link */
+static void hardware_init(void){
     gic_init(); /* initialize the gic (c.f. gic.h) */
-	led_init();		/* Initialize LED module */
+	config_init();	/* everything below reads the configuration */
+	timesync_init(config->id);	/* event lines are stamped from here on */
+	crossing_init(&crossing, &crossing_ops);	/* before any callback can raise an event */
+	if (warm){
+		crossing_resume(&crossing, last.traincoming, last.prewarned, last.keyflag, last.btnpressed);
+		gate_target = last.gate;
+	}
+	capture_init();
 	io_btn_init(main_btn_callback);
+	lat_reset(&train_lat);
 	io_sw_init(main_sw_callback);
+	io_train_init(main_train_callback);	/* ahead of the switch callback */
+	track_init(sensors, sizeof(sensors) / sizeof(sensors[0]));
 
-	ttc_init(FREQ, main_ttc_callback);
+	tick_hz = config->freq;
+	replan();
+	ttc_init(tick_hz, main_ttc_callback);
 	ttc_start();	/* start ttc */
-	servo_init();
 	adc_init();
+	gate_init(main_gate_callback);	/* gate loop needs the servo and adc */
+	health_init();
+	power_init(POWER_APER_USED, main_scaled);	/* after the timers it rescales */
 	uart_init();
+	publish();		/* first snapshot before any interrupt can observe it */
+	if (warm)
+		printf("Warm restart %lu: %s\n", (unsigned long) watchdog_restarts(), crossing_name(last.state));
+	watchdog_start();
+	boot_stage(BOOT_READY);
+	boot_print();
+}
+
+/* starts closing just in time for a tracked train (c.f. track.h) */
+static void approach(void){
+	u32 cpsr = mfcpsr();
+	XTime now;
+	bool due, changed;
+
+	XTime_GetTime(&now);
+	due = track_poll(now, config->light * 1000 / tick_hz + gate_ms	/* yellow, then the gate */
+			+ 3 * POLL_US / 1000 + config->margin);	/* passes to see it due, start and end the yellow */
+	mtcpsr(cpsr | XREG_CPSR_IRQ_ENABLE);
+	changed = due ? crossing_due(&crossing) : tracked && !upstream && crossing_upstream(&crossing, false);
+	if (changed)
+		publish();
+	tracked = due;
+	mtcpsr(cpsr);
+	if (!changed)
+		return;
+	power_boost();
+	stamp();		/* logged with IRQs back on */
+	printf(due ? "Train due, closing\n" : "Tracked train gone before arriving\n");
+#ifdef CROSSING_FREERTOS
+	xTaskNotifyGive(control_task);
+#endif
+}
+
+/* services throttled interrupts, the substation link and the configuration store */
+static void comms_poll(void){
+	static u32 passes = 0;
+
+	gic_poll();		/* throttled interrupt sources */
+	approach();
+	power_poll();
+	link_poll();
+	if (config_poll())
+		replan();
+	if (++passes % health_divider() == 0)
+		console_poll();		/* operator work is shed when hot */
+}
+
+/* samples health and reports to the substation; the update carries the
+ * train state, so only the time sync is shed when hot */
+static void telemetry_poll(void){
+	static u32 polls = 0;
+
+	health_poll();
+	if (mode == UPDATE){
+		update_request_t request = { UPDATE, config->id, (crossing.traincoming && !crossing.prewarned) ? MSG_TRAIN : 0 };
+		link_send(&request, sizeof(request));
+		polls++;
+	}
+	if (mode == UPDATE && polls % (TIMESYNC_POLLS * health_divider()) == 0){
+		time_sync_t sync;
+
+		timesync_request(&sync);
+		link_send(&sync, sizeof(sync));
+	}
+}
+
+#ifdef CROSSING_FREERTOS
+/* comms task */
+static void comms_main(void *arg){
+	TickType_t last = xTaskGetTickCount();
+
+	for(;;){
+		comms_poll();
+		watchdog_poll();
+		vTaskDelayUntil(&last, pdMS_TO_TICKS(POLL_US / 1000));
+	}
+}
+
+/* telemetry task */
+static void telemetry_main(void *arg){
+	TickType_t last = xTaskGetTickCount();
+
+	for(;;){
+		telemetry_poll();
+		vTaskDelayUntil(&last, pdMS_TO_TICKS(POLL_US / 1000));
+	}
+}
+
+/* console task: cpu accounting and the train latency */
+static void console_main(void *arg){
+	for(;;){
+		vTaskDelay(pdMS_TO_TICKS(STATS_S * 1000 * health_divider()));
+		rtos_stats();
+		lat_print(&train_lat, "Train edge to gate");
+	}
+}
+
+/* control task: brings the crossing up, then runs the sequences on each notification */
+static void control_main(void *arg){
+	hardware_init();
+	rtos_task("comms", comms_main, COMMS_PRIORITY);
+	rtos_task("telemetry", telemetry_main, TELEMETRY_PRIORITY);
+	rtos_task("console", console_main, CONSOLE_PRIORITY);
+	printf("Railway Crossing Traffic Control (FreeRTOS)!\n");
+
+	for(;;){
+		crossing_run(&crossing);	/* runs until its next blocking point */
+		watchdog_alive(WATCHDOG_MAIN);
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+	}
+}
+#endif
+
+/* Main function */
+int main()
+{
+    boot_stage(BOOT_MAIN);	/* platform up, red and the gate safe already (c.f. boot.h) */
+    warm = boot_warm(&last);
+#ifdef CROSSING_FREERTOS
+    control_task = rtos_task("control", control_main, CONTROL_PRIORITY);
+    vTaskStartScheduler();	/* does not return */
+#else
+    XTime now;
+
+    hardware_init();
 
     printf("Railway Crossing Traffic Control!\n");
     while(1){
-    	sleep(1);
+    	crossing_run(&crossing);	/* runs until its next blocking point */
+    	watchdog_alive(WATCHDOG_MAIN);
+    	comms_poll();
+    	telemetry_poll();
+    	watchdog_poll();
+    	XTime_GetTime(&now);
+    	power_idle(now + (XTime) COUNTS_PER_SECOND * POLL_US / 1000000);	/* WFI until the next pass */
     }
+#endif
     
+    watchdog_stop();
     io_btn_close();
     io_sw_close();
     ttc_stop();
     ttc_close();
+    gate_stop();
+    health_close();
 
-    gic_disconnect(XPAR_XUARTPS_1_INTR);
-    gic_disconnect(XPAR_XUARTPS_0_INTR);
+    console_close();
+    link_close();
     gic_close();
     printf("DONE!!\n");
     cleanup_platform();
@@ -288,98 +919,10 @@ int main()
 
 /* Handle UART initialization */
 void uart_init(){
-	XUartPs_Config* config = XUartPs_LookupConfig(XPAR_PS7_UART_1_DEVICE_ID);
-	XUartPs_CfgInitialize(&uartp1, config, config->BaseAddress);
-	XUartPs_SetInterruptMask(&uartp1, XUARTPS_IXR_RXOVR);
-	XUartPs_SetFifoThreshold(&uartp1, 1);
-	XUartPs_SetHandler(&uartp1, uart_1_handler, &uartp1);
-	gic_connect(XPAR_XUARTPS_1_INTR, (Xil_ExceptionHandler)XUartPs_InterruptHandler,(void*) &uartp1);//connect the uart interrupt handler
-
-	XUartPs_Config* config0 = XUartPs_LookupConfig(XPAR_PS7_UART_0_DEVICE_ID);
-	XUartPs_CfgInitialize(&uartp0, config0, config0->BaseAddress);
-	XUartPs_SetInterruptMask(&uartp0, XUARTPS_IXR_RXOVR);
-	XUartPs_SetFifoThreshold(&uartp0, 1);
-	XUartPs_SetHandler(&uartp0, uart_0_handler, &uartp0);
-	XUartPs_SetBaudRate(&uartp0, 9600);
-	gic_connect(XPAR_XUARTPS_0_INTR, (Xil_ExceptionHandler)XUartPs_InterruptHandler,(void*) &uartp0);
-
-}
-
-void change_state(void){
-	switch(state){
-	case (TRAFFIC_ON):
-		led_set(GREEN, LED_ON); //turn green light on
-		if((t3min && btnpressed) || traincoming || keyflag){
-			state = YELLOW;
-			timercnt = 0;
-			t3min = 0;
-		}
-		break;
-
-	case (YELLOW):
-		led_set(Y_LED, LED_ON);	//turn yellow light on
-			if(t3sec){
-				if(btnpressed){
-					state = PEDESTRIAN;
-				} else if(traincoming){
-					state = TRAIN_COMING;
-				} else if(keyflag){
-					state = MAINTENANCE;
-				} else {
-					state = TRAFFIC_ON;
-				}
-				timercnt = 0;
-				t3sec = 0;
-			}
-		break;
-
-	case (PEDESTRIAN):
-		led_set(RED, LED_ON);	//turn red light on
-			if(t30sec){
-				state = YELLOW;
-				t30sec = 0;
-				timercnt = 0;
-				pedcrossed = 1;
-			}
-
-			if(keyflag){
-				state = MAINTENANCE;
-				timercnt = 0;
-				t30sec = 0;
-			} else if(traincoming){
-				state = TRAIN_COMING;
-				timercnt = 0;
-				t30sec = 0;
-			}
-		break;
-
-	case (TRAIN_COMING):
-		led_set(RED, LED_ON);	//turn red light on
-		if(!traincoming){
-			state = TRAIN_GONE;
-			timercnt = 0;
-		}
-
-		break;
-
-	case (TRAIN_GONE):
-		if(t20sec){
-			state = TRAFFIC_ON;
-			servo_set(MINDUTY);
-			timercnt = 0;
-			t20sec = 0;
-		}
-
-		break;
+	console_init(commands, sizeof(commands) / sizeof(commands[0]));	/* operator console on uart1 */
 
-	case (MAINTENANCE):
-		if(!keyflag){
-			if(btnpressed){
-				led_set(4, LED_ON);
-			}
-			state = YELLOW;
-		}
-		break;
+	crossings_init(config->upstream, main_upstream_callback);
+	link_init(config->id, substation_callback, substation_raw_callback);	/* substation over udp or uart0 */
+	link_set_passthrough(mode == CONFIGURE);
 
-	}
 }